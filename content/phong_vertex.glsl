@@ -4,6 +4,8 @@ layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexNormal;
 layout(location = 2) in vec4 vertexColor;
 layout(location = 3) in vec4 vertexTCoord;
+layout(location = 4) in vec4 vertexOctNormal; // packed vertex layouts, w is 0 when unused
+layout(location = 5) in vec3 vertexOrigin;    // packed positions are relative to this point
 
 uniform mat4 mvp;
 
@@ -12,12 +14,23 @@ out vec3 vNormal;
 out vec4 vColor;
 out vec4 vTCoord;
 
+vec3 OctahedralDecode(vec2 e)
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+    {
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(v);
+}
+
 void main()
 {
-    gl_Position = mvp * vec4(vertexPosition, 1.0f);
-    vPosition = vertexPosition;
+    vec3 position = vertexOrigin + vertexPosition;
+    gl_Position = mvp * vec4(position, 1.0f);
+    vPosition = position;
 
-    vNormal = vertexNormal;
+    vNormal = mix(vertexNormal, OctahedralDecode(vertexOctNormal.xy), vertexOctNormal.w);
 
     vColor = vertexColor;
     vTCoord = vertexTCoord;
@@ -72,4 +72,20 @@ project "L-system 2D"
     files ({source_folder .. "**.h", source_folder .. "**.c", source_folder .. "**.cpp"})
     removefiles{ source_folder .. "main*.cpp"}
     files ({source_folder .. "main_2d.cpp"})
-    
\ No newline at end of file
+    
+project "Tree generator (headless)"
+    kind "ConsoleApp"
+    targetdir(binaries_folder)
+    targetname("treegen")
+    files ({source_folder .. "core/**.cpp", source_folder .. "generation/**.cpp", source_folder .. "geometry/**.cpp"})
+    files ({source_folder .. "tree.cpp", source_folder .. "treeworker.cpp", source_folder .. "treecache.cpp", source_folder .. "treebatch.cpp", source_folder .. "treeprotocol.cpp", source_folder .. "treeservice.cpp", source_folder .. "treeshared.cpp", source_folder .. "thirdparty/glmGeom.cpp", source_folder .. "thirdparty/lodepng.cpp"})
+    removefiles{ source_folder .. "core/input.cpp", source_folder .. "geometry/meshlets.cpp"} -- camera and GL draw statistics
+    files ({source_folder .. "main_treegen.cpp"})
+    removelinks { "opengl32", "SDL2" }
+
+project "Tree service client"
+    kind "ConsoleApp"
+    targetdir(binaries_folder)
+    targetname("treeclient")
+    files ({source_folder .. "core/localsocket.cpp", source_folder .. "core/sharedmemory.cpp", source_folder .. "treeprotocol.cpp", source_folder .. "treeshared.cpp", source_folder .. "main_treeclient.cpp"})
+    removelinks { "opengl32", "SDL2" }
@@ -0,0 +1,88 @@
+#pragma once
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+#include "meshdata.h"
+
+/*
+	Plain byte serialization, the tree cache keys and entries and the tree service messages are written with it.
+	Values are copied as they are in memory, so the bytes are only read back on the same kind of machine.
+*/
+struct ByteWriter
+{
+	std::vector<uint8_t>& bytes;
+
+	template <class T>
+	void Value(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(&value);
+		bytes.insert(bytes.end(), data, data + sizeof(T));
+	}
+
+	template <class T, class Allocator>
+	void Vector(const std::vector<T, Allocator>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written");
+		Value(uint64_t(values.size()));
+		const uint8_t* data = reinterpret_cast<const uint8_t*>(values.data());
+		bytes.insert(bytes.end(), data, data + values.size()*sizeof(T));
+	}
+
+	void Mesh(const TriangleMesh& mesh)
+	{
+		Value(mesh.vertexLayout);
+		Vector(mesh.positions);
+		Vector(mesh.normals);
+		Vector(mesh.colors);
+		Vector(mesh.texCoords);
+		Vector(mesh.indices);
+		Vector(mesh.chunks);
+	}
+};
+
+struct ByteReader
+{
+	const uint8_t* position;
+	const uint8_t* end;
+	bool valid = true;
+
+	template <class T>
+	void Value(T& value)
+	{
+		if (!valid || size_t(end - position) < sizeof(T))
+		{
+			valid = false;
+			return;
+		}
+		memcpy(&value, position, sizeof(T));
+		position += sizeof(T);
+	}
+
+	template <class T, class Allocator>
+	void Vector(std::vector<T, Allocator>& values)
+	{
+		uint64_t count = 0;
+		Value(count);
+		if (!valid || count > size_t(end - position) / sizeof(T))
+		{
+			valid = false;
+			return;
+		}
+		values.resize(size_t(count));
+		memcpy(values.data(), position, size_t(count)*sizeof(T));
+		position += size_t(count)*sizeof(T);
+	}
+
+	void Mesh(TriangleMesh& mesh)
+	{
+		Value(mesh.vertexLayout);
+		Vector(mesh.positions);
+		Vector(mesh.normals);
+		Vector(mesh.colors);
+		Vector(mesh.texCoords);
+		Vector(mesh.indices);
+		Vector(mesh.chunks);
+	}
+};
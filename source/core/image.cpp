@@ -0,0 +1,199 @@
+#include "image.h"
+#include <iostream>
+#include <algorithm>
+#include "../thirdparty/lodepng.h"
+
+void DrawBresenhamLine(Image& image, float x1, float y1, float x2, float y2, Color& color)
+{
+	// Taken from Rosetta Code
+	// https://rosettacode.org/wiki/Bitmap/Bresenham%27s_line_algorithm#C.2B.2B
+
+	// Bresenham's line algorithm
+	const bool steep = (fabs(y2 - y1) > fabs(x2 - x1));
+	if (steep)
+	{
+		std::swap(x1, y1);
+		std::swap(x2, y2);
+	}
+
+	if (x1 > x2)
+	{
+		std::swap(x1, x2);
+		std::swap(y1, y2);
+	}
+
+	const float dx = x2 - x1;
+	const float dy = fabs(y2 - y1);
+
+	float error = dx / 2.0f;
+	const int ystep = (y1 < y2) ? 1 : -1;
+	int y = (int)y1;
+
+	const int maxX = (int)x2;
+
+	for (int x = (int)x1; x < maxX; x++)
+	{
+		if (steep)
+		{
+			image.SetPixelSafe(y, x, color);
+		}
+		else
+		{
+			image.SetPixelSafe(x, y, color);
+		}
+
+		error -= dy;
+		if (error < 0)
+		{
+			y += ystep;
+			error += dx;
+		}
+	}
+}
+
+inline void Image::SetPixel(unsigned int pixelIndex, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	pixels[pixelIndex + 0] = r;
+	pixels[pixelIndex + 1] = g;
+	pixels[pixelIndex + 2] = b;
+	pixels[pixelIndex + 3] = a;
+}
+
+void Image::SetPixel(unsigned int x, unsigned int y, uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+	SetPixel(PixelArrayIndex(x, y), r, g, b, a);
+}
+
+void Image::SetPixel(unsigned int x, unsigned int y, double r, double g, double b, double a)
+{
+	r = std::max(std::min(1.0, r), 0.0);
+	g = std::max(std::min(1.0, g), 0.0);
+	b = std::max(std::min(1.0, b), 0.0);
+	a = std::max(std::min(1.0, a), 0.0);
+	SetPixel(x, y, uint8_t(r*255.0), uint8_t(g*255.0), uint8_t(b*255.0), uint8_t(a*255.0));
+}
+
+void Image::SetPixel(unsigned int x, unsigned int y, Color& color)
+{
+	unsigned int pixelIndex = PixelArrayIndex(x, y);
+	pixels[pixelIndex + 0] = color.r;
+	pixels[pixelIndex + 1] = color.g;
+	pixels[pixelIndex + 2] = color.b;
+	pixels[pixelIndex + 3] = color.a;
+}
+
+void Image::SetPixel(unsigned int x, unsigned int y, FColor& color)
+{
+	unsigned int pixelIndex = PixelArrayIndex(x, y);
+	pixels[pixelIndex + 0] = uint8_t(std::max(std::min(1.0f, color.r), 0.0f) * 255);
+	pixels[pixelIndex + 1] = uint8_t(std::max(std::min(1.0f, color.g), 0.0f) * 255);
+	pixels[pixelIndex + 2] = uint8_t(std::max(std::min(1.0f, color.b), 0.0f) * 255);
+	pixels[pixelIndex + 3] = uint8_t(std::max(std::min(1.0f, color.a), 0.0f) * 255);
+}
+
+void Image::SetPixelSafe(int x, int y, Color& color)
+{
+	if (x > 0 && y > 0 && x < width && y < height)
+	{
+		SetPixel(x, y, color);
+	}
+}
+
+void Image::SetPixelSafe(int x, int y, FColor& color)
+{
+	if (x > 0 && y > 0 && x < width && y < height)
+	{
+		SetPixel(x, y, color);
+	}
+}
+
+unsigned int Image::PixelArrayIndex(unsigned int x, unsigned int y) const
+{
+	return y * width * 4 + x * 4;
+}
+
+void Image::Fill(Color& color)
+{
+	for (int x = 0; x < width; ++x)
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			SetPixel(x, y, color);
+		}
+	}
+}
+
+void Image::Fill(FColor& color)
+{
+	Color remapped;
+	remapped.r = uint8_t(std::max(std::min(1.0f, color.r), 0.0f) * 255);
+	remapped.g = uint8_t(std::max(std::min(1.0f, color.g), 0.0f) * 255);
+	remapped.b = uint8_t(std::max(std::min(1.0f, color.b), 0.0f) * 255);
+	remapped.a = uint8_t(std::max(std::min(1.0f, color.a), 0.0f) * 255);
+
+	for (int x = 0; x < width; ++x)
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			SetPixel(x, y, remapped);
+		}
+	}
+}
+
+void Image::DrawLine(glm::fvec2 start, glm::fvec2 end, Color& color)
+{
+	DrawBresenhamLine(*this, start.x, start.y, end.x, end.y, color);
+}
+
+void Image::FillDebug()
+{
+	for (int x = 0; x < width; ++x)
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			uint8_t r = (uint8_t)(x / (float)width * 255);
+			uint8_t g = (uint8_t)(y / (float)height * 255);
+			uint8_t b = 0;
+			uint8_t a = 255;
+			SetPixel(x, y, r, g, b, a);
+		}
+	}
+}
+
+void Image::SaveAsPNG(std::filesystem::path filepath, bool incrementNewFile) const
+{
+	unsigned error = lodepng::encode(filepath.string(), pixels, (unsigned int)width, (unsigned int)height);
+	if (error)
+	{
+		std::cout << "encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+	}
+}
+
+bool Image::LoadPNG(std::filesystem::path filepath)
+{
+	unsigned sourceWidth, sourceHeight;
+
+	pixels.clear();
+	pixels.shrink_to_fit();
+
+	std::vector<unsigned char> png;
+	lodepng::State state;
+	unsigned error = lodepng::load_file(png, filepath.string());
+	if (!error)
+	{
+		error = lodepng::decode(pixels, sourceWidth, sourceHeight, state, png);
+	}
+
+	if (error)
+	{
+		std::cout << "decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+		return false;
+	}
+
+	const LodePNGColorMode& color = state.info_png.color;
+	width = sourceWidth;
+	height = sourceHeight;
+	numPixels = width * height;
+	size = numPixels * lodepng_get_channels(&color);
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <filesystem>
+#include "math.h"
+
+/*
+	CPU side RGBA8 image, the leaf and flower textures are drawn into it.
+	GLTexture (opengl/texture.h) adds the GPU texture on top.
+*/
+class Image
+{
+public:
+	std::vector<uint8_t> pixels; // vector is used to simplify load/save with lodepng
+
+	int size = 0;
+	int numPixels = 0;
+	int width = 0;
+	int height = 0;
+
+public:
+	Image() = default;
+	Image(std::filesystem::path imagePath)
+	{
+		LoadPNG(imagePath);
+	}
+
+	Image(int imageWidth, int imageHeight)
+		: width{ imageWidth }, height{ imageHeight }
+	{
+		numPixels = width * height;
+		size = numPixels * 4;
+		pixels.assign(size, 0);
+	}
+
+	inline uint8_t& operator[] (unsigned int i) { return pixels[i]; }
+
+	inline void SetPixel(unsigned int pixelIndex, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+	void SetPixel(unsigned int x, unsigned int y, uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+	void SetPixel(unsigned int x, unsigned int y, double r, double g, double b, double a);
+
+	void SetPixel(unsigned int x, unsigned int y, Color& color);
+	void SetPixel(unsigned int x, unsigned int y, FColor& color);
+
+	void SetPixelSafe(int x, int y, Color& color);
+	void SetPixelSafe(int x, int y, FColor& color);
+
+	unsigned int PixelArrayIndex(unsigned int x, unsigned int y) const;
+
+	void Fill(Color& color);
+	void Fill(FColor& color);
+	void DrawLine(glm::fvec2 start, glm::fvec2 end, Color& color);
+
+	void FillDebug();
+	void SaveAsPNG(std::filesystem::path filepath, bool incrementNewFile = false) const;
+	bool LoadPNG(std::filesystem::path filepath);
+};
@@ -0,0 +1,180 @@
+#include "localsocket.h"
+#include <cstring>
+#include <filesystem>
+
+#if defined(OS_WINDOWS)
+	#include <winsock2.h>
+	#include <afunix.h>
+	#if defined(_MSC_VER)
+		#pragma comment(lib, "Ws2_32.lib")
+	#endif
+	typedef SOCKET NativeSocket;
+	typedef int SocketLength;
+	static int CloseNativeSocket(NativeSocket socket) { return closesocket(socket); }
+	static const int shutdownBoth = SD_BOTH;
+#else
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+	typedef int NativeSocket;
+	typedef socklen_t SocketLength;
+	static int CloseNativeSocket(NativeSocket socket) { return close(socket); }
+	static const int shutdownBoth = SHUT_RDWR;
+#endif
+
+#if defined(MSG_NOSIGNAL)
+	static const int sendFlags = MSG_NOSIGNAL; // a closed peer fails the call instead of raising SIGPIPE
+#else
+	static const int sendFlags = 0;
+#endif
+
+// Winsock has to be started once per process, the POSIX sockets need nothing
+static bool StartSockets()
+{
+#if defined(OS_WINDOWS)
+	static bool started = []()
+	{
+		WSADATA data;
+		return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+	}();
+	return started;
+#else
+	return true;
+#endif
+}
+
+static bool SocketAddress(const std::string& path, sockaddr_un& address)
+{
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+	memcpy(address.sun_path, path.c_str(), path.size());
+	return true;
+}
+
+LocalSocket::~LocalSocket()
+{
+	Close();
+}
+
+LocalSocket::LocalSocket(LocalSocket&& other) noexcept
+	: handle{ other.handle }, listenPath{ std::move(other.listenPath) }
+{
+	other.handle = invalidHandle;
+	other.listenPath.clear();
+}
+
+LocalSocket& LocalSocket::operator=(LocalSocket&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		handle = other.handle;
+		listenPath = std::move(other.listenPath);
+		other.handle = invalidHandle;
+		other.listenPath.clear();
+	}
+	return *this;
+}
+
+bool LocalSocket::Listen(const std::string& path)
+{
+	Close();
+	sockaddr_un address;
+	if (!StartSockets() || !SocketAddress(path, address)) return false;
+
+	std::error_code error;
+	std::filesystem::remove(path, error);
+
+	NativeSocket socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	handle = uintptr_t(socket);
+	if (!Valid()) return false;
+	if (bind(socket, reinterpret_cast<sockaddr*>(&address), SocketLength(sizeof(address))) != 0 || listen(socket, 64) != 0)
+	{
+		Close();
+		return false;
+	}
+	listenPath = path;
+	return true;
+}
+
+bool LocalSocket::Connect(const std::string& path)
+{
+	Close();
+	sockaddr_un address;
+	if (!StartSockets() || !SocketAddress(path, address)) return false;
+
+	NativeSocket socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	handle = uintptr_t(socket);
+	if (!Valid()) return false;
+	if (connect(socket, reinterpret_cast<sockaddr*>(&address), SocketLength(sizeof(address))) != 0)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+LocalSocket LocalSocket::Accept(int timeoutMilliseconds)
+{
+	LocalSocket connection;
+	if (!Valid()) return connection;
+
+	NativeSocket socket = NativeSocket(handle);
+	fd_set readable;
+	FD_ZERO(&readable);
+	FD_SET(socket, &readable);
+	timeval timeout;
+	timeout.tv_sec = timeoutMilliseconds / 1000;
+	timeout.tv_usec = (timeoutMilliseconds % 1000) * 1000;
+	if (select(int(socket) + 1, &readable, nullptr, nullptr, &timeout) <= 0) return connection;
+
+	connection.handle = uintptr_t(accept(socket, nullptr, nullptr));
+	return connection;
+}
+
+bool LocalSocket::Send(const void* data, size_t bytes)
+{
+	const char* position = static_cast<const char*>(data);
+	while (bytes > 0 && Valid())
+	{
+		int chunk = int((bytes < (1u << 30)) ? bytes : (1u << 30));
+		int sent = int(send(NativeSocket(handle), position, chunk, sendFlags));
+		if (sent <= 0) return false;
+		position += sent;
+		bytes -= size_t(sent);
+	}
+	return bytes == 0;
+}
+
+bool LocalSocket::Receive(void* data, size_t bytes)
+{
+	char* position = static_cast<char*>(data);
+	while (bytes > 0 && Valid())
+	{
+		int chunk = int((bytes < (1u << 30)) ? bytes : (1u << 30));
+		int received = int(recv(NativeSocket(handle), position, chunk, 0));
+		if (received <= 0) return false;
+		position += received;
+		bytes -= size_t(received);
+	}
+	return bytes == 0;
+}
+
+void LocalSocket::Shutdown()
+{
+	if (Valid()) shutdown(NativeSocket(handle), shutdownBoth);
+}
+
+void LocalSocket::Close()
+{
+	if (Valid()) CloseNativeSocket(NativeSocket(handle));
+	handle = invalidHandle;
+	if (!listenPath.empty())
+	{
+		std::error_code error;
+		std::filesystem::remove(listenPath, error);
+		listenPath.clear();
+	}
+}
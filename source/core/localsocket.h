@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	Blocking Unix domain stream socket, used by the local tree service and its client.
+	Windows has them since Windows 10 1803 (afunix.h), elsewhere they are the POSIX ones.
+	Send and Receive move every byte or fail, a failure means the other side is gone.
+*/
+class LocalSocket
+{
+public:
+	LocalSocket() = default;
+	~LocalSocket();
+	LocalSocket(LocalSocket&& other) noexcept;
+	LocalSocket& operator=(LocalSocket&& other) noexcept;
+	LocalSocket(const LocalSocket&) = delete;
+	LocalSocket& operator=(const LocalSocket&) = delete;
+
+	// Binds and listens on the path, a socket file left over from an earlier run is removed first
+	bool Listen(const std::string& path);
+	bool Connect(const std::string& path);
+
+	// The next connection, an invalid socket when none came in within the timeout
+	LocalSocket Accept(int timeoutMilliseconds);
+
+	bool Send(const void* data, size_t bytes);
+	bool Receive(void* data, size_t bytes);
+
+	// Ends both directions, a Receive blocked on another thread returns false
+	void Shutdown();
+	void Close();
+
+	bool Valid() const { return handle != invalidHandle; }
+
+protected:
+	static constexpr uintptr_t invalidHandle = ~uintptr_t(0); // INVALID_SOCKET on Windows, -1 elsewhere
+
+	uintptr_t handle = invalidHandle;
+	std::string listenPath; // removed again on Close
+};
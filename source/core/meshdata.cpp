@@ -0,0 +1,140 @@
+#include "meshdata.h"
+#include "meshkernels.h"
+#include <stdint.h>
+
+TriangleMesh::TriangleMesh(MeshArena* arena)
+	: positions{ MeshAllocator<glm::fvec3>{ arena } }, normals{ MeshAllocator<glm::fvec3>{ arena } }, colors{ MeshAllocator<glm::fvec4>{ arena } },
+	texCoords{ MeshAllocator<glm::fvec4>{ arena } }, indices{ MeshAllocator<unsigned int>{ arena } }, chunks{ MeshAllocator<MeshChunk>{ arena } }
+{
+}
+
+void TriangleMesh::Clear()
+{
+	positions.clear();
+	normals.clear();
+	colors.clear();
+	texCoords.clear();
+	indices.clear();
+	chunks.clear();
+
+	positions.shrink_to_fit();
+	normals.shrink_to_fit();
+	colors.shrink_to_fit();
+	texCoords.shrink_to_fit();
+	indices.shrink_to_fit();
+}
+
+void TriangleMesh::AddVertex(glm::fvec3 pos, glm::fvec4 color, glm::fvec4 texcoord)
+{
+	positions.push_back(std::move(pos));
+	normals.push_back(glm::fvec3{ 0.0f });
+	colors.push_back(std::move(color));
+	texCoords.push_back(std::move(texcoord));
+}
+
+void TriangleMesh::AddVertex(glm::fvec3 pos, glm::fvec3 normal, glm::fvec4 color, glm::fvec4 texcoord)
+{
+	positions.push_back(std::move(pos));
+	normals.push_back(std::move(normal));
+	colors.push_back(std::move(color));
+	texCoords.push_back(std::move(texcoord));
+}
+
+void TriangleMesh::DefineNewTriangle(unsigned int index1, unsigned int index2, unsigned int index3)
+{
+	indices.push_back(index1);
+	indices.push_back(index2);
+	indices.push_back(index3);
+}
+
+void TriangleMesh::AppendMesh(const TriangleMesh& other)
+{
+	size_t vertexOffset = positions.size();
+	size_t indexStart = indices.size();
+
+	positions.insert(positions.end(), other.positions.begin(), other.positions.end());
+	normals.insert(normals.end(), other.normals.begin(), other.normals.end());
+	colors.insert(colors.end(), other.colors.begin(), other.colors.end());
+	texCoords.insert(texCoords.end(), other.texCoords.begin(), other.texCoords.end());
+
+	// The indices of the other mesh are offset while they are copied
+	indices.resize(indexStart + other.indices.size());
+	CopyIndicesWithOffset(other.indices.data(), indices.data() + indexStart, other.indices.size(), (unsigned int)(vertexOffset));
+}
+
+void TriangleMesh::AppendMeshTransformed(const TriangleMesh & other, glm::mat4 transform)
+{
+	size_t vertexOffset = positions.size();
+	size_t indexStart = indices.size();
+	size_t vertexCount = other.positions.size();
+
+	positions.resize(vertexOffset + vertexCount);
+	normals.resize(vertexOffset + vertexCount);
+	TransformPositions(other.positions.data(), positions.data() + vertexOffset, vertexCount, transform);
+	TransformNormals(other.normals.data(), normals.data() + vertexOffset, vertexCount, NormalMatrix(transform));
+
+	colors.insert(colors.end(), other.colors.begin(), other.colors.end());
+	texCoords.insert(texCoords.end(), other.texCoords.begin(), other.texCoords.end());
+
+	indices.resize(indexStart + other.indices.size());
+	CopyIndicesWithOffset(other.indices.data(), indices.data() + indexStart, other.indices.size(), (unsigned int)(vertexOffset));
+}
+
+void TriangleMesh::ApplyMatrix(glm::mat4 transform, int firstIndex, int lastIndex)
+{
+	firstIndex = (firstIndex < 0)? 0 : firstIndex;
+	lastIndex = (lastIndex >= positions.size()) ? int(positions.size() - 1) : lastIndex;
+	if (lastIndex < firstIndex) return;
+
+	// Normals go through the inverse-transpose so that they stay perpendicular under non-uniform scale
+	size_t count = size_t(lastIndex - firstIndex + 1);
+	TransformPositions(&positions[firstIndex], &positions[firstIndex], count, transform);
+	TransformNormals(&normals[firstIndex], &normals[firstIndex], count, NormalMatrix(transform));
+}
+
+void TriangleMesh::ApplyMatrix(glm::mat4 transform)
+{
+	ApplyMatrix(transform, 0, int(positions.size() - 1));
+}
+
+bool TriangleMesh::HasConstantColor() const
+{
+	for (auto& c : colors)
+	{
+		if (c != colors[0]) return false;
+	}
+	return true;
+}
+
+size_t TriangleMesh::GPUBytes() const
+{
+	bool constantColor = (vertexLayout != VertexLayout::Separate) && HasConstantColor();
+	size_t indexSize = chunks.empty() ? sizeof(unsigned int) : sizeof(uint16_t);
+	return positions.size() * VertexSize(vertexLayout, constantColor) + indices.size() * indexSize;
+}
+
+size_t TriangleMesh::VertexSize(VertexLayout layout, bool constantColor)
+{
+	size_t colorSize = constantColor ? 0 : sizeof(uint32_t);
+	switch (layout)
+	{
+	case VertexLayout::Packed:		return 3 * sizeof(float) + 2 * sizeof(uint32_t) + colorSize;
+	case VertexLayout::PackedHalf:	return 4 * sizeof(uint16_t) + 2 * sizeof(uint32_t) + colorSize;
+	default:						return 2 * sizeof(glm::fvec3) + 2 * sizeof(glm::fvec4);
+	}
+}
+
+void LineMesh::AddLine(glm::fvec3 start, glm::fvec3 end, glm::fvec4 color)
+{
+	lineSegments.push_back(LineSegment{ std::move(start), std::move(end) });
+	colors.push_back(color);
+	colors.push_back(std::move(color));
+}
+
+void LineMesh::Clear()
+{
+	lineSegments.clear();
+	lineSegments.shrink_to_fit();
+	colors.clear();
+	colors.shrink_to_fit();
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <new>
+#include <vector>
+#include "math.h"
+
+/*
+	CPU side mesh containers
+	Generation and the geometry passes only work on these, the GL wrappers in opengl/mesh.h add the GPU buffers on top.
+	The streams live on the heap unless the mesh is given an arena, for example a shared memory region (treeshared.h)
+	that another process reads the finished mesh from. A pass that rebuilds a stream allocates the new one from the
+	arena of the mesh, so a mesh built in an arena stays in it. A copy of a mesh goes to the heap, a mesh assigned a
+	copy keeps its arena and a mesh assigned a moved one takes over its streams and their arena.
+*/
+
+class MeshArena
+{
+public:
+	virtual ~MeshArena() = default;
+
+	// Throws std::bad_alloc when the arena is full, like the heap
+	virtual void* Allocate(size_t bytes) = 0;
+	virtual void Free(void* memory, size_t bytes) = 0;
+};
+
+template <class T>
+struct MeshAllocator
+{
+	using value_type = T;
+	using propagate_on_container_copy_assignment = std::false_type;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	MeshArena* arena = nullptr; // the heap when null
+
+	MeshAllocator() = default;
+	MeshAllocator(MeshArena* meshArena) : arena{ meshArena } {}
+	template <class U> MeshAllocator(const MeshAllocator<U>& other) : arena{ other.arena } {}
+
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(arena ? arena->Allocate(count * sizeof(T)) : ::operator new(count * sizeof(T)));
+	}
+	void deallocate(T* memory, size_t count)
+	{
+		if (arena) arena->Free(memory, count * sizeof(T));
+		else ::operator delete(memory);
+	}
+
+	MeshAllocator select_on_container_copy_construction() const { return MeshAllocator{}; }
+
+	template <class U> bool operator==(const MeshAllocator<U>& other) const { return arena == other.arena; }
+	template <class U> bool operator!=(const MeshAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <class T>
+using MeshVector = std::vector<T, MeshAllocator<T>>;
+
+// A draw range inside the shared buffers of a mesh. Indices are 16-bit and relative to baseVertex.
+struct MeshChunk
+{
+	glm::fvec3 minBounds{ 0.0f };
+	glm::fvec3 maxBounds{ 0.0f };
+	glm::fvec3 origin{ 0.0f };	// center of the bounds, half precision positions are stored relative to it
+	unsigned int firstIndex = 0;
+	unsigned int indexCount = 0;
+	unsigned int baseVertex = 0;
+	unsigned int vertexCount = 0;
+};
+
+enum class VertexLayout
+{
+	Separate,	// four float streams (position, normal, color, texcoord), 56 bytes per vertex
+	Packed,		// one interleaved stream: float position, octahedral normal, half texcoord and RGBA8 color unless it is constant
+	PackedHalf	// same as Packed but with half precision positions relative to the mesh origin, or to each chunk origin when chunked
+};
+
+class TriangleMesh
+{
+public:
+	VertexLayout vertexLayout = VertexLayout::Separate; // format used when the mesh is uploaded
+
+	MeshVector<glm::fvec3> positions;
+	MeshVector<glm::fvec3> normals;
+	MeshVector<glm::fvec4> colors;
+	MeshVector<glm::fvec4> texCoords;
+	MeshVector<unsigned int> indices;
+
+	// When set, indices are local to each chunk and are uploaded as 16-bit.
+	// Chunks are built as the last step before uploading (see geometry/meshchunks.h).
+	MeshVector<MeshChunk> chunks;
+
+	TriangleMesh() = default;
+	explicit TriangleMesh(MeshArena* arena);
+
+	// The arena the streams are allocated from, nullptr for the heap
+	MeshArena* Arena() const { return positions.get_allocator().arena; }
+
+	void Clear();
+	void AddVertex(glm::fvec3 pos, glm::fvec4 color, glm::fvec4 texcoord);
+	void AddVertex(glm::fvec3 pos, glm::fvec3 normal, glm::fvec4 color, glm::fvec4 texcoord);
+	void DefineNewTriangle(unsigned int index1, unsigned int index2, unsigned int index3);
+	void AppendMesh(const TriangleMesh& other);
+	void AppendMeshTransformed(const TriangleMesh& other, glm::mat4 transform);
+	void ApplyMatrix(glm::mat4 transform, int firstIndex, int lastIndex);
+	void ApplyMatrix(glm::mat4 transform);
+
+	// True when every vertex has the same color, the packed layouts then leave the color out
+	bool HasConstantColor() const;
+
+	// Vertex and index bytes of the mesh on the GPU with its layout and chunks
+	size_t GPUBytes() const;
+
+	// Bytes per vertex of a layout
+	static size_t VertexSize(VertexLayout layout, bool constantColor = true);
+};
+
+struct LineSegment
+{
+	glm::fvec3 start;
+	glm::fvec3 end;
+};
+
+class LineMesh
+{
+public:
+	std::vector<LineSegment> lineSegments;
+	std::vector<glm::fvec4> colors; // two per segment
+
+	void AddLine(glm::fvec3 start, glm::fvec3 end, glm::fvec4 color);
+	void Clear();
+};
@@ -0,0 +1,203 @@
+#include "meshkernels.h"
+#include "glm/gtc/matrix_inverse.hpp"
+
+#if defined(_MSC_VER) && defined(_M_X64)
+	#include <intrin.h>
+	#include <immintrin.h>
+	#define MESH_KERNELS_AVX2 1
+	#define AVX2_FUNCTION
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+	#include <immintrin.h>
+	#define MESH_KERNELS_AVX2 1
+	#define AVX2_FUNCTION __attribute__((target("avx2,fma")))
+#else
+	#define MESH_KERNELS_AVX2 0
+#endif
+
+bool MeshKernelsUseAVX2()
+{
+#if MESH_KERNELS_AVX2
+	#if defined(_MSC_VER)
+		static const bool supported = []()
+		{
+			int info[4];
+			__cpuid(info, 1);
+			bool osSavesYMM = (info[2] & (1 << 27)) && ((_xgetbv(0) & 6) == 6);
+			bool fma = (info[2] & (1 << 12)) != 0;
+			__cpuidex(info, 7, 0);
+			return osSavesYMM && fma && (info[1] & (1 << 5)) != 0;
+		}();
+	#else
+		static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+	#endif
+	return supported;
+#else
+	return false;
+#endif
+}
+
+glm::mat3 NormalMatrix(const glm::mat4& transform)
+{
+	return glm::inverseTranspose(glm::mat3{ transform });
+}
+
+#if MESH_KERNELS_AVX2
+/*
+	Eight packed fvec3 (24 floats) to and from x, y, z registers.
+	From "3D Vector Normalization Using 256-Bit Intel AVX" (Intel, 2011)
+*/
+AVX2_FUNCTION static inline void LoadVec3x8(const glm::fvec3* input, __m256& x, __m256& y, __m256& z)
+{
+	const float* p = &input[0].x;
+	__m256 m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
+	__m256 m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+	__m256 m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+
+	__m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+	__m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+	x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+	z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+AVX2_FUNCTION static inline void StoreVec3x8(glm::fvec3* output, __m256 x, __m256 y, __m256 z)
+{
+	__m256 rxy = _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+	__m256 ryz = _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 1, 3, 1));
+	__m256 rzx = _mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 1, 2, 0));
+	__m256 r03 = _mm256_shuffle_ps(rxy, rzx, _MM_SHUFFLE(2, 0, 2, 0));
+	__m256 r14 = _mm256_shuffle_ps(ryz, rxy, _MM_SHUFFLE(3, 1, 2, 0));
+	__m256 r25 = _mm256_shuffle_ps(rzx, ryz, _MM_SHUFFLE(3, 1, 3, 1));
+
+	float* p = &output[0].x;
+	_mm_storeu_ps(p, _mm256_castps256_ps128(r03));
+	_mm_storeu_ps(p + 4, _mm256_castps256_ps128(r14));
+	_mm_storeu_ps(p + 8, _mm256_castps256_ps128(r25));
+	_mm_storeu_ps(p + 12, _mm256_extractf128_ps(r03, 1));
+	_mm_storeu_ps(p + 16, _mm256_extractf128_ps(r14, 1));
+	_mm_storeu_ps(p + 20, _mm256_extractf128_ps(r25, 1));
+}
+
+AVX2_FUNCTION static size_t TransformPositionsAVX2(const glm::fvec3* input, glm::fvec3* output, size_t count, const glm::mat4& m)
+{
+	__m256 m00 = _mm256_set1_ps(m[0][0]), m01 = _mm256_set1_ps(m[0][1]), m02 = _mm256_set1_ps(m[0][2]);
+	__m256 m10 = _mm256_set1_ps(m[1][0]), m11 = _mm256_set1_ps(m[1][1]), m12 = _mm256_set1_ps(m[1][2]);
+	__m256 m20 = _mm256_set1_ps(m[2][0]), m21 = _mm256_set1_ps(m[2][1]), m22 = _mm256_set1_ps(m[2][2]);
+	__m256 m30 = _mm256_set1_ps(m[3][0]), m31 = _mm256_set1_ps(m[3][1]), m32 = _mm256_set1_ps(m[3][2]);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z;
+		LoadVec3x8(input + i, x, y, z);
+		__m256 rx = _mm256_fmadd_ps(m20, z, _mm256_fmadd_ps(m10, y, _mm256_fmadd_ps(m00, x, m30)));
+		__m256 ry = _mm256_fmadd_ps(m21, z, _mm256_fmadd_ps(m11, y, _mm256_fmadd_ps(m01, x, m31)));
+		__m256 rz = _mm256_fmadd_ps(m22, z, _mm256_fmadd_ps(m12, y, _mm256_fmadd_ps(m02, x, m32)));
+		StoreVec3x8(output + i, rx, ry, rz);
+	}
+	return i;
+}
+
+AVX2_FUNCTION static size_t TransformNormalsAVX2(const glm::fvec3* input, glm::fvec3* output, size_t count, const glm::mat3& m)
+{
+	__m256 m00 = _mm256_set1_ps(m[0][0]), m01 = _mm256_set1_ps(m[0][1]), m02 = _mm256_set1_ps(m[0][2]);
+	__m256 m10 = _mm256_set1_ps(m[1][0]), m11 = _mm256_set1_ps(m[1][1]), m12 = _mm256_set1_ps(m[1][2]);
+	__m256 m20 = _mm256_set1_ps(m[2][0]), m21 = _mm256_set1_ps(m[2][1]), m22 = _mm256_set1_ps(m[2][2]);
+	__m256 tiny = _mm256_set1_ps(1e-30f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z;
+		LoadVec3x8(input + i, x, y, z);
+		__m256 rx = _mm256_fmadd_ps(m20, z, _mm256_fmadd_ps(m10, y, _mm256_mul_ps(m00, x)));
+		__m256 ry = _mm256_fmadd_ps(m21, z, _mm256_fmadd_ps(m11, y, _mm256_mul_ps(m01, x)));
+		__m256 rz = _mm256_fmadd_ps(m22, z, _mm256_fmadd_ps(m12, y, _mm256_mul_ps(m02, x)));
+
+		__m256 length = _mm256_sqrt_ps(_mm256_max_ps(_mm256_fmadd_ps(rz, rz, _mm256_fmadd_ps(ry, ry, _mm256_mul_ps(rx, rx))), tiny));
+		StoreVec3x8(output + i, _mm256_div_ps(rx, length), _mm256_div_ps(ry, length), _mm256_div_ps(rz, length));
+	}
+	return i;
+}
+
+AVX2_FUNCTION static size_t ComputeDepthKeysAVX2(const glm::fvec3* centers, uint16_t* keys, size_t count, glm::fvec3 keyDirection, float keyOffset, float maxKey)
+{
+	__m256 dx = _mm256_set1_ps(keyDirection.x), dy = _mm256_set1_ps(keyDirection.y), dz = _mm256_set1_ps(keyDirection.z);
+	__m256 offset = _mm256_set1_ps(keyOffset);
+	__m256 zero = _mm256_setzero_ps(), keyLimit = _mm256_set1_ps(maxKey);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 x, y, z;
+		LoadVec3x8(centers + i, x, y, z);
+		__m256 depth = _mm256_fmadd_ps(dz, z, _mm256_fmadd_ps(dy, y, _mm256_mul_ps(dx, x)));
+		__m256 key = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(offset, depth), zero), keyLimit);
+		__m256i key32 = _mm256_cvttps_epi32(key);
+		__m128i key16 = _mm_packus_epi32(_mm256_castsi256_si128(key32), _mm256_extracti128_si256(key32, 1));
+		_mm_storeu_si128((__m128i*)(keys + i), key16);
+	}
+	return i;
+}
+
+AVX2_FUNCTION static size_t CopyIndicesWithOffsetAVX2(const unsigned int* input, unsigned int* output, size_t count, unsigned int offset)
+{
+	__m256i add = _mm256_set1_epi32(int(offset));
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)(input + i));
+		_mm256_storeu_si256((__m256i*)(output + i), _mm256_add_epi32(v, add));
+	}
+	return i;
+}
+#endif
+
+void TransformPositions(const glm::fvec3* input, glm::fvec3* output, size_t count, const glm::mat4& transform)
+{
+	size_t i = 0;
+#if MESH_KERNELS_AVX2
+	if (MeshKernelsUseAVX2()) i = TransformPositionsAVX2(input, output, count, transform);
+#endif
+	for (; i < count; i++)
+	{
+		output[i] = transform * glm::fvec4(input[i], 1.0f);
+	}
+}
+
+void TransformNormals(const glm::fvec3* input, glm::fvec3* output, size_t count, const glm::mat3& normalMatrix)
+{
+	size_t i = 0;
+#if MESH_KERNELS_AVX2
+	if (MeshKernelsUseAVX2()) i = TransformNormalsAVX2(input, output, count, normalMatrix);
+#endif
+	for (; i < count; i++)
+	{
+		glm::fvec3 n = normalMatrix * input[i];
+		output[i] = n / sqrtf(glm::max(glm::dot(n, n), 1e-30f));
+	}
+}
+
+void CopyIndicesWithOffset(const unsigned int* input, unsigned int* output, size_t count, unsigned int offset)
+{
+	size_t i = 0;
+#if MESH_KERNELS_AVX2
+	if (MeshKernelsUseAVX2()) i = CopyIndicesWithOffsetAVX2(input, output, count, offset);
+#endif
+	for (; i < count; i++)
+	{
+		output[i] = input[i] + offset;
+	}
+}
+
+void ComputeDepthKeys(const glm::fvec3* centers, uint16_t* keys, size_t count, glm::fvec3 keyDirection, float keyOffset, float maxKey)
+{
+	size_t i = 0;
+#if MESH_KERNELS_AVX2
+	if (MeshKernelsUseAVX2()) i = ComputeDepthKeysAVX2(centers, keys, count, keyDirection, keyOffset, maxKey);
+#endif
+	for (; i < count; i++)
+	{
+		keys[i] = uint16_t(glm::clamp(keyOffset - glm::dot(centers[i], keyDirection), 0.0f, maxKey));
+	}
+}
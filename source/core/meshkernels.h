@@ -0,0 +1,26 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "math.h"
+
+/*
+	Batch kernels for transforming and appending vertex streams
+	The AVX2 path is picked at runtime when the CPU supports it, otherwise the scalar loops run.
+	Input and output may be the same array.
+*/
+
+// output[i] = transform * (input[i], 1)
+void TransformPositions(const glm::fvec3* input, glm::fvec3* output, size_t count, const glm::mat4& transform);
+
+// output[i] = normalize(normalMatrix * input[i]), where normalMatrix is the inverse-transpose of the upper 3x3 of the transform
+void TransformNormals(const glm::fvec3* input, glm::fvec3* output, size_t count, const glm::mat3& normalMatrix);
+
+// output[i] = input[i] + offset
+void CopyIndicesWithOffset(const unsigned int* input, unsigned int* output, size_t count, unsigned int offset);
+
+// keys[i] = clamp(keyOffset - dot(centers[i], keyDirection), 0, maxKey), truncated, maxKey <= 65535
+void ComputeDepthKeys(const glm::fvec3* centers, uint16_t* keys, size_t count, glm::fvec3 keyDirection, float keyOffset, float maxKey);
+
+glm::mat3 NormalMatrix(const glm::mat4& transform);
+
+bool MeshKernelsUseAVX2();
@@ -8,6 +8,19 @@ UniformRandomGenerator::UniformRandomGenerator()
 	xorseed[1] = (uint64_t(rd()) << 32) ^ (rd());
 }
 
+UniformRandomGenerator::UniformRandomGenerator(uint64_t seed)
+{
+	// splitmix64 spreads the seed over both state words, xorshift must not start from zero
+	for (uint64_t& state : xorseed)
+	{
+		seed += 0x9E3779B97F4A7C15ull;
+		uint64_t z = seed;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		state = z ^ (z >> 31);
+	}
+}
+
 double UniformRandomGenerator::RandomDouble()
 {
 	return to_double(RandomInt());
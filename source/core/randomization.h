@@ -13,6 +13,7 @@ protected:
 
 public:
 	UniformRandomGenerator();
+	UniformRandomGenerator(uint64_t seed); // reproducible sequence, for batch generation
 	~UniformRandomGenerator() = default;
 
 protected:
@@ -0,0 +1,178 @@
+#include "sharedmemory.h"
+#include <atomic>
+
+#if defined(OS_WINDOWS)
+	#define WIN32_LEAN_AND_MEAN
+	#define NOMINMAX
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+// The name the operating system knows the memory by
+static std::string SystemName(const std::string& name)
+{
+#if defined(OS_WINDOWS)
+	return "Local\\" + name;
+#else
+	return "/" + name;
+#endif
+}
+
+static size_t PageSize()
+{
+#if defined(OS_WINDOWS)
+	SYSTEM_INFO information;
+	GetSystemInfo(&information);
+	return size_t(information.dwPageSize);
+#else
+	return size_t(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+SharedMemory::~SharedMemory()
+{
+	Close();
+}
+
+std::string SharedMemory::UniqueName(const char* prefix)
+{
+	static std::atomic<uint64_t> counter{ 0 };
+#if defined(OS_WINDOWS)
+	unsigned long processId = GetCurrentProcessId();
+#else
+	unsigned long processId = (unsigned long)(getpid());
+#endif
+	return std::string(prefix) + "-" + std::to_string(processId) + "-" + std::to_string(counter++);
+}
+
+bool SharedMemory::Create(const std::string& memoryName, size_t maxBytes)
+{
+	Close();
+	if (maxBytes == 0) return false;
+
+#if defined(OS_WINDOWS)
+	// SEC_RESERVE only reserves the pages of the section, Commit commits them
+	HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE | SEC_RESERVE, DWORD(uint64_t(maxBytes) >> 32), DWORD(maxBytes & 0xFFFFFFFF), SystemName(memoryName).c_str());
+	if (!handle) return false;
+	if (GetLastError() == ERROR_ALREADY_EXISTS)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+	void* view = MapViewOfFile(handle, FILE_MAP_WRITE, 0, 0, maxBytes);
+	if (!view)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+	mapping = handle;
+#else
+	// The object starts empty and is mapped past its end, Commit grows it. The pages are only backed once written.
+	int descriptor = shm_open(SystemName(memoryName).c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (descriptor < 0) return false;
+	void* view = mmap(nullptr, maxBytes, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	if (view == MAP_FAILED)
+	{
+		close(descriptor);
+		shm_unlink(SystemName(memoryName).c_str());
+		return false;
+	}
+	file = descriptor;
+#endif
+	data = static_cast<uint8_t*>(view);
+	size = 0;
+	reserved = maxBytes;
+	name = memoryName;
+	owner = true;
+	return true;
+}
+
+bool SharedMemory::Commit(size_t bytes)
+{
+	if (!data || !owner || bytes > reserved) return false;
+	if (bytes <= size) return true;
+
+	size_t page = PageSize();
+	size_t committed = (bytes + page - 1) / page * page;
+	committed = (committed < reserved) ? committed : reserved;
+#if defined(OS_WINDOWS)
+	if (!VirtualAlloc(data + size, committed - size, MEM_COMMIT, PAGE_READWRITE)) return false;
+#else
+	if (ftruncate(file, off_t(committed)) != 0) return false;
+#endif
+	size = committed;
+	return true;
+}
+
+void SharedMemory::Discard(size_t offset, size_t bytes)
+{
+	size_t page = PageSize();
+	size_t begin = (offset + page - 1) / page * page;
+	size_t end = (offset + bytes) / page * page;
+	end = (end < size) ? end : size;
+	if (!data || !owner || begin >= end) return;
+
+#if defined(OS_WINDOWS)
+	VirtualAlloc(data + begin, end - begin, MEM_RESET, PAGE_READWRITE);
+#elif defined(MADV_REMOVE)
+	madvise(data + begin, end - begin, MADV_REMOVE);
+#endif
+}
+
+bool SharedMemory::Open(const std::string& memoryName)
+{
+	Close();
+
+#if defined(OS_WINDOWS)
+	HANDLE handle = OpenFileMappingA(FILE_MAP_READ, FALSE, SystemName(memoryName).c_str());
+	if (!handle) return false;
+	void* view = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+	MEMORY_BASIC_INFORMATION information;
+	if (!view || VirtualQuery(view, &information, sizeof(information)) == 0)
+	{
+		if (view) UnmapViewOfFile(view);
+		CloseHandle(handle);
+		return false;
+	}
+	mapping = handle;
+	size = information.RegionSize; // the committed pages, a reserved section only commits what its creator did
+#else
+	int file = shm_open(SystemName(memoryName).c_str(), O_RDONLY, 0);
+	if (file < 0) return false;
+	struct stat status;
+	void* view = (fstat(file, &status) == 0 && status.st_size > 0) ? mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_SHARED, file, 0) : MAP_FAILED;
+	close(file);
+	if (view == MAP_FAILED) return false;
+	size = size_t(status.st_size);
+#endif
+	reserved = size;
+	data = static_cast<uint8_t*>(view);
+	name = memoryName;
+	owner = false;
+	return true;
+}
+
+void SharedMemory::Close()
+{
+	if (!data) return;
+
+#if defined(OS_WINDOWS)
+	UnmapViewOfFile(data);
+	CloseHandle(HANDLE(mapping));
+	mapping = nullptr;
+#else
+	munmap(data, reserved);
+	if (file >= 0) close(file);
+	file = -1;
+	if (owner) shm_unlink(SystemName(name).c_str());
+#endif
+	data = nullptr;
+	size = 0;
+	reserved = 0;
+	name.clear();
+	owner = false;
+}
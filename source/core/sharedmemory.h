@@ -0,0 +1,51 @@
+#pragma once
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	Named shared memory mapped into the process, for handing meshes to another process.
+	POSIX shm_open objects elsewhere, Windows file mappings backed by the page file. The creator owns the name:
+	closing it removes the name, a process that already opened the memory keeps its mapping until it closes it.
+	The creator reserves the largest size up front and commits memory as it fills it, so data can be built in place
+	before its size is known. Committed memory is zero filled, a process that opens the memory maps what is committed.
+*/
+class SharedMemory
+{
+public:
+	SharedMemory() = default;
+	~SharedMemory();
+	SharedMemory(const SharedMemory&) = delete;
+	SharedMemory& operator=(const SharedMemory&) = delete;
+
+	// A name no other process uses, made of the prefix, the process id and a counter
+	static std::string UniqueName(const char* prefix);
+
+	// Creates the named memory and maps maxBytes for writing, nothing is committed yet
+	bool Create(const std::string& name, size_t maxBytes);
+
+	// Grows the committed memory to at least the bytes, rounded up to whole pages. False beyond the reserved size.
+	bool Commit(size_t bytes);
+
+	// Gives the pages inside the range back to the system, their content is lost. The memory stays committed.
+	void Discard(size_t offset, size_t bytes);
+
+	// Maps existing memory for reading, its whole size
+	bool Open(const std::string& name);
+
+	void Close();
+
+	uint8_t* Data() const { return data; }
+	size_t Size() const { return size; } // committed
+	size_t Reserved() const { return reserved; }
+	const std::string& Name() const { return name; }
+
+protected:
+	uint8_t* data = nullptr;
+	size_t size = 0;
+	size_t reserved = 0;
+	std::string name;
+	bool owner = false;
+	void* mapping = nullptr; // the file mapping handle on Windows
+	int file = -1; // the shm_open descriptor elsewhere, kept by the creator to commit more
+};
@@ -3,7 +3,7 @@
 
 using BasicTurtle2D = Turtle2D<>;
 
-void DrawFractalTree(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawFractalTree(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	LSystemString fractalTree;
 	fractalTree.axiom = "0";
@@ -11,17 +11,17 @@ void DrawFractalTree(Canvas2D& canvas, int iterations, float scale, glm::fvec2 o
 	fractalTree.productionRules['1'] = "11";
 
 	BasicTurtle2D turtle;
-	turtle.actions['0'] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['0'] = [scale](BasicTurtle2D& t, Image& c) {
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale;
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
 	turtle.actions['1'] = turtle.actions['0'];
-	turtle.actions['['] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['['] = [scale](BasicTurtle2D& t, Image& c) {
 		t.PushState();
 		t.Rotate(45.0f);
 	};
-	turtle.actions[']'] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions[']'] = [scale](BasicTurtle2D& t, Image& c) {
 		t.PopState();
 		t.Rotate(-45.0f);
 	};
@@ -34,20 +34,20 @@ void DrawFractalTree(Canvas2D& canvas, int iterations, float scale, glm::fvec2 o
 	);
 }
 
-void DrawKochCurve(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawKochCurve(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	LSystemString kochCurve;
 	kochCurve.axiom = "F";
 	kochCurve.productionRules['F'] = "F+F-F-F+F";
 
 	BasicTurtle2D turtle;
-	turtle.actions['F'] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['F'] = [scale](BasicTurtle2D& t, Image& c) {
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale;
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
-	turtle.actions['+'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(90.0f); };
-	turtle.actions['-'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(-90.0f); };
+	turtle.actions['+'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(90.0f); };
+	turtle.actions['-'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(-90.0f); };
 
 	turtle.Draw(
 		canvas,
@@ -57,7 +57,7 @@ void DrawKochCurve(Canvas2D& canvas, int iterations, float scale, glm::fvec2 ori
 	);
 }
 
-void DrawSierpinskiTriangle(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawSierpinskiTriangle(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	LSystemString sierpinskiTriangle;
 	sierpinskiTriangle.axiom = "F-G-G";
@@ -65,14 +65,14 @@ void DrawSierpinskiTriangle(Canvas2D& canvas, int iterations, float scale, glm::
 	sierpinskiTriangle.productionRules['G'] = "GG";
 
 	BasicTurtle2D turtle;
-	turtle.actions['F'] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['F'] = [scale](BasicTurtle2D& t, Image& c) {
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale;
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
 	turtle.actions['G'] = turtle.actions['F'];
-	turtle.actions['+'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(120.0f); };
-	turtle.actions['-'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(-120.0f); };
+	turtle.actions['+'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(120.0f); };
+	turtle.actions['-'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(-120.0f); };
 
 	turtle.Draw(
 		canvas,
@@ -82,7 +82,7 @@ void DrawSierpinskiTriangle(Canvas2D& canvas, int iterations, float scale, glm::
 	);
 }
 
-void DrawDragonCurve(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawDragonCurve(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	LSystemString dragonCurve;
 	dragonCurve.axiom = "FX";
@@ -90,13 +90,13 @@ void DrawDragonCurve(Canvas2D& canvas, int iterations, float scale, glm::fvec2 o
 	dragonCurve.productionRules['Y'] = "-FX-Y";
 
 	BasicTurtle2D turtle;
-	turtle.actions['F'] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['F'] = [scale](BasicTurtle2D& t, Image& c) {
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale;
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
-	turtle.actions['+'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(-90.0f); };
-	turtle.actions['-'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(90.0f); };
+	turtle.actions['+'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(-90.0f); };
+	turtle.actions['-'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(90.0f); };
 
 	turtle.Draw(
 		canvas,
@@ -106,7 +106,7 @@ void DrawDragonCurve(Canvas2D& canvas, int iterations, float scale, glm::fvec2 o
 	);
 }
 
-void DrawFractalPlant(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawFractalPlant(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	LSystemString fractalPlant;
 	fractalPlant.axiom = "X";
@@ -114,15 +114,15 @@ void DrawFractalPlant(Canvas2D& canvas, int iterations, float scale, glm::fvec2
 	fractalPlant.productionRules['F'] = "FF";
 
 	BasicTurtle2D turtle;
-	turtle.actions['F'] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['F'] = [scale](BasicTurtle2D& t, Image& c) {
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale;
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
-	turtle.actions['+'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(-25.0f); };
-	turtle.actions['-'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(25.0f); };
-	turtle.actions['['] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.PushState(); };
-	turtle.actions[']'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.PopState(); };
+	turtle.actions['+'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(-25.0f); };
+	turtle.actions['-'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(25.0f); };
+	turtle.actions['['] = [scale](BasicTurtle2D& t, Image& c) { t.PushState(); };
+	turtle.actions[']'] = [scale](BasicTurtle2D& t, Image& c) { t.PopState(); };
 
 	turtle.Draw(
 		canvas,
@@ -132,7 +132,7 @@ void DrawFractalPlant(Canvas2D& canvas, int iterations, float scale, glm::fvec2
 	);
 }
 
-void DrawFractalTreeNezumiV1(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawFractalTreeNezumiV1(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	// https://lazynezumi.com/lsystems
 
@@ -141,15 +141,15 @@ void DrawFractalTreeNezumiV1(Canvas2D& canvas, int iterations, float scale, glm:
 	fractalTreeNezumi.productionRules['B'] = "A[-B][+B]";
 
 	BasicTurtle2D turtle;
-	turtle.actions['A'] = [scale](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['A'] = [scale](BasicTurtle2D& t, Image& c) {
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale;
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
-	turtle.actions['-'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(-20.0f); };
-	turtle.actions['+'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(20.0f); };
-	turtle.actions['['] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.PushState(); };
-	turtle.actions[']'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.PopState(); };
+	turtle.actions['-'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(-20.0f); };
+	turtle.actions['+'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(20.0f); };
+	turtle.actions['['] = [scale](BasicTurtle2D& t, Image& c) { t.PushState(); };
+	turtle.actions[']'] = [scale](BasicTurtle2D& t, Image& c) { t.PopState(); };
 
 	turtle.Draw(
 		canvas,
@@ -159,7 +159,7 @@ void DrawFractalTreeNezumiV1(Canvas2D& canvas, int iterations, float scale, glm:
 	);
 }
 
-void DrawFractalTreeNezumiV2(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawFractalTreeNezumiV2(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	// https://lazynezumi.com/lsystems
 
@@ -174,22 +174,22 @@ void DrawFractalTreeNezumiV2(Canvas2D& canvas, int iterations, float scale, glm:
 	using NezumiTurtle = Turtle2D<NezumiProps>;
 
 	NezumiTurtle turtle;
-	turtle.actions['A'] = [scale](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions['A'] = [scale](NezumiTurtle& t, Image& c)
 	{
 		NezumiProps& p = t.state.properties;
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale * p.lengthFactor;
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
-	turtle.actions['%'] = [](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions['%'] = [](NezumiTurtle& t, Image& c)
 	{
 		NezumiProps& p = t.state.properties;
 		p.lengthFactor /= 1.3f;
 	};
-	turtle.actions['-'] = [](NezumiTurtle& t, Canvas2D& c) { t.Rotate(-20.0f); };
-	turtle.actions['+'] = [](NezumiTurtle& t, Canvas2D& c) { t.Rotate(20.0f); };
-	turtle.actions['['] = [](NezumiTurtle& t, Canvas2D& c) { t.PushState(); };
-	turtle.actions[']'] = [](NezumiTurtle& t, Canvas2D& c) { t.PopState(); };
+	turtle.actions['-'] = [](NezumiTurtle& t, Image& c) { t.Rotate(-20.0f); };
+	turtle.actions['+'] = [](NezumiTurtle& t, Image& c) { t.Rotate(20.0f); };
+	turtle.actions['['] = [](NezumiTurtle& t, Image& c) { t.PushState(); };
+	turtle.actions[']'] = [](NezumiTurtle& t, Image& c) { t.PopState(); };
 
 	turtle.Draw(
 		canvas,
@@ -199,7 +199,7 @@ void DrawFractalTreeNezumiV2(Canvas2D& canvas, int iterations, float scale, glm:
 	);
 }
 
-void DrawFractalTreeNezumiV3(Canvas2D& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawFractalTreeNezumiV3(Image& canvas, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	// https://lazynezumi.com/lsystems
 
@@ -217,7 +217,7 @@ void DrawFractalTreeNezumiV3(Canvas2D& canvas, int iterations, float scale, glm:
 	using NezumiTurtle = Turtle2D<NezumiProps>;
 	NezumiTurtle turtle;
 
-	turtle.actions['A'] = [scale, &skipBranch, &uniformGenerator](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions['A'] = [scale, &skipBranch, &uniformGenerator](NezumiTurtle& t, Image& c)
 	{
 		if (skipBranch) return;
 
@@ -227,31 +227,31 @@ void DrawFractalTreeNezumiV3(Canvas2D& canvas, int iterations, float scale, glm:
 		c.DrawLine(t.state.position, newPosition, Color{ 0,0,0,255 });
 		t.state.position = newPosition;
 	};
-	turtle.actions['%'] = [&skipBranch](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions['%'] = [&skipBranch](NezumiTurtle& t, Image& c)
 	{
 		if (skipBranch) return;
 
 		NezumiProps& p = t.state.properties;
 		p.lengthFactor /= 1.6f;
 	};
-	turtle.actions['-'] = [&skipBranch, &uniformGenerator](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions['-'] = [&skipBranch, &uniformGenerator](NezumiTurtle& t, Image& c)
 	{ 
 		if (skipBranch) return;
 
 		t.Rotate(-20.0f + uniformGenerator.RandomFloat(-5.0f, 5.0f));
 	};
-	turtle.actions['+'] = [&skipBranch, &uniformGenerator](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions['+'] = [&skipBranch, &uniformGenerator](NezumiTurtle& t, Image& c)
 	{ 
 		if (skipBranch) return;
 
 		t.Rotate(20.0f + uniformGenerator.RandomFloat(-5.0f, 5.0f)); 
 	};
-	turtle.actions['['] = [&skipBranch, &uniformGenerator](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions['['] = [&skipBranch, &uniformGenerator](NezumiTurtle& t, Image& c)
 	{ 
 		skipBranch = uniformGenerator.RandomFloat() > 0.8;
 		t.PushState(); 
 	};
-	turtle.actions[']'] = [&skipBranch](NezumiTurtle& t, Canvas2D& c)
+	turtle.actions[']'] = [&skipBranch](NezumiTurtle& t, Image& c)
 	{ 
 		t.PopState(); 
 		skipBranch = false;
@@ -265,7 +265,7 @@ void DrawFractalTreeNezumiV3(Canvas2D& canvas, int iterations, float scale, glm:
 	);
 }
 
-void DrawFractalLeaf(std::vector<glm::fvec3>& generatedHull, Canvas2D& canvas, Color color, int iterations, float scale, glm::fvec2 origin, float startAngle)
+void DrawFractalLeaf(std::vector<glm::fvec3>& generatedHull, Image& canvas, Color color, int iterations, float scale, glm::fvec2 origin, float startAngle)
 {
 	LSystemString fractalLeaf;
 	fractalLeaf.axiom = "0";
@@ -275,20 +275,20 @@ void DrawFractalLeaf(std::vector<glm::fvec3>& generatedHull, Canvas2D& canvas, C
 
 	BasicTurtle2D turtle;
 	std::vector<glm::fvec3> leafPositions{ glm::fvec3{origin, 1.0f} };
-	turtle.actions['0'] = [scale, &color](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['0'] = [scale, &color](BasicTurtle2D& t, Image& c) {
 		glm::fvec2 newPosition = t.state.position + t.GetDirection() * scale;
 		c.DrawLine(t.state.position, newPosition, color);
 		t.state.position = newPosition;
 	};
 	turtle.actions['1'] = turtle.actions['0'];
-	turtle.actions['e'] = [scale, &leafPositions](BasicTurtle2D& t, Canvas2D& c) {
+	turtle.actions['e'] = [scale, &leafPositions](BasicTurtle2D& t, Image& c) {
 		leafPositions.push_back(glm::fvec3(t.state.position, 0.0f));
 	};
 
-	turtle.actions['['] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.PushState(); };
-	turtle.actions[']'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.PopState();  };
-	turtle.actions['+'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(45.0f); };
-	turtle.actions['-'] = [scale](BasicTurtle2D& t, Canvas2D& c) { t.Rotate(-45.0f); };
+	turtle.actions['['] = [scale](BasicTurtle2D& t, Image& c) { t.PushState(); };
+	turtle.actions[']'] = [scale](BasicTurtle2D& t, Image& c) { t.PopState();  };
+	turtle.actions['+'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(45.0f); };
+	turtle.actions['-'] = [scale](BasicTurtle2D& t, Image& c) { t.Rotate(-45.0f); };
 
 	turtle.Draw(
 		canvas,
@@ -352,19 +352,28 @@ void BuildBranchesForFractalTree3D(std::vector<FractalBranch>& branches, Bone<Fr
 	}
 }
 
-void GenerateFractalTree3DBasic(TreeStyle style, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions, std::function<void(Bone<FractalTree3DProps>*, std::vector<FractalBranch>&)> onResultCallback)
+std::string GenerateFractalTree3DSymbols(TreeStyle style, int iterations, float applyRandomness)
 {
-	iterations *= 2;
-
 	// https://lazynezumi.com/lsystems
 	LSystemString fractalTree;
 	fractalTree.axiom = "B";
 	fractalTree.productionRules['B'] = "AAC";
-	fractalTree.productionRules['C'] = (style == TreeStyle::Slim) ? "AA[%+B][%++B][%+++B]%A" : "A[%+B][%++B][%+++B]%B+B";
+	if (applyRandomness)
+	{
+		fractalTree.productionRules['C'] = (style == TreeStyle::Slim) ? "AA[%+B][%++B][%+++B]%B" : "A[%+B][%++B][%+++B]%B";
+	}
+	else
+	{
+		fractalTree.productionRules['C'] = (style == TreeStyle::Slim) ? "AA[%+B][%++B][%+++B]%A" : "A[%+B][%++B][%+++B]%B+B";
+	}
+	return fractalTree.RunProduction(iterations * 2);
+}
 
-	using Turtle = Turtle3D<FractalTree3DProps>;
-	Turtle turtle;
+static void SetFractalTree3DBasicActions(Turtle3D<FractalTree3DProps>& turtle, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions)
+{
+	iterations *= 2;
 
+	using Turtle = Turtle3D<FractalTree3DProps>;
 	subdivisions = (subdivisions == 0) ? 1 : subdivisions;
 	float subDivFactor = 1.0f / float(subdivisions);
 	turtle.actions['A'] = [&uniformGenerator, subdivisions, subDivFactor](Turtle& t, int repetitions)
@@ -381,7 +390,7 @@ void GenerateFractalTree3DBasic(TreeStyle style, UniformRandomGenerator& uniform
 	turtle.actions['['] = [](Turtle& t, int repetitions) { t.PushState(); };
 	turtle.actions[']'] = [](Turtle& t, int repetitions) { t.PopState(); };
 
-	turtle.actions['+'] = [&uniformGenerator, &iterations](Turtle& t, int repetitions)
+	turtle.actions['+'] = [&uniformGenerator, iterations](Turtle& t, int repetitions)
 	{
 		float depth = float(t.activeBone->nodeDepth);
 		float rollBranchOffset = 45.0f*depth;
@@ -396,26 +405,13 @@ void GenerateFractalTree3DBasic(TreeStyle style, UniformRandomGenerator& uniform
 		float degrees = 3.0f * iterations / depth;
 		t.Rotate(degrees, rotVec);
 	};
-
-	std::vector<FractalBranch> branches;
-	turtle.GenerateSkeleton(fractalTree.RunProduction(iterations));
-	BuildBranchesForFractalTree3D(branches, turtle.rootBone);
-	onResultCallback(turtle.rootBone, branches);
 }
 
-void GenerateFractalTree3DStochastic(TreeStyle style, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions, std::function<void(Bone<FractalTree3DProps>*, std::vector<FractalBranch>&)> onResultCallback)
+static void SetFractalTree3DStochasticActions(Turtle3D<FractalTree3DProps>& turtle, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions)
 {
 	iterations *= 2;
 
-	// https://lazynezumi.com/lsystems
-	LSystemString fractalTree;
-	fractalTree.axiom = "B";
-	fractalTree.productionRules['B'] = "AAC";
-	fractalTree.productionRules['C'] = (style == TreeStyle::Slim) ? "AA[%+B][%++B][%+++B]%B" : "A[%+B][%++B][%+++B]%B";
-
 	using Turtle = Turtle3D<FractalTree3DProps>;
-	Turtle turtle;
-
 	subdivisions = (subdivisions == 0) ? 1 : subdivisions;
 	float subDivFactor = 1.0f / float(subdivisions);
 	turtle.actions['A'] = [&uniformGenerator, subdivisions, subDivFactor](Turtle& t, int repetitions)
@@ -436,7 +432,7 @@ void GenerateFractalTree3DStochastic(TreeStyle style, UniformRandomGenerator& un
 	turtle.actions['['] = [](Turtle& t, int repetitions) { t.PushState(); };
 	turtle.actions[']'] = [](Turtle& t, int repetitions) { t.PopState(); };
 
-	turtle.actions['+'] = [&uniformGenerator, &iterations](Turtle& t, int repetitions)
+	turtle.actions['+'] = [&uniformGenerator, iterations](Turtle& t, int repetitions)
 	{
 		float depth = float(t.activeBone->nodeDepth);
 
@@ -451,22 +447,28 @@ void GenerateFractalTree3DStochastic(TreeStyle style, UniformRandomGenerator& un
 		float degrees = 3.0f * iterations/depth;
 		t.Rotate(degrees, rotVec);
 	};
-
-	std::vector<FractalBranch> branches;
-	turtle.GenerateSkeleton(fractalTree.RunProduction(iterations));
-	BuildBranchesForFractalTree3D(branches, turtle.rootBone);
-	onResultCallback(turtle.rootBone, branches);
 }
 
-
-void GenerateFractalTree3D(TreeStyle style, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions, float applyRandomness, std::function<void(Bone<FractalTree3DProps>*, std::vector<FractalBranch>&)> onResultCallback)
+void GenerateFractalTree3DSkeleton(Turtle3D<FractalTree3DProps>& turtle, std::vector<FractalBranch>& branches, const std::string& symbols, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions, float applyRandomness)
 {
 	if (applyRandomness)
 	{
-		GenerateFractalTree3DStochastic(style, uniformGenerator, iterations, subdivisions, onResultCallback);
+		SetFractalTree3DStochasticActions(turtle, uniformGenerator, iterations, subdivisions);
 	}
 	else
 	{
-		GenerateFractalTree3DBasic(style, uniformGenerator, iterations, subdivisions, onResultCallback);
+		SetFractalTree3DBasicActions(turtle, uniformGenerator, iterations, subdivisions);
 	}
-}
\ No newline at end of file
+
+	turtle.GenerateSkeleton(symbols);
+	turtle.actions.clear(); // they hold on to the generator
+	BuildBranchesForFractalTree3D(branches, turtle.rootBone);
+}
+
+void GenerateFractalTree3D(TreeStyle style, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions, float applyRandomness, std::function<void(Bone<FractalTree3DProps>*, std::vector<FractalBranch>&)> onResultCallback)
+{
+	Turtle3D<FractalTree3DProps> turtle;
+	std::vector<FractalBranch> branches;
+	GenerateFractalTree3DSkeleton(turtle, branches, GenerateFractalTree3DSymbols(style, iterations, applyRandomness), uniformGenerator, iterations, subdivisions, applyRandomness);
+	onResultCallback(turtle.rootBone, branches);
+}
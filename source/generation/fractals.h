@@ -1,19 +1,19 @@
 #pragma once
-#include "../opengl/canvas.h"
+#include "../core/image.h"
 #include "../core/randomization.h"
 #include "lsystem.h"
 #include "turtle2d.h"
 #include "turtle3d.h"
 
-void DrawFractalTree(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawKochCurve(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawSierpinskiTriangle(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawDragonCurve(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawFractalPlant(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawFractalTreeNezumiV1(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawFractalTreeNezumiV2(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawFractalTreeNezumiV3(Canvas2D& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
-void DrawFractalLeaf(std::vector<glm::fvec3>& generatedHull, Canvas2D& canvas, Color color, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawFractalTree(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawKochCurve(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawSierpinskiTriangle(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawDragonCurve(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawFractalPlant(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawFractalTreeNezumiV1(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawFractalTreeNezumiV2(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawFractalTreeNezumiV3(Image& canvas, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
+void DrawFractalLeaf(std::vector<glm::fvec3>& generatedHull, Image& canvas, Color color, int iterations, float scale = 10.0f, glm::fvec2 origin = glm::fvec2{ 0.0f }, float startAngle = 90);
 
 template<class T>
 void GenerateFractalPlant3D(Turtle3D<T>& turtle, UniformRandomGenerator& uniformGenerator, int iterations, float scale = 0.1f)
@@ -93,4 +93,11 @@ enum class TreeStyle
 	Default,
 	Slim
 };
+
+/*
+	The 3D fractal tree in two steps, so the symbols can be kept and the skeleton regrown from them.
+	The skeleton is owned by the turtle, the branches point into it.
+*/
+std::string GenerateFractalTree3DSymbols(TreeStyle style, int iterations, float applyRandomness);
+void GenerateFractalTree3DSkeleton(Turtle3D<FractalTree3DProps>& turtle, std::vector<FractalBranch>& branches, const std::string& symbols, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions, float applyRandomness);
 void GenerateFractalTree3D(TreeStyle style, UniformRandomGenerator& uniformGenerator, int iterations, int subdivisions, float applyRandomness, std::function<void(Bone<FractalTree3DProps>*, std::vector<FractalBranch>&)> onResultCallback);
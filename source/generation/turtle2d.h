@@ -1,5 +1,5 @@
 #pragma once
-#include "../opengl/canvas.h"
+#include "../core/image.h"
 #include "../core/math.h"
 #include <map>
 #include <stack>
@@ -23,7 +23,7 @@ public:
 	TurtleState state;
 
 	std::stack<TurtleState> turtleStack;
-	std::map<char, std::function<void(Turtle2D&, Canvas2D&)>> actions;
+	std::map<char, std::function<void(Turtle2D&, Image&)>> actions;
 
 	Turtle2D() = default;
 	~Turtle2D() = default;
@@ -33,7 +33,7 @@ public:
 		turtleStack = std::stack<TurtleState>();
 	}
 
-	void Draw(Canvas2D& canvas, std::string& symbols, glm::fvec2 startPosition, float startAngle)
+	void Draw(Image& canvas, std::string& symbols, glm::fvec2 startPosition, float startAngle)
 	{
 		if (turtleStack.size() != 0)
 		{
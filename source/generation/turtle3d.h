@@ -1,5 +1,5 @@
 #pragma once
-#include "../opengl/mesh.h"
+#include "../core/meshdata.h"
 #include "../core/math.h"
 #include <map>
 #include <stack>
@@ -148,7 +148,14 @@ public:
 		Clear();
 	}
 
-	~Turtle3D() = default;
+	~Turtle3D()
+	{
+		Clear();
+	}
+
+	// The turtle owns its bones
+	Turtle3D(const Turtle3D&) = delete;
+	Turtle3D& operator=(const Turtle3D&) = delete;
 
 	void Clear()
 	{
@@ -164,7 +171,7 @@ public:
 		branchStack = std::stack<TurtleBone*>();
 	}
 
-	void GenerateSkeleton(std::string& symbols, TTransform startTransform = TTransform{})
+	void GenerateSkeleton(const std::string& symbols, TTransform startTransform = TTransform{})
 	{
 		Clear();
 		transform = std::move(startTransform);
@@ -253,7 +260,8 @@ public:
 		}
 	}
 
-	void BonesToGLLines(GLLine& lines, glm::fvec4 boneColor, glm::fvec4 normalColor)
+	// Only fills the lines, uploading them is up to the caller
+	void BonesToLines(LineMesh& lines, glm::fvec4 boneColor, glm::fvec4 normalColor)
 	{
 		ForEachBone([&lines, &boneColor, &normalColor](TurtleBone* b) -> void
 		{
@@ -268,6 +276,5 @@ public:
 				normalColor
 			);
 		});
-		lines.SendToGPU();
 	}
 };
\ No newline at end of file
@@ -0,0 +1,416 @@
+#include "bvh.h"
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <cassert>
+
+const int sahBinCount = 16;
+const int traversalStackSize = 64;
+const int maxBuildDepth = traversalStackSize - 2; // a traversal holds at most one sibling per level plus the root
+const float traversalCost = 1.0f; // relative to one primitive test
+
+float HalfSurfaceArea(glm::fvec3 minBounds, glm::fvec3 maxBounds)
+{
+	glm::fvec3 e = maxBounds - minBounds;
+	return e.x*e.y + e.y*e.z + e.z*e.x;
+}
+
+// Returns the entry distance, or FLT_MAX when the box is missed or farther than maxDistance
+float IntersectBox(const BVHNode& node, glm::fvec3 origin, glm::fvec3 inverseDirection, float maxDistance)
+{
+	glm::fvec3 t1 = (node.minBounds - origin) * inverseDirection;
+	glm::fvec3 t2 = (node.maxBounds - origin) * inverseDirection;
+	glm::fvec3 tNear = glm::min(t1, t2);
+	glm::fvec3 tFar = glm::max(t1, t2);
+	float entry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.0f));
+	float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDistance));
+	return (entry <= exit) ? entry : FLT_MAX;
+}
+
+bool BoxesOverlap(glm::fvec3 minA, glm::fvec3 maxA, glm::fvec3 minB, glm::fvec3 maxB)
+{
+	return glm::all(glm::lessThanEqual(minA, maxB)) && glm::all(glm::lessThanEqual(minB, maxA));
+}
+
+float IntersectSphere(glm::fvec3 origin, glm::fvec3 direction, glm::fvec3 center, float radius)
+{
+	glm::fvec3 oc = origin - center;
+	float b = glm::dot(direction, oc);
+	float c = glm::dot(oc, oc) - radius*radius;
+	float h = b*b - c;
+	if (h < 0.0f) return FLT_MAX;
+
+	float t = -b - sqrtf(h);
+	return (t >= 0.0f) ? t : FLT_MAX;
+}
+
+// Direction must be normalized. Based on the capsule intersection by Inigo Quilez.
+float IntersectCapsule(glm::fvec3 origin, glm::fvec3 direction, const BVHCapsule& capsule)
+{
+	glm::fvec3 ba = capsule.end - capsule.start;
+	glm::fvec3 oa = origin - capsule.start;
+	float baba = glm::dot(ba, ba);
+	float bard = glm::dot(ba, direction);
+	float baoa = glm::dot(ba, oa);
+
+	// Cylinder body
+	float a = baba - bard*bard;
+	if (a > 1e-8f)
+	{
+		float b = baba*glm::dot(direction, oa) - baoa*bard;
+		float c = baba*glm::dot(oa, oa) - baoa*baoa - capsule.radius*capsule.radius*baba;
+		float h = b*b - a*c;
+		if (h < 0.0f) return FLT_MAX;
+
+		float t = (-b - sqrtf(h)) / a;
+		float y = baoa + t*bard;
+		if (t >= 0.0f && y > 0.0f && y < baba) return t;
+	}
+
+	// Spherical caps
+	return glm::min(
+		IntersectSphere(origin, direction, capsule.start, capsule.radius),
+		IntersectSphere(origin, direction, capsule.end, capsule.radius)
+	);
+}
+
+float IntersectQuad(glm::fvec3 origin, glm::fvec3 direction, const BVHQuad& quad)
+{
+	glm::fvec3 normal = glm::cross(quad.edgeU, quad.edgeV);
+	float denominator = glm::dot(normal, direction);
+	if (fabs(denominator) < 1e-12f) return FLT_MAX;
+
+	float t = glm::dot(normal, quad.corner - origin) / denominator;
+	if (t < 0.0f) return FLT_MAX;
+
+	// Solve for the parallelogram coordinates of the hit point
+	glm::fvec3 p = origin + direction*t - quad.corner;
+	float uu = glm::dot(quad.edgeU, quad.edgeU);
+	float uv = glm::dot(quad.edgeU, quad.edgeV);
+	float vv = glm::dot(quad.edgeV, quad.edgeV);
+	float pu = glm::dot(p, quad.edgeU);
+	float pv = glm::dot(p, quad.edgeV);
+	float determinant = uu*vv - uv*uv;
+	if (fabs(determinant) < 1e-20f) return FLT_MAX;
+
+	float s = (vv*pu - uv*pv) / determinant;
+	float r = (uu*pv - uv*pu) / determinant;
+	return (s >= 0.0f && s <= 1.0f && r >= 0.0f && r <= 1.0f) ? t : FLT_MAX;
+}
+
+void BoundingVolumeHierarchy::Clear()
+{
+	nodes.clear();
+	capsules.clear();
+	quads.clear();
+	primitiveIndices.clear();
+	primitiveMin.clear();
+	primitiveMax.clear();
+	primitiveCentroid.clear();
+}
+
+void BoundingVolumeHierarchy::Build()
+{
+	uint32_t capsuleCount = uint32_t(capsules.size());
+	uint32_t primitiveCount = capsuleCount + uint32_t(quads.size());
+
+	primitiveMin.resize(primitiveCount);
+	primitiveMax.resize(primitiveCount);
+	primitiveCentroid.resize(primitiveCount);
+	primitiveIndices.resize(primitiveCount);
+	for (uint32_t i = 0; i < capsuleCount; i++)
+	{
+		auto& c = capsules[i];
+		primitiveMin[i] = glm::min(c.start, c.end) - glm::fvec3{ c.radius };
+		primitiveMax[i] = glm::max(c.start, c.end) + glm::fvec3{ c.radius };
+	}
+	for (uint32_t i = capsuleCount; i < primitiveCount; i++)
+	{
+		auto& q = quads[i - capsuleCount];
+		glm::fvec3 corners[3] = { q.corner + q.edgeU, q.corner + q.edgeV, q.corner + q.edgeU + q.edgeV };
+		primitiveMin[i] = primitiveMax[i] = q.corner;
+		for (auto& corner : corners)
+		{
+			primitiveMin[i] = glm::min(primitiveMin[i], corner);
+			primitiveMax[i] = glm::max(primitiveMax[i], corner);
+		}
+	}
+	for (uint32_t i = 0; i < primitiveCount; i++)
+	{
+		primitiveCentroid[i] = 0.5f * (primitiveMin[i] + primitiveMax[i]);
+		primitiveIndices[i] = i;
+	}
+
+	nodes.clear();
+	if (primitiveCount == 0) return;
+
+	// Each level of parallel splits doubles the tasks, stop once there is one per hardware thread
+	int threadCount = int(std::thread::hardware_concurrency());
+	parallelDepth = 0;
+	while ((1 << parallelDepth) < threadCount)
+	{
+		parallelDepth++;
+	}
+
+	nodes.reserve(2 * primitiveCount / maxLeafSize + 1);
+	BuildRecursive(0, primitiveCount, nodes, 0);
+}
+
+void BoundingVolumeHierarchy::BuildRecursive(uint32_t begin, uint32_t end, std::vector<BVHNode>& output, int depth)
+{
+	uint32_t nodeIndex = uint32_t(output.size());
+	output.push_back(BVHNode{});
+
+	glm::fvec3 minBounds = primitiveMin[primitiveIndices[begin]];
+	glm::fvec3 maxBounds = primitiveMax[primitiveIndices[begin]];
+	glm::fvec3 minCentroid = primitiveCentroid[primitiveIndices[begin]];
+	glm::fvec3 maxCentroid = minCentroid;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		uint32_t p = primitiveIndices[i];
+		minBounds = glm::min(minBounds, primitiveMin[p]);
+		maxBounds = glm::max(maxBounds, primitiveMax[p]);
+		minCentroid = glm::min(minCentroid, primitiveCentroid[p]);
+		maxCentroid = glm::max(maxCentroid, primitiveCentroid[p]);
+	}
+
+	auto makeLeaf = [&]()
+	{
+		output[nodeIndex] = BVHNode{ minBounds, begin, maxBounds, end - begin };
+	};
+
+	// Degenerate inputs (for example long chains of nested bounds) end in larger leaves instead of overflowing the traversal stack
+	uint32_t count = end - begin;
+	if (count <= 1 || depth >= maxBuildDepth)
+	{
+		makeLeaf();
+		return;
+	}
+
+	/*
+		Binned SAH over the centroid bounds
+	*/
+	struct Bin
+	{
+		glm::fvec3 minBounds{ FLT_MAX };
+		glm::fvec3 maxBounds{ -FLT_MAX };
+		uint32_t count = 0;
+	};
+
+	glm::fvec3 centroidExtent = maxCentroid - minCentroid;
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		if (centroidExtent[axis] <= 0.0f) continue;
+
+		Bin bins[sahBinCount];
+		float binScale = sahBinCount / centroidExtent[axis];
+		for (uint32_t i = begin; i < end; i++)
+		{
+			uint32_t p = primitiveIndices[i];
+			int b = glm::min(sahBinCount - 1, int((primitiveCentroid[p][axis] - minCentroid[axis]) * binScale));
+			bins[b].count++;
+			bins[b].minBounds = glm::min(bins[b].minBounds, primitiveMin[p]);
+			bins[b].maxBounds = glm::max(bins[b].maxBounds, primitiveMax[p]);
+		}
+
+		// Sweep from both sides to get the cost of every split plane
+		float leftCost[sahBinCount - 1];
+		Bin accumulated;
+		for (int b = 0; b < sahBinCount - 1; b++)
+		{
+			accumulated.count += bins[b].count;
+			accumulated.minBounds = glm::min(accumulated.minBounds, bins[b].minBounds);
+			accumulated.maxBounds = glm::max(accumulated.maxBounds, bins[b].maxBounds);
+			leftCost[b] = (accumulated.count > 0) ? accumulated.count * HalfSurfaceArea(accumulated.minBounds, accumulated.maxBounds) : 0.0f;
+		}
+
+		accumulated = Bin{};
+		for (int b = sahBinCount - 1; b > 0; b--)
+		{
+			accumulated.count += bins[b].count;
+			accumulated.minBounds = glm::min(accumulated.minBounds, bins[b].minBounds);
+			accumulated.maxBounds = glm::max(accumulated.maxBounds, bins[b].maxBounds);
+			if (accumulated.count == 0 || accumulated.count == count) continue;
+
+			float cost = leftCost[b - 1] + accumulated.count * HalfSurfaceArea(accumulated.minBounds, accumulated.maxBounds);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	// Stop when every centroid coincides, or when a small leaf is cheaper than splitting
+	float nodeArea = HalfSurfaceArea(minBounds, maxBounds);
+	if (bestAxis < 0 || (count <= uint32_t(maxLeafSize) && traversalCost*nodeArea + bestCost >= count*nodeArea))
+	{
+		makeLeaf();
+		return;
+	}
+
+	float binScale = sahBinCount / centroidExtent[bestAxis];
+	float splitMin = minCentroid[bestAxis];
+	auto middle = std::partition(primitiveIndices.begin() + begin, primitiveIndices.begin() + end, [&](uint32_t p)
+	{
+		return glm::min(sahBinCount - 1, int((primitiveCentroid[p][bestAxis] - splitMin) * binScale)) < bestSplit;
+	});
+	uint32_t split = uint32_t(middle - primitiveIndices.begin());
+	split = (split == begin || split == end) ? begin + count / 2 : split;
+
+	/*
+		Children, large right subtrees are built on another thread into their own array
+	*/
+	uint32_t rightIndex = 0;
+	if (end - split > parallelThreshold && depth < parallelDepth)
+	{
+		std::vector<BVHNode> rightNodes;
+		auto rightTask = std::async(std::launch::async, [&]() { BuildRecursive(split, end, rightNodes, depth + 1); });
+		BuildRecursive(begin, split, output, depth + 1);
+		rightTask.get();
+
+		rightIndex = uint32_t(output.size());
+		for (auto& node : rightNodes)
+		{
+			if (node.count == 0) node.leftOrFirst += rightIndex;
+			output.push_back(node);
+		}
+	}
+	else
+	{
+		BuildRecursive(begin, split, output, depth + 1);
+		rightIndex = uint32_t(output.size());
+		BuildRecursive(split, end, output, depth + 1);
+	}
+
+	output[nodeIndex] = BVHNode{ minBounds, rightIndex, maxBounds, 0 };
+}
+
+float BoundingVolumeHierarchy::IntersectPrimitive(uint32_t primitive, const BVHRay& ray) const
+{
+	return IsCapsule(primitive)
+		? IntersectCapsule(ray.origin, ray.direction, capsules[primitive])
+		: IntersectQuad(ray.origin, ray.direction, quads[primitive - capsules.size()]);
+}
+
+bool BoundingVolumeHierarchy::IntersectNearest(const BVHRay& inputRay, BVHHit& hit) const
+{
+	hit = BVHHit{};
+	if (nodes.empty()) return false;
+
+	BVHRay ray = inputRay;
+	ray.direction = glm::normalize(ray.direction);
+	glm::fvec3 inverseDirection = 1.0f / ray.direction;
+	hit.distance = ray.maxDistance;
+
+	uint32_t stack[traversalStackSize];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const BVHNode& node = nodes[stack[--stackSize]];
+		if (IntersectBox(node, ray.origin, inverseDirection, hit.distance) == FLT_MAX) continue;
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				float t = IntersectPrimitive(primitiveIndices[i], ray);
+				if (t < hit.distance)
+				{
+					hit.distance = t;
+					hit.primitive = primitiveIndices[i];
+				}
+			}
+			continue;
+		}
+
+		// Push the farther child first so the nearer one is visited next
+		uint32_t left = uint32_t(&node - nodes.data()) + 1;
+		uint32_t right = node.leftOrFirst;
+		float leftDistance = IntersectBox(nodes[left], ray.origin, inverseDirection, hit.distance);
+		float rightDistance = IntersectBox(nodes[right], ray.origin, inverseDirection, hit.distance);
+		if (leftDistance > rightDistance)
+		{
+			std::swap(left, right);
+			std::swap(leftDistance, rightDistance);
+		}
+		assert(stackSize + 2 <= traversalStackSize);
+		if (rightDistance != FLT_MAX) stack[stackSize++] = right;
+		if (leftDistance != FLT_MAX) stack[stackSize++] = left;
+	}
+
+	return hit.primitive != ~0u;
+}
+
+bool BoundingVolumeHierarchy::IntersectAny(const BVHRay& inputRay) const
+{
+	if (nodes.empty()) return false;
+
+	BVHRay ray = inputRay;
+	ray.direction = glm::normalize(ray.direction);
+	glm::fvec3 inverseDirection = 1.0f / ray.direction;
+
+	uint32_t stack[traversalStackSize];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		uint32_t nodeIndex = stack[--stackSize];
+		const BVHNode& node = nodes[nodeIndex];
+		if (IntersectBox(node, ray.origin, inverseDirection, ray.maxDistance) == FLT_MAX) continue;
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				if (IntersectPrimitive(primitiveIndices[i], ray) < ray.maxDistance) return true;
+			}
+		}
+		else
+		{
+			assert(stackSize + 2 <= traversalStackSize);
+			stack[stackSize++] = node.leftOrFirst;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return false;
+}
+
+void BoundingVolumeHierarchy::QueryBox(glm::fvec3 minBounds, glm::fvec3 maxBounds, std::vector<uint32_t>& overlapping) const
+{
+	if (nodes.empty()) return;
+
+	uint32_t stack[traversalStackSize];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		uint32_t nodeIndex = stack[--stackSize];
+		const BVHNode& node = nodes[nodeIndex];
+		if (!BoxesOverlap(node.minBounds, node.maxBounds, minBounds, maxBounds)) continue;
+
+		if (node.count > 0)
+		{
+			for (uint32_t i = node.leftOrFirst; i < node.leftOrFirst + node.count; i++)
+			{
+				uint32_t p = primitiveIndices[i];
+				if (BoxesOverlap(primitiveMin[p], primitiveMax[p], minBounds, maxBounds))
+				{
+					overlapping.push_back(p);
+				}
+			}
+		}
+		else
+		{
+			assert(stackSize + 2 <= traversalStackSize);
+			stack[stackSize++] = node.leftOrFirst;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+}
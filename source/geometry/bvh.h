@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include <float.h>
+#include "../core/math.h"
+
+/*
+	Bounding volume hierarchy over capsules (branch bones) and quads (leaf cards)
+	Built top-down with binned SAH, the upper levels are built in parallel with at most
+	one task per hardware thread. The depth is capped so traversal fits a fixed stack.
+	Nodes are 32 bytes and stored depth-first: the left child of an interior node
+	is the next node and the right child is stored in the node itself.
+*/
+
+struct BVHCapsule
+{
+	glm::fvec3 start;
+	glm::fvec3 end;
+	float radius = 0.0f;
+};
+
+// Parallelogram spanned by two edges from a corner
+struct BVHQuad
+{
+	glm::fvec3 corner;
+	glm::fvec3 edgeU;
+	glm::fvec3 edgeV;
+};
+
+struct BVHRay
+{
+	glm::fvec3 origin{ 0.0f };
+	glm::fvec3 direction{ 0.0f, 0.0f, 1.0f };
+	float maxDistance = FLT_MAX;
+};
+
+struct BVHHit
+{
+	float distance = FLT_MAX;
+	uint32_t primitive = ~0u; // capsules come first, quads start at capsules.size()
+};
+
+struct alignas(32) BVHNode
+{
+	glm::fvec3 minBounds;
+	uint32_t leftOrFirst;	// interior: index of the right child, leaf: first entry in primitiveIndices
+	glm::fvec3 maxBounds;
+	uint32_t count;			// 0 for interior nodes
+};
+
+class BoundingVolumeHierarchy
+{
+public:
+	std::vector<BVHNode> nodes;
+	std::vector<BVHCapsule> capsules;
+	std::vector<BVHQuad> quads;
+	std::vector<uint32_t> primitiveIndices;
+
+	int maxLeafSize = 4;
+	size_t parallelThreshold = 4096; // subtrees with more primitives than this are built on their own thread, down to parallelDepth
+
+	BoundingVolumeHierarchy() = default;
+	~BoundingVolumeHierarchy() = default;
+	BoundingVolumeHierarchy(BoundingVolumeHierarchy&&) = default;
+	BoundingVolumeHierarchy& operator=(BoundingVolumeHierarchy&&) = default;
+
+	void Clear();
+	void Build();
+
+	bool IsCapsule(uint32_t primitive) const { return primitive < capsules.size(); }
+
+	bool IntersectNearest(const BVHRay& ray, BVHHit& hit) const;
+	bool IntersectAny(const BVHRay& ray) const;
+	void QueryBox(glm::fvec3 minBounds, glm::fvec3 maxBounds, std::vector<uint32_t>& overlapping) const;
+
+protected:
+	std::vector<glm::fvec3> primitiveMin;
+	std::vector<glm::fvec3> primitiveMax;
+	std::vector<glm::fvec3> primitiveCentroid;
+	int parallelDepth = 0;
+
+	void BuildRecursive(uint32_t begin, uint32_t end, std::vector<BVHNode>& output, int depth);
+	float IntersectPrimitive(uint32_t primitive, const BVHRay& ray) const;
+};
@@ -0,0 +1,208 @@
+#include "depthsort.h"
+#include "../core/meshkernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+const float incrementalShift = 1.0f;
+
+// Depth keys are 12 bits, a few millimeters over a tree crown, so the radix sort is a single
+// counting pass whose 16 KB of bucket offsets stay in the L1 cache
+const unsigned int keyBuckets = 1 << 12;
+const float maxKey = float(keyBuckets - 1);
+
+// Interleaves the low 10 bits of v with two zero bits after each bit
+static uint32_t SpreadBits(uint32_t v)
+{
+	v &= 0x3ff;
+	v = (v | (v << 16)) & 0x030000ff;
+	v = (v | (v << 8)) & 0x0300f00f;
+	v = (v | (v << 4)) & 0x030c30c3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+void DepthSorter::Clear()
+{
+	centers.clear();
+	order.clear();
+	spatialCenters.clear();
+	spatialInstances.clear();
+	instanceKeys.clear();
+	entries.clear();
+	boundsCenter = glm::fvec3{ 0.0f };
+	boundsRadius = 0.0f;
+	sorted = false;
+}
+
+void DepthSorter::SetInstances(const TriangleMesh& mesh, unsigned int verticesPerInstance)
+{
+	Clear();
+	if (verticesPerInstance == 0) return;
+
+	size_t instanceCount = mesh.positions.size() / verticesPerInstance;
+	if (instanceCount == 0) return;
+
+	centers.resize(instanceCount);
+	glm::fvec3 minBounds = mesh.positions[0];
+	glm::fvec3 maxBounds = minBounds;
+	for (size_t i = 0; i < instanceCount; i++)
+	{
+		glm::fvec3 sum{ 0.0f };
+		for (size_t v = i * verticesPerInstance; v < (i + 1) * verticesPerInstance; v++)
+		{
+			sum += mesh.positions[v];
+		}
+		centers[i] = sum / float(verticesPerInstance);
+		minBounds = glm::min(minBounds, centers[i]);
+		maxBounds = glm::max(maxBounds, centers[i]);
+	}
+
+	boundsCenter = 0.5f * (minBounds + maxBounds);
+	boundsRadius = 0.5f * glm::length(maxBounds - minBounds);
+
+	// Centers close in space get close keys from any direction, so in Morton order the scatter of
+	// the radix sort writes to a few nearby places of the order instead of all over it
+	std::vector<uint32_t> mortonCodes(instanceCount);
+	glm::fvec3 extent = glm::max(maxBounds - minBounds, glm::fvec3{ 1e-6f });
+	for (size_t i = 0; i < instanceCount; i++)
+	{
+		glm::uvec3 cell = glm::uvec3((centers[i] - minBounds) / extent * 1023.0f);
+		mortonCodes[i] = SpreadBits(cell.x) | (SpreadBits(cell.y) << 1) | (SpreadBits(cell.z) << 2);
+	}
+	spatialInstances.resize(instanceCount);
+	for (size_t i = 0; i < instanceCount; i++)
+	{
+		spatialInstances[i] = (unsigned int)(i);
+	}
+	std::sort(spatialInstances.begin(), spatialInstances.end(), [&](unsigned int a, unsigned int b) { return mortonCodes[a] < mortonCodes[b]; });
+	spatialCenters.resize(instanceCount);
+	for (size_t i = 0; i < instanceCount; i++)
+	{
+		spatialCenters[i] = centers[spatialInstances[i]];
+	}
+
+	order.resize(instanceCount);
+	instanceKeys.resize(instanceCount);
+	entries.resize(instanceCount);
+	bucketOffsets.resize(keyBuckets);
+	for (size_t i = 0; i < instanceCount; i++)
+	{
+		order[i] = (unsigned int)(i);
+	}
+}
+
+void DepthSorter::Sort(glm::fvec3 cameraPosition, glm::fvec3 viewDirection)
+{
+	auto sortStart = std::chrono::high_resolution_clock::now();
+	statistics = DepthSortStatistics{};
+	size_t count = order.size();
+	if (count == 0) return;
+
+	// The farthest point of the bounds gets key 0, so ascending keys draw back to front
+	float maxDepth = glm::dot(boundsCenter - cameraPosition, viewDirection) + boundsRadius;
+	float scale = (boundsRadius > 0.0f) ? maxKey / (2.0f * boundsRadius) : 0.0f;
+	float keyOffset = maxDepth * scale + glm::dot(cameraPosition, viewDirection) * scale;
+	glm::fvec3 keyDirection = viewDirection * scale;
+
+	// Largest key change over the bounding sphere since the last sort. Below one key the last
+	// order is as good as a new sort at this precision, so it is kept and the reference stays.
+	statistics.maxKeyShift = sorted
+		? fabsf(keyOffset - lastKeyOffset - glm::dot(boundsCenter, keyDirection - lastKeyDirection)) + boundsRadius * glm::length(keyDirection - lastKeyDirection)
+		: maxKey;
+	if (statistics.maxKeyShift < 1.0f)
+	{
+		statistics.kept = true;
+		statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sortStart).count();
+		return;
+	}
+
+	// With the instances spread over the key range an instance passes about count / keyBuckets others
+	// per key of shift. Up to about one move per instance the insertion sort is cheaper than the
+	// radix sort, so it is only tried below that and the radix sort runs directly otherwise.
+	if (statistics.maxKeyShift * float(count) <= incrementalShift * float(keyBuckets))
+	{
+		statistics.incremental = InsertionSort(keyOffset, keyDirection, count + 64);
+		statistics.fallback = !statistics.incremental;
+	}
+	if (!statistics.incremental)
+	{
+		RadixSort(keyOffset, keyDirection);
+	}
+
+	sorted = true;
+	lastKeyOffset = keyOffset;
+	lastKeyDirection = keyDirection;
+	statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sortStart).count();
+	statistics.withinBudget = statistics.milliseconds <= budgetMilliseconds;
+}
+
+bool DepthSorter::InsertionSort(float keyOffset, glm::fvec3 keyDirection, size_t maxMoves)
+{
+	// Entries in the previous order with the new keys, read straight from the centers
+	const glm::fvec3* instanceCenters = centers.data();
+	const unsigned int* previousOrder = order.data();
+	uint64_t* sortedEntries = entries.data();
+	size_t count = entries.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int instance = previousOrder[i];
+		uint16_t key = uint16_t(glm::clamp(keyOffset - glm::dot(instanceCenters[instance], keyDirection), 0.0f, maxKey));
+		sortedEntries[i] = (uint64_t(key) << 32) | instance;
+	}
+
+	// Only the keys are compared, equal keys keep their previous order
+	for (size_t i = 1; i < count; i++)
+	{
+		uint64_t entry = sortedEntries[i];
+		uint64_t key = entry >> 32;
+		size_t j = i;
+		while (j > 0 && (sortedEntries[j - 1] >> 32) > key)
+		{
+			sortedEntries[j] = sortedEntries[j - 1];
+			j--;
+
+			// Out of budget, the previous order is still intact in order
+			if (++statistics.moves > maxMoves) return false;
+		}
+		sortedEntries[j] = entry;
+	}
+
+	unsigned int* sortedOrder = order.data();
+	for (size_t i = 0; i < count; i++)
+	{
+		sortedOrder[i] = (unsigned int)(sortedEntries[i]);
+	}
+	return true;
+}
+
+void DepthSorter::RadixSort(float keyOffset, glm::fvec3 keyDirection)
+{
+	// Keys in Morton order, sequential over the spatial copy of the centers
+	uint16_t* keys = instanceKeys.data();
+	size_t count = spatialCenters.size();
+	ComputeDepthKeys(spatialCenters.data(), keys, count, keyDirection, keyOffset, maxKey);
+
+	unsigned int* offsets = bucketOffsets.data();
+	std::fill(offsets, offsets + keyBuckets, 0u);
+	for (size_t i = 0; i < count; i++)
+	{
+		offsets[keys[i]]++;
+	}
+
+	unsigned int sum = 0;
+	for (unsigned int bucket = 0; bucket < keyBuckets; bucket++)
+	{
+		unsigned int size = offsets[bucket];
+		offsets[bucket] = sum;
+		sum += size;
+	}
+
+	// One scatter of the instance indices, equal keys end up in Morton order
+	const unsigned int* instances = spatialInstances.data();
+	unsigned int* sortedOrder = order.data();
+	for (size_t i = 0; i < count; i++)
+	{
+		sortedOrder[offsets[keys[i]]++] = instances[i];
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "../core/meshdata.h"
+
+/*
+	Back-to-front ordering of blended instances (the flowers)
+	Depths along the view direction are quantized to 12-bit keys. The strategy is picked
+	before sorting from how far the keys can have moved since the last sort. Less than one
+	key keeps the last order, a small camera move leaves the previous order almost sorted
+	and an insertion sort with a bounded number of moves finishes it, otherwise a single pass
+	counting sort of the instance indices runs directly.
+*/
+
+struct DepthSortStatistics
+{
+	bool kept = false;			// the keys moved by less than one since the last sort and its order was kept
+	bool incremental = false;	// the insertion sort was enough
+	bool fallback = false;		// the insertion sort ran out of moves and the radix sort had to run after it
+	size_t moves = 0;			// element moves made by the insertion sort
+	float maxKeyShift = 0.0f;	// bound on how far any key moved since the last sort
+	double milliseconds = 0.0;
+	bool withinBudget = true;	// milliseconds <= DepthSorter::budgetMilliseconds
+};
+
+class DepthSorter
+{
+public:
+	std::vector<glm::fvec3> centers;
+	std::vector<unsigned int> order;	// instance indices, back to front after Sort
+	DepthSortStatistics statistics;
+	double budgetMilliseconds = 0.5;
+
+	DepthSorter() = default;
+	~DepthSorter() = default;
+
+	// One instance per verticesPerInstance consecutive vertices, as produced by AppendMeshTransformed
+	void SetInstances(const TriangleMesh& mesh, unsigned int verticesPerInstance);
+	void Clear();
+
+	// Camera position and view direction in the coordinate system of the centers
+	void Sort(glm::fvec3 cameraPosition, glm::fvec3 viewDirection);
+
+protected:
+	// The depth range comes from a sphere around all centers, so the keys need a single pass
+	glm::fvec3 boundsCenter{ 0.0f };
+	float boundsRadius = 0.0f;
+
+	// Key mapping of the last sort, the key of center c is keyOffset - dot(c, keyDirection)
+	bool sorted = false;
+	float lastKeyOffset = 0.0f;
+	glm::fvec3 lastKeyDirection{ 0.0f };
+
+	// The centers again in Morton order for the radix sort, with the instance of each
+	std::vector<glm::fvec3> spatialCenters;
+	std::vector<unsigned int> spatialInstances;
+
+	std::vector<uint16_t> instanceKeys;	// keys of the spatial centers
+	std::vector<unsigned int> bucketOffsets;
+
+	// Work array of the insertion sort, key in the upper 32 bits and instance in the lower 32 bits
+	std::vector<uint64_t> entries;
+
+	bool InsertionSort(float keyOffset, glm::fvec3 keyDirection, size_t maxMoves);
+	void RadixSort(float keyOffset, glm::fvec3 keyDirection);
+};
@@ -0,0 +1,397 @@
+#include "leafcard.h"
+#include "../thirdparty/glmGeom.h"
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+	float SignedArea(const std::vector<glm::fvec3>& polygon)
+	{
+		float area = 0.0f;
+		for (size_t i = 0; i < polygon.size(); i++)
+		{
+			const glm::fvec3& a = polygon[i];
+			const glm::fvec3& b = polygon[(i + 1) % polygon.size()];
+			area += a.x * b.y - b.x * a.y;
+		}
+		return 0.5f * area;
+	}
+
+	float Cross(glm::fvec3 o, glm::fvec3 a, glm::fvec3 b)
+	{
+		return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+	}
+
+	bool SegmentsCross(glm::fvec3 a, glm::fvec3 b, glm::fvec3 c, glm::fvec3 d)
+	{
+		float d1 = Cross(c, d, a);
+		float d2 = Cross(c, d, b);
+		float d3 = Cross(a, b, c);
+		float d4 = Cross(a, b, d);
+		return ((d1 > 0.0f) != (d2 > 0.0f)) && ((d3 > 0.0f) != (d4 > 0.0f));
+	}
+
+	bool IsSimple(const std::vector<glm::fvec3>& polygon)
+	{
+		size_t n = polygon.size();
+		if (n < 3) return false;
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = i + 2; j < n; j++)
+			{
+				if (i == 0 && j == n - 1) continue; // adjacent through the closing edge
+				if (SegmentsCross(polygon[i], polygon[(i + 1) % n], polygon[j], polygon[(j + 1) % n])) return false;
+			}
+		}
+		return true;
+	}
+
+	// Andrew's monotone chain. glmGeom's getConvexHull gives up after a fixed number of steps and can miss points.
+	std::vector<glm::fvec3> ConvexHull(std::vector<glm::fvec3> points)
+	{
+		std::sort(points.begin(), points.end(), [](const glm::fvec3& a, const glm::fvec3& b) { return a.x < b.x || (a.x == b.x && a.y < b.y); });
+		if (points.size() < 3) return points;
+
+		std::vector<glm::fvec3> hull(2 * points.size());
+		size_t k = 0;
+		for (size_t i = 0; i < points.size(); i++)
+		{
+			while (k >= 2 && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f) k--;
+			hull[k++] = points[i];
+		}
+		for (size_t i = points.size() - 1, lower = k + 1; i-- > 0;)
+		{
+			while (k >= lower && Cross(hull[k - 2], hull[k - 1], points[i]) <= 0.0f) k--;
+			hull[k++] = points[i];
+		}
+		hull.resize(k - 1);
+		return hull;
+	}
+
+	// Outer boundary of the 8-connected region around start (Moore neighbour tracing with Jacob's stopping criterion)
+	std::vector<glm::fvec3> TraceBoundary(const std::vector<unsigned char>& mask, int width, glm::ivec2 start)
+	{
+		// Clockwise in image coordinates, starting west
+		const glm::ivec2 neighbours[8] = { {-1, 0}, {-1, -1}, {0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1} };
+		auto isSet = [&](glm::ivec2 p) { return mask[p.y * width + p.x] != 0; };
+
+		std::vector<glm::fvec3> boundary{ glm::fvec3{ start, 0.0f } };
+		glm::ivec2 current = start;
+		int backtrack = 0; // the pixel west of the start is empty, it is the first one found in raster order
+		int startBacktrack = backtrack;
+		for (size_t steps = 0; steps < mask.size() * 4; steps++)
+		{
+			int next = -1;
+			for (int k = 1; k <= 8; k++)
+			{
+				int direction = (backtrack + k) % 8;
+				if (isSet(current + neighbours[direction]))
+				{
+					next = direction;
+					break;
+				}
+			}
+			if (next < 0) break; // isolated pixel
+
+			// The new backtrack is the empty neighbour checked just before, seen from the new pixel
+			glm::ivec2 previousEmpty = current + neighbours[(next + 7) % 8];
+			current += neighbours[next];
+			glm::ivec2 offset = previousEmpty - current;
+			for (int k = 0; k < 8; k++)
+			{
+				if (neighbours[k] == offset) backtrack = k;
+			}
+
+			if (current == start && backtrack == startBacktrack) break;
+			boundary.push_back(glm::fvec3{ current, 0.0f });
+		}
+		return boundary;
+	}
+}
+
+bool TraceLeafCard(const Image& texture, std::vector<glm::fvec3>& polygon, int maxVertices, unsigned char alphaThreshold, LeafCardStatistics* statistics)
+{
+	polygon.clear();
+	maxVertices = (maxVertices < 3) ? 3 : maxVertices;
+
+	// One texel of margin around the texture for the trace
+	int width = texture.width + 2;
+	int height = texture.height + 2;
+	std::vector<unsigned char> opaque(width * height, 0);
+	std::vector<glm::fvec3> rowExtremes;	// corners of the first and last opaque texel of every row, for the hull
+	for (int y = 0; y < texture.height; y++)
+	{
+		int first = -1;
+		int last = -1;
+		for (int x = 0; x < texture.width; x++)
+		{
+			if (texture.pixels[(y * texture.width + x) * 4 + 3] > alphaThreshold)
+			{
+				opaque[(y + 1) * width + x + 1] = 1;
+				first = (first < 0) ? x : first;
+				last = x;
+			}
+		}
+		if (first < 0) continue;
+
+		rowExtremes.push_back(glm::fvec3{ float(first), float(y), 0.0f });
+		rowExtremes.push_back(glm::fvec3{ float(first), float(y + 1), 0.0f });
+		rowExtremes.push_back(glm::fvec3{ float(last + 1), float(y), 0.0f });
+		rowExtremes.push_back(glm::fvec3{ float(last + 1), float(y + 1), 0.0f });
+	}
+	if (rowExtremes.size() < 3) return false;
+
+	auto coversOpaqueTexels = [&](const std::vector<glm::fvec3>& candidate) -> bool
+	{
+		auto inside = [&](float px, float py)
+		{
+			bool result = false;
+			for (size_t i = 0, j = candidate.size() - 1; i < candidate.size(); j = i++)
+			{
+				const glm::fvec3& a = candidate[i];
+				const glm::fvec3& b = candidate[j];
+				if ((a.y > py) != (b.y > py) && px < (b.x - a.x) * (py - a.y) / (b.y - a.y) + a.x) result = !result;
+			}
+			return result;
+		};
+		for (int y = 0; y < texture.height; y++)
+		{
+			for (int x = 0; x < texture.width; x++)
+			{
+				if (!opaque[(y + 1) * width + x + 1]) continue;
+				if (!inside(float(x), float(y)) || !inside(float(x + 1), float(y)) || !inside(float(x), float(y + 1)) || !inside(float(x + 1), float(y + 1))) return false;
+			}
+		}
+		return true;
+	};
+
+	/*
+		Simplification cuts corners in both directions, so every simplified edge is pushed outwards until the
+		outline points it replaced are behind it, the corners are where neighbouring edges meet. With texelPoints
+		the outline points are texel centers and the whole texel square has to end up behind the edge.
+	*/
+	auto fitCard = [&](const std::vector<glm::fvec3>& outline, bool texelPoints, std::vector<glm::fvec3>& card, float& cardTolerance) -> bool
+	{
+		float orientation = (SignedArea(outline) >= 0.0f) ? 1.0f : -1.0f;
+		for (float tolerance = 0.5f; tolerance <= 0.25f * float(texture.width); tolerance += 0.5f)
+		{
+			// Simplify as a closed polyline that starts and ends at the same point
+			std::vector<glm::vec3> simplified = outline;
+			simplified.push_back(outline.front());
+			simplify(simplified, tolerance);
+			if (simplified.size() > 1 && simplified.back() == simplified.front()) simplified.pop_back();
+			if (int(simplified.size()) > maxVertices || simplified.size() < 3) continue;
+
+			// The kept points are an ordered subsequence of the outline, find the outline range of every edge
+			std::vector<size_t> kept;
+			for (size_t i = 0, k = 0; i < outline.size() && k < simplified.size(); i++)
+			{
+				if (outline[i] == simplified[k])
+				{
+					kept.push_back(i);
+					k++;
+				}
+			}
+			if (kept.size() != simplified.size()) continue;
+
+			size_t n = simplified.size();
+			std::vector<glm::fvec3> normals(n);
+			std::vector<float> offsets(n);
+			for (size_t e = 0; e < n; e++)
+			{
+				glm::fvec3 a = simplified[e];
+				glm::fvec3 direction = glm::normalize(glm::fvec3{ simplified[(e + 1) % n] } - a);
+				normals[e] = orientation * glm::fvec3{ direction.y, -direction.x, 0.0f };
+
+				float offset = 0.0f;
+				size_t last = (e + 1 < n) ? kept[e + 1] : kept[0] + outline.size();
+				for (size_t i = kept[e]; i <= last; i++)
+				{
+					offset = glm::max(offset, glm::dot(outline[i % outline.size()] - a, normals[e]));
+				}
+				// A little extra keeps texel corners on the edge from counting as outside
+				offsets[e] = offset + (texelPoints ? 0.5f * (fabsf(normals[e].x) + fabsf(normals[e].y)) : 0.0f) + 0.01f;
+			}
+
+			card.resize(n);
+			for (size_t v = 0; v < n; v++)
+			{
+				size_t previous = (v + n - 1) % n;
+				glm::fvec3 p0 = glm::fvec3{ simplified[v] } + normals[previous] * offsets[previous];
+				glm::fvec3 p1 = glm::fvec3{ simplified[v] } + normals[v] * offsets[v];
+				glm::fvec3 d0 = simplified[v] - simplified[previous];
+				glm::fvec3 d1 = simplified[(v + 1) % n] - simplified[v];
+				float denominator = d0.x * d1.y - d0.y * d1.x;
+				float t = (fabsf(denominator) > 1e-6f) ? ((p1.x - p0.x) * d1.y - (p1.y - p0.y) * d1.x) / denominator : 0.0f;
+				card[v] = p0 + d0 * t;
+
+				// Nearly parallel edges meet far away, the larger offset along the averaged normal is enough there
+				float maxOffset = glm::max(offsets[previous], offsets[v]);
+				if (fabsf(denominator) <= 1e-6f || glm::length(card[v] - glm::fvec3{ simplified[v] }) > 4.0f * maxOffset + 1.0f)
+				{
+					card[v] = glm::fvec3{ simplified[v] } + glm::normalize(normals[previous] + normals[v]) * maxOffset * 1.5f;
+				}
+			}
+
+			if (IsSimple(card) && coversOpaqueTexels(card))
+			{
+				cardTolerance = tolerance;
+				return true;
+			}
+		}
+		return false;
+	};
+
+	/*
+		Candidates: the traced silhouette, which only helps where it is concave, and the convex hull of the
+		opaque texels reduced to the same budget. The smaller card wins.
+	*/
+	std::vector<glm::fvec3> hull = ConvexHull(rowExtremes);
+	float hullArea = fabsf(SignedArea(hull));
+
+	std::vector<glm::fvec3> best;
+	float bestTolerance = 0.0f;
+	std::vector<glm::fvec3> candidate;
+	float candidateTolerance = 0.0f;
+	if (hull.size() >= 3 && fitCard(hull, false, candidate, candidateTolerance))
+	{
+		best = candidate;
+		bestTolerance = candidateTolerance;
+	}
+
+	/*
+		The silhouette needs a single 8-connected region. Opaque texels that are apart (line art often is)
+		get bridged by dilating the mask a texel at a time, the card is still checked against the original texels.
+	*/
+	std::vector<unsigned char> region = opaque;
+	std::vector<unsigned char> reached(width * height);
+	std::vector<unsigned char> grown(width * height);
+	std::vector<int> stack;
+	int start = 0;
+	bool connected = false;
+	for (int dilation = 0; dilation <= 4 && !connected; dilation++)
+	{
+		if (dilation > 0)
+		{
+			for (int y = 1; y < height - 1; y++)
+			{
+				for (int x = 1; x < width - 1; x++)
+				{
+					unsigned char value = 0;
+					for (int i = 0; i < 9 && !value; i++)
+					{
+						int sx = x - 1 + i % 3;
+						int sy = y - 1 + i / 3;
+						value = (sx > 0 && sy > 0 && sx < width - 1 && sy < height - 1) ? region[sy * width + sx] : 0;
+					}
+					grown[y * width + x] = value;
+				}
+			}
+			region.swap(grown);
+		}
+
+		start = 0;
+		while (!region[start]) start++;
+		std::fill(reached.begin(), reached.end(), 0);
+		stack.assign(1, start);
+		reached[start] = 1;
+		while (!stack.empty())
+		{
+			int pixel = stack.back();
+			stack.pop_back();
+			for (int i = 0; i < 9; i++)
+			{
+				int neighbour = pixel + (i % 3 - 1) + (i / 3 - 1) * width;
+				if (region[neighbour] && !reached[neighbour])
+				{
+					reached[neighbour] = 1;
+					stack.push_back(neighbour);
+				}
+			}
+		}
+		connected = true;
+		for (size_t i = 0; i < region.size() && connected; i++)
+		{
+			connected = !region[i] || reached[i];
+		}
+	}
+
+	if (connected)
+	{
+		// Texel centers in texture coordinates
+		std::vector<glm::fvec3> outline = TraceBoundary(region, width, glm::ivec2{ start % width, start / width });
+		for (auto& p : outline)
+		{
+			p = glm::fvec3{ p.x - 0.5f, p.y - 0.5f, 0.0f };
+		}
+		if (outline.size() >= 3 && fitCard(outline, true, candidate, candidateTolerance))
+		{
+			if (best.empty() || fabsf(SignedArea(candidate)) < fabsf(SignedArea(best)))
+			{
+				best = candidate;
+				bestTolerance = candidateTolerance;
+			}
+		}
+	}
+	if (best.empty()) return false;
+
+	if (SignedArea(best) < 0.0f)
+	{
+		std::reverse(best.begin(), best.end());
+	}
+	polygon = best;
+	if (statistics)
+	{
+		statistics->tolerance = bestTolerance;
+		statistics->cardArea = SignedArea(polygon);
+		statistics->hullArea = hullArea;
+	}
+	return true;
+}
+
+void TriangulatePolygon(const std::vector<glm::fvec3>& polygon, std::vector<unsigned int>& triangles)
+{
+	size_t n = polygon.size();
+	if (n < 3) return;
+
+	float orientation = (SignedArea(polygon) >= 0.0f) ? 1.0f : -1.0f;
+	std::vector<unsigned int> remaining(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		remaining[i] = (unsigned int)(i);
+	}
+
+	while (remaining.size() > 3)
+	{
+		size_t count = remaining.size();
+		size_t ear = count;
+		for (size_t i = 0; i < count && ear == count; i++)
+		{
+			glm::fvec3 a = polygon[remaining[(i + count - 1) % count]];
+			glm::fvec3 b = polygon[remaining[i]];
+			glm::fvec3 c = polygon[remaining[(i + 1) % count]];
+			if (orientation * Cross(a, b, c) <= 0.0f) continue; // reflex or flat corner
+
+			// No other vertex may lie inside the ear
+			bool empty = true;
+			for (size_t j = 0; j < count && empty; j++)
+			{
+				if (j == i || j == (i + 1) % count || j == (i + count - 1) % count) continue;
+				glm::fvec3 p = polygon[remaining[j]];
+				empty = !(orientation * Cross(a, b, p) >= 0.0f && orientation * Cross(b, c, p) >= 0.0f && orientation * Cross(c, a, p) >= 0.0f);
+			}
+			if (empty) ear = i;
+		}
+
+		// Only degenerate input has no ear, clipping any vertex still terminates
+		if (ear == count) ear = 0;
+
+		triangles.push_back(remaining[(ear + count - 1) % count]);
+		triangles.push_back(remaining[ear]);
+		triangles.push_back(remaining[(ear + 1) % count]);
+		remaining.erase(remaining.begin() + ear);
+	}
+	triangles.push_back(remaining[0]);
+	triangles.push_back(remaining[1]);
+	triangles.push_back(remaining[2]);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include "../core/image.h"
+
+/*
+	Leaf cards
+	The card follows the alpha silhouette of the leaf texture instead of its convex hull, so less
+	transparent area is rasterized. The outer boundary of the opaque texels is traced and simplified
+	with glmGeom's simplify until the polygon fits the vertex budget. Every simplified edge is then
+	pushed out over the outline it replaced, so the card always covers every opaque texel.
+*/
+
+struct LeafCardStatistics
+{
+	float tolerance = 0.0f;		// simplification tolerance in texels that met the vertex budget
+	float cardArea = 0.0f;		// in texels
+	float hullArea = 0.0f;		// convex hull of the opaque texels
+};
+
+// Polygon in texel coordinates (z = 0), counter-clockwise when y points up. Returns false when the texture has
+// no opaque texels or no simple polygon within the budget was found, the polygon is left empty then.
+bool TraceLeafCard(const Image& texture, std::vector<glm::fvec3>& polygon, int maxVertices = 8, unsigned char alphaThreshold = 0, LeafCardStatistics* statistics = nullptr);
+
+// Ear clipping of a simple polygon in the xy plane, appends three indices per triangle with the winding of the polygon
+void TriangulatePolygon(const std::vector<glm::fvec3>& polygon, std::vector<unsigned int>& triangles);
@@ -0,0 +1,147 @@
+#include "leafpruning.h"
+#include <cmath>
+
+LeafPruningStatistics PruneHiddenLeaves(std::vector<glm::mat4>& leafTransforms, const TriangleMesh& leafMesh, const LeafPruningOptions& options)
+{
+	LeafPruningStatistics statistics;
+	statistics.leavesBefore = leafTransforms.size();
+	if (leafTransforms.empty() || leafMesh.positions.empty()) return statistics;
+
+	/*
+		Area and center of the source leaf, every placed leaf scales the area by its uniform scale squared
+	*/
+	float leafArea = 0.0f;
+	for (size_t i = 0; i + 2 < leafMesh.indices.size(); i += 3)
+	{
+		glm::fvec3 p0 = leafMesh.positions[leafMesh.indices[i]];
+		glm::fvec3 p1 = leafMesh.positions[leafMesh.indices[i + 1]];
+		glm::fvec3 p2 = leafMesh.positions[leafMesh.indices[i + 2]];
+		leafArea += 0.5f * glm::length(glm::cross(p1 - p0, p2 - p0));
+	}
+	glm::fvec3 leafCenter{ 0.0f };
+	for (auto& p : leafMesh.positions)
+	{
+		leafCenter += p;
+	}
+	leafCenter /= float(leafMesh.positions.size());
+
+	size_t leafCount = leafTransforms.size();
+	std::vector<glm::fvec3> centers(leafCount);
+	std::vector<float> areas(leafCount);
+	glm::fvec3 minBounds = leafTransforms[0] * glm::fvec4{ leafCenter, 1.0f };
+	glm::fvec3 maxBounds = minBounds;
+	for (size_t i = 0; i < leafCount; i++)
+	{
+		centers[i] = leafTransforms[i] * glm::fvec4{ leafCenter, 1.0f };
+		float scale = cbrtf(fabsf(glm::determinant(glm::mat3{ leafTransforms[i] })));
+		areas[i] = leafArea * scale * scale;
+		minBounds = glm::min(minBounds, centers[i]);
+		maxBounds = glm::max(maxBounds, centers[i]);
+	}
+
+	/*
+		Voxel grid with one empty layer around the crown, so the outside is connected
+	*/
+	glm::fvec3 extent = maxBounds - minBounds;
+	float voxelSize = options.voxelSize;
+	if (voxelSize <= 0.0f)
+	{
+		voxelSize = glm::max(glm::max(extent.x, extent.y), extent.z) / 32.0f;
+	}
+	if (voxelSize <= 0.0f) return statistics;
+
+	glm::ivec3 size = glm::ivec3{ glm::floor(extent / voxelSize) } + 3;
+	glm::fvec3 origin = minBounds - glm::fvec3{ voxelSize };
+	auto voxelIndex = [&](glm::ivec3 v) { return (v.z * size.y + v.y) * size.x + v.x; };
+
+	std::vector<float> density(size.x * size.y * size.z, 0.0f);
+	std::vector<int> leafVoxel(leafCount);
+	for (size_t i = 0; i < leafCount; i++)
+	{
+		glm::ivec3 v = glm::clamp(glm::ivec3{ glm::floor((centers[i] - origin) / voxelSize) }, glm::ivec3{ 1 }, size - 2);
+		leafVoxel[i] = voxelIndex(v);
+		density[leafVoxel[i]] += areas[i];
+	}
+
+	/*
+		Shadow pyramids: a voxel shades the (2q+1)^2 voxels q layers below it
+	*/
+	std::vector<float> shadow(density.size(), 0.0f);
+	for (int y = 0; y < size.y; y++)
+	{
+		for (int z = 0; z < size.z; z++)
+		{
+			for (int x = 0; x < size.x; x++)
+			{
+				float area = density[voxelIndex({ x, y, z })];
+				if (area <= 0.0f) continue;
+
+				statistics.occupiedVoxels++;
+				float layerShadow = area;
+				for (int q = 1; q <= options.shadowDepth && y - q >= 0; q++)
+				{
+					layerShadow /= options.shadowFalloff;
+					for (int dz = -q; dz <= q; dz++)
+					{
+						if (z + dz < 0 || z + dz >= size.z) continue;
+						for (int dx = -q; dx <= q; dx++)
+						{
+							if (x + dx < 0 || x + dx >= size.x) continue;
+							shadow[voxelIndex({ x + dx, y - q, z + dz })] += layerShadow;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	/*
+		Flood fill the empty space from the grid corner, occupied voxels next to it form the shell
+	*/
+	std::vector<unsigned char> outside(density.size(), 0);
+	std::vector<int> stack{ 0 };
+	outside[0] = 1;
+	const glm::ivec3 faces[6] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+	while (!stack.empty())
+	{
+		int index = stack.back();
+		stack.pop_back();
+		glm::ivec3 v{ index % size.x, (index / size.x) % size.y, index / (size.x * size.y) };
+		for (auto& face : faces)
+		{
+			glm::ivec3 n = v + face;
+			if (glm::any(glm::lessThan(n, glm::ivec3{ 0 })) || glm::any(glm::greaterThanEqual(n, size))) continue;
+			int neighbour = voxelIndex(n);
+			if (outside[neighbour] || density[neighbour] > 0.0f) continue;
+			outside[neighbour] = 1;
+			stack.push_back(neighbour);
+		}
+	}
+
+	std::vector<unsigned char> keep(density.size(), 0);
+	float voxelArea = voxelSize * voxelSize;
+	for (int index = 0; index < int(density.size()); index++)
+	{
+		if (density[index] <= 0.0f) continue;
+
+		bool shell = false;
+		glm::ivec3 v{ index % size.x, (index / size.x) % size.y, index / (size.x * size.y) };
+		for (auto& face : faces)
+		{
+			shell = shell || outside[voxelIndex(v + face)];
+		}
+		statistics.shellVoxels += shell ? 1 : 0;
+
+		float exposure = expf(-options.extinction * shadow[index] / voxelArea);
+		keep[index] = (exposure >= options.exposureThreshold || (shell && options.keepShell)) ? 1 : 0;
+	}
+
+	size_t write = 0;
+	for (size_t i = 0; i < leafCount; i++)
+	{
+		if (keep[leafVoxel[i]]) leafTransforms[write++] = leafTransforms[i];
+	}
+	leafTransforms.resize(write);
+	statistics.leavesRemoved = leafCount - write;
+	return statistics;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include "../core/meshdata.h"
+
+/*
+	Occlusion pruning of crown-interior leaves
+	The leaf area is splatted into a voxel grid over the crown. Every occupied voxel casts shadow into
+	a pyramid of voxels below it that weakens with depth, as in the shadow propagation model of
+	Palubicki et al. 2009. The accumulated shadow is turned into light exposure with Beer-Lambert
+	attenuation and leaves in voxels below the exposure threshold are removed. Voxels on the outer
+	shell of the crown are always kept so the silhouette does not change.
+*/
+
+struct LeafPruningOptions
+{
+	float voxelSize = 0.0f;				// 0 picks a size that splits the longest crown extent into 32 voxels
+	int shadowDepth = 5;				// voxel layers a voxel casts shadow into
+	float shadowFalloff = 2.0f;			// shadow of a layer q voxels down is divided by shadowFalloff^q
+	float extinction = 0.5f;			// Beer-Lambert coefficient per unit of leaf area index
+	float exposureThreshold = 0.1f;		// leaves in voxels with less exposure (0 to 1) are removed
+	bool keepShell = true;				// never remove leaves from voxels that touch the empty space around the crown
+};
+
+struct LeafPruningStatistics
+{
+	size_t leavesBefore = 0;
+	size_t leavesRemoved = 0;
+	int occupiedVoxels = 0;
+	int shellVoxels = 0;
+};
+
+// Removes the hidden leaves from leafTransforms, the transforms place leafMesh like AppendMeshTransformed does. Light comes from +y.
+LeafPruningStatistics PruneHiddenLeaves(std::vector<glm::mat4>& leafTransforms, const TriangleMesh& leafMesh, const LeafPruningOptions& options);
@@ -0,0 +1,179 @@
+#include "meshchunks.h"
+#include <algorithm>
+
+MeshChunkStatistics BuildMeshChunks(TriangleMesh& mesh, unsigned int maxVertices, unsigned int maxTriangles, float maxExtent)
+{
+	MeshChunkStatistics statistics;
+	mesh.chunks.clear();
+
+	unsigned int triangleCount = (unsigned int)(mesh.indices.size() / 3);
+	if (triangleCount == 0) return statistics;
+
+	maxVertices = (maxVertices > 65535) ? 65535 : maxVertices;
+	maxVertices = (maxVertices < 3) ? 3 : maxVertices;
+	maxTriangles = (maxTriangles < 1) ? 1 : maxTriangles;
+
+	std::vector<glm::fvec3> centroids(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		centroids[t] = (mesh.positions[mesh.indices[t*3]] + mesh.positions[mesh.indices[t*3 + 1]] + mesh.positions[mesh.indices[t*3 + 2]]) / 3.0f;
+	}
+
+	// Each vertex remembers the last chunk that referenced it, this avoids clearing a lookup table per chunk
+	size_t sourceVertexCount = mesh.positions.size();
+	std::vector<unsigned int> vertexStamp(sourceVertexCount, ~0u);
+	std::vector<unsigned int> localIndex(sourceVertexCount, 0);
+	unsigned int stamp = 0;
+
+	auto countVertices = [&](const unsigned int* triangles, size_t count) -> unsigned int
+	{
+		stamp++;
+		unsigned int unique = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = mesh.indices[triangles[i]*3 + c];
+				if (vertexStamp[v] != stamp)
+				{
+					vertexStamp[v] = stamp;
+					unique++;
+				}
+			}
+		}
+		return unique;
+	};
+
+	auto fitsExtent = [&](const unsigned int* triangles, size_t count) -> bool
+	{
+		if (maxExtent <= 0.0f) return true;
+		glm::fvec3 minBounds = mesh.positions[mesh.indices[triangles[0]*3]];
+		glm::fvec3 maxBounds = minBounds;
+		for (size_t i = 0; i < count; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				minBounds = glm::min(minBounds, mesh.positions[mesh.indices[triangles[i]*3 + c]]);
+				maxBounds = glm::max(maxBounds, mesh.positions[mesh.indices[triangles[i]*3 + c]]);
+			}
+		}
+		glm::fvec3 extent = maxBounds - minBounds;
+		return std::max(extent.x, std::max(extent.y, extent.z)) <= maxExtent;
+	};
+
+	/*
+		Split into triangle ranges
+	*/
+	std::vector<unsigned int> triangles(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		triangles[t] = t;
+	}
+
+	struct Range { size_t begin; size_t end; };
+	std::vector<Range> pending{ Range{ 0, triangles.size() } };
+	std::vector<Range> leaves;
+	std::vector<float> keys;
+	while (!pending.empty())
+	{
+		Range range = pending.back();
+		pending.pop_back();
+
+		size_t count = range.end - range.begin;
+		// A single triangle cannot be split further, even when it is larger than maxExtent
+		if (count <= maxTriangles && countVertices(&triangles[range.begin], count) <= maxVertices && (count == 1 || fitsExtent(&triangles[range.begin], count)))
+		{
+			leaves.push_back(range);
+			continue;
+		}
+
+		glm::fvec3 minBounds = centroids[triangles[range.begin]];
+		glm::fvec3 maxBounds = minBounds;
+		for (size_t i = range.begin; i < range.end; i++)
+		{
+			minBounds = glm::min(minBounds, centroids[triangles[i]]);
+			maxBounds = glm::max(maxBounds, centroids[triangles[i]]);
+		}
+		glm::fvec3 extent = maxBounds - minBounds;
+		int axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+
+		keys.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			keys[i] = centroids[triangles[range.begin + i]][axis];
+		}
+		std::nth_element(keys.begin(), keys.begin() + count/2, keys.end());
+		float median = keys[count/2];
+
+		auto first = triangles.begin() + range.begin;
+		auto last = triangles.begin() + range.end;
+		auto middle = std::stable_partition(first, last, [&](unsigned int t) { return centroids[t][axis] < median; });
+
+		// Coincident centroids cannot be separated spatially, fall back to splitting the list in half
+		if (middle == first || middle == last)
+		{
+			middle = first + count/2;
+		}
+
+		size_t split = range.begin + size_t(middle - first);
+		pending.push_back(Range{ split, range.end });
+		pending.push_back(Range{ range.begin, split });
+	}
+
+	/*
+		Emit the chunks with local vertices and indices, into streams of the final size from the arena of the mesh
+	*/
+	size_t chunkedVertexCount = 0;
+	for (Range& range : leaves)
+	{
+		chunkedVertexCount += countVertices(&triangles[range.begin], range.end - range.begin);
+	}
+	TriangleMesh chunked{ mesh.Arena() };
+	chunked.positions.reserve(chunkedVertexCount);
+	chunked.normals.reserve(chunkedVertexCount);
+	chunked.colors.reserve(chunkedVertexCount);
+	chunked.texCoords.reserve(chunkedVertexCount);
+	chunked.indices.reserve(mesh.indices.size());
+
+	for (Range& range : leaves)
+	{
+		stamp++;
+		MeshChunk chunk;
+		chunk.firstIndex = (unsigned int)(chunked.indices.size());
+		chunk.baseVertex = (unsigned int)(chunked.positions.size());
+		chunk.minBounds = chunk.maxBounds = mesh.positions[mesh.indices[triangles[range.begin]*3]];
+
+		for (size_t i = range.begin; i < range.end; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = mesh.indices[triangles[i]*3 + c];
+				if (vertexStamp[v] != stamp)
+				{
+					vertexStamp[v] = stamp;
+					localIndex[v] = chunk.vertexCount++;
+					chunked.AddVertex(mesh.positions[v], mesh.normals[v], mesh.colors[v], mesh.texCoords[v]);
+					chunk.minBounds = glm::min(chunk.minBounds, mesh.positions[v]);
+					chunk.maxBounds = glm::max(chunk.maxBounds, mesh.positions[v]);
+				}
+				chunked.indices.push_back(localIndex[v]);
+			}
+		}
+
+		chunk.origin = 0.5f*(chunk.minBounds + chunk.maxBounds);
+		chunk.indexCount = (unsigned int)(chunked.indices.size()) - chunk.firstIndex;
+		chunked.chunks.push_back(chunk);
+	}
+
+	statistics.chunkCount = int(chunked.chunks.size());
+	statistics.duplicatedVertices = int(chunked.positions.size()) - int(sourceVertexCount);
+
+	mesh.positions.swap(chunked.positions);
+	mesh.normals.swap(chunked.normals);
+	mesh.colors.swap(chunked.colors);
+	mesh.texCoords.swap(chunked.texCoords);
+	mesh.indices.swap(chunked.indices);
+	mesh.chunks.swap(chunked.chunks);
+
+	return statistics;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "../core/meshdata.h"
+
+/*
+	Spatial chunking
+	The triangles are split recursively at the median centroid along the longest axis
+	until every chunk fits in 16-bit indices. The split is stable, so the triangle order
+	within a chunk (for example from the vertex cache pass) is kept. Vertices shared
+	between chunks are duplicated and every chunk stores its vertices contiguously in
+	first-use order.
+	With maxExtent above zero a chunk is also split until its vertex bounds are at most
+	that long on every axis, this keeps half precision positions relative to the chunk
+	origin accurate.
+*/
+
+struct MeshChunkStatistics
+{
+	int chunkCount = 0;
+	int duplicatedVertices = 0;
+};
+
+// Rewrites the mesh so that its indices are local to mesh.chunks. Returns the number of chunks and duplicated vertices.
+MeshChunkStatistics BuildMeshChunks(TriangleMesh& mesh, unsigned int maxVertices = 65535, unsigned int maxTriangles = ~0u, float maxExtent = 0.0f);
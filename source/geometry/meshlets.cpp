@@ -0,0 +1,276 @@
+#include "meshlets.h"
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+
+void MeshletSet::Clear()
+{
+	meshlets.clear();
+	vertices.clear();
+	triangles.clear();
+}
+
+void ComputeMeshletBounds(Meshlet& meshlet, const MeshletSet& meshletSet, const MeshVector<glm::fvec3>& positions)
+{
+	const unsigned int* meshletVertices = &meshletSet.vertices[meshlet.vertexOffset];
+	const uint8_t* meshletTriangles = &meshletSet.triangles[meshlet.triangleOffset];
+
+	// Sphere around the box center
+	glm::fvec3 minBounds = positions[meshletVertices[0]];
+	glm::fvec3 maxBounds = minBounds;
+	for (unsigned int i = 0; i < meshlet.vertexCount; i++)
+	{
+		minBounds = glm::min(minBounds, positions[meshletVertices[i]]);
+		maxBounds = glm::max(maxBounds, positions[meshletVertices[i]]);
+	}
+	meshlet.center = 0.5f * (minBounds + maxBounds);
+	meshlet.radius = 0.0f;
+	for (unsigned int i = 0; i < meshlet.vertexCount; i++)
+	{
+		meshlet.radius = glm::max(meshlet.radius, glm::length(positions[meshletVertices[i]] - meshlet.center));
+	}
+
+	// Normal cone
+	std::vector<glm::fvec3> normals(meshlet.triangleCount);
+	glm::fvec3 axis{ 0.0f };
+	for (unsigned int t = 0; t < meshlet.triangleCount; t++)
+	{
+		glm::fvec3 p0 = positions[meshletVertices[meshletTriangles[t*3]]];
+		glm::fvec3 p1 = positions[meshletVertices[meshletTriangles[t*3 + 1]]];
+		glm::fvec3 p2 = positions[meshletVertices[meshletTriangles[t*3 + 2]]];
+		glm::fvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(normal);
+		normals[t] = (area > 0.0f) ? normal / area : glm::fvec3{ 0.0f };
+		axis += normals[t];
+	}
+
+	meshlet.coneAxis = glm::fvec3{ 0.0f };
+	meshlet.coneApex = meshlet.center;
+	meshlet.coneCutoff = 1.0f;
+	float axisLength = glm::length(axis);
+	if (axisLength <= 0.0f) return;
+
+	axis /= axisLength;
+	float minDot = 1.0f;
+	for (auto& normal : normals)
+	{
+		minDot = glm::min(minDot, glm::dot(normal, axis));
+	}
+
+	// Wider than about 84 degrees from the axis, the cone would reject almost nothing
+	if (minDot <= 0.1f) return;
+
+	// Move the apex back along the axis until it is behind every triangle plane
+	float maxT = 0.0f;
+	for (unsigned int t = 0; t < meshlet.triangleCount; t++)
+	{
+		glm::fvec3 p0 = positions[meshletVertices[meshletTriangles[t*3]]];
+		float distance = glm::dot(p0 - meshlet.center, normals[t]);
+		float projection = glm::dot(normals[t], axis);
+		if (projection > 0.0f) maxT = glm::max(maxT, -distance / projection);
+	}
+
+	meshlet.coneAxis = axis;
+	meshlet.coneApex = meshlet.center - axis * maxT;
+	meshlet.coneCutoff = sqrtf(1.0f - minDot*minDot);
+}
+
+void BuildMeshlets(const TriangleMesh& mesh, MeshletSet& meshletSet, unsigned int maxVertices, unsigned int maxTriangles, bool groupByNormal)
+{
+	meshletSet.Clear();
+	maxVertices = glm::clamp(maxVertices, 3u, 256u);
+	maxTriangles = glm::clamp(maxTriangles, 1u, 512u);
+
+	// Triangles with absolute vertex indices
+	std::vector<unsigned int> triangleIndices;
+	triangleIndices.reserve(mesh.indices.size());
+	if (mesh.chunks.empty())
+	{
+		triangleIndices.assign(mesh.indices.begin(), mesh.indices.end());
+	}
+	else
+	{
+		for (auto& chunk : mesh.chunks)
+		{
+			for (unsigned int i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; i++)
+			{
+				triangleIndices.push_back(mesh.indices[i] + chunk.baseVertex);
+			}
+		}
+	}
+
+	unsigned int vertexCount = (unsigned int)(mesh.positions.size());
+	unsigned int triangleCount = (unsigned int)(triangleIndices.size() / 3);
+	if (triangleCount == 0) return;
+
+	/*
+		Vertex-triangle adjacency
+	*/
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (unsigned int v : triangleIndices)
+	{
+		adjacencyOffsets[v + 1]++;
+	}
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<unsigned int> adjacency(triangleIndices.size());
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			adjacency[fill[triangleIndices[t*3 + c]]++] = t;
+		}
+	}
+
+	std::vector<glm::fvec3> triangleNormals(triangleCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		glm::fvec3 p0 = mesh.positions[triangleIndices[t*3]];
+		glm::fvec3 normal = glm::cross(mesh.positions[triangleIndices[t*3 + 1]] - p0, mesh.positions[triangleIndices[t*3 + 2]] - p0);
+		float area = glm::length(normal);
+		triangleNormals[t] = (area > 0.0f) ? normal / area : glm::fvec3{ 0.0f };
+	}
+
+	/*
+		Grow each meshlet from a seed by adding the neighbouring triangle that needs the fewest new vertices.
+		With groupByNormal, triangles that turn away from the meshlet's average normal are penalized, otherwise
+		meshlets wrap around the thin branches and their normal cones become too wide to ever cull.
+	*/
+	const float coneWeight = 1.0f;
+	const float maxConeSpread = 0.5f;		// minimum dot product with the meshlet normal for a neighbour to join
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> localIndex(vertexCount, ~0u);
+	std::vector<unsigned int> candidates;
+	Meshlet meshlet;
+	glm::fvec3 normalSum{ 0.0f };
+	unsigned int seed = 0;
+
+	auto flush = [&]()
+	{
+		if (meshlet.triangleCount == 0) return;
+
+		ComputeMeshletBounds(meshlet, meshletSet, mesh.positions);
+		for (unsigned int i = 0; i < meshlet.vertexCount; i++)
+		{
+			localIndex[meshletSet.vertices[meshlet.vertexOffset + i]] = ~0u;
+		}
+		meshletSet.meshlets.push_back(meshlet);
+
+		meshlet = Meshlet{};
+		meshlet.vertexOffset = (unsigned int)(meshletSet.vertices.size());
+		meshlet.triangleOffset = (unsigned int)(meshletSet.triangles.size());
+		normalSum = glm::fvec3{ 0.0f };
+		candidates.clear();
+	};
+
+	auto newVertices = [&](unsigned int t) -> unsigned int
+	{
+		return (localIndex[triangleIndices[t*3]] == ~0u) + (localIndex[triangleIndices[t*3 + 1]] == ~0u) + (localIndex[triangleIndices[t*3 + 2]] == ~0u);
+	};
+
+	for (unsigned int emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// Best neighbour of the current meshlet
+		float normalLength = glm::length(normalSum);
+		glm::fvec3 averageNormal = (normalLength > 0.0f) ? normalSum / normalLength : glm::fvec3{ 0.0f };
+		unsigned int best = ~0u;
+		unsigned int bestNew = 4;
+		float bestScore = FLT_MAX;
+		size_t write = 0;
+		for (unsigned int t : candidates)
+		{
+			if (emitted[t]) continue;
+			candidates[write++] = t;
+
+			float alignment = (groupByNormal && normalLength > 0.0f) ? glm::dot(triangleNormals[t], averageNormal) : 1.0f;
+			if (alignment < maxConeSpread) continue;
+
+			unsigned int added = newVertices(t);
+			float score = float(added) + coneWeight * (1.0f - alignment);
+			if (score < bestScore)
+			{
+				best = t;
+				bestNew = added;
+				bestScore = score;
+			}
+		}
+		candidates.resize(write);
+
+		if (best != ~0u && (meshlet.vertexCount + bestNew > maxVertices || meshlet.triangleCount + 1 > maxTriangles))
+		{
+			best = ~0u;
+		}
+		if (best == ~0u)
+		{
+			flush();
+			while (emitted[seed]) seed++;
+			best = seed;
+		}
+
+		// Add the triangle
+		emitted[best] = true;
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int v = triangleIndices[best*3 + c];
+			if (localIndex[v] == ~0u)
+			{
+				localIndex[v] = meshlet.vertexCount++;
+				meshletSet.vertices.push_back(v);
+
+				for (unsigned int i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; i++)
+				{
+					if (!emitted[adjacency[i]]) candidates.push_back(adjacency[i]);
+				}
+			}
+			meshletSet.triangles.push_back(uint8_t(localIndex[v]));
+		}
+		meshlet.triangleCount++;
+		normalSum += triangleNormals[best];
+	}
+	flush();
+}
+
+void MeshletSet::Cull(const Frustum& frustum, glm::fvec3 cameraPosition, bool backfaceCulling, std::vector<unsigned int>& visibleIndices, GLDrawStatistics& statistics) const
+{
+	for (const Meshlet& meshlet : meshlets)
+	{
+		bool visible = frustum.IntersectsSphere(meshlet.center, meshlet.radius);
+		if (visible && backfaceCulling && meshlet.coneCutoff < 1.0f)
+		{
+			glm::fvec3 view = meshlet.coneApex - cameraPosition;
+			float viewLength = glm::length(view);
+			visible = viewLength <= 0.0f || glm::dot(view, meshlet.coneAxis) < meshlet.coneCutoff * viewLength;
+		}
+
+		if (!visible)
+		{
+			statistics.culledChunks++;
+			continue;
+		}
+
+		const unsigned int* meshletVertices = &vertices[meshlet.vertexOffset];
+		const uint8_t* meshletTriangles = &triangles[meshlet.triangleOffset];
+		for (unsigned int i = 0; i < meshlet.triangleCount * 3; i++)
+		{
+			visibleIndices.push_back(meshletVertices[meshletTriangles[i]]);
+		}
+		statistics.drawnChunks++;
+		statistics.drawnTriangles += meshlet.triangleCount;
+	}
+}
+
+bool MeshletSet::Save(const char* path) const
+{
+	FILE* file = fopen(path, "wb");
+	if (!file) return false;
+
+	uint32_t header[5] = { 0x54454c4d, 1, uint32_t(meshlets.size()), uint32_t(vertices.size()), uint32_t(triangles.size()) }; // "MLET", version 1
+	bool written = fwrite(header, sizeof(header), 1, file) == 1;
+	written = written && fwrite(meshlets.data(), sizeof(Meshlet), meshlets.size(), file) == meshlets.size();
+	written = written && fwrite(vertices.data(), sizeof(unsigned int), vertices.size(), file) == vertices.size();
+	written = written && fwrite(triangles.data(), sizeof(uint8_t), triangles.size(), file) == triangles.size();
+	return (fclose(file) == 0) && written;
+}
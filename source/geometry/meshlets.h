@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "../opengl/mesh.h"
+#include "../opengl/camera.h"
+
+/*
+	Meshlets
+	Small clusters of at most 64 vertices and 124 triangles, grown over the triangle
+	adjacency so they stay compact. Each meshlet has a bounding sphere for frustum
+	culling and a normal cone for backface culling of the whole cluster
+	(the cone test is the one from meshoptimizer).
+*/
+
+const unsigned int maxMeshletVertices = 64;
+const unsigned int maxMeshletTriangles = 124;
+
+struct Meshlet
+{
+	glm::fvec3 center{ 0.0f };
+	float radius = 0.0f;
+
+	// Back facing from every position where dot(normalize(coneApex - position), coneAxis) >= coneCutoff.
+	// A cutoff of 1 means the triangles face too many directions and the meshlet is never back facing.
+	glm::fvec3 coneApex{ 0.0f };
+	glm::fvec3 coneAxis{ 0.0f };
+	float coneCutoff = 1.0f;
+
+	unsigned int vertexOffset = 0;		// first entry in MeshletSet::vertices
+	unsigned int triangleOffset = 0;	// first entry in MeshletSet::triangles, 3 local indices per triangle
+	unsigned int vertexCount = 0;
+	unsigned int triangleCount = 0;
+};
+
+class MeshletSet
+{
+public:
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned int> vertices;	// meshlet vertex to mesh vertex (absolute, chunk base vertices applied)
+	std::vector<uint8_t> triangles;
+
+	MeshletSet() = default;
+	~MeshletSet() = default;
+
+	void Clear();
+
+	// Appends the triangles of the meshlets that pass the tests to visibleIndices as absolute vertex indices.
+	// The frustum and camera position are in the mesh coordinate system.
+	void Cull(const Frustum& frustum, glm::fvec3 cameraPosition, bool backfaceCulling, std::vector<unsigned int>& visibleIndices, GLDrawStatistics& statistics) const;
+
+	// Binary export: "MLET", version, counts, then the meshlet, vertex and triangle arrays. False when the file could not be written.
+	bool Save(const char* path) const;
+};
+
+// groupByNormal keeps the normals inside a meshlet close together so the cones can cull, at the cost of more, smaller meshlets.
+// Turn it off for two-sided geometry that is never backface culled.
+void BuildMeshlets(const TriangleMesh& mesh, MeshletSet& meshletSet, unsigned int maxVertices = maxMeshletVertices, unsigned int maxTriangles = maxMeshletTriangles, bool groupByNormal = true);
@@ -0,0 +1,566 @@
+#include "simplify.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <unordered_map>
+
+/*
+	Quadric as the symmetric matrix A, the vector b and the constant c of
+	p.A.p + 2 b.p + c, in double precision to keep small errors meaningful.
+	The planes are weighted by area, weight is the sum of those weights so that
+	Distance gives the weighted RMS distance to the planes in mesh units.
+*/
+struct Quadric
+{
+	double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+	double b0 = 0, b1 = 0, b2 = 0;
+	double c = 0;
+	double weight = 0;
+
+	static Quadric FromPlane(glm::dvec3 n, double d, double weight)
+	{
+		Quadric q;
+		q.a00 = weight * n.x*n.x; q.a01 = weight * n.x*n.y; q.a02 = weight * n.x*n.z;
+		q.a11 = weight * n.y*n.y; q.a12 = weight * n.y*n.z; q.a22 = weight * n.z*n.z;
+		q.b0 = weight * n.x*d; q.b1 = weight * n.y*d; q.b2 = weight * n.z*d;
+		q.c = weight * d*d;
+		q.weight = weight;
+		return q;
+	}
+
+	void operator+=(const Quadric& o)
+	{
+		a00 += o.a00; a01 += o.a01; a02 += o.a02; a11 += o.a11; a12 += o.a12; a22 += o.a22;
+		b0 += o.b0; b1 += o.b1; b2 += o.b2;
+		c += o.c;
+		weight += o.weight;
+	}
+
+	double Evaluate(glm::dvec3 p) const
+	{
+		double value = a00*p.x*p.x + 2.0*a01*p.x*p.y + 2.0*a02*p.x*p.z + a11*p.y*p.y + 2.0*a12*p.y*p.z + a22*p.z*p.z
+			+ 2.0*(b0*p.x + b1*p.y + b2*p.z) + c;
+		return (value > 0.0) ? value : 0.0;
+	}
+
+	double Distance(glm::dvec3 p) const
+	{
+		return (weight > 0.0) ? sqrt(Evaluate(p) / weight) : 0.0;
+	}
+};
+
+enum class SimplifyVertexKind : char
+{
+	Manifold,	// can collapse onto any neighbour
+	Seam,		// shares its position with a twin, collapses along the seam together with it
+	Locked
+};
+
+// An independent piece of a mesh, with indices into its own vertex list
+struct SimplifyPart
+{
+	size_t mesh = 0;
+	std::vector<unsigned int> vertices;	// part vertex to mesh vertex
+	std::vector<unsigned int> indices;
+	unsigned int targetTriangles = 0;
+	float error = 0.0f;
+};
+
+void SimplifyPartTriangles(SimplifyPart& part, const MeshVector<glm::fvec3>& meshPositions, const SimplifyOptions& options)
+{
+	unsigned int vertexCount = (unsigned int)(part.vertices.size());
+	std::vector<unsigned int>& indices = part.indices;
+	if (indices.size() / 3 <= part.targetTriangles) return;
+
+	std::vector<glm::fvec3> positions(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		positions[v] = meshPositions[part.vertices[v]];
+	}
+
+	/*
+		Vertices with the same position form a group with one quadric
+	*/
+	std::vector<unsigned int> sorted(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		sorted[v] = v;
+	}
+	std::sort(sorted.begin(), sorted.end(), [&](unsigned int a, unsigned int b)
+	{
+		const glm::fvec3& pa = positions[a];
+		const glm::fvec3& pb = positions[b];
+		return (pa.x != pb.x) ? pa.x < pb.x : ((pa.y != pb.y) ? pa.y < pb.y : pa.z < pb.z);
+	});
+
+	std::vector<unsigned int> group(vertexCount);
+	std::vector<unsigned int> groupSize;
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		if (i == 0 || positions[sorted[i]] != positions[sorted[i - 1]]) groupSize.push_back(0);
+		group[sorted[i]] = (unsigned int)(groupSize.size() - 1);
+		groupSize.back()++;
+	}
+
+	std::vector<unsigned int> twin(vertexCount, ~0u);
+	for (unsigned int i = 1; i < vertexCount; i++)
+	{
+		unsigned int a = sorted[i - 1], b = sorted[i];
+		if (group[a] == group[b] && groupSize[group[a]] == 2)
+		{
+			twin[a] = b;
+			twin[b] = a;
+		}
+	}
+
+	size_t groupCount = groupSize.size();
+	std::vector<bool> groupLocked(groupCount, false);
+	for (size_t g = 0; g < groupCount; g++)
+	{
+		groupLocked[g] = groupSize[g] > 2;
+	}
+
+	/*
+		Face quadrics, borders, feature edges and cone tips
+	*/
+	size_t triangleCount = indices.size() / 3;
+	std::vector<glm::fvec3> faceNormals(triangleCount);
+	std::vector<Quadric> quadrics(groupCount);
+	std::vector<glm::dvec4> facePlanes(triangleCount);
+	std::vector<std::vector<unsigned int>> groupFaces(groupCount); // original faces whose planes bound the distance of the group
+	std::vector<float> angleSum(groupCount, 0.0f);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		glm::fvec3 p[3] = { positions[indices[t*3]], positions[indices[t*3 + 1]], positions[indices[t*3 + 2]] };
+		glm::fvec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+		float area = 0.5f * glm::length(normal);
+		faceNormals[t] = (area > 0.0f) ? normal / (2.0f * area) : glm::fvec3{ 0.0f };
+
+		Quadric q = Quadric::FromPlane(glm::dvec3{ faceNormals[t] }, -glm::dot(faceNormals[t], p[0]), area);
+		facePlanes[t] = glm::dvec4{ glm::dvec3{ faceNormals[t] }, -glm::dot(faceNormals[t], p[0]) };
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int g = group[indices[t*3 + c]];
+			quadrics[g] += q;
+			if (groupFaces[g].empty() || groupFaces[g].back() != t) groupFaces[g].push_back((unsigned int)(t));
+
+			glm::fvec3 e1 = p[(c + 1) % 3] - p[c];
+			glm::fvec3 e2 = p[(c + 2) % 3] - p[c];
+			float lengths = glm::length(e1) * glm::length(e2);
+			if (lengths > 0.0f) angleSum[g] += acosf(glm::clamp(glm::dot(e1, e2) / lengths, -1.0f, 1.0f));
+		}
+	}
+
+	struct EdgeFaces
+	{
+		unsigned int count = 0;
+		unsigned int faces[2] = { 0, 0 };
+	};
+	std::unordered_map<uint64_t, EdgeFaces> groupEdges;
+	groupEdges.reserve(indices.size());
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int ga = group[indices[t*3 + c]];
+			unsigned int gb = group[indices[t*3 + (c + 1) % 3]];
+			uint64_t key = (uint64_t(std::min(ga, gb)) << 32) | std::max(ga, gb);
+			EdgeFaces& edge = groupEdges[key];
+			if (edge.count < 2) edge.faces[edge.count] = (unsigned int)(t);
+			edge.count++;
+		}
+	}
+
+	float featureCosine = cosf(glm::radians(options.featureAngle));
+	for (auto& edge : groupEdges)
+	{
+		bool border = edge.second.count != 2;
+		bool feature = !border && glm::dot(faceNormals[edge.second.faces[0]], faceNormals[edge.second.faces[1]]) < featureCosine;
+		if (border || feature)
+		{
+			groupLocked[edge.first >> 32] = true;
+			groupLocked[edge.first & 0xffffffffu] = true;
+		}
+	}
+
+	for (size_t g = 0; g < groupCount; g++)
+	{
+		if (2.0f * PI_f - angleSum[g] > options.tipAngleDeficit) groupLocked[g] = true;
+	}
+
+	std::vector<SimplifyVertexKind> kind(vertexCount, SimplifyVertexKind::Manifold);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		if (groupLocked[group[v]]) kind[v] = SimplifyVertexKind::Locked;
+		else if (twin[v] != ~0u) kind[v] = SimplifyVertexKind::Seam;
+	}
+
+	/*
+		Collapse passes, every pass collapses the cheapest edges whose neighbourhoods do not overlap
+	*/
+	// Collapses are ordered by the area weighted cost, which prefers small faces. The RMS distance of the quadric is a lower
+	// bound of the largest plane distance and filters the candidates, a collapse is only made when the surviving vertex
+	// lies within maxError of every original face plane merged into it.
+	double acceptedError = 0.0;
+	auto planeDistance = [&](unsigned int g, glm::dvec3 p)
+	{
+		double distance = 0.0;
+		for (unsigned int face : groupFaces[g])
+		{
+			distance = std::max(distance, fabs(glm::dot(glm::dvec3{ facePlanes[face] }, p) + facePlanes[face].w));
+		}
+		return distance;
+	};
+
+	struct Collapse
+	{
+		unsigned int from;
+		unsigned int to;
+		double cost;
+		double distance; // RMS
+	};
+	std::vector<Collapse> candidates;
+	std::vector<uint64_t> edgeKeys;
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<bool> passLocked(vertexCount);
+
+	while (indices.size() / 3 > part.targetTriangles)
+	{
+		triangleCount = indices.size() / 3;
+
+		// Vertex to triangle adjacency
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (unsigned int v : indices)
+		{
+			adjacencyOffsets[v + 1]++;
+		}
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		}
+		adjacency.resize(indices.size());
+		std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				adjacency[fill[indices[t*3 + c]]++] = (unsigned int)(t);
+			}
+		}
+
+		auto hasEdge = [&](unsigned int a, unsigned int b) -> bool
+		{
+			for (unsigned int i = adjacencyOffsets[a]; i < adjacencyOffsets[a + 1]; i++)
+			{
+				const unsigned int* triangle = &indices[adjacency[i] * 3];
+				if (triangle[0] == b || triangle[1] == b || triangle[2] == b) return true;
+			}
+			return false;
+		};
+
+		auto canCollapse = [&](unsigned int from, unsigned int to) -> bool
+		{
+			if (kind[from] == SimplifyVertexKind::Locked) return false;
+			if (kind[from] == SimplifyVertexKind::Manifold) return true;
+			return kind[to] == SimplifyVertexKind::Seam && twin[from] != to && hasEdge(twin[from], twin[to]);
+		};
+
+		// Rejects collapses that flip or rotate a remaining face beyond the feature angle
+		auto keepsOrientation = [&](unsigned int from, unsigned int to) -> bool
+		{
+			for (unsigned int i = adjacencyOffsets[from]; i < adjacencyOffsets[from + 1]; i++)
+			{
+				const unsigned int* triangle = &indices[adjacency[i] * 3];
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue;
+
+				glm::fvec3 before[3], after[3];
+				for (int c = 0; c < 3; c++)
+				{
+					before[c] = positions[triangle[c]];
+					after[c] = (triangle[c] == from) ? positions[to] : before[c];
+				}
+				glm::fvec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::fvec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				float lengths = glm::length(normalBefore) * glm::length(normalAfter);
+				if (lengths <= 0.0f || glm::dot(normalBefore, normalAfter) < featureCosine * lengths) return false;
+			}
+			return true;
+		};
+
+		// Unique edges and their cheapest allowed direction
+		edgeKeys.clear();
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int a = indices[t*3 + c];
+				unsigned int b = indices[t*3 + (c + 1) % 3];
+				edgeKeys.push_back((uint64_t(std::min(a, b)) << 32) | std::max(a, b));
+			}
+		}
+		std::sort(edgeKeys.begin(), edgeKeys.end());
+		edgeKeys.erase(std::unique(edgeKeys.begin(), edgeKeys.end()), edgeKeys.end());
+
+		candidates.clear();
+		for (uint64_t key : edgeKeys)
+		{
+			unsigned int a = (unsigned int)(key >> 32);
+			unsigned int b = (unsigned int)(key & 0xffffffffu);
+			Quadric q = quadrics[group[a]];
+			if (group[a] != group[b]) q += quadrics[group[b]];
+
+			bool forward = canCollapse(a, b), backward = canCollapse(b, a);
+			if (!forward && !backward) continue;
+
+			auto collapseOnto = [&](unsigned int from, unsigned int to) -> Collapse
+			{
+				glm::dvec3 p{ positions[to] };
+				return Collapse{ from, to, q.Evaluate(p), q.Distance(p) };
+			};
+			Collapse best = forward ? collapseOnto(a, b) : collapseOnto(b, a);
+			if (forward && backward)
+			{
+				Collapse other = collapseOnto(b, a);
+				if (other.cost < best.cost) best = other;
+			}
+			if (best.distance <= options.maxError) candidates.push_back(best);
+		}
+		std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			remap[v] = v;
+		}
+		std::fill(passLocked.begin(), passLocked.end(), false);
+
+		auto lockNeighbourhood = [&](unsigned int v)
+		{
+			for (unsigned int i = adjacencyOffsets[v]; i < adjacencyOffsets[v + 1]; i++)
+			{
+				const unsigned int* triangle = &indices[adjacency[i] * 3];
+				passLocked[triangle[0]] = passLocked[triangle[1]] = passLocked[triangle[2]] = true;
+			}
+		};
+
+		size_t removeGoal = triangleCount - part.targetTriangles;
+		size_t removed = 0;
+		for (const Collapse& collapse : candidates)
+		{
+			if (removed >= removeGoal) break;
+
+			unsigned int from = collapse.from, to = collapse.to;
+			bool seam = kind[from] == SimplifyVertexKind::Seam;
+			if (passLocked[from] || passLocked[to]) continue;
+			if (seam && (passLocked[twin[from]] || passLocked[twin[to]])) continue;
+			if (!keepsOrientation(from, to)) continue;
+			if (seam && !keepsOrientation(twin[from], twin[to])) continue;
+
+			glm::dvec3 p{ positions[to] };
+			double distance = std::max(planeDistance(group[from], p), planeDistance(group[to], p));
+			if (distance > options.maxError) continue;
+
+			remap[from] = to;
+			lockNeighbourhood(from);
+			lockNeighbourhood(to);
+			if (seam)
+			{
+				remap[twin[from]] = twin[to];
+				lockNeighbourhood(twin[from]);
+				lockNeighbourhood(twin[to]);
+			}
+
+			if (group[from] != group[to])
+			{
+				quadrics[group[to]] += quadrics[group[from]];
+				std::vector<unsigned int>& faces = groupFaces[group[to]];
+				faces.insert(faces.end(), groupFaces[group[from]].begin(), groupFaces[group[from]].end());
+				std::sort(faces.begin(), faces.end());
+				faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+			}
+			acceptedError = std::max(acceptedError, distance);
+			removed += 2;
+		}
+		if (removed == 0) break;
+
+		// Apply the collapses and drop the triangles that became degenerate
+		size_t write = 0;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			unsigned int a = remap[indices[t*3]], b = remap[indices[t*3 + 1]], c = remap[indices[t*3 + 2]];
+			if (a == b || b == c || c == a) continue;
+
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+	}
+
+	part.error = float(acceptedError);
+}
+
+std::vector<SimplifyStatistics> SimplifyMeshes(const std::vector<TriangleMesh*>& meshes, const SimplifyOptions& options)
+{
+	std::vector<SimplifyStatistics> statistics(meshes.size());
+
+	/*
+		Split every mesh into parts
+	*/
+	std::vector<SimplifyPart> parts;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		TriangleMesh& mesh = *meshes[m];
+		size_t triangleCount = mesh.indices.size() / 3;
+		statistics[m].trianglesBefore = triangleCount;
+		if (triangleCount == 0) continue;
+
+		size_t firstPart = parts.size();
+		std::vector<unsigned int> localIndex(mesh.positions.size(), ~0u);
+		auto addTriangle = [&](SimplifyPart& part, const unsigned int* triangle, unsigned int baseVertex)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = triangle[c] + baseVertex;
+				if (localIndex[v] == ~0u)
+				{
+					localIndex[v] = (unsigned int)(part.vertices.size());
+					part.vertices.push_back(v);
+				}
+				part.indices.push_back(localIndex[v]);
+			}
+		};
+
+		if (!mesh.chunks.empty())
+		{
+			for (MeshChunk& chunk : mesh.chunks)
+			{
+				parts.push_back(SimplifyPart{});
+				parts.back().mesh = m;
+				for (unsigned int i = chunk.firstIndex; i < chunk.firstIndex + chunk.indexCount; i += 3)
+				{
+					addTriangle(parts.back(), &mesh.indices[i], chunk.baseVertex);
+				}
+			}
+		}
+		else
+		{
+			// Connected components with union-find
+			std::vector<unsigned int> parent(mesh.positions.size());
+			for (unsigned int v = 0; v < parent.size(); v++)
+			{
+				parent[v] = v;
+			}
+			auto find = [&](unsigned int v) -> unsigned int
+			{
+				while (parent[v] != v)
+				{
+					parent[v] = parent[parent[v]];
+					v = parent[v];
+				}
+				return v;
+			};
+			for (size_t i = 0; i < mesh.indices.size(); i += 3)
+			{
+				unsigned int root = find(mesh.indices[i]);
+				parent[find(mesh.indices[i + 1])] = root;
+				parent[find(mesh.indices[i + 2])] = root;
+			}
+
+			std::vector<unsigned int> componentPart(mesh.positions.size(), ~0u);
+			for (size_t i = 0; i < mesh.indices.size(); i += 3)
+			{
+				unsigned int root = find(mesh.indices[i]);
+				if (componentPart[root] == ~0u)
+				{
+					componentPart[root] = (unsigned int)(parts.size());
+					parts.push_back(SimplifyPart{});
+					parts.back().mesh = m;
+				}
+				addTriangle(parts[componentPart[root]], &mesh.indices[i], 0);
+			}
+		}
+
+		// Spread the triangle target over the parts by size
+		for (size_t p = firstPart; p < parts.size(); p++)
+		{
+			size_t partTriangles = parts[p].indices.size() / 3;
+			parts[p].targetTriangles = (unsigned int)((partTriangles * options.targetTriangles + triangleCount - 1) / triangleCount);
+		}
+	}
+
+	/*
+		Simplify the parts on worker threads
+	*/
+	std::atomic<size_t> nextPart{ 0 };
+	auto worker = [&]()
+	{
+		for (size_t p = nextPart++; p < parts.size(); p = nextPart++)
+		{
+			SimplifyPartTriangles(parts[p], meshes[parts[p].mesh]->positions, options);
+		}
+	};
+
+	int threadCount = (options.threadCount > 0) ? options.threadCount : int(std::thread::hardware_concurrency());
+	threadCount = std::max(1, std::min(threadCount, int(parts.size())));
+	std::vector<std::thread> threads;
+	for (int i = 1; i < threadCount; i++)
+	{
+		threads.emplace_back(worker);
+	}
+	worker();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	/*
+		Rebuild the meshes from the simplified parts
+	*/
+	size_t p = 0;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		TriangleMesh& mesh = *meshes[m];
+		if (p >= parts.size() || parts[p].mesh != m) continue;
+
+		TriangleMesh simplified{ mesh.Arena() };
+		std::vector<unsigned int> outputIndex;
+		for (; p < parts.size() && parts[p].mesh == m; p++)
+		{
+			SimplifyPart& part = parts[p];
+			statistics[m].maxError = std::max(statistics[m].maxError, part.error);
+
+			// Only the vertices that are still referenced are kept
+			outputIndex.assign(part.vertices.size(), ~0u);
+			for (unsigned int v : part.indices)
+			{
+				if (outputIndex[v] != ~0u) continue;
+
+				unsigned int source = part.vertices[v];
+				outputIndex[v] = (unsigned int)(simplified.positions.size());
+				simplified.AddVertex(mesh.positions[source], mesh.normals[source], mesh.colors[source], mesh.texCoords[source]);
+			}
+			for (unsigned int v : part.indices)
+			{
+				simplified.indices.push_back(outputIndex[v]);
+			}
+		}
+
+		statistics[m].trianglesAfter = simplified.indices.size() / 3;
+		mesh.positions.swap(simplified.positions);
+		mesh.normals.swap(simplified.normals);
+		mesh.colors.swap(simplified.colors);
+		mesh.texCoords.swap(simplified.texCoords);
+		mesh.indices.swap(simplified.indices);
+		mesh.chunks.clear();
+	}
+
+	return statistics;
+}
+
+SimplifyStatistics SimplifyMesh(TriangleMesh& mesh, const SimplifyOptions& options)
+{
+	return SimplifyMeshes({ &mesh }, options)[0];
+}
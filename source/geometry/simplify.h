@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <float.h>
+#include "../core/meshdata.h"
+
+/*
+	Quadric error metric simplification (Garland, Heckbert 1997)
+	Edges are collapsed onto one of their vertices, so the surviving vertices keep
+	their attributes. Vertices that share a position (the UV seam of the branch rings)
+	share one quadric and a seam vertex only collapses along the seam together with
+	its twin. Open borders, sharp feature edges and cone tips are locked.
+
+	The mesh is split into independent parts (its chunks, or else its connected
+	components, which are the separate branch tubes) and the parts are simplified
+	in parallel. The result is unchunked.
+*/
+
+struct SimplifyOptions
+{
+	unsigned int targetTriangles = 0;	// stop at this many triangles, 0 only stops at maxError
+	float maxError = FLT_MAX;			// bound on the distance of every surviving vertex from the planes of the original faces merged into it
+	float featureAngle = 75.0f;			// edges with a larger dihedral angle are kept, collapses may not rotate a face further than this
+	float tipAngleDeficit = 1.0f;		// vertices whose face angles sum to less than 2 pi minus this (cone tips) are kept
+	int threadCount = 0;				// 0 uses the hardware concurrency
+};
+
+struct SimplifyStatistics
+{
+	size_t trianglesBefore = 0;
+	size_t trianglesAfter = 0;
+	float maxError = 0.0f;				// largest distance of an accepted collapse, in the units of SimplifyOptions::maxError
+};
+
+SimplifyStatistics SimplifyMesh(TriangleMesh& mesh, const SimplifyOptions& options);
+
+// Simplifies several meshes in one batch, the parts of all meshes share the worker threads.
+// The triangle target applies to every mesh separately.
+std::vector<SimplifyStatistics> SimplifyMeshes(const std::vector<TriangleMesh*>& meshes, const SimplifyOptions& options);
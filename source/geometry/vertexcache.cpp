@@ -0,0 +1,191 @@
+#include "vertexcache.h"
+
+float ComputeACMR(const MeshVector<unsigned int>& indices, int vertexCount, int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return 0.0f;
+
+	// The cache is a ring buffer, a vertex is in the cache while its insertion time is within cacheSize inserts
+	std::vector<int> insertionTime(vertexCount, -cacheSize - 1);
+	int time = 0;
+	int misses = 0;
+	for (unsigned int v : indices)
+	{
+		if (time - insertionTime[v] > cacheSize)
+		{
+			insertionTime[v] = time++;
+			misses++;
+		}
+	}
+
+	return misses / float(triangleCount);
+}
+
+void OptimizeVertexCache(MeshVector<unsigned int>& indices, int vertexCount, int cacheSize)
+{
+	int triangleCount = int(indices.size() / 3);
+	if (triangleCount == 0 || vertexCount == 0) return;
+
+	/*
+		Vertex-triangle adjacency
+	*/
+	std::vector<int> liveTriangles(vertexCount, 0);
+	for (unsigned int v : indices)
+	{
+		liveTriangles[v]++;
+	}
+
+	std::vector<int> adjacencyOffsets(vertexCount + 1, 0);
+	for (int v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+
+	std::vector<int> adjacency(indices.size());
+	std::vector<int> fillCount(vertexCount, 0);
+	for (int t = 0; t < triangleCount; t++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			unsigned int v = indices[t * 3 + c];
+			adjacency[adjacencyOffsets[v] + fillCount[v]++] = t;
+		}
+	}
+
+	/*
+		Tipsify
+	*/
+	std::vector<int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<int> deadEndStack;
+	std::vector<int> candidates;
+	MeshVector<unsigned int> output{ indices.get_allocator() };
+	output.reserve(indices.size());
+
+	int time = cacheSize + 1;
+	int cursor = 1;
+	int fanningVertex = 0;
+
+	auto skipDeadEnd = [&]() -> int
+	{
+		// Recently touched vertices first, then scan for any vertex with triangles left
+		while (!deadEndStack.empty())
+		{
+			int d = deadEndStack.back();
+			deadEndStack.pop_back();
+			if (liveTriangles[d] > 0) return d;
+		}
+
+		while (cursor < vertexCount)
+		{
+			if (liveTriangles[cursor] > 0) return cursor;
+			cursor++;
+		}
+
+		return -1;
+	};
+
+	auto nextVertex = [&]() -> int
+	{
+		int best = -1;
+		int bestPriority = -1;
+		for (int v : candidates)
+		{
+			if (liveTriangles[v] <= 0) continue;
+
+			// Prefer the oldest vertex that will still be in the cache after its remaining triangles are emitted
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+			{
+				priority = time - cacheTime[v];
+			}
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		return (best == -1) ? skipDeadEnd() : best;
+	};
+
+	while (fanningVertex >= 0)
+	{
+		candidates.clear();
+		for (int a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++)
+		{
+			int t = adjacency[a];
+			if (emitted[t]) continue;
+
+			for (int c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[t * 3 + c];
+				output.push_back(v);
+				deadEndStack.push_back(int(v));
+				candidates.push_back(int(v));
+				liveTriangles[v]--;
+
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		fanningVertex = nextVertex();
+	}
+
+	indices.swap(output);
+}
+
+void OptimizeVertexFetch(TriangleMesh& mesh)
+{
+	const unsigned int unassigned = ~0u;
+	std::vector<unsigned int> remap(mesh.positions.size(), unassigned);
+
+	unsigned int nextIndex = 0;
+	for (unsigned int& v : mesh.indices)
+	{
+		if (remap[v] == unassigned)
+		{
+			remap[v] = nextIndex++;
+		}
+		v = remap[v];
+	}
+
+	// The new streams come from the same arena as the old ones
+	MeshVector<glm::fvec3> positions(nextIndex, mesh.positions.get_allocator());
+	MeshVector<glm::fvec3> normals(nextIndex, mesh.normals.get_allocator());
+	MeshVector<glm::fvec4> colors(nextIndex, mesh.colors.get_allocator());
+	MeshVector<glm::fvec4> texCoords(nextIndex, mesh.texCoords.get_allocator());
+	for (size_t v = 0; v < remap.size(); v++)
+	{
+		unsigned int target = remap[v];
+		if (target == unassigned) continue;
+
+		positions[target] = mesh.positions[v];
+		normals[target] = mesh.normals[v];
+		colors[target] = mesh.colors[v];
+		texCoords[target] = mesh.texCoords[v];
+	}
+
+	mesh.positions.swap(positions);
+	mesh.normals.swap(normals);
+	mesh.colors.swap(colors);
+	mesh.texCoords.swap(texCoords);
+}
+
+VertexCacheStatistics OptimizeMeshForVertexCache(TriangleMesh& mesh, int cacheSize)
+{
+	VertexCacheStatistics statistics;
+	int vertexCount = int(mesh.positions.size());
+
+	statistics.acmrBefore = ComputeACMR(mesh.indices, vertexCount, cacheSize);
+	OptimizeVertexCache(mesh.indices, vertexCount, cacheSize);
+	OptimizeVertexFetch(mesh);
+	statistics.acmrAfter = ComputeACMR(mesh.indices, int(mesh.positions.size()), cacheSize);
+
+	return statistics;
+}
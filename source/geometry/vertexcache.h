@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+#include "../core/meshdata.h"
+
+/*
+	Post-transform vertex cache optimization
+	Triangles are reordered with Tipsify (Sander, Nehab, Barczak 2007) and
+	vertices are then renumbered in the order they are first referenced.
+*/
+
+struct VertexCacheStatistics
+{
+	float acmrBefore = 0.0f; // average cache miss ratio, transformed vertices per triangle
+	float acmrAfter = 0.0f;
+};
+
+// Simulates a FIFO post-transform cache of the given size.
+float ComputeACMR(const MeshVector<unsigned int>& indices, int vertexCount, int cacheSize = 16);
+
+// Reorders the triangles in place for vertex cache locality.
+void OptimizeVertexCache(MeshVector<unsigned int>& indices, int vertexCount, int cacheSize = 16);
+
+// Renumbers the vertices in first-use order. Unreferenced vertices are removed.
+void OptimizeVertexFetch(TriangleMesh& mesh);
+
+// Runs both passes on the mesh and reports the cache miss ratio before and after.
+VertexCacheStatistics OptimizeMeshForVertexCache(TriangleMesh& mesh, int cacheSize = 16);
@@ -0,0 +1,116 @@
+#include "weld.h"
+#include <unordered_map>
+
+const float attributeTolerance = 1e-4f;
+
+WeldStatistics WeldVertices(TriangleMesh& mesh, float distance, bool matchAttributes)
+{
+	WeldStatistics statistics;
+	size_t vertexCount = mesh.positions.size();
+	statistics.verticesBefore = statistics.verticesAfter = vertexCount;
+	if (vertexCount == 0 || !mesh.chunks.empty()) return statistics;
+
+	/*
+		Spatial hash, every cell keeps a list of the representatives inside it
+	*/
+	float cellSize = (distance > 1e-6f) ? distance : 1e-6f;
+	auto cellOf = [&](glm::fvec3 p) -> glm::ivec3
+	{
+		return glm::ivec3{ glm::floor(p / cellSize) };
+	};
+	auto cellKey = [](glm::ivec3 cell) -> uint64_t
+	{
+		return (uint64_t(cell.x & 0x1fffff) << 42) | (uint64_t(cell.y & 0x1fffff) << 21) | uint64_t(cell.z & 0x1fffff);
+	};
+
+	auto sameAttributes = [&](unsigned int a, unsigned int b) -> bool
+	{
+		if (!matchAttributes) return true;
+
+		glm::fvec3 normalDifference = glm::abs(mesh.normals[a] - mesh.normals[b]);
+		glm::fvec4 colorDifference = glm::abs(mesh.colors[a] - mesh.colors[b]);
+		glm::fvec4 texCoordDifference = glm::abs(mesh.texCoords[a] - mesh.texCoords[b]);
+		float difference = glm::max(glm::max(normalDifference.x, glm::max(normalDifference.y, normalDifference.z)),
+			glm::max(glm::max(glm::max(colorDifference.x, colorDifference.y), glm::max(colorDifference.z, colorDifference.w)),
+			glm::max(glm::max(texCoordDifference.x, texCoordDifference.y), glm::max(texCoordDifference.z, texCoordDifference.w))));
+		return difference <= attributeTolerance;
+	};
+
+	std::unordered_map<uint64_t, unsigned int> cellHead;
+	cellHead.reserve(vertexCount);
+	std::vector<unsigned int> next(vertexCount, ~0u);
+	std::vector<unsigned int> remap(vertexCount);
+	float distanceSquared = distance * distance;
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		glm::fvec3 p = mesh.positions[v];
+		glm::ivec3 cell = cellOf(p);
+		remap[v] = v;
+
+		// The weld distance equals the cell size, so the match is in one of the 27 surrounding cells
+		for (int z = -1; z <= 1 && remap[v] == v; z++)
+		{
+			for (int y = -1; y <= 1 && remap[v] == v; y++)
+			{
+				for (int x = -1; x <= 1 && remap[v] == v; x++)
+				{
+					auto head = cellHead.find(cellKey(cell + glm::ivec3{ x, y, z }));
+					if (head == cellHead.end()) continue;
+
+					for (unsigned int r = head->second; r != ~0u; r = next[r])
+					{
+						glm::fvec3 offset = mesh.positions[r] - p;
+						if (glm::dot(offset, offset) <= distanceSquared && sameAttributes(r, v))
+						{
+							remap[v] = r;
+							break;
+						}
+					}
+				}
+			}
+		}
+
+		if (remap[v] == v)
+		{
+			uint64_t key = cellKey(cell);
+			auto head = cellHead.find(key);
+			next[v] = (head != cellHead.end()) ? head->second : ~0u;
+			cellHead[key] = v;
+		}
+	}
+
+	/*
+		Rewrite the triangles and drop the unreferenced vertices
+	*/
+	size_t triangleCount = mesh.indices.size() / 3;
+	std::vector<unsigned int> outputIndex(vertexCount, ~0u);
+	TriangleMesh welded{ mesh.Arena() };
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int triangle[3] = { remap[mesh.indices[t*3]], remap[mesh.indices[t*3 + 1]], remap[mesh.indices[t*3 + 2]] };
+		if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[2] == triangle[0])
+		{
+			statistics.trianglesRemoved++;
+			continue;
+		}
+
+		for (unsigned int v : triangle)
+		{
+			if (outputIndex[v] == ~0u)
+			{
+				outputIndex[v] = (unsigned int)(welded.positions.size());
+				welded.AddVertex(mesh.positions[v], mesh.normals[v], mesh.colors[v], mesh.texCoords[v]);
+			}
+			welded.indices.push_back(outputIndex[v]);
+		}
+	}
+
+	statistics.verticesAfter = welded.positions.size();
+	mesh.positions.swap(welded.positions);
+	mesh.normals.swap(welded.normals);
+	mesh.colors.swap(welded.colors);
+	mesh.texCoords.swap(welded.texCoords);
+	mesh.indices.swap(welded.indices);
+
+	return statistics;
+}
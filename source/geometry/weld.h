@@ -0,0 +1,19 @@
+#pragma once
+#include "../core/meshdata.h"
+
+/*
+	Vertex welding
+	Vertices closer than the weld distance are merged through a spatial hash with
+	cells of that size. Triangles that become degenerate and vertices that are no
+	longer referenced are removed. Runs on unchunked meshes only.
+*/
+
+struct WeldStatistics
+{
+	size_t verticesBefore = 0;
+	size_t verticesAfter = 0;
+	size_t trianglesRemoved = 0;
+};
+
+// With matchAttributes only vertices with the same normal, color and texture coordinate are merged, so UV seams stay intact.
+WeldStatistics WeldVertices(TriangleMesh& mesh, float distance, bool matchAttributes = true);
@@ -1,4 +1,4 @@
-#define USE_MULTITHREADING false
+#define USE_MULTITHREADING true
 
 // STL includes
 #include <cstdio>
@@ -9,6 +9,7 @@
 #include <fstream>
 #include <filesystem>
 #include <functional>
+#include <random>
 
 // SDL includes
 #include <SDL2/SDL.h>
@@ -31,8 +32,14 @@
 #include "generation/turtle3d.h"
 #include "generation/lsystem.h"
 #include "generation/fractals.h"
+#include "geometry/meshlets.h"
+#include "geometry/depthsort.h"
 
 #include "tree.h"
+#include "treeworker.h"
+#include "treepreview.h"
+#include "treecache.h"
+#include "treepool.h"
 
 #include "thirdparty/imgui/imgui_impl.h"
 #include "thirdparty/imgui/imgui.h"
@@ -60,8 +67,6 @@ int main()
 		WINDOW_VSYNC, WINDOW_FULLSCREEN, WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_RATIO, contentFolder
 	});
 
-	UniformRandomGenerator uniformGenerator;
-
 	OpenGLWindow windowObj;
 	windowObj.SetTitle("Tree Generation");
 	windowObj.SetClearColor(0.5f, 0.5f, 0.5f, 1.0f);
@@ -85,6 +90,7 @@ printf(R"(
 
         6:              Toggle display of skeleton
         F:              Re-center camera on origin
+        P:              Pick the branch or leaf under the cursor
 
         S:              Take screenshot
 
@@ -164,24 +170,214 @@ printf(R"(
 	*/
 	GLTriangleMesh leafMesh;
 	Canvas2D leafCanvas{128, 128};
-	GenerateLeaf(leafCanvas, leafMesh);
+	LeafCardStatistics leafCard;
+	GenerateLeaf(*leafCanvas.GetTexture(), leafMesh, &leafCard);
+	if (leafCard.hullArea > 0.0f)
+	{
+		printf("\r\n    Leaf card: %zu vertices, %.0f texels, %.1f%% of the convex hull of the opaque texels",
+			leafMesh.positions.size(), fabsf(leafCard.cardArea), 100.0f * fabsf(leafCard.cardArea) / leafCard.hullArea);
+	}
+	leafCanvas.GetTexture()->CopyToGPU();
+	leafMesh.SendToGPU();
 
 	/*
 		Build flower texture and mesh
 	*/
 	GLTriangleMesh flowerMesh;
 	Canvas2D flowerCanvas{128, 128};
-	GenerateFlower(flowerCanvas, flowerMesh);
+	GenerateFlower(*flowerCanvas.GetTexture(), flowerMesh);
+	flowerCanvas.GetTexture()->CopyToGPU();
+	flowerMesh.SendToGPU();
 
 	/*
 		Build tree mesh
 	*/
 	GLLine skeletonLines, coordinateReferenceLines;
 	GLTriangleMesh branchMeshes, crownLeavesMeshes, crownFlowersMeshes;
+	TreeGenerationOptions generationOptions;
+	// The optional passes keep their defaults (off) and are toggled in the mesh options,
+	// these values only apply once a pass is enabled. Flowers are blended, so they are sorted unless turned off.
+	generationOptions.optimizeVertexCache = true;
+	generationOptions.sortableFlowers = true;
+	generationOptions.clusterTriangles = 2048;
+	generationOptions.branchSimplification.maxError = 0.01f;
+	TreeLODChain treeLODs;
+	struct GLTreeLODLevel
+	{
+		GLTriangleMesh branches, leaves, flowers;
+	};
+	std::vector<std::unique_ptr<GLTreeLODLevel>> glTreeLODs; // GPU copies of treeLODs.levels
+	BoundingVolumeHierarchy treeBVH;
+	BVHHit pickedHit;
+	MeshletSet branchMeshlets, leafMeshlets;
+	DepthSorter flowerSorter;
+	TreeBudgetReport treeBudget;
+	const GLTriangleMesh* sortedFlowers = nullptr; // the mesh flowerSorter was set up for, it changes with the LOD level
+	treeLODs.pixelsPerRadian = WINDOW_HEIGHT / glm::radians(CAMERA_FOV);
+	glm::fvec3 treeCenter{ 0.0f };
 	bool showFlowers = true;
-	auto GenerateRandomTree = [&](int iterations = 5, int subdivisions = 3) {
+
+	// Trees are generated on the worker thread, the finished meshes are swapped in and uploaded here on the render thread
+	// Finished trees are cached by their parameters, so flipping an option back and forth does not generate again
+	TreeCache treeCache{ 512ull << 20, fs::current_path().parent_path() / "cache" };
+	TreeGenerationWorker treeWorker{ leafMesh, flowerMesh, &treeCache };
+	std::random_device seedSource;
+	auto NewTreeSeed = [&]() { return (uint64_t(seedSource()) << 32) ^ seedSource(); };
+	uint64_t treeSeed = NewTreeSeed(); // only G picks a new tree, the other changes regenerate the same one
+	TreePregenerationPool treePool{ leafMesh, flowerMesh }; // a few trees for the current settings ready for G
+	bool progressiveGeneration = true;
+	float uploadBudgetMilliseconds = 4.0f; // per frame, for streaming in the parts of a progressive generation
+	TreePreview treePreview;
+	std::vector<TreePart> treeParts;
+	int shownGeneration = -1;
+
+	// A mesh whose key did not change since the last tree is already on the GPU, see TreeStageCache
+	uint64_t uploadedBranchesKey = 0, uploadedLeavesKey = 0, uploadedFlowersKey = 0;
+	auto UploadTreeMesh = [](GLTriangleMesh& target, TriangleMesh&& mesh, uint64_t key, uint64_t& uploadedKey)
+	{
+		if (key != 0 && key == uploadedKey) return;
+		target.SendToGPU(std::move(mesh));
+		uploadedKey = key;
+	};
+	auto PrintTreeStatistics = [](const TreeGenerationResult& result)
+	{
+		const TreeGenerationOptions& options = result.request.options;
+		const TreeGenerationStatistics& statistics = result.statistics;
+		const TreeBudgetReport& budget = result.budget;
+		size_t budgetTarget = (options.triangleBudget > 0) ? options.triangleBudget : options.byteBudget;
+		if (budgetTarget > 0)
+		{
+			std::string divisions;
+			for (size_t depth = 0; depth < budget.cylinderDivisions.size(); depth++)
+			{
+				divisions += (depth > 0 ? "/" : "") + std::to_string(budget.cylinderDivisions[depth]);
+			}
+			printf("\r\n    Budget of %zu %s: detail %.3f, cylinder divisions %s, min branch thickness %.4f, leaf density %.3f, flower rate %.3f, predicted %zu triangles and %zu KB",
+				budgetTarget, (options.triangleBudget > 0) ? "triangles" : "bytes", budget.detail, divisions.c_str(), budget.minBranchThickness, budget.leafDensity, budget.flowerRate,
+				budget.predictedTriangles, budget.predictedBytes / 1024);
+		}
+		if (result.fromCache)
+		{
+			printf("\r\n    Loaded from the tree cache");
+			return;
+		}
+
+		if (options.pruneHiddenLeaves)
+		{
+			printf("\r\n    Leaf pruning: %zu of %zu leaves removed (%d occupied voxels, %d on the shell)", statistics.leafPruning.leavesRemoved,
+				statistics.leafPruning.leavesBefore, statistics.leafPruning.occupiedVoxels, statistics.leafPruning.shellVoxels);
+		}
+		if (options.weldBranches)
+		{
+			printf("\r\n    Junctions: %zu buried triangles culled, %zu vertices welded, %zu degenerate triangles removed", statistics.buriedTriangles,
+				statistics.weld.verticesBefore - statistics.weld.verticesAfter, statistics.weld.trianglesRemoved);
+		}
+		if (options.simplifyBranches)
+		{
+			printf("\r\n    Simplified branches from %zu to %zu triangles (error %.4f)", statistics.branchSimplification.trianglesBefore,
+				statistics.branchSimplification.trianglesAfter, statistics.branchSimplification.maxError);
+		}
+		if (options.optimizeVertexCache)
+		{
+			const char* names[] = { "branches", "leaves", "flowers" };
+			for (int m = 0; m < (options.sortableFlowers ? 2 : 3); m++)
+			{
+				printf("\r\n    %-8s ACMR %.3f -> %.3f", names[m], statistics.vertexCache[m].acmrBefore, statistics.vertexCache[m].acmrAfter);
+			}
+		}
+		if (statistics.chunks > 0) printf("\r\n    %d chunks with 16-bit indices", statistics.chunks);
+		if (result.request.buildBVH)
+		{
+			printf("\r\n    BVH: %zu nodes over %zu capsules and %zu quads in %.2f ms", statistics.bvhNodes, result.bvh.capsules.size(), result.bvh.quads.size(), statistics.bvhMilliseconds);
+		}
+		printf("\r\n    GPU memory: branches %zu KB, leaves %zu KB, flowers %zu KB", result.branches.GPUBytes() / 1024, result.leaves.GPUBytes() / 1024, result.flowers.GPUBytes() / 1024);
+		if (budgetTarget > 0)
+		{
+			size_t achieved = (options.triangleBudget > 0) ? budget.triangles : budget.bytes;
+			printf("\r\n    Budget result: %zu triangles, %zu KB (%+.1f%% of the budget)", budget.triangles, budget.bytes / 1024,
+				100.0 * (double(achieved) - double(budgetTarget)) / double(budgetTarget));
+		}
+		if (!statistics.reusedStages.empty())
+		{
+			printf("\r\n    Reused stages:");
+			for (size_t s = 0; s < statistics.reusedStages.size(); s++)
+			{
+				printf("%s %s", (s > 0) ? "," : "", statistics.reusedStages[s]);
+			}
+		}
+		printf("\r\n    Generated in %.1f ms", result.milliseconds);
+	};
+	auto ApplyGeneratedTree = [&](std::unique_ptr<TreeGenerationResult> result) {
+		PrintTreeStatistics(*result);
+		shownGeneration = result->generation;
+		if (treePreview.generation <= shownGeneration) treePreview.End();
+		treeBudget = result->budget;
+		treeBVH = std::move(result->bvh);
+		treeLODs.levels = std::move(result->lodChain.levels);
+		pickedHit = BVHHit{};
+
+		skeletonLines.SendToGPU(std::move(result->skeletonLines));
+		UploadTreeMesh(branchMeshes, std::move(result->branches), result->branchesKey, uploadedBranchesKey);
+		UploadTreeMesh(crownLeavesMeshes, std::move(result->leaves), result->leavesKey, uploadedLeavesKey);
+		UploadTreeMesh(crownFlowersMeshes, std::move(result->flowers), result->flowersKey, uploadedFlowersKey);
+		glTreeLODs.clear();
+		for (auto& level : treeLODs.levels)
+		{
+			glTreeLODs.push_back(std::make_unique<GLTreeLODLevel>());
+			glTreeLODs.back()->branches.SendToGPU(level->branches);
+			glTreeLODs.back()->leaves.SendToGPU(level->leaves);
+			glTreeLODs.back()->flowers.SendToGPU(level->flowers);
+		}
+
+		// The LOD level is picked from the distance to the middle of the tree
+		glm::fvec3 minBounds{ 0.0f }, maxBounds{ 0.0f };
+		for (auto& p : branchMeshes.positions)
+		{
+			minBounds = glm::min(minBounds, p);
+			maxBounds = glm::max(maxBounds, p);
+		}
+		for (auto& p : crownLeavesMeshes.positions)
+		{
+			minBounds = glm::min(minBounds, p);
+			maxBounds = glm::max(maxBounds, p);
+		}
+		treeCenter = 0.5f * (minBounds + maxBounds);
+
+		sortedFlowers = nullptr;
+		BuildMeshlets(branchMeshes, branchMeshlets);
+		BuildMeshlets(crownLeavesMeshes, leafMeshlets, maxMeshletVertices, maxMeshletTriangles, false);
+		printf("\r\n    %zu branch meshlets, %zu leaf meshlets", branchMeshlets.meshlets.size(), leafMeshlets.meshlets.size());
+	};
+	auto GenerateRandomTree = [&](int iterations = 5, int subdivisions = 3, bool newTree = false) {
+		TreeGenerationRequest request;
+		request.seed = treeSeed;
+		request.iterations = iterations;
+		request.subdivisions = subdivisions;
+		request.showFlowers = showFlowers;
+		request.progressive = progressiveGeneration;
+		request.options = generationOptions;
+		request.lodSettings = treeLODs.settings;
+		request.lodPixelsPerRadian = treeLODs.pixelsPerRadian;
+		treePool.SetSettings(request);
+
+		// A new tree comes from the pool when it has one ready, the tree in flight is dropped for it
+		if (newTree)
+		{
+			if (auto pooledTree = treePool.Take(request))
+			{
+				printf("\r\nNew tree from the pregeneration pool");
+				treeSeed = pooledTree->request.seed;
+				pooledTree->generation = treeWorker.Cancel();
+				ApplyGeneratedTree(std::move(pooledTree));
+				return;
+			}
+			treeSeed = NewTreeSeed();
+			request.seed = treeSeed;
+		}
+
 		printf("\r\nGenerating tree (%d iterations, %d subdivisions)... ", iterations, subdivisions);
-		GenerateNewTree(skeletonLines, branchMeshes, crownLeavesMeshes, crownFlowersMeshes, leafMesh, flowerMesh, uniformGenerator, iterations, subdivisions, showFlowers);
+		if (USE_MULTITHREADING) treeWorker.Request(request);
+		else ApplyGeneratedTree(treeWorker.Generate(request));
 	};
 	GenerateRandomTree();
 
@@ -201,6 +397,11 @@ printf(R"(
 		User interaction options
 	*/
 	bool renderSkeleton = false;
+	bool useLOD = true;
+	bool useFrustumCulling = true;
+	bool useMeshletCulling = true;
+	std::vector<unsigned int> visibleIndices;
+	GLDrawStatistics drawStatistics;
 	int treeIterations = 5;
 	int treeSubdivisions = 3;
 
@@ -264,6 +465,28 @@ printf(R"(
 
 		windowObj.SetTitle("FPS: " + FpsString(deltaTime));
 
+		// Stream in what a progressive generation published so far, then pick up a tree the worker finished since the last frame.
+		// Parts are taken first, the parts of a finished tree are then always older than the tree itself.
+		int partsGeneration = treeWorker.TakeParts(treeParts);
+		if (!treeParts.empty() && partsGeneration > shownGeneration)
+		{
+			if (partsGeneration != treePreview.generation)
+			{
+				treePreview.Begin(partsGeneration, branchMeshes, crownLeavesMeshes, crownFlowersMeshes);
+			}
+			treePreview.Queue(treeParts);
+		}
+		treeParts.clear();
+		if (treePreview.active)
+		{
+			treePreview.Upload(uploadBudgetMilliseconds);
+		}
+		if (auto generatedTree = treeWorker.TakeResult())
+		{
+			ApplyGeneratedTree(std::move(generatedTree));
+		}
+		treePool.Pause(treeWorker.Busy()); // the pool only fills while the viewer's own tree is not generating
+
 		// Start new ImGui frame
 		ImGuiImpl::NewFrame(window);
 
@@ -314,8 +537,146 @@ printf(R"(
 				flowerColor = hsvToRgb(flowerHue, 1.0f, 1.0f);
 				UpdateColors();
 			}
+			// Sorting needs every flower as its own vertex range, so the tree is generated again
+			if (ImGui::Checkbox("Sort flowers back to front", &generationOptions.sortableFlowers))
+			{
+				GenerateRandomTree(treeIterations, treeSubdivisions);
+			}
+			if (generationOptions.sortableFlowers)
+			{
+				const DepthSortStatistics& sortStatistics = flowerSorter.statistics;
+				ImGui::Text("Sorted %zu flowers in %.3f ms of %.1f (%s)%s", flowerSorter.order.size(), sortStatistics.milliseconds, flowerSorter.budgetMilliseconds,
+					sortStatistics.kept ? "kept" : (sortStatistics.incremental ? "incremental" : (sortStatistics.fallback ? "insertion, then radix" : "radix")),
+					sortStatistics.withinBudget ? "" : " over budget");
+			}
 		}
 		
+		// Mesh options
+		ImGui::Separator();
+		if (ImGui::Checkbox("Optimize vertex cache", &generationOptions.optimizeVertexCache))
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		if (ImGui::Checkbox("16-bit index chunks", &generationOptions.chunkMeshes))
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		if (generationOptions.chunkMeshes)
+		{
+			int clusterTriangles = int(generationOptions.clusterTriangles);
+			if (ImGui::SliderInt("Cluster triangles (0 is off)", &clusterTriangles, 0, 8192))
+			{
+				generationOptions.clusterTriangles = (unsigned int)(clusterTriangles);
+			}
+			if (ImGui::IsItemDeactivatedAfterEdit())
+			{
+				GenerateRandomTree(treeIterations, treeSubdivisions);
+			}
+		}
+		ImGui::SliderFloat("Branch ring tolerance", &generationOptions.ringTolerance, 0.0f, 0.5f, "%.3f");
+		if (ImGui::IsItemDeactivatedAfterEdit())
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		ImGui::SliderInt("Trunk cylinder divisions", &generationOptions.trunkCylinderDivisions, 8, 64);
+		if (ImGui::IsItemDeactivatedAfterEdit())
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		ImGui::SliderFloat("Leaf scale", &generationOptions.leafScale, 0.25f, 3.0f, "%.2f");
+		if (ImGui::IsItemDeactivatedAfterEdit())
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		if (showFlowers)
+		{
+			ImGui::SliderFloat("Flower chance", &generationOptions.flowerChance, 0.0f, 1.0f, "%.2f");
+			if (ImGui::IsItemDeactivatedAfterEdit())
+			{
+				GenerateRandomTree(treeIterations, treeSubdivisions);
+			}
+		}
+		if (ImGui::Checkbox("Clip and weld branch junctions", &generationOptions.weldBranches))
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		if (ImGui::Checkbox("Simplify branches", &generationOptions.simplifyBranches))
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		if (ImGui::Checkbox("Prune hidden leaves", &generationOptions.pruneHiddenLeaves))
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		if (generationOptions.pruneHiddenLeaves)
+		{
+			ImGui::SliderFloat("Leaf exposure threshold", &generationOptions.leafPruning.exposureThreshold, 0.0f, 0.5f, "%.2f");
+			if (ImGui::IsItemDeactivatedAfterEdit())
+			{
+				GenerateRandomTree(treeIterations, treeSubdivisions);
+			}
+		}
+		int triangleBudget = int(generationOptions.triangleBudget / 1000);
+		if (ImGui::SliderInt("Triangle budget (thousands, 0 is off)", &triangleBudget, 0, 500))
+		{
+			generationOptions.triangleBudget = size_t(triangleBudget) * 1000;
+		}
+		if (ImGui::IsItemDeactivatedAfterEdit())
+		{
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+		if (generationOptions.triangleBudget > 0)
+		{
+			ImGui::Text("Detail %.2f, trunk divisions %d, leaves %.0f%%: %zu triangles%s", treeBudget.detail,
+				treeBudget.cylinderDivisions.empty() ? 0 : treeBudget.cylinderDivisions[0], 100.0f * treeBudget.leafDensity,
+				treeBudget.triangles, treeBudget.withinBudget ? "" : " (outside the budget)");
+		}
+		const char* vertexLayouts[] = { "Float streams (56 B)", "Packed", "Packed half positions" };
+		int vertexLayout = int(generationOptions.vertexLayout);
+		if (ImGui::Combo("Vertex layout", &vertexLayout, vertexLayouts, IM_ARRAYSIZE(vertexLayouts)))
+		{
+			generationOptions.vertexLayout = VertexLayout(vertexLayout);
+			GenerateRandomTree(treeIterations, treeSubdivisions);
+		}
+
+		ImGui::Checkbox("Progressive generation", &progressiveGeneration);
+		if (progressiveGeneration)
+		{
+			ImGui::SliderFloat("Upload budget (ms per frame)", &uploadBudgetMilliseconds, 0.5f, 16.0f, "%.1f");
+		}
+		if (treeWorker.Busy())
+		{
+			ImGui::ProgressBar(treeWorker.Progress(), ImVec2{ -1.0f, 0.0f }, treeWorker.Stage());
+		}
+		TreeCacheStatistics cacheStatistics = treeCache.Statistics();
+		ImGui::Text("Tree cache: %zu trees, %zu MB, %zu memory hits, %zu disk hits, %zu misses", cacheStatistics.entries,
+			cacheStatistics.memoryBytes >> 20, cacheStatistics.memoryHits, cacheStatistics.diskHits, cacheStatistics.misses);
+		TreePoolStatistics poolStatistics = treePool.Statistics();
+		ImGui::Text("Pregenerated: %zu ready, %zu MB, %zu hits, %zu misses, %zu dropped", poolStatistics.ready,
+			poolStatistics.memoryBytes >> 20, poolStatistics.hits, poolStatistics.misses, poolStatistics.dropped);
+
+		// Level of detail
+		ImGui::Checkbox("Distance LOD", &useLOD);
+		ImGui::Text("Active LOD level: %d", useLOD ? treeLODs.activeLevel + 1 : 0);
+
+		// Culling
+		ImGui::Separator();
+		ImGui::Checkbox("Frustum culling", &useFrustumCulling);
+		ImGui::Checkbox("Meshlet culling (full detail only)", &useMeshletCulling);
+		if (ImGui::Button("Export meshlets"))
+		{
+			if (!branchMeshlets.Save("branches.meshlets")) printf("\r\nFailed to write meshlets to branches.meshlets");
+			if (!leafMeshlets.Save("leaves.meshlets")) printf("\r\nFailed to write meshlets to leaves.meshlets");
+		}
+		ImGui::Text("Clusters drawn: %d, culled: %d", drawStatistics.drawnChunks, drawStatistics.culledChunks);
+		ImGui::Text("Triangles drawn: %zu", drawStatistics.drawnTriangles);
+
+		ImGui::Separator();
+		ImGui::Text("BVH nodes: %zu (P: pick under cursor)", treeBVH.nodes.size());
+		if (pickedHit.primitive == ~0u) ImGui::Text("Picked: nothing");
+		else if (treeBVH.IsCapsule(pickedHit.primitive)) ImGui::Text("Picked: branch bone %u at %.2f", pickedHit.primitive, pickedHit.distance);
+		else ImGui::Text("Picked: leaf %zu at %.2f", pickedHit.primitive - treeBVH.capsules.size(), pickedHit.distance);
+
 		ImGui::End();
 
 		SDL_Event event;
@@ -337,6 +698,21 @@ printf(R"(
 					if		(key == SDLK_6) renderSkeleton = !renderSkeleton;
 					else if (key == SDLK_s) TakeScreenshot("screenshot.png", WINDOW_WIDTH, WINDOW_HEIGHT);
 					else if (key == SDLK_f) turntable.SnapToOrigin();
+					else if (key == SDLK_p)
+					{
+						// Cast a ray through the cursor, unprojected into mesh space
+						int mouseX, mouseY;
+						SDL_GetMouseState(&mouseX, &mouseY);
+						glm::fvec2 ndc{ 2.0f * mouseX / WINDOW_WIDTH - 1.0f, 1.0f - 2.0f * mouseY / WINDOW_HEIGHT };
+						glm::mat4 inverseMVP = glm::inverse(camera.ViewProjectionMatrix() * branchMeshes.transform.ModelMatrix());
+						glm::fvec4 nearPoint = inverseMVP * glm::fvec4{ ndc, -1.0f, 1.0f };
+						glm::fvec4 farPoint = inverseMVP * glm::fvec4{ ndc, 1.0f, 1.0f };
+
+						BVHRay ray;
+						ray.origin = glm::fvec3{ nearPoint } / nearPoint.w;
+						ray.direction = glm::fvec3{ farPoint } / farPoint.w - ray.origin;
+						treeBVH.IntersectNearest(ray, pickedHit);
+					}
 					else if (key == SDLK_UP)    ++treeIterations;
 					else if (key == SDLK_DOWN)  treeIterations = (treeIterations <= 1) ? 1 : treeIterations - 1;
 					else if (key == SDLK_LEFT)  treeSubdivisions = (treeSubdivisions <= 1) ? 1 : treeSubdivisions - 1;
@@ -346,7 +722,7 @@ printf(R"(
 					{
 					case SDLK_g:case SDLK_UP:case SDLK_DOWN:case SDLK_LEFT:case SDLK_RIGHT:
 					{
-						GenerateRandomTree(treeIterations, treeSubdivisions);
+						GenerateRandomTree(treeIterations, treeSubdivisions, key == SDLK_g);
 					}
 					default: { break; }
 					}
@@ -404,13 +780,48 @@ printf(R"(
 		glm::mat4 projection = camera.ViewProjectionMatrix();
 		glm::mat4 mvp = projection * branchMeshes.transform.ModelMatrix();
 
+		// Pick the level of detail from the camera distance
+		GLTreeLODLevel* lodLevel = nullptr;
+		if (useLOD && treeLODs.SelectLevel(glm::distance(camera.GetPosition(), treeCenter)))
+		{
+			lodLevel = glTreeLODs[treeLODs.activeLevel].get();
+		}
+		GLTriangleMesh& drawnBranches = treePreview.active ? treePreview.branches : lodLevel ? lodLevel->branches : branchMeshes;
+		GLTriangleMesh& drawnLeaves = treePreview.active ? treePreview.leaves : lodLevel ? lodLevel->leaves : crownLeavesMeshes;
+		GLTriangleMesh& drawnFlowers = treePreview.active ? treePreview.flowers : lodLevel ? lodLevel->flowers : crownFlowersMeshes;
+
+		// Clusters outside the view are skipped, the frustum is taken from the mvp so it is in mesh space
+		Frustum frustum{ mvp };
+		drawStatistics = GLDrawStatistics{};
+		glm::fvec3 meshCameraPosition = glm::inverse(branchMeshes.transform.ModelMatrix()) * glm::fvec4{ camera.GetPosition(), 1.0f };
+		auto drawTreeMesh = [&](GLTriangleMesh& mesh, const MeshletSet* meshlets, bool backfaceCulling)
+		{
+			// Meshlets are only built for the full detail meshes
+			if (useFrustumCulling && useMeshletCulling && meshlets && !lodLevel && !treePreview.active)
+			{
+				visibleIndices.clear();
+				meshlets->Cull(frustum, meshCameraPosition, backfaceCulling, visibleIndices, drawStatistics);
+				mesh.DrawIndices(visibleIndices);
+			}
+			else if (useFrustumCulling)
+			{
+				mesh.DrawVisible(frustum, drawStatistics);
+			}
+			else
+			{
+				mesh.Draw();
+				drawStatistics.drawnChunks += int(mesh.chunks.empty() ? 1 : mesh.chunks.size());
+				drawStatistics.drawnTriangles += mesh.indices.size() / 3;
+			}
+		};
+
 		// Render tree branches
 		treeShader.Use();
 		treeShader.SetUniformVec3("cameraPosition", camera.GetPosition());
 		treeShader.UpdateMVP(mvp);
 		defaultTexture.UseForDrawing();
 		glUniform1i(glGetUniformLocation(treeShader.Id(), "textureSampler"), 0);  // Bind texture to unit 0
-		branchMeshes.Draw();
+		drawTreeMesh(drawnBranches, &branchMeshlets, true);
 
 		// Render leaves
 		leafShader.Use();
@@ -419,7 +830,7 @@ printf(R"(
 		leafShader.UpdateMVP(mvp);
 		leafCanvas.GetTexture()->UseForDrawing();
 		glUniform1i(glGetUniformLocation(leafShader.Id(), "textureSampler"), 0);  // Bind texture to unit 0
-		crownLeavesMeshes.Draw();
+		drawTreeMesh(drawnLeaves, &leafMeshlets, false); // leaves are two sided
 
 		// Render flowers if enabled
 		if (showFlowers)
@@ -433,7 +844,22 @@ printf(R"(
 			flowerShader.UpdateMVP(mvp);
 			flowerCanvas.GetTexture()->UseForDrawing();
 			glUniform1i(glGetUniformLocation(flowerShader.Id(), "textureSampler"), 0);
-			crownFlowersMeshes.Draw();
+			if (generationOptions.sortableFlowers && !treePreview.active && drawnFlowers.chunks.empty())
+			{
+				if (sortedFlowers != &drawnFlowers)
+				{
+					flowerSorter.SetInstances(drawnFlowers, (unsigned int)(flowerMesh.positions.size()));
+					sortedFlowers = &drawnFlowers;
+				}
+				glm::fvec3 meshViewDirection = glm::normalize(glm::mat3{ glm::inverse(branchMeshes.transform.ModelMatrix()) } * camera.ForwardVector());
+				flowerSorter.Sort(meshCameraPosition, meshViewDirection);
+				drawnFlowers.DrawInstances(flowerSorter.order, (unsigned int)(flowerMesh.indices.size()));
+				drawStatistics.drawnTriangles += drawnFlowers.indices.size() / 3;
+			}
+			else
+			{
+				drawTreeMesh(drawnFlowers, nullptr, false);
+			}
 			
 			// Disable alpha blending after flowers
 			glDisable(GL_BLEND);
@@ -447,7 +873,11 @@ printf(R"(
 		lineShader.UpdateMVP(projection);
 		lineShader.Use();
 		coordinateReferenceLines.Draw();
-		if (renderSkeleton)
+		if (treePreview.active)
+		{
+			treePreview.skeletonLines.Draw(); // the skeleton is the first part to arrive
+		}
+		else if (renderSkeleton)
 		{
 			skeletonLines.Draw();
 		}
@@ -0,0 +1,235 @@
+// STL includes
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
+
+// Application includes
+#include "core/localsocket.h"
+#include "core/sharedmemory.h"
+#include "treeprotocol.h"
+#include "treeshared.h"
+
+/*
+	Tree service client
+	Drives a service started with treegen --serve: sends generation requests over a few connections, keeps some
+	in flight on each, and reports the throughput, the latencies it measured and the service's own metrics.
+	With --shared the trees come back in shared memory, which the client maps, reads in place and releases.
+	It can also just ask for the metrics or stop the service.
+*/
+
+struct ClientArguments
+{
+	std::string socketPath;
+	int requests = 100;
+	int connections = 4;
+	int pipeline = 4;		// requests in flight per connection
+	int seeds = 0;			// distinct seeds the requests cycle through, 0 gives every request its own
+	TreeServiceRequest request;
+	bool metricsOnly = false;
+	bool shutdown = false;
+};
+
+static void PrintUsage()
+{
+	printf(
+		"usage: treeclient SOCKET [options]\n"
+		"    --requests N            generation requests to send (100)\n"
+		"    --connections N         connections sending them (4)\n"
+		"    --pipeline N            requests in flight per connection (4)\n"
+		"    --seeds N               distinct seeds, counting up from --seed, 0 makes every request unique (0)\n"
+		"    --seed N                first seed (1)\n"
+		"    --iterations N          L-system iterations (5)\n"
+		"    --subdivisions N        branch subdivisions (3)\n"
+		"    --style S               default or slim\n"
+		"    --no-flowers            leave the flowers out\n"
+		"    --shared                have the trees handed over in shared memory\n"
+		"    --metrics               only print the service's metrics\n"
+		"    --shutdown              stop the service, it finishes the requests it has queued\n");
+}
+
+static bool ParseArguments(int argc, char* argv[], ClientArguments& arguments)
+{
+	if (argc < 2 || argv[1][0] == '-') return false;
+	arguments.socketPath = argv[1];
+	for (int i = 2; i < argc; i++)
+	{
+		std::string name = argv[i];
+		bool hasValue = (i + 1 < argc);
+		auto value = [&]() { return argv[++i]; };
+
+		if (name == "--requests" && hasValue)				arguments.requests = atoi(value());
+		else if (name == "--connections" && hasValue)		arguments.connections = std::max(atoi(value()), 1);
+		else if (name == "--pipeline" && hasValue)			arguments.pipeline = std::max(atoi(value()), 1);
+		else if (name == "--seeds" && hasValue)				arguments.seeds = atoi(value());
+		else if (name == "--seed" && hasValue)				arguments.request.seed = strtoull(value(), nullptr, 10);
+		else if (name == "--iterations" && hasValue)		arguments.request.iterations = atoi(value());
+		else if (name == "--subdivisions" && hasValue)		arguments.request.subdivisions = atoi(value());
+		else if (name == "--style" && hasValue)
+		{
+			std::string style = value();
+			if (style == "default")		arguments.request.style = TreeStyle::Default;
+			else if (style == "slim")	arguments.request.style = TreeStyle::Slim;
+			else return false;
+		}
+		else if (name == "--no-flowers")					arguments.request.showFlowers = false;
+		else if (name == "--shared")						arguments.request.sharedMemory = true;
+		else if (name == "--metrics")						arguments.metricsOnly = true;
+		else if (name == "--shutdown")						arguments.shutdown = true;
+		else return false;
+	}
+	return true;
+}
+
+// Sends a message without payload and prints the text of the answer
+static bool Command(const std::string& socketPath, TreeServiceMessage type)
+{
+	LocalSocket socket;
+	TreeServiceHeader header;
+	std::vector<uint8_t> payload;
+	if (!socket.Connect(socketPath) || !SendTreeServiceMessage(socket, type, 0, {}) || !ReceiveTreeServiceMessage(socket, header, payload))
+	{
+		printf("No service on %s\r\n", socketPath.c_str());
+		return false;
+	}
+	if (type == TreeServiceMessage::Shutdown) printf("The service is stopping\r\n");
+	else printf("%.*s\r\n", int(payload.size()), reinterpret_cast<const char*>(payload.data()));
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	ClientArguments arguments;
+	if (!ParseArguments(argc, argv, arguments))
+	{
+		PrintUsage();
+		return 1;
+	}
+	if (arguments.metricsOnly || arguments.shutdown)
+	{
+		return Command(arguments.socketPath, arguments.shutdown ? TreeServiceMessage::Shutdown : TreeServiceMessage::Metrics) ? 0 : 1;
+	}
+
+	using Clock = std::chrono::steady_clock;
+	std::atomic<int> nextRequest{ 0 };
+	std::mutex mutex;
+	std::vector<double> latencies;
+	size_t trees = 0, cachedTrees = 0, triangles = 0, errors = 0, failedConnections = 0;
+
+	auto connection = [&]()
+	{
+		LocalSocket socket;
+		if (!socket.Connect(arguments.socketPath))
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			failedConnections++;
+			return;
+		}
+
+		std::unordered_map<uint64_t, Clock::time_point> sent;
+		std::vector<double> connectionLatencies;
+		size_t connectionTrees = 0, connectionCached = 0, connectionTriangles = 0, connectionErrors = 0;
+		bool open = true;
+		while (open)
+		{
+			// Keep the pipeline full while there are requests left
+			while (int(sent.size()) < arguments.pipeline)
+			{
+				int index = nextRequest++;
+				if (index >= arguments.requests) break;
+
+				TreeServiceRequest request = arguments.request;
+				request.seed += uint64_t((arguments.seeds > 0) ? index % arguments.seeds : index);
+				sent[uint64_t(index)] = Clock::now();
+				if (!SendTreeServiceMessage(socket, TreeServiceMessage::Generate, uint64_t(index), EncodeTreeServiceRequest(request)))
+				{
+					open = false;
+					break;
+				}
+			}
+			if (sent.empty() || !open) break;
+
+			TreeServiceHeader header;
+			std::vector<uint8_t> payload;
+			if (!ReceiveTreeServiceMessage(socket, header, payload)) break;
+			auto request = sent.find(header.id);
+			if (request == sent.end()) continue;
+			connectionLatencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - request->second).count());
+			sent.erase(request);
+
+			TreeServiceTree tree;
+			TreeServiceSharedTree sharedTree;
+			if (header.type == TreeServiceMessage::Tree && DecodeTreeServiceTree(payload, tree))
+			{
+				connectionTrees++;
+				connectionCached += tree.fromCache ? 1 : 0;
+				connectionTriangles += (tree.branches.indices.size() + tree.leaves.indices.size() + tree.flowers.indices.size()) / 3;
+			}
+			else if (header.type == TreeServiceMessage::SharedTree && DecodeTreeServiceSharedTree(payload, sharedTree))
+			{
+				// Mapped, the service can let go of it right away
+				SharedMemory memory;
+				bool opened = memory.Open(sharedTree.name);
+				SendTreeServiceMessage(socket, TreeServiceMessage::Release, header.id, {});
+				const TreeSharedLayout* layout = opened ? ReadTreeShared(memory.Data(), memory.Size()) : nullptr;
+				if (!layout)
+				{
+					connectionErrors++;
+					continue;
+				}
+				connectionTrees++;
+				connectionCached += sharedTree.fromCache ? 1 : 0;
+				connectionTriangles += size_t(layout->meshes[TreeSharedBranches].indexCount + layout->meshes[TreeSharedLeaves].indexCount + layout->meshes[TreeSharedFlowers].indexCount) / 3;
+			}
+			else
+			{
+				if (connectionErrors == 0 && header.type == TreeServiceMessage::Error)
+				{
+					printf("Error for request %llu: %.*s\r\n", (unsigned long long)(header.id), int(payload.size()), reinterpret_cast<const char*>(payload.data()));
+				}
+				connectionErrors++;
+			}
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		latencies.insert(latencies.end(), connectionLatencies.begin(), connectionLatencies.end());
+		trees += connectionTrees;
+		cachedTrees += connectionCached;
+		triangles += connectionTriangles;
+		errors += connectionErrors + sent.size(); // unanswered when the connection broke
+	};
+
+	auto startTime = Clock::now();
+	std::vector<std::thread> threads;
+	for (int i = 0; i < arguments.connections; i++)
+	{
+		threads.emplace_back(connection);
+	}
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+	if (failedConnections == size_t(arguments.connections))
+	{
+		printf("No service on %s\r\n", arguments.socketPath.c_str());
+		return 1;
+	}
+
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&](double fraction) { return latencies.empty() ? 0.0 : latencies[std::min(size_t(fraction * latencies.size()), latencies.size() - 1)]; };
+	printf("%zu trees (%zu from the cache, %zu errors) over %d connections in %.2f s: %.1f trees/s, %.0f triangles/s\r\n",
+		trees, cachedTrees, errors, arguments.connections - int(failedConnections), seconds, trees / seconds, triangles / seconds);
+	printf("Latency: p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms\r\n", percentile(0.5), percentile(0.9), percentile(0.99), percentile(1.0));
+	printf("Service: ");
+	Command(arguments.socketPath, TreeServiceMessage::Metrics);
+	return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,637 @@
+// STL includes
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+#include <csignal>
+
+// Application includes
+#include "core/meshdata.h"
+#include "core/image.h"
+
+#include "tree.h"
+#include "treeworker.h"
+#include "treecache.h"
+#include "treebatch.h"
+#include "treeservice.h"
+
+/*
+	Headless tree generator
+	Builds a tree from command line parameters without a window or GL context and
+	writes the meshes as OBJ and the statistics as JSON next to each other.
+	In batch mode it reads a list of jobs and writes one OBJ and JSON pair per job, numbered by the job's line.
+	In sweep mode it generates a grid of parameters (or one shard of it) and writes a row of statistics per point
+	as CSV and JSON, optionally with a thumbnail per point, instead of the meshes.
+	In service mode it stays up and answers generation requests on a Unix domain socket (treeservice.h),
+	the other options are the defaults for what the requests leave out. treeclient drives it.
+*/
+
+namespace fs = std::filesystem;
+
+struct TreegenArguments
+{
+	int iterations = 5;
+	int subdivisions = 3;
+	uint64_t seed = 1;
+	bool flowers = true;
+	bool textures = false;
+	fs::path output = "tree";
+	fs::path cacheFolder; // empty when there is no cache
+	fs::path batchFile;	// empty for a single tree
+	int threads = 0;
+	size_t memoryMegabytes = 1024;
+	bool sweep = false;
+	TreeSweepGrid sweepGrid;
+	int shard = 0;
+	int shardCount = 1;
+	int thumbnailSize = 0; // 0 writes none
+	std::string socketPath; // empty when not serving
+	TreeGenerationOptions options;
+};
+
+static void PrintUsage()
+{
+	printf(
+		"usage: treegen [options]\n"
+		"    --iterations N          L-system iterations (5)\n"
+		"    --subdivisions N        branch subdivisions (3)\n"
+		"    --seed N                random seed (1)\n"
+		"    --no-flowers            leave the flowers out\n"
+		"    --ring-tolerance X      curvature adaptive branch rings, see TreeGenerationOptions\n"
+		"    --trunk-divisions N     cylinder divisions of the trunk (32)\n"
+		"    --leaf-scale X          leaf size multiplier (1)\n"
+		"    --flower-chance X       chance of a flower on the last nodes of a branch (0.4)\n"
+		"    --weld X                weld branch vertices closer than X\n"
+		"    --simplify X            decimate the branches up to the error X\n"
+		"    --prune                 remove leaves hidden inside the crown\n"
+		"    --triangles N           triangle budget\n"
+		"    --bytes N               GPU byte budget\n"
+		"    --layout L              separate, packed or half (vertex layout used for the byte counts)\n"
+		"    --textures              also write the leaf and flower textures as PNG\n"
+		"    --cache FOLDER          reuse trees generated before with the same parameters, see treecache.h\n"
+		"    --out PATH              output path without extension (tree)\n"
+		"    --batch FILE            generate the jobs in FILE, one per line: seed style iterations subdivisions flowers\n"
+		"                            (style is default or slim, flowers 0 or 1), written to PATH_<line>\n"
+		"    --threads N             batch threads (hardware concurrency)\n"
+		"    --memory MB             batch trees in flight and waiting to be written, or the service's cache (1024)\n"
+		"    --sweep                 generate a grid of parameters and write its statistics to PATH.csv and PATH.json\n"
+		"    --sweep-iterations A-B  iterations of the grid (5)\n"
+		"    --sweep-subdivisions A-B subdivisions of the grid (3)\n"
+		"    --sweep-styles LIST     comma separated styles of the grid (default)\n"
+		"    --sweep-seeds N         seeds of the grid, counting up from --seed (1)\n"
+		"    --shard I/N             only the I-th of N interleaved shards of the grid, I counts from 0\n"
+		"    --thumbnails SIZE       also write a SIZE x SIZE front view of every point to PATH_<point>.png\n"
+		"    --serve SOCKET          answer generation requests on a Unix domain socket until stopped, see treeservice.h\n");
+}
+
+static bool ParseArguments(int argc, char* argv[], TreegenArguments& arguments)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string name = argv[i];
+		bool hasValue = (i + 1 < argc);
+		auto value = [&]() { return argv[++i]; };
+
+		if (name == "--iterations" && hasValue)				arguments.iterations = atoi(value());
+		else if (name == "--subdivisions" && hasValue)		arguments.subdivisions = atoi(value());
+		else if (name == "--seed" && hasValue)				arguments.seed = strtoull(value(), nullptr, 10);
+		else if (name == "--no-flowers")					arguments.flowers = false;
+		else if (name == "--ring-tolerance" && hasValue)	arguments.options.ringTolerance = float(atof(value()));
+		else if (name == "--trunk-divisions" && hasValue)	arguments.options.trunkCylinderDivisions = atoi(value());
+		else if (name == "--leaf-scale" && hasValue)		arguments.options.leafScale = float(atof(value()));
+		else if (name == "--flower-chance" && hasValue)		arguments.options.flowerChance = float(atof(value()));
+		else if (name == "--weld" && hasValue)
+		{
+			arguments.options.weldBranches = true;
+			arguments.options.weldDistance = float(atof(value()));
+		}
+		else if (name == "--simplify" && hasValue)
+		{
+			arguments.options.simplifyBranches = true;
+			arguments.options.branchSimplification.maxError = float(atof(value()));
+		}
+		else if (name == "--prune")							arguments.options.pruneHiddenLeaves = true;
+		else if (name == "--triangles" && hasValue)			arguments.options.triangleBudget = size_t(strtoull(value(), nullptr, 10));
+		else if (name == "--bytes" && hasValue)				arguments.options.byteBudget = size_t(strtoull(value(), nullptr, 10));
+		else if (name == "--layout" && hasValue)
+		{
+			std::string layout = value();
+			if (layout == "separate")		arguments.options.vertexLayout = VertexLayout::Separate;
+			else if (layout == "packed")	arguments.options.vertexLayout = VertexLayout::Packed;
+			else if (layout == "half")		arguments.options.vertexLayout = VertexLayout::PackedHalf;
+			else return false;
+		}
+		else if (name == "--textures")						arguments.textures = true;
+		else if (name == "--cache" && hasValue)				arguments.cacheFolder = value();
+		else if (name == "--out" && hasValue)				arguments.output = value();
+		else if (name == "--batch" && hasValue)				arguments.batchFile = value();
+		else if (name == "--threads" && hasValue)			arguments.threads = atoi(value());
+		else if (name == "--memory" && hasValue)			arguments.memoryMegabytes = size_t(strtoull(value(), nullptr, 10));
+		else if (name == "--sweep")							arguments.sweep = true;
+		else if ((name == "--sweep-iterations" || name == "--sweep-subdivisions") && hasValue)
+		{
+			int first = 0, last = 0;
+			int read = sscanf(value(), "%d-%d", &first, &last);
+			if (read < 1) return false;
+			last = (read == 2) ? last : first;
+			if (last < first) return false;
+			bool iterations = (name == "--sweep-iterations");
+			(iterations ? arguments.sweepGrid.minIterations : arguments.sweepGrid.minSubdivisions) = first;
+			(iterations ? arguments.sweepGrid.maxIterations : arguments.sweepGrid.maxSubdivisions) = last;
+			arguments.sweep = true;
+		}
+		else if (name == "--sweep-styles" && hasValue)
+		{
+			arguments.sweepGrid.styles.clear();
+			std::string styles = value();
+			for (size_t start = 0; start <= styles.size();)
+			{
+				size_t end = std::min(styles.find(',', start), styles.size());
+				std::string style = styles.substr(start, end - start);
+				if (style == "default")		arguments.sweepGrid.styles.push_back(TreeStyle::Default);
+				else if (style == "slim")	arguments.sweepGrid.styles.push_back(TreeStyle::Slim);
+				else return false;
+				start = end + 1;
+			}
+			arguments.sweep = true;
+		}
+		else if (name == "--sweep-seeds" && hasValue)
+		{
+			arguments.sweepGrid.seedCount = atoi(value());
+			if (arguments.sweepGrid.seedCount < 1) return false;
+			arguments.sweep = true;
+		}
+		else if (name == "--shard" && hasValue)
+		{
+			if (sscanf(value(), "%d/%d", &arguments.shard, &arguments.shardCount) != 2) return false;
+			if (arguments.shardCount < 1 || arguments.shard < 0 || arguments.shard >= arguments.shardCount) return false;
+		}
+		else if (name == "--thumbnails" && hasValue)		arguments.thumbnailSize = atoi(value());
+		else if (name == "--serve" && hasValue)				arguments.socketPath = value();
+		else return false;
+	}
+	return true;
+}
+
+// One OBJ object per mesh, chunked meshes have their indices made absolute again
+static void WriteOBJObject(FILE* file, const char* name, const TriangleMesh& mesh, size_t& vertexOffset)
+{
+	fprintf(file, "o %s\n", name);
+	for (auto& p : mesh.positions) fprintf(file, "v %f %f %f\n", p.x, p.y, p.z);
+	for (auto& n : mesh.normals) fprintf(file, "vn %f %f %f\n", n.x, n.y, n.z);
+	for (auto& t : mesh.texCoords) fprintf(file, "vt %f %f\n", t.x, t.y);
+
+	auto writeTriangles = [&](size_t firstIndex, size_t indexCount, size_t baseVertex)
+	{
+		for (size_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3)
+		{
+			size_t a = vertexOffset + baseVertex + mesh.indices[i] + 1;
+			size_t b = vertexOffset + baseVertex + mesh.indices[i + 1] + 1;
+			size_t c = vertexOffset + baseVertex + mesh.indices[i + 2] + 1;
+			fprintf(file, "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a, a, a, b, b, b, c, c, c);
+		}
+	};
+	if (mesh.chunks.empty())
+	{
+		writeTriangles(0, mesh.indices.size(), 0);
+	}
+	for (auto& chunk : mesh.chunks)
+	{
+		writeTriangles(chunk.firstIndex, chunk.indexCount, chunk.baseVertex);
+	}
+	vertexOffset += mesh.positions.size();
+}
+
+static void WriteMeshStatistics(FILE* file, const char* name, const TriangleMesh& mesh, bool last = false)
+{
+	fprintf(file, "\t\t\"%s\": { \"vertices\": %zu, \"triangles\": %zu, \"gpuBytes\": %zu }%s\n",
+		name, mesh.positions.size(), mesh.indices.size() / 3, mesh.GPUBytes(), last ? "" : ",");
+}
+
+// Writes the OBJ and the JSON statistics of a tree next to each other
+static bool WriteTree(const fs::path& output, const TreeGenerationResult& tree)
+{
+	const TriangleMesh& branchMeshes = tree.branches;
+	const TriangleMesh& crownLeavesMeshes = tree.leaves;
+	const TriangleMesh& crownFlowersMeshes = tree.flowers;
+	const TreeBudgetReport& budget = tree.budget;
+	const TreeGenerationStatistics& passes = tree.statistics;
+
+	fs::path objPath = fs::path{ output }.replace_extension(".obj");
+	fs::path statisticsPath = fs::path{ output }.replace_extension(".json");
+
+	FILE* objFile = fopen(objPath.string().c_str(), "w");
+	if (!objFile)
+	{
+		printf("Could not write %s\r\n", objPath.string().c_str());
+		return false;
+	}
+	size_t vertexOffset = 0;
+	WriteOBJObject(objFile, "branches", branchMeshes, vertexOffset);
+	WriteOBJObject(objFile, "leaves", crownLeavesMeshes, vertexOffset);
+	WriteOBJObject(objFile, "flowers", crownFlowersMeshes, vertexOffset);
+	fclose(objFile);
+
+	FILE* statisticsFile = fopen(statisticsPath.string().c_str(), "w");
+	if (!statisticsFile)
+	{
+		printf("Could not write %s\r\n", statisticsPath.string().c_str());
+		return false;
+	}
+	fprintf(statisticsFile, "{\n");
+	fprintf(statisticsFile, "\t\"iterations\": %d,\n\t\"subdivisions\": %d,\n\t\"seed\": %llu,\n", tree.request.iterations, tree.request.subdivisions, (unsigned long long)(tree.request.seed));
+	fprintf(statisticsFile, "\t\"generationMilliseconds\": %.3f,\n\t\"fromCache\": %s,\n", tree.milliseconds, tree.fromCache ? "true" : "false");
+	fprintf(statisticsFile, "\t\"meshes\": {\n");
+	WriteMeshStatistics(statisticsFile, "branches", branchMeshes);
+	WriteMeshStatistics(statisticsFile, "leaves", crownLeavesMeshes);
+	WriteMeshStatistics(statisticsFile, "flowers", crownFlowersMeshes, true);
+	fprintf(statisticsFile, "\t},\n");
+	fprintf(statisticsFile, "\t\"budget\": { \"detail\": %f, \"minBranchThickness\": %f, \"leafDensity\": %f, \"flowerRate\": %f, \"triangles\": %zu, \"bytes\": %zu, \"withinBudget\": %s },\n",
+		budget.detail, budget.minBranchThickness, budget.leafDensity, budget.flowerRate, budget.triangles, budget.bytes, budget.withinBudget ? "true" : "false");
+
+	// Zero for the passes that did not run and for cached trees
+	fprintf(statisticsFile, "\t\"passes\": {\n");
+	fprintf(statisticsFile, "\t\t\"leafPruning\": { \"leavesBefore\": %zu, \"leavesRemoved\": %zu },\n", passes.leafPruning.leavesBefore, passes.leafPruning.leavesRemoved);
+	fprintf(statisticsFile, "\t\t\"junctions\": { \"buriedTriangles\": %zu, \"weldedVertices\": %zu, \"degenerateTriangles\": %zu },\n",
+		passes.buriedTriangles, passes.weld.verticesBefore - passes.weld.verticesAfter, passes.weld.trianglesRemoved);
+	fprintf(statisticsFile, "\t\t\"simplification\": { \"trianglesBefore\": %zu, \"trianglesAfter\": %zu, \"maxError\": %f },\n",
+		passes.branchSimplification.trianglesBefore, passes.branchSimplification.trianglesAfter, passes.branchSimplification.maxError);
+	fprintf(statisticsFile, "\t\t\"acmr\": { \"branches\": [%f, %f], \"leaves\": [%f, %f], \"flowers\": [%f, %f] },\n",
+		passes.vertexCache[0].acmrBefore, passes.vertexCache[0].acmrAfter, passes.vertexCache[1].acmrBefore, passes.vertexCache[1].acmrAfter,
+		passes.vertexCache[2].acmrBefore, passes.vertexCache[2].acmrAfter);
+	fprintf(statisticsFile, "\t\t\"chunks\": %d,\n\t\t\"peakStageBytes\": %zu,\n\t\t\"reusedStages\": [", passes.chunks, passes.peakStageBytes);
+	for (size_t s = 0; s < passes.reusedStages.size(); s++)
+	{
+		fprintf(statisticsFile, "%s\"%s\"", (s > 0) ? ", " : "", passes.reusedStages[s]);
+	}
+	fprintf(statisticsFile, "]\n\t}\n");
+	fprintf(statisticsFile, "}\n");
+	fclose(statisticsFile);
+	return true;
+}
+
+// One job per line, empty lines and lines starting with # are skipped
+static bool ReadBatchJobs(const fs::path& path, std::vector<TreeBatchJob>& jobs)
+{
+	FILE* file = fopen(path.string().c_str(), "r");
+	if (!file)
+	{
+		printf("Could not read %s\r\n", path.string().c_str());
+		return false;
+	}
+
+	char line[256];
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		lineNumber++;
+		unsigned long long seed;
+		char style[32];
+		int flowers = 1;
+		TreeBatchJob job;
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') continue;
+		if (sscanf(line, "%llu %31s %d %d %d", &seed, style, &job.iterations, &job.subdivisions, &flowers) < 4 || (strcmp(style, "default") != 0 && strcmp(style, "slim") != 0))
+		{
+			printf("%s:%d: expected seed style iterations subdivisions [flowers]\r\n", path.string().c_str(), lineNumber);
+			fclose(file);
+			return false;
+		}
+		job.seed = seed;
+		job.style = (strcmp(style, "slim") == 0) ? TreeStyle::Slim : TreeStyle::Default;
+		job.showFlowers = (flowers != 0);
+		jobs.push_back(job);
+	}
+	fclose(file);
+	return true;
+}
+
+static int RunBatch(const TreegenArguments& arguments, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh, TreeCache* cache)
+{
+	std::vector<TreeBatchJob> jobs;
+	if (!ReadBatchJobs(arguments.batchFile, jobs)) return 1;
+
+	TreeBatchSettings settings;
+	settings.request.options = arguments.options;
+	settings.request.buildBVH = false;
+	settings.threadCount = arguments.threads;
+	settings.memoryByteCap = arguments.memoryMegabytes << 20;
+
+	bool written = true;
+	TreeBatchStatistics statistics = GenerateTreeBatch(jobs, settings, leafMesh, flowerMesh, [&](size_t job, TreeGenerationResult& tree)
+	{
+		written = WriteTree(fs::path{ arguments.output }.concat("_" + std::to_string(job)), tree) && written;
+	}, cache);
+
+	printf("\r\n%zu trees (%zu from the cache) and %zu triangles in %.2f s: %.1f trees/s, %.0f triangles/s, at most %zu MB held\r\n",
+		statistics.trees, statistics.cachedTrees, statistics.triangles, statistics.seconds, statistics.TreesPerSecond(), statistics.TrianglesPerSecond(), statistics.peakMemoryBytes >> 20);
+	double generatedTrees = double(statistics.trees - statistics.cachedTrees);
+	for (auto& time : statistics.stageTimes)
+	{
+		printf("    %-18s %10.1f ms total, %8.2f ms per tree\r\n", time.stage, time.milliseconds, time.milliseconds / generatedTrees);
+	}
+	return written ? 0 : 1;
+}
+
+// Flat shaded orthographic front view of the meshes, fitted to the image
+static void RenderThumbnail(const TreeGenerationResult& tree, Image& image)
+{
+	std::vector<const TriangleMesh*> meshes{ &tree.branches, &tree.leaves, &tree.flowers };
+	const glm::fvec3 colors[] = { { 0.45f, 0.3f, 0.2f }, { 0.3f, 0.6f, 0.2f }, { 0.95f, 0.7f, 0.8f } };
+
+	glm::fvec3 minBounds{ FLT_MAX }, maxBounds{ -FLT_MAX };
+	for (auto mesh : meshes)
+	{
+		for (auto& p : mesh->positions)
+		{
+			minBounds = glm::min(minBounds, p);
+			maxBounds = glm::max(maxBounds, p);
+		}
+	}
+	Color background{ 255, 255, 255, 255 };
+	image.Fill(background);
+	if (minBounds.x > maxBounds.x) return;
+
+	// Fit the larger of the width and the height with a small margin, x goes right and y up
+	float extent = std::max(maxBounds.x - minBounds.x, maxBounds.y - minBounds.y) * 1.05f;
+	float scale = float(std::min(image.width, image.height)) / std::max(extent, 1e-6f);
+	glm::fvec2 center{ (minBounds.x + maxBounds.x) * 0.5f, (minBounds.y + maxBounds.y) * 0.5f };
+	auto project = [&](glm::fvec3 p)
+	{
+		return glm::fvec3{ (p.x - center.x) * scale + image.width * 0.5f, image.height * 0.5f - (p.y - center.y) * scale, p.z };
+	};
+
+	std::vector<float> depth(size_t(image.numPixels), -FLT_MAX);
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const TriangleMesh& mesh = *meshes[m];
+		auto drawTriangles = [&](size_t firstIndex, size_t indexCount, size_t baseVertex)
+		{
+			for (size_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3)
+			{
+				glm::fvec3 p0 = mesh.positions[baseVertex + mesh.indices[i]];
+				glm::fvec3 p1 = mesh.positions[baseVertex + mesh.indices[i + 1]];
+				glm::fvec3 p2 = mesh.positions[baseVertex + mesh.indices[i + 2]];
+				glm::fvec3 normal = glm::cross(p1 - p0, p2 - p0);
+				float length = glm::length(normal);
+				float light = 0.35f + 0.65f * ((length > 0.0f) ? fabs(glm::dot(normal / length, glm::normalize(glm::fvec3{ 0.3f, 0.6f, 1.0f }))) : 1.0f);
+				glm::fvec3 shade = colors[m] * light;
+
+				glm::fvec3 a = project(p0), b = project(p1), c = project(p2);
+				float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+				if (area == 0.0f) continue;
+				int x0 = std::max(int(floor(std::min({ a.x, b.x, c.x }))), 0), x1 = std::min(int(ceil(std::max({ a.x, b.x, c.x }))), image.width - 1);
+				int y0 = std::max(int(floor(std::min({ a.y, b.y, c.y }))), 0), y1 = std::min(int(ceil(std::max({ a.y, b.y, c.y }))), image.height - 1);
+				for (int y = y0; y <= y1; y++)
+				{
+					for (int x = x0; x <= x1; x++)
+					{
+						float px = x + 0.5f, py = y + 0.5f;
+						float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) / area;
+						float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) / area;
+						float w2 = 1.0f - w0 - w1;
+						if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+						float z = w0 * a.z + w1 * b.z + w2 * c.z;
+						size_t pixel = size_t(y) * image.width + x;
+						if (z <= depth[pixel]) continue;
+						depth[pixel] = z;
+						image.SetPixel(unsigned(x), unsigned(y), double(shade.r), double(shade.g), double(shade.b), 1.0);
+					}
+				}
+			}
+		};
+		if (mesh.chunks.empty())
+		{
+			drawTriangles(0, mesh.indices.size(), 0);
+		}
+		for (auto& chunk : mesh.chunks)
+		{
+			drawTriangles(chunk.firstIndex, chunk.indexCount, chunk.baseVertex);
+		}
+	}
+}
+
+struct SweepRow
+{
+	size_t point = 0;
+	TreeBatchJob job;
+	size_t bones = 0;
+	size_t branches = 0;
+	size_t vertices[3] = {};	// branches, leaves, flowers
+	size_t triangles[3] = {};
+	size_t cpuBytes = 0;
+	size_t workingBytes = 0;	// see TreeWorkingBytes
+	size_t gpuBytes = 0;
+	double milliseconds = 0.0;
+	bool fromCache = false;
+	std::vector<TreeStageTime> stageTimes;
+};
+
+static int RunSweep(const TreegenArguments& arguments, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh, TreeCache* cache)
+{
+	TreeSweepGrid grid = arguments.sweepGrid;
+	grid.firstSeed = arguments.seed;
+	grid.showFlowers = arguments.flowers;
+	std::vector<size_t> points = grid.ShardPoints(arguments.shard, arguments.shardCount);
+	std::vector<TreeBatchJob> jobs;
+	for (size_t point : points)
+	{
+		jobs.push_back(grid.Point(point));
+	}
+	printf("Sweeping %zu of %zu points (shard %d/%d)\r\n", points.size(), grid.PointCount(), arguments.shard, arguments.shardCount);
+
+	TreeBatchSettings settings;
+	settings.request.options = arguments.options;
+	settings.request.buildBVH = false;
+	settings.threadCount = arguments.threads;
+	settings.memoryByteCap = arguments.memoryMegabytes << 20;
+
+	std::vector<SweepRow> rows(jobs.size());
+	std::vector<const char*> stages; // columns, in the order they first appear
+	bool written = true;
+	TreeBatchStatistics statistics = GenerateTreeBatch(jobs, settings, leafMesh, flowerMesh, [&](size_t job, TreeGenerationResult& tree)
+	{
+		SweepRow& row = rows[job];
+		row.point = points[job];
+		row.job = jobs[job];
+		row.bones = tree.budget.bones;
+		row.branches = tree.budget.branches;
+		const TriangleMesh* meshes[] = { &tree.branches, &tree.leaves, &tree.flowers };
+		for (int m = 0; m < 3; m++)
+		{
+			row.vertices[m] = meshes[m]->positions.size();
+			row.triangles[m] = meshes[m]->indices.size() / 3;
+		}
+		row.cpuBytes = TreeResultBytes(tree);
+		row.workingBytes = TreeWorkingBytes(tree);
+		row.gpuBytes = tree.budget.bytes;
+		row.milliseconds = tree.milliseconds;
+		row.fromCache = tree.fromCache;
+		row.stageTimes = tree.stageTimes;
+		for (auto& time : tree.stageTimes)
+		{
+			if (std::none_of(stages.begin(), stages.end(), [&](const char* stage) { return strcmp(stage, time.stage) == 0; })) stages.push_back(time.stage);
+		}
+
+		if (arguments.thumbnailSize > 0)
+		{
+			Image thumbnail{ arguments.thumbnailSize, arguments.thumbnailSize };
+			RenderThumbnail(tree, thumbnail);
+			thumbnail.SaveAsPNG(fs::path{ arguments.output }.concat("_" + std::to_string(row.point) + ".png"));
+		}
+	}, cache);
+
+	auto stageMilliseconds = [](const SweepRow& row, const char* stage)
+	{
+		for (auto& time : row.stageTimes)
+		{
+			if (strcmp(time.stage, stage) == 0) return time.milliseconds;
+		}
+		return 0.0;
+	};
+
+	fs::path csvPath = fs::path{ arguments.output }.replace_extension(".csv");
+	FILE* csvFile = fopen(csvPath.string().c_str(), "w");
+	if (csvFile)
+	{
+		fprintf(csvFile, "point,style,iterations,subdivisions,seed,flowers,bones,branches,branchVertices,branchTriangles,leafVertices,leafTriangles,flowerVertices,flowerTriangles,cpuBytes,workingBytes,gpuBytes,milliseconds,fromCache");
+		for (auto stage : stages) fprintf(csvFile, ",%s ms", stage);
+		fprintf(csvFile, "\n");
+		for (auto& row : rows)
+		{
+			fprintf(csvFile, "%zu,%s,%d,%d,%llu,%d,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%zu,%.3f,%d", row.point, (row.job.style == TreeStyle::Slim) ? "slim" : "default",
+				row.job.iterations, row.job.subdivisions, (unsigned long long)(row.job.seed), row.job.showFlowers ? 1 : 0, row.bones, row.branches,
+				row.vertices[0], row.triangles[0], row.vertices[1], row.triangles[1], row.vertices[2], row.triangles[2], row.cpuBytes, row.workingBytes, row.gpuBytes, row.milliseconds, row.fromCache ? 1 : 0);
+			for (auto stage : stages) fprintf(csvFile, ",%.3f", stageMilliseconds(row, stage));
+			fprintf(csvFile, "\n");
+		}
+		fclose(csvFile);
+	}
+	else
+	{
+		printf("Could not write %s\r\n", csvPath.string().c_str());
+		written = false;
+	}
+
+	fs::path jsonPath = fs::path{ arguments.output }.replace_extension(".json");
+	FILE* jsonFile = fopen(jsonPath.string().c_str(), "w");
+	if (jsonFile)
+	{
+		fprintf(jsonFile, "{\n\t\"shard\": %d,\n\t\"shardCount\": %d,\n\t\"gridPoints\": %zu,\n", arguments.shard, arguments.shardCount, grid.PointCount());
+		fprintf(jsonFile, "\t\"seconds\": %.3f,\n\t\"treesPerSecond\": %.3f,\n\t\"trianglesPerSecond\": %.1f,\n\t\"peakMemoryBytes\": %zu,\n",
+			statistics.seconds, statistics.TreesPerSecond(), statistics.TrianglesPerSecond(), statistics.peakMemoryBytes);
+		fprintf(jsonFile, "\t\"points\": [\n");
+		for (size_t r = 0; r < rows.size(); r++)
+		{
+			const SweepRow& row = rows[r];
+			fprintf(jsonFile, "\t\t{ \"point\": %zu, \"style\": \"%s\", \"iterations\": %d, \"subdivisions\": %d, \"seed\": %llu, \"flowers\": %s, \"bones\": %zu, \"branches\": %zu,\n",
+				row.point, (row.job.style == TreeStyle::Slim) ? "slim" : "default", row.job.iterations, row.job.subdivisions, (unsigned long long)(row.job.seed),
+				row.job.showFlowers ? "true" : "false", row.bones, row.branches);
+			fprintf(jsonFile, "\t\t  \"meshes\": { \"branches\": { \"vertices\": %zu, \"triangles\": %zu }, \"leaves\": { \"vertices\": %zu, \"triangles\": %zu }, \"flowers\": { \"vertices\": %zu, \"triangles\": %zu } },\n",
+				row.vertices[0], row.triangles[0], row.vertices[1], row.triangles[1], row.vertices[2], row.triangles[2]);
+			fprintf(jsonFile, "\t\t  \"cpuBytes\": %zu, \"workingBytes\": %zu, \"gpuBytes\": %zu, \"milliseconds\": %.3f, \"fromCache\": %s, \"stageMilliseconds\": {",
+				row.cpuBytes, row.workingBytes, row.gpuBytes, row.milliseconds, row.fromCache ? "true" : "false");
+			for (size_t t = 0; t < row.stageTimes.size(); t++)
+			{
+				fprintf(jsonFile, "%s \"%s\": %.3f", (t > 0) ? "," : "", row.stageTimes[t].stage, row.stageTimes[t].milliseconds);
+			}
+			fprintf(jsonFile, " } }%s\n", (r + 1 < rows.size()) ? "," : "");
+		}
+		fprintf(jsonFile, "\t]\n}\n");
+		fclose(jsonFile);
+	}
+	else
+	{
+		printf("Could not write %s\r\n", jsonPath.string().c_str());
+		written = false;
+	}
+
+	printf("\r\n%zu points in %.2f s: %.1f trees/s, %.0f triangles/s, at most %zu MB held, written to %s and %s\r\n", statistics.trees, statistics.seconds,
+		statistics.TreesPerSecond(), statistics.TrianglesPerSecond(), statistics.peakMemoryBytes >> 20, csvPath.string().c_str(), jsonPath.string().c_str());
+	return written ? 0 : 1;
+}
+
+static TreeGenerationService* runningService = nullptr;
+
+static int RunService(const TreegenArguments& arguments, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh)
+{
+	TreeServiceSettings settings;
+	settings.socketPath = arguments.socketPath;
+	settings.defaults.options = arguments.options;
+	settings.defaults.showFlowers = arguments.flowers;
+	settings.threadCount = arguments.threads;
+	settings.cacheBytes = arguments.memoryMegabytes << 20;
+	settings.cacheFolder = arguments.cacheFolder;
+
+	TreeGenerationService service{ settings, leafMesh, flowerMesh };
+	runningService = &service;
+	signal(SIGINT, [](int) { if (runningService) runningService->Stop(); });
+	signal(SIGTERM, [](int) { if (runningService) runningService->Stop(); });
+
+	printf("Serving on %s, Ctrl+C or a shutdown request stops\r\n", settings.socketPath.c_str());
+	bool served = service.Run();
+	runningService = nullptr;
+	if (!served)
+	{
+		printf("Could not listen on %s\r\n", settings.socketPath.c_str());
+		return 1;
+	}
+	printf("Stopped: %s\r\n", service.Metrics().JSON().c_str());
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	TreegenArguments arguments;
+	if (!ParseArguments(argc, argv, arguments))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	Image leafImage{ 128, 128 }, flowerImage{ 128, 128 };
+	TriangleMesh leafMesh, flowerMesh;
+	GenerateLeaf(leafImage, leafMesh);
+	GenerateFlower(flowerImage, flowerMesh);
+	if (arguments.textures)
+	{
+		leafImage.SaveAsPNG(fs::path{ arguments.output }.concat("_leaf.png"));
+		flowerImage.SaveAsPNG(fs::path{ arguments.output }.concat("_flower.png"));
+	}
+
+	if (!arguments.socketPath.empty())
+	{
+		return RunService(arguments, leafMesh, flowerMesh);
+	}
+
+	std::unique_ptr<TreeCache> cache = arguments.cacheFolder.empty() ? nullptr : std::make_unique<TreeCache>(0, arguments.cacheFolder); // only the disk store
+	if (!arguments.batchFile.empty())
+	{
+		return RunBatch(arguments, leafMesh, flowerMesh, cache.get());
+	}
+	if (arguments.sweep)
+	{
+		return RunSweep(arguments, leafMesh, flowerMesh, cache.get());
+	}
+
+	TreeGenerationRequest request;
+	request.seed = arguments.seed;
+	request.iterations = arguments.iterations;
+	request.subdivisions = arguments.subdivisions;
+	request.showFlowers = arguments.flowers;
+	request.options = arguments.options;
+	request.buildBVH = false;
+
+	TreeGenerator generator{ leafMesh, flowerMesh, cache.get() };
+	std::unique_ptr<TreeGenerationResult> tree = generator.Generate(request);
+	printf("\r\n");
+	if (!WriteTree(arguments.output, *tree)) return 1;
+
+	printf("Wrote %s and %s (%zu triangles, %.1f ms)\r\n", fs::path{ arguments.output }.replace_extension(".obj").string().c_str(),
+		fs::path{ arguments.output }.replace_extension(".json").string().c_str(), tree->budget.triangles, tree->milliseconds);
+	return 0;
+}
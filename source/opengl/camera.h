@@ -2,6 +2,59 @@
 #include "../core/math.h"
 #include "../core/application.h"
 
+// Clip space planes extracted from a view projection matrix (Gribb & Hartmann).
+// Plane normals point into the frustum.
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	Frustum(const glm::mat4& viewProjection)
+	{
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+		}
+
+		planes[0] = rows[3] + rows[0]; // left
+		planes[1] = rows[3] - rows[0]; // right
+		planes[2] = rows[3] + rows[1]; // bottom
+		planes[3] = rows[3] - rows[1]; // top
+		planes[4] = rows[3] + rows[2]; // near
+		planes[5] = rows[3] - rows[2]; // far
+	}
+
+	// Conservative test, boxes near the frustum corners may pass
+	bool IntersectsBox(const glm::vec3& minBounds, const glm::vec3& maxBounds) const
+	{
+		for (auto& plane : planes)
+		{
+			glm::vec3 positiveCorner{
+				(plane.x >= 0.0f) ? maxBounds.x : minBounds.x,
+				(plane.y >= 0.0f) ? maxBounds.y : minBounds.y,
+				(plane.z >= 0.0f) ? maxBounds.z : minBounds.z
+			};
+			if (glm::dot(glm::vec3(plane), positiveCorner) + plane.w < 0.0f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool IntersectsSphere(const glm::vec3& center, float radius) const
+	{
+		for (auto& plane : planes)
+		{
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius * glm::length(glm::vec3(plane)))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
 // This camera uses a position and a focus point to determine orientation.
 // The getters and setters are used to ensure that the internals update.
 class Camera
@@ -1,16 +1,38 @@
 #include "mesh.h"
 #include "../core/application.h"
+#include "camera.h"
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include "glm/gtx/euler_angles.hpp"
+#include "glm/gtc/packing.hpp"
 
 #include <string>
 #include <iostream>
+#include <cstring>
+#include <algorithm>
 
 const GLuint positionAttribId = 0;
 const GLuint normalAttribId = 1;
 const GLuint colorAttribId = 2;
 const GLuint texCoordAttribId = 3;
+const GLuint octNormalAttribId = 4;	// packed layouts only, w is 1 when the attribute is in use
+const GLuint originAttribId = 5;	// constant attribute added to the position in the shaders
+
+// Octahedral normal encoding, maps the unit sphere onto the [-1, 1] square
+glm::fvec2 OctahedralEncode(glm::fvec3 n)
+{
+	float l1 = fabs(n.x) + fabs(n.y) + fabs(n.z);
+	if (l1 == 0.0f) return glm::fvec2{ 0.0f };
+
+	n /= l1;
+	glm::fvec2 p{ n.x, n.y };
+	if (n.z < 0.0f)
+	{
+		glm::fvec2 signs{ (p.x >= 0.0f) ? 1.0f : -1.0f, (p.y >= 0.0f) ? 1.0f : -1.0f };
+		p = (1.0f - glm::abs(glm::fvec2{ p.y, p.x })) * signs;
+	}
+	return p;
+}
 
 glm::mat4 MeshTransform::ModelMatrix()
 {
@@ -40,18 +62,38 @@ GLMeshInterface::~GLMeshInterface()
 
 
 
-GLTriangleMesh::GLTriangleMesh(bool allocate)
+GLTriangleMesh::GLTriangleMesh()
 {
-	allocated = allocate;
-	if (!allocated) return;
-
 	glBindVertexArray(vao);
 
 	glGenBuffers(1, &positionBuffer);
 	glGenBuffers(1, &normalBuffer);
 	glGenBuffers(1, &colorBuffer);
 	glGenBuffers(1, &texCoordBuffer);
+	glGenBuffers(1, &interleavedBuffer);
 	glGenBuffers(1, &indexBuffer);
+	glGenBuffers(1, &streamIndexBuffer);
+
+	BindSeparateAttributes();
+
+	// Index buffer
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+}
+
+GLTriangleMesh::~GLTriangleMesh()
+{
+	glDeleteBuffers(1, &positionBuffer);
+	glDeleteBuffers(1, &normalBuffer);
+	glDeleteBuffers(1, &colorBuffer);
+	glDeleteBuffers(1, &texCoordBuffer);
+	glDeleteBuffers(1, &interleavedBuffer);
+	glDeleteBuffers(1, &indexBuffer);
+	glDeleteBuffers(1, &streamIndexBuffer);
+}
+
+void GLTriangleMesh::BindSeparateAttributes()
+{
+	glBindVertexArray(vao);
 
 	// Position buffer
 	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
@@ -62,6 +104,7 @@ GLTriangleMesh::GLTriangleMesh(bool allocate)
 	glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
 	glEnableVertexAttribArray(normalAttribId);
 	glVertexAttribPointer(normalAttribId, 3, GL_FLOAT, false, 0, 0);
+	glDisableVertexAttribArray(octNormalAttribId);
 
 	// Color buffer
 	glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
@@ -72,42 +115,33 @@ GLTriangleMesh::GLTriangleMesh(bool allocate)
 	glBindBuffer(GL_ARRAY_BUFFER, texCoordBuffer);
 	glEnableVertexAttribArray(texCoordAttribId);
 	glVertexAttribPointer(texCoordAttribId, 4, GL_FLOAT, false, 0, 0);
-
-	// Index buffer
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-}
-
-GLTriangleMesh::~GLTriangleMesh()
-{
-	if (!allocated) return;
-
-	glDeleteBuffers(1, &positionBuffer);
-	glDeleteBuffers(1, &normalBuffer);
-	glDeleteBuffers(1, &colorBuffer);
-	glDeleteBuffers(1, &texCoordBuffer);
-	glDeleteBuffers(1, &indexBuffer);
 }
 
 void GLTriangleMesh::Clear()
 {
-	positions.clear();
-	normals.clear();
-	colors.clear();
-	texCoords.clear();
-	indices.clear();
-
-	positions.shrink_to_fit();
-	normals.shrink_to_fit();
-	colors.shrink_to_fit();
-	texCoords.shrink_to_fit();
-	indices.shrink_to_fit();
-
+	TriangleMesh::Clear();
 	SendToGPU();
 }
 
 void GLTriangleMesh::SendToGPU()
 {
-	if (!allocated) return;
+	if (vertexLayout != VertexLayout::Separate)
+	{
+		SendPackedToGPU();
+		return;
+	}
+
+	if (uploadedLayout != VertexLayout::Separate)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, interleavedBuffer);
+		glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+		BindSeparateAttributes();
+	}
+	uploadedLayout = VertexLayout::Separate;
+	vertexOrigin = glm::fvec3{ 0.0f };
+	constantColor = false;
+	uploadedBytes = positions.size()*(2*sizeof(glm::fvec3) + 2*sizeof(glm::fvec4));
+	vertexCapacity = positions.size();
 
 	glBindVertexArray(vao);
 	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
@@ -122,95 +156,372 @@ void GLTriangleMesh::SendToGPU()
 	glBindBuffer(GL_ARRAY_BUFFER, texCoordBuffer);
 	glBufferVector(GL_ARRAY_BUFFER, texCoords, GL_STATIC_DRAW);
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-	glBufferVector(GL_ELEMENT_ARRAY_BUFFER, indices, GL_STATIC_DRAW);
+	SendIndicesToGPU();
 }
 
-void GLTriangleMesh::Draw()
+void GLTriangleMesh::SendToGPU(TriangleMesh mesh)
 {
-	if (allocated && positions.size() > 0 && indices.size() > 0)
+	TriangleMesh::operator=(std::move(mesh));
+	SendToGPU();
+}
+
+void GLTriangleMesh::Reserve(size_t vertexCount, size_t indexCount)
+{
+	// Only the float streams can be appended to
+	if (uploadedLayout != VertexLayout::Separate || vertexLayout != VertexLayout::Separate)
 	{
-		glBindVertexArray(vao);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
-		glDrawElements(GL_TRIANGLES, GLsizei(indices.size()), GL_UNSIGNED_INT, (void*)0);
+		vertexLayout = VertexLayout::Separate;
+		SendToGPU();
+	}
+
+	// Reallocates a buffer and copies the CPU side data back in
+	auto reallocate = [](GLenum bufferType, GLuint buffer, const auto& data, size_t capacity)
+	{
+		size_t elementSize = sizeof(data[0]);
+		glBindBuffer(bufferType, buffer);
+		glBufferData(bufferType, capacity*elementSize, NULL, GL_DYNAMIC_DRAW);
+		if (!data.empty()) glBufferSubData(bufferType, 0, data.size()*elementSize, data.data());
+	};
+
+	glBindVertexArray(vao);
+	if (vertexCount > vertexCapacity)
+	{
+		vertexCapacity = vertexCount;
+		reallocate(GL_ARRAY_BUFFER, positionBuffer, positions, vertexCapacity);
+		reallocate(GL_ARRAY_BUFFER, normalBuffer, normals, vertexCapacity);
+		reallocate(GL_ARRAY_BUFFER, colorBuffer, colors, vertexCapacity);
+		reallocate(GL_ARRAY_BUFFER, texCoordBuffer, texCoords, vertexCapacity);
+	}
+	if (indexCount > indexCapacity)
+	{
+		indexCapacity = indexCount;
+		reallocate(GL_ELEMENT_ARRAY_BUFFER, indexBuffer, indices, indexCapacity);
 	}
 }
 
-void GLTriangleMesh::AddVertex(glm::fvec3 pos, glm::fvec4 color, glm::fvec4 texcoord)
+void GLTriangleMesh::AppendVertices(const TriangleMesh& source, size_t first, size_t count)
 {
-	positions.push_back(std::move(pos));
-	normals.push_back(glm::fvec3{ 0.0f });
-	colors.push_back(std::move(color));
-	texCoords.push_back(std::move(texcoord));
+	if (count == 0) return;
+
+	size_t offset = positions.size();
+	if (offset + count > vertexCapacity)
+	{
+		Reserve(glm::max(2*vertexCapacity, offset + count), indexCapacity);
+	}
+
+	positions.insert(positions.end(), source.positions.begin() + first, source.positions.begin() + first + count);
+	normals.insert(normals.end(), source.normals.begin() + first, source.normals.begin() + first + count);
+	colors.insert(colors.end(), source.colors.begin() + first, source.colors.begin() + first + count);
+	texCoords.insert(texCoords.end(), source.texCoords.begin() + first, source.texCoords.begin() + first + count);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, positionBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, offset*sizeof(glm::fvec3), count*sizeof(glm::fvec3), &positions[offset]);
+	glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, offset*sizeof(glm::fvec3), count*sizeof(glm::fvec3), &normals[offset]);
+	glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, offset*sizeof(glm::fvec4), count*sizeof(glm::fvec4), &colors[offset]);
+	glBindBuffer(GL_ARRAY_BUFFER, texCoordBuffer);
+	glBufferSubData(GL_ARRAY_BUFFER, offset*sizeof(glm::fvec4), count*sizeof(glm::fvec4), &texCoords[offset]);
+	uploadedBytes += count*(2*sizeof(glm::fvec3) + 2*sizeof(glm::fvec4));
 }
 
-void GLTriangleMesh::AddVertex(glm::fvec3 pos, glm::fvec3 normal, glm::fvec4 color, glm::fvec4 texcoord)
+void GLTriangleMesh::AppendIndices(const std::vector<unsigned int>& source, size_t first, size_t count)
 {
-	positions.push_back(std::move(pos));
-	normals.push_back(std::move(normal));
-	colors.push_back(std::move(color));
-	texCoords.push_back(std::move(texcoord));
+	if (count == 0) return;
+
+	size_t offset = indices.size();
+	if (offset + count > indexCapacity)
+	{
+		Reserve(vertexCapacity, glm::max(2*indexCapacity, offset + count));
+	}
+
+	indices.insert(indices.end(), source.begin() + first, source.begin() + first + count);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset*sizeof(unsigned int), count*sizeof(unsigned int), &indices[offset]);
+	uploadedBytes += count*sizeof(unsigned int);
 }
 
-void GLTriangleMesh::DefineNewTriangle(unsigned int index1, unsigned int index2, unsigned int index3)
+void GLTriangleMesh::SendIndicesToGPU()
 {
-	indices.push_back(index1);
-	indices.push_back(index2);
-	indices.push_back(index3);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	indexCapacity = 0;
+	if (chunks.empty())
+	{
+		glBufferVector(GL_ELEMENT_ARRAY_BUFFER, indices, GL_STATIC_DRAW);
+		uploadedBytes += indices.size()*sizeof(unsigned int);
+		indexCapacity = indices.size();
+	}
+	else
+	{
+		std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+		glBufferVector(GL_ELEMENT_ARRAY_BUFFER, shortIndices, GL_STATIC_DRAW);
+		uploadedBytes += shortIndices.size()*sizeof(uint16_t);
+	}
 }
 
-void GLTriangleMesh::AppendMesh(const GLTriangleMesh& other)
+void GLTriangleMesh::SendPackedToGPU()
 {
-	// These two values are used to re-calculate the indices of the other mesh
-	// after it has been appended.
-	int newIndicesOffset = int(positions.size());
-	int newIndicesStart = int(indices.size());
+	bool halfPositions = (vertexLayout == VertexLayout::PackedHalf);
+
+	// Positions are stored relative to the center of the bounds to make the most of half precision.
+	// A chunked mesh uses the origin of each chunk instead, see SetChunkOrigin.
+	glm::fvec3 minBounds{ 0.0f }, maxBounds{ 0.0f };
+	if (positions.size() > 0)
+	{
+		minBounds = maxBounds = positions[0];
+	}
+	for (auto& p : positions)
+	{
+		minBounds = glm::min(minBounds, p);
+		maxBounds = glm::max(maxBounds, p);
+	}
+	vertexOrigin = halfPositions ? 0.5f*(minBounds + maxBounds) : glm::fvec3{ 0.0f };
 
-	positions.reserve(positions.size() + other.positions.size());
-	normals.reserve(normals.size() + other.normals.size());
-	colors.reserve(colors.size() + other.colors.size());
-	texCoords.reserve(texCoords.size() + other.texCoords.size());
-	indices.reserve(indices.size() + other.indices.size());
+	// A color shared by every vertex is sent as a constant attribute instead
+	constantColor = HasConstantColor();
+	vertexColor = (colors.size() > 0) ? colors[0] : glm::fvec4{ 1.0f };
 
-	positions.insert(positions.end(), other.positions.begin(), other.positions.end());
-	normals.insert(normals.end(), other.normals.begin(), other.normals.end());
-	colors.insert(colors.end(), other.colors.begin(), other.colors.end());
-	texCoords.insert(texCoords.end(), other.texCoords.begin(), other.texCoords.end());
-	indices.insert(indices.end(), other.indices.begin(), other.indices.end());
+	const size_t positionSize = halfPositions ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+	const size_t normalOffset = positionSize;
+	const size_t texCoordOffset = normalOffset + sizeof(uint32_t);
+	const size_t colorOffset = texCoordOffset + sizeof(uint32_t);
+	const size_t stride = colorOffset + (constantColor ? 0 : sizeof(uint32_t));
 
-	for (int i = newIndicesStart; i < indices.size(); ++i)
+	std::vector<glm::fvec3> origins;
+	if (halfPositions && !chunks.empty())
 	{
-		indices[i] += newIndicesOffset;
+		origins.resize(positions.size(), vertexOrigin);
+		for (auto& chunk : chunks)
+		{
+			std::fill(origins.begin() + chunk.baseVertex, origins.begin() + chunk.baseVertex + chunk.vertexCount, chunk.origin);
+		}
 	}
+
+	std::vector<unsigned char> vertexData(positions.size() * stride);
+	for (size_t i = 0; i < positions.size(); i++)
+	{
+		unsigned char* vertex = vertexData.data() + i*stride;
+
+		glm::fvec3 p = positions[i] - (origins.empty() ? vertexOrigin : origins[i]);
+		if (halfPositions)
+		{
+			uint32_t packed[2] = { glm::packHalf2x16(glm::fvec2{ p.x, p.y }), glm::packHalf2x16(glm::fvec2{ p.z, 0.0f }) };
+			memcpy(vertex, packed, sizeof(packed));
+		}
+		else
+		{
+			memcpy(vertex, &p[0], 3 * sizeof(float));
+		}
+
+		uint32_t normal = glm::packSnorm2x16(OctahedralEncode(normals[i]));
+		uint32_t texCoord = glm::packHalf2x16(glm::fvec2{ texCoords[i].x, texCoords[i].y });
+		memcpy(vertex + normalOffset, &normal, sizeof(uint32_t));
+		memcpy(vertex + texCoordOffset, &texCoord, sizeof(uint32_t));
+
+		if (!constantColor)
+		{
+			uint32_t color = glm::packUnorm4x8(colors[i]);
+			memcpy(vertex + colorOffset, &color, sizeof(uint32_t));
+		}
+	}
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, interleavedBuffer);
+	glBufferVector(GL_ARRAY_BUFFER, vertexData, GL_STATIC_DRAW);
+
+	GLsizei glStride = GLsizei(stride);
+	glEnableVertexAttribArray(positionAttribId);
+	glVertexAttribPointer(positionAttribId, 3, halfPositions ? GL_HALF_FLOAT : GL_FLOAT, false, glStride, (void*)0);
+
+	glDisableVertexAttribArray(normalAttribId);
+	glEnableVertexAttribArray(octNormalAttribId);
+	glVertexAttribPointer(octNormalAttribId, 2, GL_SHORT, true, glStride, (void*)normalOffset);
+
+	glEnableVertexAttribArray(texCoordAttribId);
+	glVertexAttribPointer(texCoordAttribId, 2, GL_HALF_FLOAT, false, glStride, (void*)texCoordOffset);
+
+	if (constantColor)
+	{
+		glDisableVertexAttribArray(colorAttribId);
+	}
+	else
+	{
+		glEnableVertexAttribArray(colorAttribId);
+		glVertexAttribPointer(colorAttribId, 4, GL_UNSIGNED_BYTE, true, glStride, (void*)colorOffset);
+	}
+
+	// Release the separate streams if they were used before
+	if (uploadedLayout == VertexLayout::Separate)
+	{
+		for (GLuint buffer : { positionBuffer, normalBuffer, colorBuffer, texCoordBuffer })
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, buffer);
+			glBufferData(GL_ARRAY_BUFFER, 0, NULL, GL_STATIC_DRAW);
+		}
+	}
+
+	uploadedLayout = vertexLayout;
+	uploadedBytes = vertexData.size();
+	vertexCapacity = 0;
+	SendIndicesToGPU();
 }
 
-void GLTriangleMesh::AppendMeshTransformed(const GLTriangleMesh & other, glm::mat4 transform)
+void GLTriangleMesh::Draw()
 {
-	int newPositionsStart = int(positions.size());
-	AppendMesh(other);
-	int newPositionsEnd = int(positions.size() - 1);
-	ApplyMatrix(transform, newPositionsStart, newPositionsEnd);
+	if (positions.size() > 0 && indices.size() > 0)
+	{
+		glBindVertexArray(vao);
+		SetConstantAttributes();
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		if (chunks.empty())
+		{
+			glDrawElements(GL_TRIANGLES, GLsizei(indices.size()), GL_UNSIGNED_INT, (void*)0);
+		}
+		else
+		{
+			for (auto& chunk : chunks)
+			{
+				SetChunkOrigin(chunk);
+				glDrawElementsBaseVertex(GL_TRIANGLES, GLsizei(chunk.indexCount), GL_UNSIGNED_SHORT, (void*)(chunk.firstIndex*sizeof(uint16_t)), GLint(chunk.baseVertex));
+			}
+		}
+	}
 }
 
-void GLTriangleMesh::ApplyMatrix(glm::mat4 transform, int firstIndex, int lastIndex)
+void GLTriangleMesh::DrawVisible(const Frustum& frustum, GLDrawStatistics& statistics)
 {
-	firstIndex = (firstIndex < 0)? 0 : firstIndex;
-	lastIndex = (lastIndex >= positions.size()) ? int(positions.size() - 1) : lastIndex;
+	if (positions.size() == 0 || indices.size() == 0) return;
+
+	if (chunks.empty())
+	{
+		Draw();
+		statistics.drawnChunks++;
+		statistics.drawnTriangles += indices.size() / 3;
+		return;
+	}
 
-	for (int i=firstIndex; i<=lastIndex; i++)
+	std::vector<GLsizei> counts;
+	std::vector<void*> offsets;
+	std::vector<GLint> baseVertices;
+	counts.reserve(chunks.size());
+	offsets.reserve(chunks.size());
+	baseVertices.reserve(chunks.size());
+	for (auto& chunk : chunks)
 	{
-		positions[i] = transform * glm::fvec4(positions[i], 1.0f);
-		normals[i] = transform * glm::fvec4(normals[i], 0.0f);
+		if (!frustum.IntersectsBox(chunk.minBounds, chunk.maxBounds))
+		{
+			statistics.culledChunks++;
+			continue;
+		}
+
+		counts.push_back(GLsizei(chunk.indexCount));
+		offsets.push_back((void*)(chunk.firstIndex*sizeof(uint16_t)));
+		baseVertices.push_back(GLint(chunk.baseVertex));
+		statistics.drawnChunks++;
+		statistics.drawnTriangles += chunk.indexCount / 3;
+	}
+
+	if (counts.empty()) return;
+
+	glBindVertexArray(vao);
+	SetConstantAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	if (uploadedLayout != VertexLayout::PackedHalf)
+	{
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_SHORT, offsets.data(), GLsizei(counts.size()), baseVertices.data());
+		return;
+	}
+
+	// Every chunk has its own origin for the half positions, which is a constant attribute between draws
+	for (auto& chunk : chunks)
+	{
+		if (!frustum.IntersectsBox(chunk.minBounds, chunk.maxBounds)) continue;
+		SetChunkOrigin(chunk);
+		glDrawElementsBaseVertex(GL_TRIANGLES, GLsizei(chunk.indexCount), GL_UNSIGNED_SHORT, (void*)(chunk.firstIndex*sizeof(uint16_t)), GLint(chunk.baseVertex));
 	}
 }
 
-void GLTriangleMesh::ApplyMatrix(glm::mat4 transform)
+void GLTriangleMesh::DrawIndices(const std::vector<unsigned int>& absoluteIndices)
 {
-	ApplyMatrix(transform, 0, int(positions.size() - 1));
+	if (positions.size() == 0 || absoluteIndices.empty()) return;
+
+	glBindVertexArray(vao);
+	SetConstantAttributes();
+
+	// The element buffer binding is part of the VAO, the regular index buffer is restored afterwards
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, streamIndexBuffer);
+	glBufferVector(GL_ELEMENT_ARRAY_BUFFER, absoluteIndices, GL_STREAM_DRAW);
+	if (uploadedLayout != VertexLayout::PackedHalf || chunks.empty())
+	{
+		glDrawElements(GL_TRIANGLES, GLsizei(absoluteIndices.size()), GL_UNSIGNED_INT, (void*)0);
+	}
+	else
+	{
+		// Half positions are relative to the origin of their chunk, so the list is drawn in runs of triangles from the same chunk.
+		// The chunks are in vertex order and a triangle never spans two of them.
+		auto chunkOf = [&](unsigned int vertex)
+		{
+			auto next = std::upper_bound(chunks.begin(), chunks.end(), vertex, [](unsigned int v, const MeshChunk& chunk) { return v < chunk.baseVertex; });
+			return size_t(next - chunks.begin()) - 1;
+		};
+		size_t runStart = 0;
+		size_t runChunk = chunkOf(absoluteIndices[0]);
+		for (size_t i = 3; i <= absoluteIndices.size(); i += 3)
+		{
+			size_t chunk = (i < absoluteIndices.size()) ? chunkOf(absoluteIndices[i]) : ~size_t(0);
+			if (chunk == runChunk) continue;
+
+			SetChunkOrigin(chunks[runChunk]);
+			glDrawElements(GL_TRIANGLES, GLsizei(i - runStart), GL_UNSIGNED_INT, (void*)(runStart*sizeof(unsigned int)));
+			runStart = i;
+			runChunk = chunk;
+		}
+	}
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
 }
 
+void GLTriangleMesh::DrawInstances(const std::vector<unsigned int>& order, unsigned int indicesPerInstance)
+{
+	if (positions.size() == 0 || indices.size() == 0 || !chunks.empty() || order.empty()) return;
+
+	std::vector<GLsizei> counts(order.size(), GLsizei(indicesPerInstance));
+	std::vector<void*> offsets(order.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		offsets[i] = (void*)(size_t(order[i]) * indicesPerInstance * sizeof(unsigned int));
+	}
 
+	glBindVertexArray(vao);
+	SetConstantAttributes();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, offsets.data(), GLsizei(order.size()));
+}
 
+void GLTriangleMesh::SetChunkOrigin(const MeshChunk& chunk)
+{
+	if (uploadedLayout == VertexLayout::PackedHalf)
+	{
+		glVertexAttrib3fv(originAttribId, &chunk.origin[0]);
+	}
+}
+
+void GLTriangleMesh::SetConstantAttributes()
+{
+	// Constant attributes are context state and must be set for every draw
+	glVertexAttrib3fv(originAttribId, &vertexOrigin[0]);
+	if (uploadedLayout == VertexLayout::Separate)
+	{
+		glVertexAttrib4f(octNormalAttribId, 0.0f, 0.0f, 0.0f, 0.0f);
+	}
+	if (constantColor)
+	{
+		glVertexAttrib4fv(colorAttribId, &vertexColor[0]);
+	}
+}
 
 GLLine::GLLine()
 {
@@ -239,19 +550,15 @@ GLLine::~GLLine()
 	glDeleteBuffers(1, &colorBuffer);
 }
 
-void GLLine::AddLine(glm::fvec3 start, glm::fvec3 end, glm::fvec4 color)
+void GLLine::Clear()
 {
-	lineSegments.push_back(GLLineSegment{ std::move(start), std::move(end) });
-	colors.push_back(color);
-	colors.push_back(std::move(color));
+	LineMesh::Clear();
+	SendToGPU();
 }
 
-void GLLine::Clear()
+void GLLine::SendToGPU(LineMesh lines)
 {
-	lineSegments.clear();
-	lineSegments.shrink_to_fit();
-	colors.clear();
-	colors.shrink_to_fit();
+	LineMesh::operator=(std::move(lines));
 	SendToGPU();
 }
 
@@ -2,6 +2,7 @@
 #include <vector>
 #include "glad/glad.h"
 #include "../core/math.h"
+#include "../core/meshdata.h"
 
 struct GLQuadProperties
 {
@@ -34,8 +35,8 @@ public:
 	~GLMeshInterface();
 
 	// Behaves like glBufferData, but for std::vector<T>.
-	template <class T>
-	void glBufferVector(GLenum glBufferType, const std::vector<T>& vector, GLenum usage = GL_STATIC_DRAW)
+	template <class T, class Allocator>
+	void glBufferVector(GLenum glBufferType, const std::vector<T, Allocator>& vector, GLenum usage = GL_STATIC_DRAW)
 	{
 		size_t count = vector.size();
 		float* frontPtr = (float*)((count > 0) ? &vector.front() : NULL);
@@ -43,63 +44,82 @@ public:
 	}
 };
 
-class GLTriangleMesh : public GLMeshInterface
+struct Frustum;
+
+// Counters for the chunks submitted by GLTriangleMesh::DrawVisible
+struct GLDrawStatistics
+{
+	int drawnChunks = 0;
+	int culledChunks = 0;
+	size_t drawnTriangles = 0;
+};
+
+// GPU buffers for the CPU side mesh it extends, the vertex data is uploaded by SendToGPU
+class GLTriangleMesh : public GLMeshInterface, public TriangleMesh
 {
 protected:
-	bool allocated = false;
 	GLuint positionBuffer = 0;
 	GLuint normalBuffer = 0;
 	GLuint colorBuffer = 0;
 	GLuint texCoordBuffer = 0;
+	GLuint interleavedBuffer = 0;
 	GLuint indexBuffer = 0;
+	GLuint streamIndexBuffer = 0; // per frame index lists, see DrawIndices
 
-public:
-	std::vector<glm::fvec3> positions;
-	std::vector<glm::fvec3> normals;
-	std::vector<glm::fvec4> colors;
-	std::vector<glm::fvec4> texCoords;
-	std::vector<unsigned int> indices;
+	// State of the last upload, the packed layouts need it when drawing
+	VertexLayout uploadedLayout = VertexLayout::Separate;
+	glm::fvec3 vertexOrigin{ 0.0f };
+	bool constantColor = false;
+	glm::fvec4 vertexColor{ 1.0f };
+	size_t uploadedBytes = 0;
+	size_t vertexCapacity = 0; // of the float streams
+	size_t indexCapacity = 0;
 
-	GLTriangleMesh(bool allocate = true);
+public:
+	GLTriangleMesh();
 	~GLTriangleMesh();
 
-	void Clear();
+	void Clear(); // also empties the GPU buffers
 	void SendToGPU();
+	void SendToGPU(TriangleMesh mesh); // replaces the CPU side data with mesh before uploading it, move in to avoid the copy
 	void Draw();
-	void AddVertex(glm::fvec3 pos, glm::fvec4 color, glm::fvec4 texcoord);
-	void AddVertex(glm::fvec3 pos, glm::fvec3 normal, glm::fvec4 color, glm::fvec4 texcoord);
-	void DefineNewTriangle(unsigned int index1, unsigned int index2, unsigned int index3);
-	void AppendMesh(const GLTriangleMesh& other);
-	void AppendMeshTransformed(const GLTriangleMesh& other, glm::mat4 transform);
-	void ApplyMatrix(glm::mat4 transform, int firstIndex, int lastIndex);
-	void ApplyMatrix(glm::mat4 transform);
-};
+	void DrawVisible(const Frustum& frustum, GLDrawStatistics& statistics); // frustum in the mesh coordinate system
+	void DrawIndices(const std::vector<unsigned int>& absoluteIndices); // streams a 32-bit index list over the uploaded vertices (for example from culled meshlets)
+	void DrawInstances(const std::vector<unsigned int>& order, unsigned int indicesPerInstance); // draws equal index ranges in the given order, the mesh must not be chunked
 
-struct GLLineSegment
-{
-	glm::fvec3 start;
-	glm::fvec3 end;
+	// Progressive uploads into preallocated float streams, the mesh must not be chunked.
+	// The appended vertices and indices are added to the CPU side and copied in with glBufferSubData,
+	// the buffers are only reallocated (to twice the size) when they run out of room.
+	void Reserve(size_t vertexCount, size_t indexCount);
+	void AppendVertices(const TriangleMesh& source, size_t first, size_t count);
+	void AppendIndices(const std::vector<unsigned int>& source, size_t first, size_t count);
+
+	// Vertex and index bytes sent to the GPU by the last SendToGPU
+	size_t UploadedBytes() const { return uploadedBytes; }
+
+protected:
+	void BindSeparateAttributes();
+	void SendPackedToGPU();
+	void SendIndicesToGPU();
+	void SetConstantAttributes();
+	void SetChunkOrigin(const MeshChunk& chunk);
 };
 
-class GLLine : public GLMeshInterface
+class GLLine : public GLMeshInterface, public LineMesh
 {
 protected:
 	GLuint positionBuffer = 0;
 	GLuint colorBuffer = 0;
 
-	std::vector<GLLineSegment> lineSegments;
-	std::vector<glm::fvec4> colors;
-
 public:
 	GLLine();
 
 	~GLLine();
 
-	void AddLine(glm::fvec3 start, glm::fvec3 end, glm::fvec4 color);
-
-	void Clear();
+	void Clear(); // also empties the GPU buffers
 
 	void SendToGPU();
+	void SendToGPU(LineMesh lines); // replaces the CPU side data with lines before uploading them
 
 	void Draw();
 };
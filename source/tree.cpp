@@ -1,19 +1,30 @@
 #include "tree.h"
+#include "geometry/vertexcache.h"
+#include "geometry/meshchunks.h"
+#include "geometry/bvh.h"
+#include "geometry/weld.h"
+#include "geometry/leafcard.h"
+#include "geometry/leafpruning.h"
+#include "thirdparty/glmGeom.h"
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <type_traits>
 
-void GenerateLeaf(Canvas2D & leafCanvas, GLTriangleMesh& leafMesh)
+void GenerateLeaf(Image& leafImage, TriangleMesh& leafMesh, LeafCardStatistics* cardStatistics)
 {
 	/*
 		Leaf texture
 	*/
-	int leafTextureSize = leafCanvas.GetTexture()->width;
+	int leafTextureSize = leafImage.width;
 	Color leafFillColor{ 0,200,0,0 };
 	Color leafLineColor{ 0,100,0,255 };
 
-	leafCanvas.Fill(leafFillColor);
+	leafImage.Fill(leafFillColor);
 	std::vector<glm::fvec3> leafHull;
 	DrawFractalLeaf(
 		leafHull,
-		leafCanvas,
+		leafImage,
 		leafLineColor,
 		6,
 		1.0f,
@@ -21,14 +32,27 @@ void GenerateLeaf(Canvas2D & leafCanvas, GLTriangleMesh& leafMesh)
 		90
 	);
 
+	// The card follows the silhouette of the veins, the convex hull of the tips is the fallback
+	std::vector<glm::fvec3> leafCard;
+	LeafCardStatistics traceStatistics;
+	if (TraceLeafCard(leafImage, leafCard, 8, 0, &traceStatistics))
+	{
+		// Keep the winding of the hull
+		if ((getArea(leafHull) < 0.0f) != (traceStatistics.cardArea < 0.0f))
+		{
+			std::reverse(leafCard.begin(), leafCard.end());
+		}
+		if (cardStatistics) *cardStatistics = traceStatistics;
+		leafHull = leafCard;
+	}
+
 	glm::fvec2 previous = leafHull[0];
 	for (int i = 1; i < leafHull.size(); i++)
 	{
 		
-		leafCanvas.DrawLine(leafHull[i - 1], leafHull[i], leafLineColor);
+		leafImage.DrawLine(leafHull[i - 1], leafHull[i], leafLineColor);
 	}
-	leafCanvas.DrawLine(leafHull.back(), leafHull[0], leafLineColor);
-	leafCanvas.GetTexture()->CopyToGPU();
+	leafImage.DrawLine(leafHull.back(), leafHull[0], leafLineColor);
 
 
 	/*
@@ -50,24 +74,25 @@ void GenerateLeaf(Canvas2D & leafCanvas, GLTriangleMesh& leafMesh)
 			{ p.x, p.y, 0.0f, 0.0f }	// texture coordinate
 		);
 	}
-	for (int i = 1; i < leafHull.size() - 1; i++)
+	std::vector<unsigned int> cardTriangles;
+	TriangulatePolygon(leafHull, cardTriangles);
+	for (size_t i = 0; i + 2 < cardTriangles.size(); i += 3)
 	{
-		leafMesh.DefineNewTriangle(0, i, i + 1);
+		leafMesh.DefineNewTriangle(cardTriangles[i], cardTriangles[i + 1], cardTriangles[i + 2]);
 	}
 	leafMesh.ApplyMatrix(glm::scale(glm::mat4{ 1.0f }, glm::fvec3{ 0.5f }));
-	leafMesh.SendToGPU();
 }
 
-void GenerateFlower(Canvas2D& flowerCanvas, GLTriangleMesh& flowerMesh)
+void GenerateFlower(Image& flowerImage, TriangleMesh& flowerMesh)
 {
 	/*
 		Flower texture
 	*/
-	int flowerTextureSize = flowerCanvas.GetTexture()->width;
+	int flowerTextureSize = flowerImage.width;
 	Color flowerFillColor{ 255, 255, 255, 255 };
 	Color flowerLineColor{ 255, 255, 255, 255 };
 
-	flowerCanvas.Fill(flowerFillColor);
+	flowerImage.Fill(flowerFillColor);
 	
 	// Draw flower petals
 	int numPetals = 8;  // Increased number of petals
@@ -91,11 +116,9 @@ void GenerateFlower(Canvas2D& flowerCanvas, GLTriangleMesh& flowerMesh)
 	// Draw the petal outline
 	for (int i = 0; i < petalHull.size(); i++) {
 		int next = (i + 1) % petalHull.size();
-		flowerCanvas.DrawLine(petalHull[i], petalHull[next], flowerLineColor);
+		flowerImage.DrawLine(petalHull[i], petalHull[next], flowerLineColor);
 	}
 
-	flowerCanvas.GetTexture()->CopyToGPU();
-
 	/*
 		Create flower mesh with 3D petal arrangement
 	*/
@@ -108,7 +131,7 @@ void GenerateFlower(Canvas2D& flowerCanvas, GLTriangleMesh& flowerMesh)
 	}
 
 	// Create a single petal
-	GLTriangleMesh basePetal;
+	TriangleMesh basePetal;
 	for (glm::fvec3& p : normalizedHull) {
 		float gradient = p.y; // Assuming Y is normalized to [0, 1]
 		glm::fvec4 vertexColor = glm::mix(
@@ -154,7 +177,7 @@ void GenerateFlower(Canvas2D& flowerCanvas, GLTriangleMesh& flowerMesh)
 			flowerMesh.AppendMeshTransformed(basePetal, transform);
 		}
 	}
-	//GLTriangleMesh centerDisk;
+	//TriangleMesh centerDisk;
 	//int centerSegments = 16; // Number of segments for the disk
 	//float centerRadius = 0.1f; // Radius of the disk
 	//glm::fvec3 centerNormal{ 0.0f, 0.0f, 1.0f };
@@ -178,15 +201,247 @@ void GenerateFlower(Canvas2D& flowerCanvas, GLTriangleMesh& flowerMesh)
 
 	// Scale the entire flower
 	flowerMesh.ApplyMatrix(glm::scale(glm::mat4{ 1.0f }, glm::fvec3{ 0.5f }));
-	flowerMesh.SendToGPU();
 }
 
-void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTriangleMesh& crownLeavesMeshes, GLTriangleMesh& crownFlowersMeshes, const GLTriangleMesh& leafMesh, const GLTriangleMesh& flowerMesh, UniformRandomGenerator& uniformGenerator, int treeIterations, int treeSubdivisions, bool showFlowers)
+void TreeLODChain::Clear()
+{
+	levels.clear();
+	activeLevel = -1;
+}
+
+TreeLODLevel* TreeLODChain::SelectLevel(float cameraDistance)
+{
+	int levelCount = int(levels.size());
+	activeLevel = (activeLevel >= levelCount) ? levelCount - 1 : activeLevel;
+
+	// Only move one way per call so that the hysteresis band cannot make the level oscillate
+	int previousLevel = activeLevel;
+	while (activeLevel + 1 < levelCount && cameraDistance > levels[activeLevel + 1]->settings.switchDistance * (1.0f + hysteresis))
+	{
+		activeLevel++;
+	}
+	if (activeLevel != previousLevel) return levels[activeLevel].get();
+
+	while (activeLevel >= 0 && cameraDistance < levels[activeLevel]->settings.switchDistance * (1.0f - hysteresis))
+	{
+		activeLevel--;
+	}
+
+	return (activeLevel >= 0) ? levels[activeLevel].get() : nullptr;
+}
+
+// A ring of the branch cylinder
+struct BranchRing
+{
+	glm::fvec3 position;
+	glm::fvec3 localX;	// ring start direction
+	glm::fvec3 localY;	// along the branch
+	float thickness;
+	float texU;
+	bool guide = false; // buried in the parent, it only steers the junction of the next ring and gets no vertices
+};
+
+/*
+	Hash of the inputs of a stage (64-bit FNV-1a), fields are added one at a time so that struct padding never ends up in it
+*/
+struct StageKey
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	template <class T>
+	StageKey& Value(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain values can be hashed");
+		Bytes(&value, sizeof(T));
+		return *this;
+	}
+
+	template <class T, class Allocator>
+	StageKey& Vector(const std::vector<T, Allocator>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain values can be hashed");
+		Value(uint64_t(values.size()));
+		Bytes(values.data(), values.size()*sizeof(T));
+		return *this;
+	}
+
+	StageKey& Mesh(const TriangleMesh& mesh)
+	{
+		return Vector(mesh.positions).Vector(mesh.normals).Vector(mesh.colors).Vector(mesh.texCoords).Vector(mesh.indices);
+	}
+
+	void Bytes(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+		}
+	}
+};
+
+// The last output of a stage and the key of the inputs it was built from
+template <class T>
+struct MemoizedStage
+{
+	T value;
+	uint64_t key = 0;
+	bool valid = false; // false while the value is rebuilt, a cancelled stage stays invalid
+
+	// True when the value was built from the same inputs, otherwise the stage is invalidated and the caller rebuilds it
+	bool Reuse(uint64_t inputKey)
+	{
+		if (valid && key == inputKey) return true;
+		valid = false;
+		return false;
+	}
+
+	void Finish(uint64_t inputKey)
+	{
+		key = inputKey;
+		valid = true;
+	}
+};
+
+struct TreeStageCache::Stages
+{
+	struct Skeleton
+	{
+		Turtle3D<FractalTree3DProps> turtle;	// owns the bones the branches point to
+		std::vector<FractalBranch> branches;
+		UniformRandomGenerator generatorAfter{ 0 }; // the foliage continues the random sequence from here
+	};
+
+	// Rings of the full mesh, they do not depend on the cylinder divisions
+	struct Rings
+	{
+		std::vector<std::vector<BranchRing>> rings;
+		std::vector<size_t> buried;
+		std::vector<float> thickness;
+	};
+
+	struct Foliage
+	{
+		std::vector<glm::mat4> leaves;
+		std::vector<glm::mat4> flowers;
+		UniformRandomGenerator generatorAfter{ 0 };
+	};
+
+	struct BranchMesh
+	{
+		TriangleMesh mesh;
+		size_t buriedTriangles = 0;
+	};
+
+	MemoizedStage<std::string> symbols;
+	MemoizedStage<Skeleton> skeleton;
+	MemoizedStage<Rings> rings;
+	MemoizedStage<Foliage> foliage;
+	MemoizedStage<BranchMesh> branchMesh;
+	MemoizedStage<TriangleMesh> leaves;
+	MemoizedStage<TriangleMesh> flowers;
+};
+
+TreeStageCache::TreeStageCache()
+{
+	Clear();
+}
+
+TreeStageCache::~TreeStageCache() = default;
+
+void TreeStageCache::Clear()
 {
+	stages = std::make_unique<Stages>();
+	branchesKey = leavesKey = flowersKey = 0;
+	stageTimes.clear();
+	statistics = TreeGenerationStatistics{};
+	leafInstances = MeshVector<glm::mat4>{};
+	flowerInstances = MeshVector<glm::mat4>{};
+}
+
+void GenerateNewTree(LineMesh& skeletonLines, TriangleMesh& branchMeshes, TriangleMesh& crownLeavesMeshes, TriangleMesh& crownFlowersMeshes, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh, UniformRandomGenerator& uniformGenerator, int treeIterations, int treeSubdivisions, bool showFlowers, const TreeGenerationOptions& options, TreeLODChain* lodChain, BoundingVolumeHierarchy* bvh, TreeBudgetReport* budgetReport, TreeGenerationProgress* progress, TreeStageCache* stageCache)
+{
+	/*
+		Stages
+		Without a stage cache every stage runs, with one a stage is reused while its key matches (see TreeStageCache)
+	*/
+	TreeStageCache localStages;
+	TreeStageCache& stageOutputs = stageCache ? *stageCache : localStages;
+	TreeStageCache::Stages& stages = *stageOutputs.stages;
+	stageOutputs.branchesKey = stageOutputs.leavesKey = stageOutputs.flowersKey = 0;
+	stageOutputs.stageTimes.clear();
+	stageOutputs.statistics = TreeGenerationStatistics{};
+	TreeGenerationStatistics& statistics = stageOutputs.statistics;
+	stageOutputs.leafInstances = MeshVector<glm::mat4>{}; // the previous ones may be in another arena
+	stageOutputs.flowerInstances = MeshVector<glm::mat4>{};
+	bool keepMeshes = (stageCache != nullptr); // the meshes are only copied into a cache that outlives the call
+
+	// Bytes held by the stage outputs and the working copies of the foliage placements, see TreeGenerationStatistics::peakStageBytes
+	size_t workingCopyBytes = 0;
+	auto stageBytes = [&]()
+	{
+		auto meshBytes = [](const TriangleMesh& mesh)
+		{
+			return mesh.positions.capacity() * sizeof(glm::fvec3) + mesh.normals.capacity() * sizeof(glm::fvec3) + mesh.colors.capacity() * sizeof(glm::fvec4)
+				+ mesh.texCoords.capacity() * sizeof(glm::fvec4) + mesh.indices.capacity() * sizeof(unsigned int);
+		};
+		size_t bytes = workingCopyBytes + stages.symbols.value.capacity();
+		bytes += stages.skeleton.value.branches.capacity() * sizeof(FractalBranch);
+		for (auto& branch : stages.skeleton.value.branches) bytes += branch.nodes.capacity() * sizeof(branch.nodes[0]);
+		for (auto& ring : stages.rings.value.rings) bytes += ring.capacity() * sizeof(BranchRing);
+		bytes += stages.rings.value.buried.capacity() * sizeof(size_t) + stages.rings.value.thickness.capacity() * sizeof(float);
+		bytes += (stages.foliage.value.leaves.capacity() + stages.foliage.value.flowers.capacity()) * sizeof(glm::mat4);
+		bytes += meshBytes(stages.branchMesh.value.mesh) + meshBytes(stages.leaves.value) + meshBytes(stages.flowers.value);
+		return bytes;
+	};
+
+	// Times the stage that just ended, returns true when the caller asked to stop
+	const char* currentStage = nullptr;
+	auto stageStart = std::chrono::high_resolution_clock::now();
+	auto reachedStage = [&](float fraction, const char* stage) -> bool
+	{
+		if (stage != currentStage)
+		{
+			size_t bytes = stageBytes();
+			statistics.peakStageBytes = (bytes > statistics.peakStageBytes) ? bytes : statistics.peakStageBytes;
+			auto time = std::chrono::high_resolution_clock::now();
+			if (currentStage) stageOutputs.stageTimes.push_back(TreeStageTime{ currentStage, std::chrono::duration<double, std::milli>(time - stageStart).count() });
+			currentStage = stage;
+			stageStart = time;
+		}
+
+		if (!progress) return false;
+		progress->fraction = fraction;
+		progress->stage = stage;
+		return progress->cancel;
+	};
+	if (reachedStage(0.0f, "Skeleton")) return;
+
+	// Progressive generation, publishes what was added to a mesh since the last call
+	bool progressive = progress && progress->publishPart;
+	auto publishMesh = [&](TreePartKind kind, int branchDepth, const TriangleMesh& mesh, size_t& publishedVertices, size_t& publishedIndices)
+	{
+		if (!progressive || mesh.indices.size() == publishedIndices) return;
+
+		TreePart part;
+		part.kind = kind;
+		part.branchDepth = branchDepth;
+		part.mesh.positions.assign(mesh.positions.begin() + publishedVertices, mesh.positions.end());
+		part.mesh.normals.assign(mesh.normals.begin() + publishedVertices, mesh.normals.end());
+		part.mesh.colors.assign(mesh.colors.begin() + publishedVertices, mesh.colors.end());
+		part.mesh.texCoords.assign(mesh.texCoords.begin() + publishedVertices, mesh.texCoords.end());
+		part.mesh.indices.assign(mesh.indices.begin() + publishedIndices, mesh.indices.end());
+		publishedVertices = mesh.positions.size();
+		publishedIndices = mesh.indices.size();
+		progress->publishPart(std::move(part));
+	};
+
 	skeletonLines.Clear();
 	branchMeshes.Clear();
 	crownLeavesMeshes.Clear();
 	crownFlowersMeshes.Clear();
+	if (lodChain) lodChain->Clear();
+	if (bvh) bvh->Clear();
 
 	/*
 		Tree branch propertes
@@ -194,13 +449,13 @@ void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTria
 	float trunkThickness = 0.5f * powf(1.3f, float(treeIterations));
 	float branchScalar = 0.4f;											// how the branch thickness relates to the parent
 	float depthScalar = powf(0.75f, 1.0f / float(treeSubdivisions));	// how much the branch shrinks in thickness the farther from the root it goes (the pow is to counter the subdiv growth)
-	const int trunkCylinderDivisions = 32;
+	const int trunkCylinderDivisions = options.trunkCylinderDivisions;
 
 	/*
 		Leaf generation properties
 	*/
-	float leafMinScale = 0.25f;
-	float leafMaxScale = 1.5f;
+	float leafMinScale = 0.25f * options.leafScale;
+	float leafMaxScale = 1.5f * options.leafScale;
 	float growthCurve = treeIterations / (1.0f + float(treeIterations));
 	float pruningChance = growthCurve * 2.0f - 1.0f;// Random chance to remove a leaf (chance increases by the number of iterations)
 
@@ -210,155 +465,441 @@ void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTria
 	/*
 		Helper functions
 	*/
-	auto& getBranchThickness = [&](int branchDepth, int nodeDepth) -> float
+	auto getBranchThickness = [&](int branchDepth, int nodeDepth) -> float
 	{
 		return trunkThickness * powf(branchScalar, float(branchDepth)) * powf(depthScalar, float(nodeDepth));
 	};
 
-	auto& getCylinderDivisions = [&](int branchDepth) -> int
+	auto getCylinderDivisions = [&](int branchDepth) -> int
 	{
 		int cylinderDivisions = int(trunkCylinderDivisions / pow(2, branchDepth));
 		return (cylinderDivisions < 4) ? 6 : cylinderDivisions;
 	};
 
-	int branchCount = 0;
-	GenerateFractalTree3D(
-		TreeStyle::Default,
-		uniformGenerator,
-		treeIterations,
-		treeSubdivisions,
-		1.0f, // applyRandomness
-		[&](Bone<FractalTree3DProps>* root, std::vector<FractalBranch>& branches) -> void
+	/*
+		Places rings along a Catmull-Rom spline through the bone rings, a ring is only emitted when
+		the spline bends or changes thickness by more than the tolerance since the previous ring
+	*/
+	auto fitBranchRings = [](const std::vector<BranchRing>& keys, glm::fvec3 tipPosition, float tolerance, std::vector<BranchRing>& rings)
 	{
-		if (!root) return;
-		using TBone = Bone<FractalTree3DProps>;
+		int keyCount = int(keys.size());
+		auto controlPoint = [&](int i) -> glm::fvec3
+		{
+			if (i < 0) return 2.0f * keys[0].position - ((keyCount > 1) ? keys[1].position : tipPosition);
+			if (i < keyCount) return keys[i].position;
+			return tipPosition;
+		};
 
-		for (int b = 0; b < branches.size(); b++)
+		// Dense samples of the spline, the key rings are always among them
+		const int samplesPerSegment = 8;
+		std::vector<BranchRing> samples;
+		samples.reserve((keyCount - 1) * samplesPerSegment + 1);
+		for (int k = 0; k < keyCount - 1; k++)
 		{
-			int cylinderDivisions = getCylinderDivisions(branches[b].depth);
-			GLTriangleMesh newBranchMesh{ false };
-
-			/*
-				Vertex
-				Positions, Normals, Texture Coordinates
-			*/
-			// Create vertex rings around each bone
-			auto& branchNodes = branches[b].nodes;
-			float rootLength = branchNodes[0]->length;
-			float texU = 0.0f; // Texture coordinate along branch, it varies depending on the bone length and must be tracked
-			for (int depth = 0; depth < branchNodes.size(); depth++)
+			glm::fvec3 p0 = controlPoint(k - 1), p1 = controlPoint(k), p2 = controlPoint(k + 1), p3 = controlPoint(k + 2);
+			for (int j = 0; j < samplesPerSegment; j++)
 			{
-				auto& bone = branchNodes[depth];
-				float thickness = getBranchThickness(branches[b].depth, bone->nodeDepth);
-				float circumference = 2.0f*PI_f*thickness;
-				texU += bone->length / circumference;
+				float t = j / float(samplesPerSegment);
+				float t2 = t*t, t3 = t2*t;
 
-				skeletonLines.AddLine(bone->transform.position, bone->tipPosition(), glm::fvec4(0.0f, 1.0f, 0.0f, 1.0f));
-				skeletonLines.AddLine(bone->transform.position, bone->transform.position+bone->transform.up*0.2f, glm::fvec4(1.0f, 0.0f, 0.0f, 1.0f));
+				BranchRing sample;
+				sample.position = 0.5f * (2.0f*p1 + (p2 - p0)*t + (2.0f*p0 - 5.0f*p1 + 4.0f*p2 - p3)*t2 + (3.0f*p1 - p0 - 3.0f*p2 + p3)*t3);
+				glm::fvec3 tangent = 0.5f * ((p2 - p0) + 2.0f*(2.0f*p0 - 5.0f*p1 + 4.0f*p2 - p3)*t + 3.0f*(3.0f*p1 - p0 - 3.0f*p2 + p3)*t2);
+				float tangentLength = glm::length(tangent);
+				sample.localY = (tangentLength > 1e-6f) ? tangent / tangentLength : keys[k].localY;
 
-				glm::fvec3 localX = bone->transform.up;
-				glm::fvec3 localY = bone->transform.forward;
+				glm::fvec3 localX = glm::mix(keys[k].localX, keys[k + 1].localX, t);
+				localX -= glm::dot(localX, sample.localY) * sample.localY;
+				float localXLength = glm::length(localX);
+				sample.localX = (localXLength > 1e-6f) ? localX / localXLength : keys[k].localX;
 
-				// Make the branch root blend into its parent a bit. (this makes the branches appear less angular)
-				auto& t = bone->transform;
-				glm::fvec3 position = t.position;
-				if (depth < (treeSubdivisions - 1) && branchNodes[0]->parent)
-				{
-					auto& parent = branchNodes[0]->parent;
-					float blendAlpha = depth / float(treeSubdivisions);
-
-					glm::fvec3 u = parent->transform.forward;
-					glm::fvec3 v = bone->transform.position - parent->transform.position;
-					float length = glm::length(v);
-					v /= length;
-					glm::fvec3 projectionOnParent = parent->transform.position + glm::dot(u, v) * u * length * blendAlpha;
-
-					position = glm::mix(projectionOnParent, t.position, 0.5f + 0.5f*blendAlpha);
-					thickness = glm::mix(thickness / branchScalar, thickness, 0.4f + 0.6f*blendAlpha);
-
-					// Blend orientation of cylinder ring to give a spline
-					auto& parentForward = parent->transform.forward;
-					auto& boneForward = bone->transform.forward;
-					localY = glm::normalize(glm::mix(parentForward, boneForward, blendAlpha));
-					glm::fvec3 rotationVector = glm::normalize(glm::cross(boneForward, localY));
-					float angle = glm::acos(glm::dot(boneForward, localY));
-					localX = glm::rotate(glm::mat4(1.0f), angle, rotationVector) * glm::fvec4(localX, 0.0f);
-				}
+				sample.thickness = glm::mix(keys[k].thickness, keys[k + 1].thickness, t);
+				sample.texU = glm::mix(keys[k].texU, keys[k + 1].texU, t);
+				samples.push_back(sample);
+			}
+		}
+		samples.push_back(keys.back());
 
-				// Generate the cylinder ring
-				float angleStep = 360.0f / float(cylinderDivisions);
-				for (int i = 0; i < cylinderDivisions; i++)
-				{
-					float angle = angleStep * i;
-					glm::mat4 rot = glm::rotate(glm::mat4{ 1.0f }, glm::radians(angle), localY);
-					glm::fvec3 normal = rot * glm::fvec4(localX, 0.0f);
-
-					newBranchMesh.AddVertex(
-						position + normal * thickness,
-						normal,
-						glm::fvec4{ 1.0f },
-						glm::fvec4{ texU, i / float(cylinderDivisions), 1.0f, 1.0f }
-					);
-				}
+		// Greedily extend each cylinder section while every skipped sample stays within the tolerance.
+		// The error is the bend of the spline away from the section (sine of the angle) and the relative thickness error.
+		auto fits = [&](int a, int b) -> bool
+		{
+			const BranchRing& ringA = samples[a];
+			const BranchRing& ringB = samples[b];
+			glm::fvec3 chord = ringB.position - ringA.position;
+			float chordLength = glm::length(chord);
+			if (chordLength < 1e-6f) return true;
+
+			chord /= chordLength;
+			for (int i = a; i <= b; i++)
+			{
+				const BranchRing& sample = samples[i];
+				float thickness = glm::mix(ringA.thickness, ringB.thickness, (i - a) / float(b - a));
+				float bendError = glm::length(glm::cross(sample.localY, chord));
+				float thicknessError = fabs(sample.thickness - thickness) / sample.thickness;
+				if (bendError > tolerance || thicknessError > tolerance) return false;
+			}
+			return true;
+		};
+
+		rings.clear();
+		int last = int(samples.size()) - 1;
+		int current = 0;
+		rings.push_back(samples[0]);
+		while (current < last)
+		{
+			int next = current + 1;
+			while (next < last && fits(current, next + 1)) next++;
+			rings.push_back(samples[next]);
+			current = next;
+		}
+	};
+
+	size_t buriedTriangles = 0;
+
+	// Distance from a point to the axis of the parent bone or its continuation
+	auto distanceToParent = [](FractalBranch::TBone* parent, glm::fvec3 p) -> float
+	{
+		float distance = FLT_MAX;
+		for (auto* bone : { parent, parent->lastChild })
+		{
+			if (!bone) continue;
+			glm::fvec3 start = bone->transform.position;
+			glm::fvec3 axis = bone->tipPosition() - start;
+			float axisLength2 = glm::dot(axis, axis);
+			float t = (axisLength2 > 0.0f) ? glm::clamp(glm::dot(p - start, axis) / axisLength2, 0.0f, 1.0f) : 0.0f;
+			distance = glm::min(distance, glm::length(p - (start + axis*t)));
+		}
+		return distance;
+	};
+
+	/*
+		Places the rings of a branch, returns the number of rings dropped inside the parent.
+		The rings do not depend on the cylinder divisions, so the budget pass can count them before meshing.
+	*/
+	auto buildBranchRings = [&](FractalBranch& branch, float ringTolerance, std::vector<BranchRing>& rings) -> size_t
+	{
+		// Create a ring around each bone
+		auto& branchNodes = branch.nodes;
+		rings.clear();
+		rings.reserve(branchNodes.size());
+		float texU = 0.0f; // Texture coordinate along branch, it varies depending on the bone length and must be tracked
+		for (int depth = 0; depth < branchNodes.size(); depth++)
+		{
+			auto& bone = branchNodes[depth];
+			float thickness = getBranchThickness(branch.depth, bone->nodeDepth);
+			float circumference = 2.0f*PI_f*thickness;
+			texU += bone->length / circumference;
+
+			glm::fvec3 localX = bone->transform.up;
+			glm::fvec3 localY = bone->transform.forward;
+
+			// Make the branch root blend into its parent a bit. (this makes the branches appear less angular)
+			auto& t = bone->transform;
+			glm::fvec3 position = t.position;
+			if (depth < (treeSubdivisions - 1) && branchNodes[0]->parent)
+			{
+				auto& parent = branchNodes[0]->parent;
+				float blendAlpha = depth / float(treeSubdivisions);
+
+				glm::fvec3 u = parent->transform.forward;
+				glm::fvec3 v = bone->transform.position - parent->transform.position;
+				float length = glm::length(v);
+				v /= length;
+				glm::fvec3 projectionOnParent = parent->transform.position + glm::dot(u, v) * u * length * blendAlpha;
+
+				position = glm::mix(projectionOnParent, t.position, 0.5f + 0.5f*blendAlpha);
+				thickness = glm::mix(thickness / branchScalar, thickness, 0.4f + 0.6f*blendAlpha);
+
+				// Blend orientation of cylinder ring to give a spline
+				auto& parentForward = parent->transform.forward;
+				auto& boneForward = bone->transform.forward;
+				localY = glm::normalize(glm::mix(parentForward, boneForward, blendAlpha));
+				glm::fvec3 rotationVector = glm::normalize(glm::cross(boneForward, localY));
+				float angle = glm::acos(glm::dot(boneForward, localY));
+				localX = glm::rotate(glm::mat4(1.0f), angle, rotationVector) * glm::fvec4(localX, 0.0f);
+			}
+
+			rings.push_back(BranchRing{ position, localX, localY, thickness, texU });
+		}
+
+		// Replace the per bone rings with rings placed by curvature
+		if (ringTolerance > 0.0f && rings.size() > 1)
+		{
+			std::vector<BranchRing> keys;
+			keys.swap(rings);
+			fitBranchRings(keys, branchNodes.back()->tipPosition(), ringTolerance, rings);
+		}
+
+		/*
+			Junction with the parent branch
+			Rings that are completely inside the parent tube are never seen. The outermost one stays as a guide
+			without vertices, the first visible ring is snapped along the tube towards it onto the parent surface.
+			Two visible rings are always left, the snapped one and the one its buried vertices slide towards.
+		*/
+		auto& parent = branchNodes[0]->parent;
+		if (!options.weldBranches || !parent || rings.size() <= 2) return 0;
+
+		float parentThickness = getBranchThickness(branch.depth - 1, parent->nodeDepth);
+		size_t buried = 0;
+		while (buried + 2 < rings.size() && distanceToParent(parent, rings[buried].position) + rings[buried].thickness <= parentThickness) buried++;
+		if (buried == 0) return 0;
+
+		rings.erase(rings.begin(), rings.begin() + (buried - 1));
+		rings[0].guide = true;
+		return buried;
+	};
+
+	auto meshBranchRings = [&](FractalBranch& branch, const std::vector<BranchRing>& rings, int cylinderDivisions, TriangleMesh& targetMesh)
+	{
+		TriangleMesh newBranchMesh;
+		auto& lastBone = branch.nodes.back();
+		auto& parent = branch.nodes[0]->parent;
+		bool clipToParent = options.weldBranches && parent;
+		float parentThickness = parent ? getBranchThickness(branch.depth - 1, parent->nodeDepth) : 0.0f;
+
+		/*
+			Vertex
+			Positions, Normals, Texture Coordinates
+		*/
+		// Generate the cylinder rings, a guide ring only gives the positions the junction is snapped towards
+		float angleStep = 360.0f / float(cylinderDivisions);
+		auto ringPoint = [&](const BranchRing& ring, int i) -> glm::fvec3
+		{
+			glm::mat4 rot = glm::rotate(glm::mat4{ 1.0f }, glm::radians(angleStep * (i % cylinderDivisions)), ring.localY);
+			return ring.position + glm::fvec3{ rot * glm::fvec4(ring.localX, 0.0f) } * ring.thickness;
+		};
+		const BranchRing* guide = rings[0].guide ? &rings[0] : nullptr;
+		int firstRing = guide ? 1 : 0;
+		int ringCount = int(rings.size()) - firstRing;
+		for (int r = firstRing; r < int(rings.size()); r++)
+		{
+			auto& ring = rings[r];
+			for (int i = 0; i < cylinderDivisions; i++)
+			{
+				float angle = angleStep * i;
+				glm::mat4 rot = glm::rotate(glm::mat4{ 1.0f }, glm::radians(angle), ring.localY);
+				glm::fvec3 normal = rot * glm::fvec4(ring.localX, 0.0f);
 
-				// Add extra set of vertices for the UV seam
 				newBranchMesh.AddVertex(
-					position + localX * thickness,
-					localX,
+					ring.position + normal * ring.thickness,
+					normal,
 					glm::fvec4{ 1.0f },
-					glm::fvec4{ texU, 1.0f, 1.0f, 1.0f }
+					glm::fvec4{ ring.texU, i / float(cylinderDivisions), 1.0f, 1.0f }
 				);
 			}
 
-			// Add tip for branch
-			auto& lastBone = branchNodes.back();
+			// Add extra set of vertices for the UV seam
 			newBranchMesh.AddVertex(
-				lastBone->tipPosition(),
-				lastBone->transform.forward,
+				ring.position + ring.localX * ring.thickness,
+				ring.localX,
 				glm::fvec4{ 1.0f },
-				glm::fvec4{ texU + lastBone->length, 0.5f, 1.0f, 1.0f }
+				glm::fvec4{ ring.texU, 1.0f, 1.0f, 1.0f }
 			);
+		}
 
-			/*
-				Triangle Indices
-			*/
-			// Generate indices for cylinders
-			int ringStep = cylinderDivisions + 1; // +1 because of UV seam
-			for (int depth = 1; depth < branchNodes.size(); depth++)
+		// Moves the vertices of the first ring onto the parent surface where the segment from inside to outside crosses it
+		auto snapToParent = [&](int i, glm::fvec3 inside, glm::fvec3 outside)
+		{
+			float low = 0.0f, high = 1.0f;
+			for (int step = 0; step < 12; step++)
+			{
+				float middle = 0.5f * (low + high);
+				if (distanceToParent(parent, glm::mix(inside, outside, middle)) < parentThickness) low = middle;
+				else high = middle;
+			}
+			newBranchMesh.positions[i] = glm::mix(inside, outside, low);
+		};
+		if (clipToParent && ringCount > 1)
+		{
+			// Vertices inside the parent slide out along the tube, with a guide the ones outside are pulled back onto the surface
+			int ringStep = cylinderDivisions + 1;
+			for (int i = 0; i < ringStep; i++)
 			{
-				int uStart = depth * ringStep;
-				int lStart = uStart - ringStep;
+				glm::fvec3 first = newBranchMesh.positions[i];
+				glm::fvec3 second = newBranchMesh.positions[ringStep + i];
+				bool firstInside = distanceToParent(parent, first) < parentThickness;
+				if (firstInside && distanceToParent(parent, second) > parentThickness) snapToParent(i, first, second);
+				else if (!firstInside && guide) snapToParent(i, ringPoint(*guide, i), first);
+			}
+		}
 
-				for (int i = 0; i < cylinderDivisions; i++)
-				{
-					int u = uStart + i;
-					int l = lStart + i;
+		// Add tip for branch
+		newBranchMesh.AddVertex(
+			lastBone->tipPosition(),
+			lastBone->transform.forward,
+			glm::fvec4{ 1.0f },
+			glm::fvec4{ rings.back().texU + lastBone->length, 0.5f, 1.0f, 1.0f }
+		);
 
-					newBranchMesh.DefineNewTriangle(l, l + 1, u + 1);
-					newBranchMesh.DefineNewTriangle(u + 1, u, l);
-				}
-			}
+		/*
+			Triangle Indices
+		*/
+		// Generate indices for cylinders
+		int ringStep = cylinderDivisions + 1; // +1 because of UV seam
+		for (int depth = 1; depth < ringCount; depth++)
+		{
+			int uStart = depth * ringStep;
+			int lStart = uStart - ringStep;
 
-			// Generate indices for tip
-			int tipIndex = int(newBranchMesh.positions.size()) - 1;
-			int lastRing = ringStep * (int(branchNodes.size()) - 1);
-			for (int i = 1; i < ringStep; i++)
+			for (int i = 0; i < cylinderDivisions; i++)
 			{
-				int ringId = lastRing + i;
-				newBranchMesh.DefineNewTriangle(ringId - 1, ringId, tipIndex);
+				int u = uStart + i;
+				int l = lStart + i;
+
+				newBranchMesh.DefineNewTriangle(l, l + 1, u + 1);
+				newBranchMesh.DefineNewTriangle(u + 1, u, l);
 			}
+		}
 
-			branchMeshes.AppendMesh(newBranchMesh);
+		// Generate indices for tip
+		int tipIndex = int(newBranchMesh.positions.size()) - 1;
+		int lastRing = ringStep * (ringCount - 1);
+		for (int i = 1; i < ringStep; i++)
+		{
+			int ringId = lastRing + i;
+			newBranchMesh.DefineNewTriangle(ringId - 1, ringId, tipIndex);
 		}
 
-		/*
-			Generate leaves
-		*/
-		int maxBranchDepth = 0;
-		for (auto& branch : branches)
+		targetMesh.AppendMesh(newBranchMesh);
+	};
+
+	auto meshBranch = [&](FractalBranch& branch, int cylinderDivisions, float ringTolerance, TriangleMesh& targetMesh)
+	{
+		std::vector<BranchRing> rings;
+		buildBranchRings(branch, ringTolerance, rings);
+		meshBranchRings(branch, rings, cylinderDivisions, targetMesh);
+	};
+
+	// Keeps a stable, evenly spread subset of the placements and scales the survivors up so that the covered area stays about the same
+	auto appendThinnedFoliage = [](TriangleMesh& targetMesh, const TriangleMesh& sourceMesh, const MeshVector<glm::mat4>& transforms, float density)
+	{
+		if (density <= 0.0f) return;
+
+		density = (density > 1.0f) ? 1.0f : density;
+		glm::mat4 enlarge = glm::scale(glm::mat4{ 1.0f }, glm::fvec3{ 1.0f / sqrtf(density) });
+		float accumulator = 0.0f;
+		for (auto& transform : transforms)
+		{
+			accumulator += density;
+			if (accumulator < 1.0f) continue;
+
+			accumulator -= 1.0f;
+			targetMesh.AppendMeshTransformed(sourceMesh, transform * enlarge);
+		}
+	};
+
+	// Thins the placements themselves, keeps exactly floor(count * density) of them. Without keepArea the survivors keep their size.
+	auto thinFoliage = [](MeshVector<glm::mat4>& transforms, float density, bool keepArea)
+	{
+		if (density >= 1.0f) return;
+		if (density <= 0.0f)
+		{
+			transforms.clear();
+			return;
+		}
+
+		glm::mat4 enlarge = glm::scale(glm::mat4{ 1.0f }, glm::fvec3{ keepArea ? 1.0f / sqrtf(density) : 1.0f });
+		size_t kept = 0;
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			if (size_t((i + 1) * double(density)) == size_t(i * double(density))) continue;
+			transforms[kept++] = transforms[i] * enlarge;
+		}
+		transforms.resize(kept);
+	};
+
+	// The reused stages are listed at the end
+	auto reuseStage = [&](auto& stage, uint64_t key, const char* name) -> bool
+	{
+		if (!stage.Reuse(key)) return false;
+		statistics.reusedStages.push_back(name);
+		return true;
+	};
+	uint64_t branchMeshKey = 0, leavesKey = 0, flowersKey = 0;
+	uint64_t leafMeshKey = StageKey{}.Mesh(leafMesh).hash;
+	uint64_t flowerMeshKey = StageKey{}.Mesh(flowerMesh).hash;
+
+	// Symbols of the L-system
+	const float applyRandomness = 1.0f;
+	uint64_t symbolsKey = StageKey{}.Value(options.style).Value(treeIterations).Value(applyRandomness).hash;
+	if (!reuseStage(stages.symbols, symbolsKey, "symbols"))
+	{
+		stages.symbols.value = GenerateFractalTree3DSymbols(options.style, treeIterations, applyRandomness);
+		stages.symbols.Finish(symbolsKey);
+	}
+
+	// Skeleton, the turtle draws random numbers so the state of the generator is one of its inputs
+	uint64_t skeletonKey = StageKey{}.Value(symbolsKey).Value(uniformGenerator).Value(treeIterations).Value(treeSubdivisions).hash;
+	if (!reuseStage(stages.skeleton, skeletonKey, "skeleton"))
+	{
+		auto& skeleton = stages.skeleton.value;
+		GenerateFractalTree3DSkeleton(skeleton.turtle, skeleton.branches, stages.symbols.value, uniformGenerator, treeIterations, treeSubdivisions, applyRandomness);
+		skeleton.generatorAfter = uniformGenerator;
+		stages.skeleton.Finish(skeletonKey);
+	}
+	uniformGenerator = stages.skeleton.value.generatorAfter;
+
+	TreeBudgetReport budget;
+	if (stages.skeleton.value.branches.empty() || reachedStage(0.3f, "Foliage")) return;
+	std::vector<FractalBranch>& branches = stages.skeleton.value.branches;
+	budget.branches = branches.size();
+	for (auto& branch : branches)
+	{
+		budget.bones += branch.nodes.size();
+		for (auto& bone : branch.nodes)
 		{
-			maxBranchDepth = (branch.depth > maxBranchDepth) ? branch.depth : maxBranchDepth;
+			skeletonLines.AddLine(bone->transform.position, bone->tipPosition(), glm::fvec4(0.0f, 1.0f, 0.0f, 1.0f));
+			skeletonLines.AddLine(bone->transform.position, bone->transform.position+bone->transform.up*0.2f, glm::fvec4(1.0f, 0.0f, 0.0f, 1.0f));
 		}
+	}
+	if (progressive)
+	{
+		TreePart part;
+		part.kind = TreePartKind::Skeleton;
+		part.lines = skeletonLines;
+		progress->publishPart(std::move(part));
+	}
+
+	int maxBranchDepth = 0;
+	for (auto& branch : branches)
+	{
+		maxBranchDepth = (branch.depth > maxBranchDepth) ? branch.depth : maxBranchDepth;
+	}
+
+	// Rings of the full mesh, the budget counts them before anything is meshed
+	uint64_t ringsKey = StageKey{}.Value(skeletonKey).Value(options.ringTolerance).Value(options.weldBranches).hash;
+	if (!reuseStage(stages.rings, ringsKey, "rings"))
+	{
+		auto& rings = stages.rings.value;
+		rings.rings.assign(branches.size(), {});
+		rings.buried.assign(branches.size(), 0);
+		rings.thickness.assign(branches.size(), 0.0f);
+		for (int b = 0; b < branches.size(); b++)
+		{
+			rings.buried[b] = buildBranchRings(branches[b], options.ringTolerance, rings.rings[b]);
+			rings.thickness[b] = getBranchThickness(branches[b].depth, branches[b].nodes[0]->nodeDepth);
+		}
+		stages.rings.Finish(ringsKey);
+	}
+	const std::vector<std::vector<BranchRing>>& branchRings = stages.rings.value.rings;
+	const std::vector<size_t>& buriedRings = stages.rings.value.buried;
+	const std::vector<float>& branchThickness = stages.rings.value.thickness;
+
+	/*
+		Generate leaves
+		The placements continue the random sequence of the skeleton, they only depend on the skeleton and the foliage options.
+	*/
+	uint64_t foliageKey = StageKey{}.Value(skeletonKey).Value(showFlowers).Value(options.leafScale).Value(options.flowerChance).Value(options.pruneHiddenLeaves)
+		.Value(options.leafPruning.voxelSize).Value(options.leafPruning.shadowDepth).Value(options.leafPruning.shadowFalloff).Value(options.leafPruning.extinction)
+		.Value(options.leafPruning.exposureThreshold).Value(options.leafPruning.keepShell).Value(leafMeshKey).hash;
+	if (!reuseStage(stages.foliage, foliageKey, "foliage"))
+	{
+		auto& foliage = stages.foliage.value;
+		std::vector<glm::mat4>& leafTransforms = foliage.leaves;
+		std::vector<glm::mat4>& flowerTransforms = foliage.flowers;
+		leafTransforms.clear();
+		flowerTransforms.clear();
 
 		int startDepth = maxBranchDepth - 2;
 		startDepth = (startDepth > 2) ? startDepth : 2;
@@ -379,7 +920,6 @@ void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTria
 				glm::fvec3 nodeNormal = leafNode->transform.up;
 
 				float thickness = getBranchThickness(branch.depth, leafNode->nodeDepth);
-				float circumference = 2.0f*PI_f*thickness;
 
 				int leafId = leavesPerBranch;
 				float stepSize = leafNode->length / leavesPerBranch;
@@ -399,8 +939,7 @@ void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTria
 					normal = glm::rotate(glm::mat4{ 1.0f }, angle, direction) * glm::fvec4{ nodeDirection, 1.0f };					// random twist
 
 					// Insert the leaf
-					crownLeavesMeshes.AppendMeshTransformed(
-						leafMesh,
+					leafTransforms.push_back(
 						glm::inverse(glm::lookAt(position, position - direction, -normal)) * glm::scale(glm::mat4{ 1.0f }, glm::fvec3{ uniformGenerator.RandomFloat(leafMinScale, leafMaxScale) })
 					);
 				}
@@ -408,14 +947,19 @@ void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTria
 				// Put a leaf at the tip of the branch
 				if (i == lastIndex)
 				{
-					crownLeavesMeshes.AppendMeshTransformed(
-						leafMesh,
+					leafTransforms.push_back(
 						glm::inverse(glm::lookAt(nodeEnd, nodeEnd - nodeDirection, -nodeNormal)) * glm::scale(glm::mat4{ 1.0f }, glm::fvec3{ uniformGenerator.RandomFloat(leafMinScale, leafMaxScale) })
 					);
 				}
 			}
 		}
 
+		// Interior leaves are dropped before anything else (levels of detail, BVH) sees them
+		if (options.pruneHiddenLeaves)
+		{
+			statistics.leafPruning = PruneHiddenLeaves(leafTransforms, leafMesh, options.leafPruning);
+		}
+
 		// Add flowers to the tree
 		if (showFlowers)
 		{
@@ -426,37 +970,37 @@ void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTria
 				{
 					auto& branchNodes = branches[b].nodes;
 					int lastIndex = int(branchNodes.size() - 1);
-					
+				
 					// Calculate how many flowers to add based on branch depth and length
 					int numFlowers = 1 + int(branches[b].depth * 0.5f);
-					
+				
 					// Add flowers starting from the last node and moving backwards
 					for (int i = 0; i < numFlowers; i++)
 					{
 						// Only add flowers if random chance succeeds
-						if (uniformGenerator.RandomFloat() < 0.4f)
+						if (uniformGenerator.RandomFloat() < options.flowerChance)
 						{
 							// Calculate position along the branch
 							int nodeIndex = lastIndex - i;
 							if (nodeIndex < 0) break;  // Stop if we've gone too far back
-							
+						
 							auto& node = branchNodes[nodeIndex];
-							
+						
 							// Calculate position slightly away from the branch
 							glm::vec3 branchDirection = node->transform.forward;
 							glm::vec3 branchNormal = node->transform.up;
 							glm::vec3 offsetDirection = glm::normalize(glm::cross(branchDirection, branchNormal));
-							
+						
 							// Position the flower slightly away from the branch
 							//glm::vec3 flowerPosition = node->tipPosition() + offsetDirection * 0.1f;  // 0.1 units away from branch
 							glm::vec3 flowerPosition = node->tipPosition();
 
 							/*glm::mat4 flowerTransform = glm::translate(glm::mat4(1.0f), flowerPosition);
-							
+						
 							// Add a single flower with random orientation
 							float randomAngle = uniformGenerator.RandomFloat(-30.0f, 30.0f);
 							flowerTransform = glm::rotate(flowerTransform, glm::radians(randomAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-							
+						
 							// Add slight random offset to position
 							float offset = 0.05f * uniformGenerator.RandomFloat(-1.0f, 1.0f);
 							flowerTransform = glm::translate(flowerTransform, glm::vec3(offset, 0.0f, offset));
@@ -489,17 +1033,462 @@ void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTria
 							// Add slight random offset to position
 							float offset = 0.05f * uniformGenerator.RandomFloat(-1.0f, 1.0f);
 							flowerTransform = glm::translate(flowerTransform, glm::vec3(offset, 0.0f, offset));*/
-							crownFlowersMeshes.AppendMeshTransformed(flowerMesh, flowerTransform);
+							flowerTransforms.push_back(flowerTransform);
 						}
 					}
 				}
 			}
 		}
-	});
 
-	skeletonLines.SendToGPU();
-	branchMeshes.SendToGPU();
-	crownLeavesMeshes.SendToGPU();
-	crownFlowersMeshes.SendToGPU();
+		foliage.generatorAfter = uniformGenerator;
+		stages.foliage.Finish(foliageKey);
+	}
+	uniformGenerator = stages.foliage.value.generatorAfter;
+
+	// Copies, the budget and the levels of detail thin them. They end up as the instances of the finished tree, so they live in its arena.
+	MeshAllocator<glm::mat4> instanceAllocator{ branchMeshes.Arena() };
+	MeshVector<glm::mat4> leafTransforms{ stages.foliage.value.leaves.begin(), stages.foliage.value.leaves.end(), instanceAllocator };
+	MeshVector<glm::mat4> flowerTransforms{ stages.foliage.value.flowers.begin(), stages.foliage.value.flowers.end(), instanceAllocator };
+	workingCopyBytes = (leafTransforms.capacity() + flowerTransforms.capacity()) * sizeof(glm::mat4);
+
+	if (reachedStage(0.45f, "Budget")) return;
+
+	/*
+		Budget
+		Every cost is known at this point: the rings of each branch, the leaves left after pruning and the flowers.
+		One detail value scales the cylinder divisions, the leaf density and the flower rate together, so each part
+		keeps its share, and it is bisected until the prediction lands within the tolerance. Only a budget below the
+		coarsest detail drops whole branches, thinnest first (their leaves stay, like in the coarse LOD levels), and
+		when the trunk alone is still too much the foliage is thinned further.
+	*/
+	auto divisionsAt = [&](int depth, float detail) -> int
+	{
+		int divisions = int(round(getCylinderDivisions(depth) * detail));
+		return (divisions < 3) ? 3 : divisions;
+	};
+
+	const size_t vertexSize = TriangleMesh::VertexSize(options.vertexLayout);
+	const size_t indexSize = (options.chunkMeshes || options.vertexLayout == VertexLayout::PackedHalf) ? sizeof(uint16_t) : sizeof(unsigned int);
+	const size_t flowerVertexSize = TriangleMesh::VertexSize(VertexLayout::Separate);
+	const size_t flowerIndexSize = (options.chunkMeshes && !options.sortableFlowers) ? sizeof(uint16_t) : sizeof(unsigned int);
+
+	// Chunking duplicates the vertices shared between chunks, the predicted vertices are scaled by the duplication
+	// measured on trial meshes (see below)
+	bool halfPositions = (options.vertexLayout == VertexLayout::PackedHalf);
+	bool chunkFlowers = options.chunkMeshes && !options.sortableFlowers;
+	unsigned int chunkTriangles = (options.chunkMeshes && options.clusterTriangles > 0) ? options.clusterTriangles : ~0u;
+	// Half floats have 11 significant bits, chunks at most 2 units long keep the rounding error below half a millimeter
+	float chunkExtent = halfPositions ? 2.0f : 0.0f;
+	double branchDuplication = 1.0, leafDuplication = 1.0, flowerDuplication = 1.0;
+
+	auto predictCost = [&](float detail, float minThickness, float density, size_t& triangles, size_t& bytes)
+	{
+		size_t branchVertices = 0, branchTriangles = 0;
+		for (int b = 0; b < branches.size(); b++)
+		{
+			if (branchThickness[b] < minThickness) continue;
+
+			size_t divisions = divisionsAt(branches[b].depth, detail);
+			size_t rings = branchRings[b].size() - (branchRings[b][0].guide ? 1 : 0);
+			branchVertices += rings * (divisions + 1) + 1;
+			branchTriangles += 2 * divisions * (rings - 1) + divisions;
+		}
+
+		size_t leaves = size_t(leafTransforms.size() * double(density));
+		size_t flowers = size_t(flowerTransforms.size() * double(density));
+		size_t leafTriangles = leaves * (leafMesh.indices.size() / 3);
+		size_t flowerTriangles = flowers * (flowerMesh.indices.size() / 3);
+		size_t leafVertices = size_t(leaves * leafMesh.positions.size() * leafDuplication);
+		size_t flowerVertices = size_t(flowers * flowerMesh.positions.size() * flowerDuplication);
+		triangles = branchTriangles + leafTriangles + flowerTriangles;
+		bytes = (size_t(branchVertices * branchDuplication) + leafVertices) * vertexSize + (branchTriangles + leafTriangles) * 3 * indexSize
+			+ flowerVertices * flowerVertexSize + flowerTriangles * 3 * flowerIndexSize;
+	};
+
+	bool triangleBudget = options.triangleBudget > 0;
+	double target = double(triangleBudget ? options.triangleBudget : options.byteBudget);
+	auto cost = [&](float detail, float minThickness, float density) -> double
+	{
+		size_t triangles, bytes;
+		predictCost(detail, minThickness, density, triangles, bytes);
+		return double(triangleBudget ? triangles : bytes);
+	};
+	auto budgetError = [&](double value) -> double { return fabs(value - target) / target; };
+
+	// The cost grows with the detail, bisect on a log scale. At the coarsest detail the trunk is down to 3 divisions
+	// and a tenth of the leaves is left, like in the last LOD level.
+	const float minDetail = 0.1f;
+	const float maxDetail = 4.0f;
+	float detail = 1.0f;
+	float minBranchThickness = 0.0f;
+	float density = 1.0f;
+	auto searchDetail = [&](float minThickness) -> double
+	{
+		float low = minDetail, high = maxDetail;
+		double bestError = budgetError(cost(detail, minThickness, density));
+		for (int step = 0; step < 32 && bestError > options.budgetTolerance; step++)
+		{
+			float middle = sqrtf(low * high);
+			double value = cost(middle, minThickness, glm::min(middle, 1.0f));
+			if (budgetError(value) < bestError)
+			{
+				bestError = budgetError(value);
+				detail = middle;
+			}
+			if (value > target) high = middle;
+			else low = middle;
+		}
+		density = glm::min(detail, 1.0f);
+		return bestError;
+	};
+	auto searchBudget = [&]()
+	{
+		detail = 1.0f;
+		minBranchThickness = 0.0f;
+		density = 1.0f;
+		if (target <= 0.0 || budgetError(cost(detail, 0.0f, density)) <= options.budgetTolerance) return;
+		double bestError = searchDetail(0.0f);
+
+		// Still too expensive at the coarsest detail, raise the minimum thickness (the thickest branch always stays)
+		if (bestError > options.budgetTolerance && cost(minDetail, 0.0f, minDetail) > target)
+		{
+			detail = minDetail;
+			density = minDetail;
+			std::vector<float> thicknesses = branchThickness;
+			std::sort(thicknesses.begin(), thicknesses.end());
+			thicknesses.erase(std::unique(thicknesses.begin(), thicknesses.end()), thicknesses.end());
+
+			size_t lowIndex = 0, highIndex = thicknesses.size() - 1;
+			while (lowIndex < highIndex)
+			{
+				size_t middle = (lowIndex + highIndex) / 2;
+				if (cost(detail, thicknesses[middle], density) > target) lowIndex = middle + 1;
+				else highIndex = middle;
+			}
+			if (lowIndex > 0 && budgetError(cost(detail, thicknesses[lowIndex - 1], density)) < budgetError(cost(detail, thicknesses[lowIndex], density))) lowIndex--;
+			minBranchThickness = thicknesses[lowIndex];
+
+			double value = cost(detail, minBranchThickness, density);
+			if (budgetError(value) > options.budgetTolerance && value < target)
+			{
+				// Dropping a whole thickness class can leave the cost well below the target, the detail of the
+				// remaining branches and the foliage is raised again to fill it
+				searchDetail(minBranchThickness);
+			}
+			else if (budgetError(value) > options.budgetTolerance)
+			{
+				// Still above the target with the thinner branches dropped, the foliage is thinned further
+				float lowDensity = 0.0f, highDensity = minDetail;
+				for (int step = 0; step < 32; step++)
+				{
+					density = 0.5f * (lowDensity + highDensity);
+					double value = cost(detail, minBranchThickness, density);
+					if (budgetError(value) <= options.budgetTolerance) break;
+					if (value > target) highDensity = density;
+					else lowDensity = density;
+				}
+			}
+		}
+	};
+	searchBudget();
+
+	// The duplication of chunked vertices depends on the geometry, it is measured by chunking trial meshes at the chosen
+	// detail and the search runs again with it. The duplication changes with the detail, so this repeats a few times.
+	bool chunked = options.chunkMeshes || halfPositions;
+	if (!triangleBudget && target > 0.0 && chunked)
+	{
+		auto duplication = [&](TriangleMesh& mesh, float maxExtent) -> double
+		{
+			if (mesh.positions.empty()) return 1.0;
+			size_t vertices = mesh.positions.size();
+			BuildMeshChunks(mesh, 65535, chunkTriangles, maxExtent);
+			return double(mesh.positions.size()) / double(vertices);
+		};
+		for (int round = 0; round < 4; round++)
+		{
+			TriangleMesh trialBranches, trialLeaves, trialFlowers;
+			for (int b = 0; b < branches.size(); b++)
+			{
+				if (branchThickness[b] < minBranchThickness) continue;
+				meshBranchRings(branches[b], branchRings[b], divisionsAt(branches[b].depth, detail), trialBranches);
+			}
+			MeshVector<glm::mat4> trialTransforms = leafTransforms;
+			thinFoliage(trialTransforms, density, true);
+			for (auto& transform : trialTransforms) trialLeaves.AppendMeshTransformed(leafMesh, transform);
+			branchDuplication = duplication(trialBranches, chunkExtent);
+			leafDuplication = duplication(trialLeaves, chunkExtent);
+			if (chunkFlowers)
+			{
+				trialTransforms = flowerTransforms;
+				thinFoliage(trialTransforms, density, false);
+				for (auto& transform : trialTransforms) trialFlowers.AppendMeshTransformed(flowerMesh, transform);
+				flowerDuplication = duplication(trialFlowers, 0.0f);
+			}
+
+			if (round == 3 || budgetError(cost(detail, minBranchThickness, density)) <= options.budgetTolerance) break;
+			searchBudget();
+		}
+	}
+
+	budget.detail = detail;
+	budget.minBranchThickness = minBranchThickness;
+	budget.leafDensity = density;
+	budget.flowerRate = density;
+	budget.cylinderDivisions.clear();
+	for (int depth = 0; depth <= maxBranchDepth; depth++)
+	{
+		budget.cylinderDivisions.push_back(divisionsAt(depth, detail));
+	}
+	predictCost(detail, minBranchThickness, density, budget.predictedTriangles, budget.predictedBytes);
+
+
+	if (reachedStage(0.5f, "Meshing")) return;
+
+	/*
+		Mesh the branches and the foliage with the chosen detail.
+		A progressive generation meshes the branches one depth at a time so the trunk can be shown first,
+		a reused mesh is published whole.
+	*/
+	branchMeshKey = StageKey{}.Value(ringsKey).Vector(budget.cylinderDivisions).Value(minBranchThickness).Value(progressive).hash;
+	size_t publishedVertices = 0, publishedIndices = 0;
+	if (reuseStage(stages.branchMesh, branchMeshKey, "branch mesh"))
+	{
+		branchMeshes = stages.branchMesh.value.mesh;
+		buriedTriangles = stages.branchMesh.value.buriedTriangles;
+		publishMesh(TreePartKind::Branches, maxBranchDepth, branchMeshes, publishedVertices, publishedIndices);
+	}
+	else
+	{
+		std::vector<int> branchOrder(branches.size());
+		for (int b = 0; b < branches.size(); b++) branchOrder[b] = b;
+		if (progressive)
+		{
+			std::stable_sort(branchOrder.begin(), branchOrder.end(), [&](int a, int b) { return branches[a].depth < branches[b].depth; });
+		}
+
+		for (int i = 0; i < branchOrder.size(); i++)
+		{
+			int b = branchOrder[i];
+			if (branchThickness[b] < minBranchThickness) continue;
+
+			int cylinderDivisions = budget.cylinderDivisions[branches[b].depth];
+			buriedTriangles += buriedRings[b] * 2 * cylinderDivisions;
+			meshBranchRings(branches[b], branchRings[b], cylinderDivisions, branchMeshes);
+
+			bool lastOfDepth = (i + 1 == branchOrder.size()) || (branches[branchOrder[i + 1]].depth != branches[b].depth);
+			if (progressive && lastOfDepth)
+			{
+				publishMesh(TreePartKind::Branches, branches[b].depth, branchMeshes, publishedVertices, publishedIndices);
+				if (reachedStage(0.5f + 0.05f * (branches[b].depth + 1) / float(maxBranchDepth + 1), "Meshing")) return;
+			}
+		}
+
+		if (keepMeshes)
+		{
+			stages.branchMesh.value.mesh = branchMeshes;
+			stages.branchMesh.value.buriedTriangles = buriedTriangles;
+			stages.branchMesh.Finish(branchMeshKey);
+		}
+	}
+
+	// Foliage is published in batches of this many placements
+	const size_t foliagePerPart = 2048;
+	auto meshFoliage = [&](MemoizedStage<TriangleMesh>& stage, uint64_t key, const char* name, TreePartKind kind, const TriangleMesh& sourceMesh, const MeshVector<glm::mat4>& transforms, TriangleMesh& targetMesh)
+	{
+		publishedVertices = publishedIndices = 0;
+		if (reuseStage(stage, key, name))
+		{
+			targetMesh = stage.value;
+			publishMesh(kind, 0, targetMesh, publishedVertices, publishedIndices);
+			return;
+		}
+
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			targetMesh.AppendMeshTransformed(sourceMesh, transforms[i]);
+			if ((i + 1) % foliagePerPart == 0 || i + 1 == transforms.size())
+			{
+				publishMesh(kind, 0, targetMesh, publishedVertices, publishedIndices);
+			}
+		}
+		if (keepMeshes)
+		{
+			stage.value = targetMesh;
+			stage.Finish(key);
+		}
+	};
+	thinFoliage(leafTransforms, budget.leafDensity, true);
+	thinFoliage(flowerTransforms, budget.flowerRate, false);
+	leavesKey = StageKey{}.Value(foliageKey).Value(budget.leafDensity).Value(leafMeshKey).hash;
+	flowersKey = StageKey{}.Value(foliageKey).Value(budget.flowerRate).Value(flowerMeshKey).hash;
+	meshFoliage(stages.leaves, leavesKey, "leaves", TreePartKind::Leaves, leafMesh, leafTransforms, crownLeavesMeshes);
+	meshFoliage(stages.flowers, flowersKey, "flowers", TreePartKind::Flowers, flowerMesh, flowerTransforms, crownFlowersMeshes);
+
+	if (reachedStage(0.6f, "Levels of detail")) return;
+
+	/*
+		Coarser levels of detail reuse the skeleton and the foliage placements
+	*/
+	if (lodChain)
+	{
+		for (auto& lodSettings : lodChain->settings)
+		{
+			lodChain->levels.push_back(std::make_unique<TreeLODLevel>(lodSettings));
+			TreeLODLevel& level = *lodChain->levels.back();
+
+			for (auto& branch : branches)
+			{
+				float rootThickness = getBranchThickness(branch.depth, branch.nodes[0]->nodeDepth);
+				float projectedThickness = 2.0f * rootThickness / lodSettings.switchDistance * lodChain->pixelsPerRadian;
+				if (projectedThickness < lodSettings.minProjectedThickness || rootThickness < budget.minBranchThickness) continue;
+
+				int cylinderDivisions = int(round(budget.cylinderDivisions[branch.depth] * lodSettings.cylinderDivisionScale));
+				meshBranch(branch, (cylinderDivisions < 3) ? 3 : cylinderDivisions, options.ringTolerance / lodSettings.cylinderDivisionScale, level.branches);
+			}
+
+			appendThinnedFoliage(level.leaves, leafMesh, leafTransforms, lodSettings.leafDensity);
+			appendThinnedFoliage(level.flowers, flowerMesh, flowerTransforms, lodSettings.leafDensity);
+		}
+	}
+
+	/*
+		Ray query primitives: a capsule per bone and a quad per leaf
+	*/
+	if (bvh)
+	{
+		for (auto& branch : branches)
+		{
+			for (auto& bone : branch.nodes)
+			{
+				bvh->capsules.push_back(BVHCapsule{ bone->transform.position, bone->tipPosition(), getBranchThickness(branch.depth, bone->nodeDepth) });
+			}
+		}
+
+		// The leaf card is flat, span the quad over its two largest local extents
+		if (!leafMesh.positions.empty())
+		{
+			glm::fvec3 leafMin = leafMesh.positions[0];
+			glm::fvec3 leafMax = leafMin;
+			for (auto& p : leafMesh.positions)
+			{
+				leafMin = glm::min(leafMin, p);
+				leafMax = glm::max(leafMax, p);
+			}
+			glm::fvec3 leafExtent = leafMax - leafMin;
+			int flatAxis = (leafExtent.x < leafExtent.y) ? ((leafExtent.x < leafExtent.z) ? 0 : 2) : ((leafExtent.y < leafExtent.z) ? 1 : 2);
+			glm::fvec3 leafCorner = leafMin;
+			leafCorner[flatAxis] = 0.5f * (leafMin[flatAxis] + leafMax[flatAxis]);
+			glm::fvec3 leafEdgeU{ 0.0f }, leafEdgeV{ 0.0f };
+			leafEdgeU[(flatAxis + 1) % 3] = leafExtent[(flatAxis + 1) % 3];
+			leafEdgeV[(flatAxis + 2) % 3] = leafExtent[(flatAxis + 2) % 3];
+
+			bvh->quads.reserve(leafTransforms.size());
+			for (auto& transform : leafTransforms)
+			{
+				bvh->quads.push_back(BVHQuad{
+					glm::fvec3{ transform * glm::fvec4{ leafCorner, 1.0f } },
+					glm::fvec3{ transform * glm::fvec4{ leafEdgeU, 0.0f } },
+					glm::fvec3{ transform * glm::fvec4{ leafEdgeV, 0.0f } }
+				});
+			}
+		}
+	}
+
+	if (reachedStage(0.7f, "Welding")) return;
+	if (options.weldBranches)
+	{
+		statistics.buriedTriangles = buriedTriangles;
+		statistics.weld = WeldVertices(branchMeshes, options.weldDistance);
+	}
+
+	if (reachedStage(0.75f, "Simplification")) return;
+	if (options.simplifyBranches)
+	{
+		statistics.branchSimplification = SimplifyMesh(branchMeshes, options.branchSimplification);
+	}
+
+	if (reachedStage(0.85f, "Vertex cache")) return;
+	if (options.optimizeVertexCache)
+	{
+		statistics.vertexCache[0] = OptimizeMeshForVertexCache(branchMeshes);
+		statistics.vertexCache[1] = OptimizeMeshForVertexCache(crownLeavesMeshes);
+		if (!options.sortableFlowers) statistics.vertexCache[2] = OptimizeMeshForVertexCache(crownFlowersMeshes);
+		if (lodChain)
+		{
+			for (auto& level : lodChain->levels)
+			{
+				OptimizeMeshForVertexCache(level->branches);
+				OptimizeMeshForVertexCache(level->leaves);
+				if (!options.sortableFlowers) OptimizeMeshForVertexCache(level->flowers);
+			}
+		}
+	}
+
+	if (reachedStage(0.9f, "Chunking")) return;
+
+	// Chunking must come after the vertex cache pass, it keeps the triangle order within each chunk.
+	// Half precision positions are relative to the chunk origin, so they always need chunks small enough to keep the error low.
+	if (chunked)
+	{
+		for (TriangleMesh* mesh : { &branchMeshes, &crownLeavesMeshes, &crownFlowersMeshes })
+		{
+			if (mesh == &crownFlowersMeshes && !chunkFlowers) continue;
+			statistics.chunks += BuildMeshChunks(*mesh, 65535, chunkTriangles, (mesh == &crownFlowersMeshes) ? 0.0f : chunkExtent).chunkCount;
+		}
+
+		if (lodChain)
+		{
+			for (auto& level : lodChain->levels)
+			{
+				BuildMeshChunks(level->branches, 65535, chunkTriangles, chunkExtent);
+				BuildMeshChunks(level->leaves, 65535, chunkTriangles, chunkExtent);
+				if (chunkFlowers) BuildMeshChunks(level->flowers, 65535, chunkTriangles);
+			}
+		}
+	}
+
+	if (reachedStage(0.95f, "BVH")) return;
+	if (bvh)
+	{
+		auto buildStart = std::chrono::high_resolution_clock::now();
+		bvh->Build();
+		statistics.bvhMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - buildStart).count();
+		statistics.bvhNodes = bvh->nodes.size();
+	}
+
+	branchMeshes.vertexLayout = options.vertexLayout;
+	crownLeavesMeshes.vertexLayout = options.vertexLayout;
+	if (lodChain)
+	{
+		for (auto& level : lodChain->levels)
+		{
+			level->branches.vertexLayout = options.vertexLayout;
+			level->leaves.vertexLayout = options.vertexLayout;
+		}
+	}
+
+	// The welding, simplification and chunking passes run after the prediction, the budget is checked on the final meshes
+	budget.triangles = (branchMeshes.indices.size() + crownLeavesMeshes.indices.size() + crownFlowersMeshes.indices.size()) / 3;
+	budget.bytes = branchMeshes.GPUBytes() + crownLeavesMeshes.GPUBytes() + crownFlowersMeshes.GPUBytes();
+	size_t budgetTarget = (options.triangleBudget > 0) ? options.triangleBudget : options.byteBudget;
+	if (budgetTarget > 0)
+	{
+		size_t result = (options.triangleBudget > 0) ? budget.triangles : budget.bytes;
+		double deviation = (double(result) - double(budgetTarget)) / double(budgetTarget);
+		budget.withinBudget = fabs(deviation) <= options.budgetTolerance;
+	}
+	if (budgetReport) *budgetReport = budget;
+
+	// The passes after meshing are deterministic, their options complete the keys of the finished meshes
+	uint64_t passesKey = StageKey{}.Value(options.optimizeVertexCache).Value(options.vertexLayout).Value(options.chunkMeshes).Value(options.clusterTriangles).Value(options.sortableFlowers).hash;
+	stageOutputs.branchesKey = StageKey{}.Value(passesKey).Value(branchMeshKey).Value(options.weldBranches).Value(options.weldDistance).Value(options.simplifyBranches)
+		.Value(options.branchSimplification.targetTriangles).Value(options.branchSimplification.maxError).Value(options.branchSimplification.featureAngle)
+		.Value(options.branchSimplification.tipAngleDeficit).hash;
+	stageOutputs.leavesKey = StageKey{}.Value(passesKey).Value(leavesKey).hash;
+	stageOutputs.flowersKey = StageKey{}.Value(passesKey).Value(flowersKey).hash;
+	stageOutputs.leafInstances = std::move(leafTransforms);
+	stageOutputs.flowerInstances = std::move(flowerTransforms);
+	workingCopyBytes = 0; // the placements are part of the finished tree now
+	reachedStage(1.0f, "Done");
 }
 
@@ -1,10 +1,212 @@
 #pragma once
 
-#include "opengl/mesh.h"
-#include "opengl/canvas.h"
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include "core/meshdata.h"
+#include "core/image.h"
 #include "core/randomization.h"
 #include "generation/fractals.h"
+#include "geometry/bvh.h"
+#include "geometry/simplify.h"
+#include "geometry/leafpruning.h"
+#include "geometry/leafcard.h"
+#include "geometry/weld.h"
+#include "geometry/vertexcache.h"
 
-void GenerateLeaf(Canvas2D& leafCanvas, GLTriangleMesh& leafMesh);
-void GenerateFlower(Canvas2D& flowerCanvas, GLTriangleMesh& flowerMesh);
-void GenerateNewTree(GLLine& skeletonLines, GLTriangleMesh& branchMeshes, GLTriangleMesh& crownLeavesMeshes, GLTriangleMesh& crownFlowersMeshes, const GLTriangleMesh& leafMesh, const GLTriangleMesh& flowerMesh, UniformRandomGenerator& uniformGenerator, int treeIterations, int treeSubdivisions, bool showFlowers);
\ No newline at end of file
+/*
+	Optional passes applied to the generated meshes
+*/
+// Bump when a change to the generation changes its output, it invalidates the cached trees (see treecache.h)
+const uint32_t treeGeneratorVersion = 7;
+
+struct TreeGenerationOptions
+{
+	TreeStyle style = TreeStyle::Default;
+	bool optimizeVertexCache = false;	// reorder triangles and vertices for the post-transform cache before uploading
+	VertexLayout vertexLayout = VertexLayout::Separate; // GPU vertex format of the branches and leaves (flowers keep the float streams)
+	bool chunkMeshes = false;			// split the meshes into spatial chunks of at most 65535 vertices with 16-bit indices
+	unsigned int clusterTriangles = 0;	// when above zero the chunks are also limited to this many triangles and serve as frustum culling clusters
+	bool weldBranches = false;			// drop branch rings buried inside the parent branch and weld vertices closer than weldDistance
+	float weldDistance = 1e-4f;
+	bool simplifyBranches = false;		// decimate the branch mesh with branchSimplification, for exports with a polygon budget
+	SimplifyOptions branchSimplification;
+	int trunkCylinderDivisions = 32;	// halved with every branch depth, the budget scales them further
+	float ringTolerance = 0.0f;			// when above zero the branch rings follow a spline through the bones and are placed by curvature, the value is the allowed bend (sine of the angle) and relative thickness change between rings
+	bool sortableFlowers = false;		// keep every flower as its own contiguous vertex and index range (no vertex cache pass or chunking) so they can be depth sorted, see geometry/depthsort.h
+	float leafScale = 1.0f;				// multiplies the random size of every leaf
+	float flowerChance = 0.4f;			// chance of a flower on each of the last nodes of a branch
+	bool pruneHiddenLeaves = false;		// remove leaves deep inside the crown that get little light, see geometry/leafpruning.h
+	LeafPruningOptions leafPruning;
+	size_t triangleBudget = 0;			// when above zero the detail is chosen so the full mesh (branches, leaves and flowers) lands within budgetTolerance of this many triangles
+	size_t byteBudget = 0;				// the same for the vertex and index bytes uploaded to the GPU, used when there is no triangle budget
+	float budgetTolerance = 0.05f;
+};
+
+/*
+	Detail chosen by a budgeted generation, the defaults are the unbudgeted tree
+*/
+struct TreeBudgetReport
+{
+	size_t bones = 0;					// of the skeleton
+	size_t branches = 0;
+	float detail = 1.0f;				// the value the search settled on, the choices below follow from it
+	std::vector<int> cylinderDivisions;	// per branch depth
+	float minBranchThickness = 0.0f;	// thinner branches are not meshed, their leaves are kept
+	float leafDensity = 1.0f;			// fraction of the leaves kept, the survivors are enlarged to keep the foliage area
+	float flowerRate = 1.0f;			// fraction of the flowers kept
+	size_t predictedTriangles = 0;		// before meshing
+	size_t predictedBytes = 0;
+	size_t triangles = 0;				// of the uploaded meshes, after welding, simplification and chunking
+	size_t bytes = 0;
+	bool withinBudget = true;
+};
+
+/*
+	Progressive generation publishes the meshes while they are built: the skeleton, then the branches one depth
+	at a time (trunk first) and then the leaves and flowers in batches. A part only holds what was added since the
+	previous part of the same mesh, its indices already count the vertices published before it.
+	The parts are the raw meshes, the optional passes (welding, vertex cache, chunking, packed layouts) only apply to the final result.
+*/
+enum class TreePartKind
+{
+	Skeleton,
+	Branches,
+	Leaves,
+	Flowers
+};
+
+struct TreePart
+{
+	TreePartKind kind = TreePartKind::Skeleton;
+	int branchDepth = 0;
+	LineMesh lines;		// skeleton
+	TriangleMesh mesh;	// new vertices and triangles
+};
+
+/*
+	Shared with a generation running on another thread, it tells how far the generation got and lets the caller stop it.
+	A cancelled generation returns at the next stage and leaves the meshes incomplete.
+*/
+struct TreeGenerationProgress
+{
+	std::atomic<float> fraction{ 0.0f };
+	std::atomic<const char*> stage{ "" };
+	std::atomic<bool> cancel{ false };
+	std::function<void(TreePart&&)> publishPart; // when set the generation is progressive, it is called on the generating thread
+};
+
+/*
+	Level of detail
+*/
+struct TreeLODSettings
+{
+	float switchDistance = 0.0f;		// camera distance at which this level becomes active
+	float cylinderDivisionScale = 1.0f;	// multiplies the cylinder divisions of every branch depth
+	float minProjectedThickness = 0.0f;	// branches thinner than this (in pixels at switchDistance) are dropped
+	float leafDensity = 1.0f;			// fraction of leaves and flowers kept, the survivors are enlarged to keep the foliage area
+};
+
+class TreeLODLevel
+{
+public:
+	TreeLODSettings settings;
+	TriangleMesh branches;
+	TriangleMesh leaves;
+	TriangleMesh flowers;
+
+	TreeLODLevel(TreeLODSettings levelSettings) : settings{ levelSettings } {}
+	~TreeLODLevel() = default;
+};
+
+class TreeLODChain
+{
+public:
+	// Coarser levels in order of increasing switch distance. The full mesh is used below the first switch distance.
+	std::vector<TreeLODSettings> settings = {
+		TreeLODSettings{ 25.0f, 0.5f,   1.0f, 0.5f },
+		TreeLODSettings{ 45.0f, 0.25f,  2.0f, 0.25f },
+		TreeLODSettings{ 70.0f, 0.125f, 3.0f, 0.1f }
+	};
+	std::vector<std::unique_ptr<TreeLODLevel>> levels;
+
+	float hysteresis = 0.1f;		// fraction of the switch distance the camera must pass before the level changes
+	float pixelsPerRadian = 720.0f;	// viewport height divided by the vertical field of view
+	int activeLevel = -1;			// -1 is the full mesh
+
+	TreeLODChain() = default;
+	~TreeLODChain() = default;
+
+	void Clear();
+
+	// Returns the level to draw at the given camera distance, nullptr means the full mesh.
+	TreeLODLevel* SelectLevel(float cameraDistance);
+};
+
+/*
+	Memoized generation stages
+	A generation runs as a chain of stages: symbols, skeleton, branch rings, foliage placements, branch mesh and
+	foliage meshes. With a stage cache each stage keeps its last output under a hash of its inputs, and the key of a
+	stage includes the keys of the stages it reads, so a stage only reruns when something upstream of it changed.
+	A new leaf scale or flower chance reruns the foliage placement, new cylinder divisions only remesh the branches.
+	The levels of detail and the passes after meshing (welding, vertex cache, chunking, BVH) always run.
+	One generation at a time, a generator owns one (see treeworker.h).
+*/
+struct TreeStageTime
+{
+	const char* stage;	// as reported in TreeGenerationProgress
+	double milliseconds;
+};
+
+// Figures of the passes of a generation, generation prints nothing itself. Passes that did not run leave theirs at zero.
+struct TreeGenerationStatistics
+{
+	LeafPruningStatistics leafPruning;
+	size_t buriedTriangles = 0;				// culled at the branch junctions by the welding pass
+	WeldStatistics weld;
+	SimplifyStatistics branchSimplification;
+	VertexCacheStatistics vertexCache[3];	// branches, leaves and flowers
+	int chunks = 0;							// of the full detail meshes
+	size_t bvhNodes = 0;
+	double bvhMilliseconds = 0.0;
+	std::vector<const char*> reusedStages;	// taken from the stage cache
+
+	// Most bytes the stage outputs and the working copies held besides the finished meshes, sampled at the stage boundaries.
+	// The finished tree plus this bounds the memory a generation needs, the scratch memory inside a pass is not included.
+	size_t peakStageBytes = 0;
+};
+
+class TreeStageCache
+{
+public:
+	struct Stages;
+	std::unique_ptr<Stages> stages; // the stage outputs, defined in tree.cpp
+
+	// Keys of the finished meshes, they include the passes after meshing. A mesh whose key did not change
+	// since the previous generation is identical and does not need to be uploaded again.
+	uint64_t branchesKey = 0;
+	uint64_t leavesKey = 0;
+	uint64_t flowersKey = 0;
+
+	std::vector<TreeStageTime> stageTimes; // of the last generation, in order
+	TreeGenerationStatistics statistics; // of the last generation
+
+	// Placements of the last generation's leaves and flowers, the foliage meshes are the leaf and flower meshes transformed by them.
+	// They come from the arena of the branch mesh the generation was given.
+	MeshVector<glm::mat4> leafInstances;
+	MeshVector<glm::mat4> flowerInstances;
+
+	TreeStageCache();
+	~TreeStageCache();
+
+	void Clear();
+};
+
+/*
+	Generation only fills the CPU side containers, uploading them is up to the caller.
+	The tree meshes keep their arena (see MeshArena), so a tree can be built straight into shared memory.
+*/
+void GenerateLeaf(Image& leafImage, TriangleMesh& leafMesh, LeafCardStatistics* cardStatistics = nullptr); // cardStatistics stays untouched when the convex hull is used instead of a card
+void GenerateFlower(Image& flowerImage, TriangleMesh& flowerMesh);
+void GenerateNewTree(LineMesh& skeletonLines, TriangleMesh& branchMeshes, TriangleMesh& crownLeavesMeshes, TriangleMesh& crownFlowersMeshes, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh, UniformRandomGenerator& uniformGenerator, int treeIterations, int treeSubdivisions, bool showFlowers, const TreeGenerationOptions& options = TreeGenerationOptions{}, TreeLODChain* lodChain = nullptr, BoundingVolumeHierarchy* bvh = nullptr, TreeBudgetReport* budgetReport = nullptr, TreeGenerationProgress* progress = nullptr, TreeStageCache* stageCache = nullptr);
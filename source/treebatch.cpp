@@ -0,0 +1,191 @@
+#include "treebatch.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+size_t TreeSweepGrid::PointCount() const
+{
+	size_t iterations = size_t(std::max(maxIterations - minIterations + 1, 0));
+	size_t subdivisions = size_t(std::max(maxSubdivisions - minSubdivisions + 1, 0));
+	return styles.size() * iterations * subdivisions * size_t(std::max(seedCount, 0));
+}
+
+TreeBatchJob TreeSweepGrid::Point(size_t index) const
+{
+	size_t subdivisionCount = size_t(maxSubdivisions - minSubdivisions + 1);
+	size_t iterationCount = size_t(maxIterations - minIterations + 1);
+
+	TreeBatchJob job;
+	job.seed = firstSeed + index % seedCount;
+	index /= seedCount;
+	job.subdivisions = minSubdivisions + int(index % subdivisionCount);
+	index /= subdivisionCount;
+	job.iterations = minIterations + int(index % iterationCount);
+	index /= iterationCount;
+	job.style = styles[index];
+	job.showFlowers = showFlowers;
+	return job;
+}
+
+std::vector<size_t> TreeSweepGrid::ShardPoints(int shard, int shardCount) const
+{
+	std::vector<size_t> points;
+	for (size_t point = size_t(shard); point < PointCount(); point += size_t(shardCount))
+	{
+		points.push_back(point);
+	}
+	return points;
+}
+
+TreeGenerationRequest TreeBatchRequest(const TreeBatchJob& job, const TreeGenerationRequest& settings)
+{
+	TreeGenerationRequest request = settings;
+	request.seed = job.seed;
+	request.options.style = job.style;
+	request.iterations = job.iterations;
+	request.subdivisions = job.subdivisions;
+	request.showFlowers = job.showFlowers;
+	request.progressive = false;
+	request.options.branchSimplification.threadCount = 1; // the batch threads already use the cores, the result does not depend on it
+	return request;
+}
+
+TreeBatchStatistics GenerateTreeBatch(const std::vector<TreeBatchJob>& jobs, const TreeBatchSettings& settings, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh,
+	const std::function<void(size_t jobIndex, TreeGenerationResult& result)>& write, TreeCache* cache)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	TreeBatchStatistics statistics;
+
+	struct FinishedTree
+	{
+		size_t job;
+		size_t bytes;
+		std::unique_ptr<TreeGenerationResult> result;
+	};
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<FinishedTree> finishedTrees;
+	size_t nextJob = 0;
+	size_t writtenJobs = 0;
+	int inFlight = 0;
+	size_t waitingBytes = 0;	// finished and not written yet
+	size_t largestWorkingBytes = 0;	// the estimate for a tree in flight, see TreeWorkingBytes
+
+	// When each job started, finished and was written, counted in events, for the peak memory once the batch is done.
+	// A tree in flight holds its working bytes from its start to its end, a finished one its result bytes until it is written.
+	struct JobMemory
+	{
+		size_t started = 0;
+		size_t finished = 0;
+		size_t written = 0;
+		size_t workingBytes = 0;
+		size_t resultBytes = 0;
+	};
+	std::vector<JobMemory> jobMemory(jobs.size());
+	size_t events = 0;
+
+	auto generate = [&](TreeGenerator& generator)
+	{
+		std::unique_lock<std::mutex> lock{ mutex };
+		while (true)
+		{
+			// Backpressure, a job is only started while another tree the size of the largest one still fits.
+			// Without anything waiting or in flight the next job always starts, so a tree larger than the cap cannot stall the batch.
+			wake.wait(lock, [&]()
+			{
+				bool idle = finishedTrees.empty() && inFlight == 0;
+				return nextJob >= jobs.size() || idle || waitingBytes + (inFlight + 1) * largestWorkingBytes <= settings.memoryByteCap;
+			});
+			if (nextJob >= jobs.size()) return;
+
+			size_t job = nextJob++;
+			inFlight++;
+			jobMemory[job].started = events++;
+			lock.unlock();
+
+			std::unique_ptr<TreeGenerationResult> result = generator.Generate(TreeBatchRequest(jobs[job], settings.request));
+			size_t bytes = TreeResultBytes(*result);
+			size_t workingBytes = TreeWorkingBytes(*result);
+
+			lock.lock();
+			inFlight--;
+			waitingBytes += bytes;
+			largestWorkingBytes = (workingBytes > largestWorkingBytes) ? workingBytes : largestWorkingBytes;
+			jobMemory[job].finished = events++;
+			jobMemory[job].workingBytes = workingBytes;
+			jobMemory[job].resultBytes = bytes;
+			finishedTrees.push_back(FinishedTree{ job, bytes, std::move(result) });
+			wake.notify_all();
+		}
+	};
+
+	// Every thread generates through a generator of its own, so each keeps its own stage cache
+	int threadCount = (settings.threadCount > 0) ? settings.threadCount : int(std::thread::hardware_concurrency());
+	threadCount = (threadCount < 1) ? 1 : threadCount;
+	std::vector<std::unique_ptr<TreeGenerator>> generators;
+	for (int i = 0; i < threadCount; i++)
+	{
+		generators.push_back(std::make_unique<TreeGenerator>(leafMesh, flowerMesh, cache));
+	}
+	std::vector<std::thread> threads;
+	for (auto& generator : generators)
+	{
+		threads.emplace_back(generate, std::ref(*generator));
+	}
+
+	// The calling thread writes the trees as they come in
+	std::unique_lock<std::mutex> lock{ mutex };
+	while (writtenJobs < jobs.size())
+	{
+		wake.wait(lock, [&]() { return !finishedTrees.empty(); });
+		FinishedTree finished = std::move(finishedTrees.front());
+		finishedTrees.pop_front();
+		lock.unlock();
+
+		TreeGenerationResult& result = *finished.result;
+		statistics.trees++;
+		statistics.triangles += (result.branches.indices.size() + result.leaves.indices.size() + result.flowers.indices.size()) / 3;
+		statistics.cachedTrees += result.fromCache ? 1 : 0;
+		for (auto& time : result.stageTimes)
+		{
+			auto total = std::find_if(statistics.stageTimes.begin(), statistics.stageTimes.end(), [&](const TreeStageTime& t) { return strcmp(t.stage, time.stage) == 0; });
+			if (total == statistics.stageTimes.end()) statistics.stageTimes.push_back(time);
+			else total->milliseconds += time.milliseconds;
+		}
+		if (write) write(finished.job, result);
+		finished.result.reset();
+
+		lock.lock();
+		writtenJobs++;
+		waitingBytes -= finished.bytes;
+		jobMemory[finished.job].written = events++;
+		wake.notify_all();
+	}
+	lock.unlock();
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::vector<long long> memoryChange(events + 1, 0);
+	for (auto& memory : jobMemory)
+	{
+		memoryChange[memory.started] += (long long)(memory.workingBytes);
+		memoryChange[memory.finished] += (long long)(memory.resultBytes) - (long long)(memory.workingBytes);
+		memoryChange[memory.written] -= (long long)(memory.resultBytes);
+	}
+	long long memoryBytes = 0;
+	for (long long change : memoryChange)
+	{
+		memoryBytes += change;
+		statistics.peakMemoryBytes = (size_t(memoryBytes) > statistics.peakMemoryBytes) ? size_t(memoryBytes) : statistics.peakMemoryBytes;
+	}
+	statistics.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return statistics;
+}
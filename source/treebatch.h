@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include "treeworker.h"
+
+/*
+	Batch generation
+	Generates a list of trees on a pool of threads and hands each one to a callback as soon as it is finished.
+	A tree only depends on its job and the shared request settings, every job seeds a generator of its own, so
+	the output is bit identical whatever the thread count or the order the jobs finish in.
+	Finished trees that were not written yet count against a memory cap, together with an estimate for the trees
+	in flight (the largest working set so far, see TreeWorkingBytes), and the threads wait before starting another job
+	while it is reached.
+*/
+
+class TreeCache;
+
+struct TreeBatchJob
+{
+	uint64_t seed = 1;
+	TreeStyle style = TreeStyle::Default;
+	int iterations = 5;
+	int subdivisions = 3;
+	bool showFlowers = true;
+};
+
+struct TreeBatchSettings
+{
+	TreeGenerationRequest request;		// everything that is not part of a job, the job fields replace its seed, style, iterations, subdivisions and flowers
+	int threadCount = 0;				// 0 uses the hardware concurrency
+	size_t memoryByteCap = 1ull << 30;	// see TreeResultBytes
+};
+
+struct TreeBatchStatistics
+{
+	size_t trees = 0;
+	size_t triangles = 0;
+	size_t cachedTrees = 0;
+	size_t peakMemoryBytes = 0;			// at once, of the trees in flight at their working bytes and those waiting to be written
+	double seconds = 0.0;				// wall clock, including the writing
+	std::vector<TreeStageTime> stageTimes; // summed over the generated trees, per stage
+
+	double TreesPerSecond() const { return (seconds > 0.0) ? trees / seconds : 0.0; }
+	double TrianglesPerSecond() const { return (seconds > 0.0) ? triangles / seconds : 0.0; }
+};
+
+/*
+	Parameter sweep
+	The grid enumerates every style, iteration count, subdivision count and seed, with the seed changing fastest.
+	A shard takes every shardCount-th point starting at shard, so the shards of a grid never overlap, together cover it,
+	and share the expensive points evenly. The points keep their index in the whole grid.
+*/
+struct TreeSweepGrid
+{
+	std::vector<TreeStyle> styles{ TreeStyle::Default };
+	int minIterations = 5;
+	int maxIterations = 5;
+	int minSubdivisions = 3;
+	int maxSubdivisions = 3;
+	uint64_t firstSeed = 1;
+	int seedCount = 1;
+	bool showFlowers = true;
+
+	size_t PointCount() const;
+	TreeBatchJob Point(size_t index) const;
+
+	// Indices of the points of a shard, in order
+	std::vector<size_t> ShardPoints(int shard, int shardCount) const;
+};
+
+TreeGenerationRequest TreeBatchRequest(const TreeBatchJob& job, const TreeGenerationRequest& settings);
+
+// The trees are handed to write on the calling thread, one at a time, in the order they finish
+TreeBatchStatistics GenerateTreeBatch(const std::vector<TreeBatchJob>& jobs, const TreeBatchSettings& settings, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh,
+	const std::function<void(size_t jobIndex, TreeGenerationResult& result)>& write, TreeCache* cache = nullptr);
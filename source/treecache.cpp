@@ -0,0 +1,298 @@
+#include "treecache.h"
+#include <fstream>
+#include "core/bytestream.h"
+
+const uint32_t treeCacheMagic = 0x31435254; // "TRC1"
+
+// 64-bit FNV-1a
+static uint64_t HashBytes(const std::vector<uint8_t>& bytes)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for (uint8_t byte : bytes)
+	{
+		hash = (hash ^ byte) * 0x100000001B3ull;
+	}
+	return hash;
+}
+
+uint64_t TreeCacheKey(const TreeGenerationRequest& request, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh)
+{
+	// Every field is written on its own so that struct padding never ends up in the hash.
+	// The progressive flag only changes the order of the branch triangles, it is left out,
+	// and so is the simplification thread count, the parts are simplified independently.
+	std::vector<uint8_t> bytes;
+	ByteWriter writer{ bytes };
+	writer.Value(treeGeneratorVersion);
+	writer.Value(request.seed);
+	writer.Value(request.iterations);
+	writer.Value(request.subdivisions);
+	writer.Value(request.showFlowers);
+	writer.Value(request.buildBVH);
+
+	const TreeGenerationOptions& options = request.options;
+	writer.Value(options.style);
+	writer.Value(options.optimizeVertexCache);
+	writer.Value(options.vertexLayout);
+	writer.Value(options.chunkMeshes);
+	writer.Value(options.clusterTriangles);
+	writer.Value(options.weldBranches);
+	writer.Value(options.weldDistance);
+	writer.Value(options.simplifyBranches);
+	writer.Value(options.branchSimplification.targetTriangles);
+	writer.Value(options.branchSimplification.maxError);
+	writer.Value(options.branchSimplification.featureAngle);
+	writer.Value(options.branchSimplification.tipAngleDeficit);
+	writer.Value(options.trunkCylinderDivisions);
+	writer.Value(options.ringTolerance);
+	writer.Value(options.sortableFlowers);
+	writer.Value(options.leafScale);
+	writer.Value(options.flowerChance);
+	writer.Value(options.pruneHiddenLeaves);
+	writer.Value(options.leafPruning.voxelSize);
+	writer.Value(options.leafPruning.shadowDepth);
+	writer.Value(options.leafPruning.shadowFalloff);
+	writer.Value(options.leafPruning.extinction);
+	writer.Value(options.leafPruning.exposureThreshold);
+	writer.Value(options.leafPruning.keepShell);
+	writer.Value(uint64_t(options.triangleBudget));
+	writer.Value(uint64_t(options.byteBudget));
+	writer.Value(options.budgetTolerance);
+
+	writer.Value(uint64_t(request.lodSettings.size()));
+	for (auto& lod : request.lodSettings)
+	{
+		writer.Value(lod.switchDistance);
+		writer.Value(lod.cylinderDivisionScale);
+		writer.Value(lod.minProjectedThickness);
+		writer.Value(lod.leafDensity);
+	}
+	writer.Value(request.lodPixelsPerRadian);
+
+	writer.Mesh(leafMesh);
+	writer.Mesh(flowerMesh);
+	return HashBytes(bytes);
+}
+
+static void SerializeTree(uint64_t key, const TreeGenerationResult& result, std::vector<uint8_t>& bytes)
+{
+	ByteWriter writer{ bytes };
+	writer.Value(treeCacheMagic);
+	writer.Value(treeGeneratorVersion);
+	writer.Value(key);
+
+	writer.Vector(result.skeletonLines.lineSegments);
+	writer.Vector(result.skeletonLines.colors);
+	writer.Mesh(result.branches);
+	writer.Mesh(result.leaves);
+	writer.Mesh(result.flowers);
+
+	writer.Value(uint64_t(result.lodChain.levels.size()));
+	for (auto& level : result.lodChain.levels)
+	{
+		writer.Value(level->settings);
+		writer.Mesh(level->branches);
+		writer.Mesh(level->leaves);
+		writer.Mesh(level->flowers);
+	}
+
+	writer.Vector(result.bvh.capsules);
+	writer.Vector(result.bvh.quads);
+	writer.Vector(result.leafInstances);
+	writer.Vector(result.flowerInstances);
+
+	const TreeBudgetReport& budget = result.budget;
+	writer.Value(uint64_t(budget.bones));
+	writer.Value(uint64_t(budget.branches));
+	writer.Value(budget.detail);
+	writer.Vector(budget.cylinderDivisions);
+	writer.Value(budget.minBranchThickness);
+	writer.Value(budget.leafDensity);
+	writer.Value(budget.flowerRate);
+	writer.Value(uint64_t(budget.predictedTriangles));
+	writer.Value(uint64_t(budget.predictedBytes));
+	writer.Value(uint64_t(budget.triangles));
+	writer.Value(uint64_t(budget.bytes));
+	writer.Value(budget.withinBudget);
+	writer.Value(result.milliseconds);
+}
+
+static bool DeserializeTree(uint64_t key, const std::vector<uint8_t>& bytes, TreeGenerationResult& result)
+{
+	ByteReader reader{ bytes.data(), bytes.data() + bytes.size() };
+	uint32_t magic = 0, version = 0;
+	uint64_t storedKey = 0;
+	reader.Value(magic);
+	reader.Value(version);
+	reader.Value(storedKey);
+	if (!reader.valid || magic != treeCacheMagic || version != treeGeneratorVersion || storedKey != key) return false;
+
+	reader.Vector(result.skeletonLines.lineSegments);
+	reader.Vector(result.skeletonLines.colors);
+	reader.Mesh(result.branches);
+	reader.Mesh(result.leaves);
+	reader.Mesh(result.flowers);
+
+	uint64_t levelCount = 0;
+	reader.Value(levelCount);
+	result.lodChain.levels.clear();
+	for (uint64_t i = 0; i < levelCount && reader.valid; i++)
+	{
+		TreeLODSettings settings;
+		reader.Value(settings);
+		result.lodChain.levels.push_back(std::make_unique<TreeLODLevel>(settings));
+		reader.Mesh(result.lodChain.levels.back()->branches);
+		reader.Mesh(result.lodChain.levels.back()->leaves);
+		reader.Mesh(result.lodChain.levels.back()->flowers);
+	}
+
+	result.bvh.Clear();
+	reader.Vector(result.bvh.capsules);
+	reader.Vector(result.bvh.quads);
+	reader.Vector(result.leafInstances);
+	reader.Vector(result.flowerInstances);
+
+	TreeBudgetReport& budget = result.budget;
+	uint64_t bones = 0, branches = 0, predictedTriangles = 0, predictedBytes = 0, triangles = 0, budgetBytes = 0;
+	reader.Value(bones);
+	reader.Value(branches);
+	reader.Value(budget.detail);
+	reader.Vector(budget.cylinderDivisions);
+	reader.Value(budget.minBranchThickness);
+	reader.Value(budget.leafDensity);
+	reader.Value(budget.flowerRate);
+	reader.Value(predictedTriangles);
+	reader.Value(predictedBytes);
+	reader.Value(triangles);
+	reader.Value(budgetBytes);
+	reader.Value(budget.withinBudget);
+	reader.Value(result.milliseconds);
+	budget.bones = size_t(bones);
+	budget.branches = size_t(branches);
+	budget.predictedTriangles = size_t(predictedTriangles);
+	budget.predictedBytes = size_t(predictedBytes);
+	budget.triangles = size_t(triangles);
+	budget.bytes = size_t(budgetBytes);
+	if (!reader.valid) return false;
+
+	if (!result.bvh.capsules.empty() || !result.bvh.quads.empty())
+	{
+		result.bvh.Build();
+	}
+	return true;
+}
+
+TreeCache::TreeCache(size_t memoryByteCap, std::filesystem::path storeFolder)
+	: memoryCap{ memoryByteCap }, folder{ storeFolder }
+{
+	if (!folder.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(folder, error);
+	}
+}
+
+std::filesystem::path TreeCache::EntryPath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.tree", (unsigned long long)(key));
+	return folder / name;
+}
+
+bool TreeCache::Find(uint64_t key, TreeGenerationResult& result)
+{
+	std::shared_ptr<const std::vector<uint8_t>> data;
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		auto found = entryLookup.find(key);
+		if (found != entryLookup.end())
+		{
+			entries.splice(entries.begin(), entries, found->second);
+			data = found->second->data;
+		}
+	}
+
+	// Deserialized outside the lock, the entry data is shared and never changes
+	if (data && DeserializeTree(key, *data, result))
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		statistics.memoryHits++;
+		return true;
+	}
+
+	if (!folder.empty())
+	{
+		std::ifstream file{ EntryPath(key), std::ios::binary };
+		if (file)
+		{
+			std::vector<uint8_t> bytes{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+			if (DeserializeTree(key, bytes, result))
+			{
+				Insert(key, std::move(bytes));
+				std::lock_guard<std::mutex> lock{ mutex };
+				statistics.diskHits++;
+				return true;
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock{ mutex };
+	statistics.misses++;
+	return false;
+}
+
+void TreeCache::Store(uint64_t key, const TreeGenerationResult& result)
+{
+	std::vector<uint8_t> bytes;
+	SerializeTree(key, result, bytes);
+
+	// Written next to the entry and renamed, so a reader never sees a partly written file
+	if (!folder.empty())
+	{
+		std::filesystem::path path = EntryPath(key);
+		std::filesystem::path temporaryPath = path;
+		temporaryPath += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+		{
+			std::ofstream file{ temporaryPath, std::ios::binary };
+			file.write(reinterpret_cast<const char*>(bytes.data()), std::streamsize(bytes.size()));
+		}
+		std::error_code error;
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error) std::filesystem::remove(temporaryPath, error);
+	}
+
+	Insert(key, std::move(bytes));
+}
+
+void TreeCache::Insert(uint64_t key, std::vector<uint8_t>&& data)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	auto found = entryLookup.find(key);
+	if (found != entryLookup.end())
+	{
+		statistics.memoryBytes -= found->second->data->size();
+		entries.erase(found->second);
+		entryLookup.erase(found);
+	}
+
+	// A tree larger than the whole cap is only kept on disk
+	if (data.size() > memoryCap) return;
+
+	statistics.memoryBytes += data.size();
+	entries.push_front(Entry{ key, std::make_shared<const std::vector<uint8_t>>(std::move(data)) });
+	entryLookup[key] = entries.begin();
+
+	while (statistics.memoryBytes > memoryCap)
+	{
+		statistics.memoryBytes -= entries.back().data->size();
+		entryLookup.erase(entries.back().key);
+		entries.pop_back();
+	}
+	statistics.entries = entries.size();
+}
+
+TreeCacheStatistics TreeCache::Statistics()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	statistics.entries = entries.size();
+	return statistics;
+}
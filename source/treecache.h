@@ -0,0 +1,60 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+#include <stdint.h>
+#include "treeworker.h"
+
+/*
+	Content addressed tree cache
+	Finished trees are stored under a hash of everything that decides the result: the seed, the style, the
+	iterations and subdivisions, every generation option, the leaf and flower meshes and treeGeneratorVersion.
+	Recent trees are kept in memory up to a byte cap (least recently used go first), and when a folder is set
+	every tree is also written to disk so later runs and batch jobs find it. Entries are kept serialized, the
+	same bytes go to memory and to disk. The BVH is rebuilt from its primitives when a tree is loaded.
+	Thread safe.
+*/
+
+uint64_t TreeCacheKey(const TreeGenerationRequest& request, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh);
+
+struct TreeCacheStatistics
+{
+	size_t memoryHits = 0;
+	size_t diskHits = 0;
+	size_t misses = 0;
+	size_t memoryBytes = 0;
+	size_t entries = 0;
+};
+
+class TreeCache
+{
+public:
+	TreeCache(size_t memoryByteCap = 512ull << 20, std::filesystem::path storeFolder = {});
+
+	// Fills result and returns true when the tree is cached, in memory or on disk
+	bool Find(uint64_t key, TreeGenerationResult& result);
+	void Store(uint64_t key, const TreeGenerationResult& result);
+
+	TreeCacheStatistics Statistics();
+
+protected:
+	struct Entry
+	{
+		uint64_t key;
+		std::shared_ptr<const std::vector<uint8_t>> data; // shared so that it can be read outside the lock
+	};
+
+	void Insert(uint64_t key, std::vector<uint8_t>&& data); // in memory, evicts down to the cap
+	std::filesystem::path EntryPath(uint64_t key) const;
+
+	size_t memoryCap;
+	std::filesystem::path folder;
+
+	std::mutex mutex;
+	std::list<Entry> entries; // most recently used first
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> entryLookup;
+	TreeCacheStatistics statistics;
+};
@@ -0,0 +1,141 @@
+#include "treepool.h"
+#include "treecache.h"
+
+TreePregenerationPool::TreePregenerationPool(const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh, size_t readyTrees, size_t memoryByteCap, int threadCount)
+	: leafMesh{ treeLeafMesh }, flowerMesh{ treeFlowerMesh }, capacity{ readyTrees }, memoryCap{ memoryByteCap }
+{
+	for (int i = 0; i < threadCount; i++)
+	{
+		generators.push_back(std::make_unique<TreeGenerator>(leafMesh, flowerMesh));
+	}
+	for (auto& generator : generators)
+	{
+		threads.emplace_back(&TreePregenerationPool::Run, this, generator.get());
+	}
+}
+
+TreePregenerationPool::~TreePregenerationPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+uint64_t TreePregenerationPool::SettingsKey(const TreeGenerationRequest& request) const
+{
+	TreeGenerationRequest withoutSeed = request;
+	withoutSeed.seed = 0;
+	return TreeCacheKey(withoutSeed, leafMesh, flowerMesh);
+}
+
+void TreePregenerationPool::SetSettings(const TreeGenerationRequest& request)
+{
+	uint64_t key = SettingsKey(request);
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (settings && key == settingsKey) return;
+
+		settings = std::make_unique<TreeGenerationRequest>(request);
+		settings->progressive = false; // the parts would go nowhere
+		settingsKey = key;
+		statistics.dropped += readyTrees.size();
+		readyTrees.clear();
+		readyBytes.clear();
+		largestTreeBytes = 0;
+	}
+	wake.notify_all();
+}
+
+std::unique_ptr<TreeGenerationResult> TreePregenerationPool::Take(const TreeGenerationRequest& request)
+{
+	uint64_t key = SettingsKey(request);
+	std::unique_ptr<TreeGenerationResult> result;
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (!settings || key != settingsKey || readyTrees.empty())
+		{
+			statistics.misses++;
+			return nullptr;
+		}
+
+		statistics.hits++;
+		result = std::move(readyTrees.front());
+		readyTrees.pop_front();
+		readyBytes.erase(readyBytes.begin());
+	}
+	wake.notify_all(); // refill
+	return result;
+}
+
+void TreePregenerationPool::Pause(bool pause)
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		if (paused == pause) return;
+		paused = pause;
+	}
+	wake.notify_all();
+}
+
+TreePoolStatistics TreePregenerationPool::Statistics()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	statistics.ready = readyTrees.size();
+	statistics.memoryBytes = 0;
+	for (size_t bytes : readyBytes) statistics.memoryBytes += bytes;
+	return statistics;
+}
+
+void TreePregenerationPool::Run(TreeGenerator* generator)
+{
+	std::unique_lock<std::mutex> lock{ mutex };
+	while (true)
+	{
+		// Another tree is started while the ready ones and those in flight are below the capacity and one more still fits the cap
+		auto memoryBytes = [&]()
+		{
+			size_t bytes = 0;
+			for (size_t treeBytes : readyBytes) bytes += treeBytes;
+			return bytes;
+		};
+		wake.wait(lock, [&]()
+		{
+			return quit || (settings && !paused && readyTrees.size() + inFlight < capacity && memoryBytes() + (inFlight + 1) * largestTreeBytes <= memoryCap);
+		});
+		if (quit) return;
+
+		TreeGenerationRequest request = *settings;
+		request.seed = (uint64_t(seedSource()) << 32) ^ seedSource();
+		uint64_t requestKey = settingsKey;
+		inFlight++;
+		lock.unlock();
+
+		std::unique_ptr<TreeGenerationResult> result = generator->Generate(request);
+		size_t bytes = TreeResultBytes(*result);
+
+		lock.lock();
+		inFlight--;
+		statistics.generated++;
+		if (requestKey != settingsKey)
+		{
+			statistics.dropped++;
+			continue;
+		}
+
+		// A tree larger than the cap stops the pool until the settings change
+		largestTreeBytes = (bytes > largestTreeBytes) ? bytes : largestTreeBytes;
+		if (memoryBytes() + bytes > memoryCap)
+		{
+			statistics.dropped++;
+			continue;
+		}
+		readyTrees.push_back(std::move(result));
+		readyBytes.push_back(bytes);
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include "treeworker.h"
+
+/*
+	Pregenerated trees
+	Idle background threads keep a few trees ready for the current settings, each with a seed of its own, so a new
+	tree can be swapped in at once while the pool refills. The settings are the whole request without its seed, when
+	they change (iterations, subdivisions, style or any option) the ready trees are dropped, and so are the ones in
+	flight once they finish. The ready trees are kept under a memory cap. Thread safe.
+*/
+
+struct TreePoolStatistics
+{
+	size_t hits = 0;		// Take handed out a ready tree
+	size_t misses = 0;		// Take found none for the settings
+	size_t generated = 0;
+	size_t dropped = 0;		// finished for settings that had changed, or over the memory cap
+	size_t ready = 0;
+	size_t memoryBytes = 0;	// of the ready trees
+};
+
+class TreePregenerationPool
+{
+public:
+	TreePregenerationPool(const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh, size_t readyTrees = 3, size_t memoryByteCap = 256ull << 20, int threadCount = 1);
+	~TreePregenerationPool();
+
+	// The pool generates for these settings, the seed is ignored. Different settings empty the pool.
+	void SetSettings(const TreeGenerationRequest& request);
+
+	// A ready tree with the same settings as the request, nullptr when there is none (a miss)
+	std::unique_ptr<TreeGenerationResult> Take(const TreeGenerationRequest& request);
+
+	// The background threads only start a tree while the pool is not paused, the viewer pauses it while its own worker runs
+	void Pause(bool paused);
+
+	TreePoolStatistics Statistics();
+
+protected:
+	void Run(TreeGenerator* generator);
+	uint64_t SettingsKey(const TreeGenerationRequest& request) const;
+
+	TriangleMesh leafMesh;
+	TriangleMesh flowerMesh;
+	size_t capacity;
+	size_t memoryCap;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::unique_ptr<TreeGenerationRequest> settings;
+	uint64_t settingsKey = 0;
+	std::deque<std::unique_ptr<TreeGenerationResult>> readyTrees;
+	std::vector<size_t> readyBytes; // per ready tree
+	size_t largestTreeBytes = 0;	// for the current settings, a tree is only started while one this size still fits
+	int inFlight = 0;
+	bool paused = false;
+	bool quit = false;
+	std::random_device seedSource;
+	TreePoolStatistics statistics;
+
+	// Every thread generates through a generator of its own, which keeps its stage cache
+	std::vector<std::unique_ptr<TreeGenerator>> generators;
+	std::vector<std::thread> threads; // started last, after everything they use
+};
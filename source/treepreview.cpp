@@ -0,0 +1,72 @@
+#include "treepreview.h"
+#include <chrono>
+
+void TreePreview::Begin(int partsGeneration, const TriangleMesh& sizeBranches, const TriangleMesh& sizeLeaves, const TriangleMesh& sizeFlowers)
+{
+	End();
+	generation = partsGeneration;
+	active = true;
+
+	branches.Reserve(sizeBranches.positions.size(), sizeBranches.indices.size());
+	leaves.Reserve(sizeLeaves.positions.size(), sizeLeaves.indices.size());
+	flowers.Reserve(sizeFlowers.positions.size(), sizeFlowers.indices.size());
+}
+
+void TreePreview::End()
+{
+	active = false;
+	queuedParts.clear();
+	uploadedVertices = 0;
+
+	skeletonLines.Clear();
+	branches.Clear();
+	leaves.Clear();
+	flowers.Clear();
+}
+
+void TreePreview::Queue(std::vector<TreePart>& parts)
+{
+	for (auto& part : parts)
+	{
+		queuedParts.push_back(std::move(part));
+	}
+	parts.clear();
+}
+
+void TreePreview::Upload(double budgetMilliseconds)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	auto elapsedMilliseconds = [&]()
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	};
+
+	do
+	{
+		if (queuedParts.empty()) return;
+
+		TreePart& part = queuedParts.front();
+		if (part.kind == TreePartKind::Skeleton)
+		{
+			skeletonLines.SendToGPU(std::move(part.lines));
+			queuedParts.pop_front();
+			continue;
+		}
+
+		GLTriangleMesh& target = (part.kind == TreePartKind::Branches) ? branches : (part.kind == TreePartKind::Leaves) ? leaves : flowers;
+		size_t remainingVertices = part.mesh.positions.size() - uploadedVertices;
+		if (remainingVertices > 0)
+		{
+			size_t count = (remainingVertices < verticesPerUpload) ? remainingVertices : verticesPerUpload;
+			target.AppendVertices(part.mesh, uploadedVertices, count);
+			uploadedVertices += count;
+		}
+		else
+		{
+			// The triangles go in once all of their vertices are on the GPU
+			target.AppendIndices(part.mesh.indices, 0, part.mesh.indices.size());
+			queuedParts.pop_front();
+			uploadedVertices = 0;
+		}
+	} while (elapsedMilliseconds() < budgetMilliseconds);
+}
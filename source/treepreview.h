@@ -0,0 +1,38 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include "opengl/mesh.h"
+#include "tree.h"
+
+/*
+	GPU side of a progressive generation
+	The parts published by the generation are queued and copied into preallocated buffers a slice at a time,
+	under a time budget per frame, so a large tree streams in without dropping the frame rate.
+	The finished tree replaces the preview.
+*/
+class TreePreview
+{
+public:
+	GLLine skeletonLines;
+	GLTriangleMesh branches;
+	GLTriangleMesh leaves;
+	GLTriangleMesh flowers;
+	int generation = -1;	// the generation the parts belong to
+	bool active = false;
+
+	size_t verticesPerUpload = 16384; // largest slice copied at once, so a single large part cannot overrun the budget
+
+	// Starts over for a new generation, the buffers are preallocated for a tree the size of the given meshes
+	void Begin(int partsGeneration, const TriangleMesh& sizeBranches, const TriangleMesh& sizeLeaves, const TriangleMesh& sizeFlowers);
+	void End();
+
+	void Queue(std::vector<TreePart>& parts);
+
+	// Uploads queued parts until the time budget is spent, at least one slice per call
+	void Upload(double budgetMilliseconds);
+
+protected:
+	std::deque<TreePart> queuedParts;
+	size_t uploadedVertices = 0; // of the first queued part
+};
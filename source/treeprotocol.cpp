@@ -0,0 +1,140 @@
+#include "treeprotocol.h"
+#include "core/bytestream.h"
+
+TreeGenerationRequest TreeServiceRequest::Apply(const TreeGenerationRequest& settings) const
+{
+	TreeGenerationRequest request = settings;
+	request.seed = seed;
+	request.iterations = iterations;
+	request.subdivisions = subdivisions;
+	request.showFlowers = showFlowers;
+	request.progressive = false;
+	request.options.style = style;
+	request.options.trunkCylinderDivisions = trunkCylinderDivisions;
+	request.options.leafScale = leafScale;
+	request.options.flowerChance = flowerChance;
+	request.options.triangleBudget = size_t(triangleBudget);
+	request.options.byteBudget = size_t(byteBudget);
+	return request;
+}
+
+bool SendTreeServiceMessage(LocalSocket& socket, TreeServiceMessage type, uint64_t id, const std::vector<uint8_t>& payload)
+{
+	// Every field on its own, the header struct has no padding to send
+	std::vector<uint8_t> header;
+	ByteWriter writer{ header };
+	writer.Value(treeServiceMagic);
+	writer.Value(type);
+	writer.Value(id);
+	writer.Value(uint64_t(payload.size()));
+	return socket.Send(header.data(), header.size()) && (payload.empty() || socket.Send(payload.data(), payload.size()));
+}
+
+bool ReceiveTreeServiceMessage(LocalSocket& socket, TreeServiceHeader& header, std::vector<uint8_t>& payload)
+{
+	uint8_t bytes[sizeof(uint32_t) * 2 + sizeof(uint64_t) * 2];
+	if (!socket.Receive(bytes, sizeof(bytes))) return false;
+
+	ByteReader reader{ bytes, bytes + sizeof(bytes) };
+	reader.Value(header.magic);
+	reader.Value(header.type);
+	reader.Value(header.id);
+	reader.Value(header.payloadBytes);
+	if (!reader.valid || header.magic != treeServiceMagic || header.payloadBytes > treeServiceMaxPayload) return false;
+
+	payload.resize(size_t(header.payloadBytes));
+	return payload.empty() || socket.Receive(payload.data(), payload.size());
+}
+
+std::vector<uint8_t> EncodeTreeServiceRequest(const TreeServiceRequest& request)
+{
+	std::vector<uint8_t> payload;
+	ByteWriter writer{ payload };
+	writer.Value(request.seed);
+	writer.Value(request.iterations);
+	writer.Value(request.subdivisions);
+	writer.Value(request.style);
+	writer.Value(request.showFlowers);
+	writer.Value(request.trunkCylinderDivisions);
+	writer.Value(request.leafScale);
+	writer.Value(request.flowerChance);
+	writer.Value(request.triangleBudget);
+	writer.Value(request.byteBudget);
+	writer.Value(request.sharedMemory);
+	return payload;
+}
+
+bool DecodeTreeServiceRequest(const std::vector<uint8_t>& payload, TreeServiceRequest& request)
+{
+	// The style and the flags are read as plain integers, only the values they can take are accepted
+	static_assert(sizeof(TreeStyle) == sizeof(int32_t) && sizeof(bool) == sizeof(uint8_t), "the style is sent as 4 bytes and the flags as single bytes");
+	int32_t style = 0;
+	uint8_t showFlowers = 0, sharedMemory = 0;
+
+	ByteReader reader{ payload.data(), payload.data() + payload.size() };
+	reader.Value(request.seed);
+	reader.Value(request.iterations);
+	reader.Value(request.subdivisions);
+	reader.Value(style);
+	reader.Value(showFlowers);
+	reader.Value(request.trunkCylinderDivisions);
+	reader.Value(request.leafScale);
+	reader.Value(request.flowerChance);
+	reader.Value(request.triangleBudget);
+	reader.Value(request.byteBudget);
+	reader.Value(sharedMemory);
+	if (!reader.valid || reader.position != reader.end) return false;
+	if (style != int32_t(TreeStyle::Default) && style != int32_t(TreeStyle::Slim)) return false;
+	if (showFlowers > 1 || sharedMemory > 1) return false;
+
+	request.style = TreeStyle(style);
+	request.showFlowers = (showFlowers != 0);
+	request.sharedMemory = (sharedMemory != 0);
+	return true;
+}
+
+std::vector<uint8_t> EncodeTreeServiceTree(const TreeGenerationResult& result)
+{
+	std::vector<uint8_t> payload;
+	ByteWriter writer{ payload };
+	writer.Value(result.fromCache);
+	writer.Value(result.milliseconds);
+	writer.Mesh(result.branches);
+	writer.Mesh(result.leaves);
+	writer.Mesh(result.flowers);
+	return payload;
+}
+
+bool DecodeTreeServiceTree(const std::vector<uint8_t>& payload, TreeServiceTree& tree)
+{
+	ByteReader reader{ payload.data(), payload.data() + payload.size() };
+	reader.Value(tree.fromCache);
+	reader.Value(tree.milliseconds);
+	reader.Mesh(tree.branches);
+	reader.Mesh(tree.leaves);
+	reader.Mesh(tree.flowers);
+	return reader.valid && reader.position == reader.end;
+}
+
+std::vector<uint8_t> EncodeTreeServiceSharedTree(const TreeServiceSharedTree& tree)
+{
+	std::vector<uint8_t> payload;
+	ByteWriter writer{ payload };
+	writer.Value(tree.fromCache);
+	writer.Value(tree.milliseconds);
+	writer.Value(tree.bytes);
+	writer.Vector(std::vector<char>(tree.name.begin(), tree.name.end()));
+	return payload;
+}
+
+bool DecodeTreeServiceSharedTree(const std::vector<uint8_t>& payload, TreeServiceSharedTree& tree)
+{
+	ByteReader reader{ payload.data(), payload.data() + payload.size() };
+	std::vector<char> name;
+	reader.Value(tree.fromCache);
+	reader.Value(tree.milliseconds);
+	reader.Value(tree.bytes);
+	reader.Vector(name);
+	tree.name.assign(name.begin(), name.end());
+	return reader.valid && reader.position == reader.end;
+}
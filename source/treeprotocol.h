@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "core/localsocket.h"
+#include "core/meshdata.h"
+#include "treeworker.h"
+
+/*
+	Tree service protocol
+	Every message is a header followed by its payload, written with ByteWriter (core/bytestream.h). A client may
+	send several requests without waiting, every response carries the id of its request and they come back in the
+	order the trees finish. The service fills everything a request leaves out from its own settings.
+*/
+
+const uint32_t treeServiceMagic = 0x56535254; // "TRSV"
+const uint64_t treeServiceMaxPayload = 1ull << 30;
+
+enum class TreeServiceMessage : uint32_t
+{
+	Generate = 1,	// TreeServiceRequest, answered with Tree, SharedTree or Error
+	Metrics,		// no payload, answered with Metrics, a JSON object
+	Shutdown,		// no payload, answered with Shutdown at once, the service then stops taking requests and finishes the queued ones
+	Tree,			// TreeServiceTree
+	Error,			// a text
+	SharedTree,		// TreeServiceSharedTree, the tree is in shared memory (treeshared.h) until the client sends Release
+	Release			// no payload and no answer, the id is the one of the SharedTree
+};
+
+struct TreeServiceHeader
+{
+	uint32_t magic = treeServiceMagic;
+	TreeServiceMessage type = TreeServiceMessage::Error;
+	uint64_t id = 0;
+	uint64_t payloadBytes = 0;
+};
+
+struct TreeServiceRequest
+{
+	uint64_t seed = 1;
+	int32_t iterations = 5;
+	int32_t subdivisions = 3;
+	TreeStyle style = TreeStyle::Default;
+	bool showFlowers = true;
+	int32_t trunkCylinderDivisions = 32;
+	float leafScale = 1.0f;
+	float flowerChance = 0.4f;
+	uint64_t triangleBudget = 0;
+	uint64_t byteBudget = 0;
+	bool sharedMemory = false;	// answer with the tree in shared memory instead of in the message
+
+	// The fields of the request replace those of the service's settings
+	TreeGenerationRequest Apply(const TreeGenerationRequest& settings) const;
+};
+
+struct TreeServiceTree
+{
+	bool fromCache = false;
+	double milliseconds = 0.0; // of the generation
+	TriangleMesh branches;
+	TriangleMesh leaves;
+	TriangleMesh flowers;
+};
+
+struct TreeServiceSharedTree
+{
+	bool fromCache = false;
+	double milliseconds = 0.0;
+	uint64_t bytes = 0;
+	std::string name; // for SharedMemory::Open
+};
+
+bool SendTreeServiceMessage(LocalSocket& socket, TreeServiceMessage type, uint64_t id, const std::vector<uint8_t>& payload);
+bool ReceiveTreeServiceMessage(LocalSocket& socket, TreeServiceHeader& header, std::vector<uint8_t>& payload);
+
+std::vector<uint8_t> EncodeTreeServiceRequest(const TreeServiceRequest& request);
+// False for a malformed payload, also when the style or a flag holds a value it cannot take. The ranges are up to the service.
+bool DecodeTreeServiceRequest(const std::vector<uint8_t>& payload, TreeServiceRequest& request);
+
+// The meshes are the blobs of ByteWriter::Mesh, with their layout and chunks
+std::vector<uint8_t> EncodeTreeServiceTree(const TreeGenerationResult& result);
+bool DecodeTreeServiceTree(const std::vector<uint8_t>& payload, TreeServiceTree& tree);
+
+std::vector<uint8_t> EncodeTreeServiceSharedTree(const TreeServiceSharedTree& tree);
+bool DecodeTreeServiceSharedTree(const std::vector<uint8_t>& payload, TreeServiceSharedTree& tree);
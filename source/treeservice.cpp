@@ -0,0 +1,339 @@
+#include "treeservice.h"
+#include "treeshared.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const size_t latencyWindow = 4096; // requests the percentiles are taken over
+
+// Why a decoded request is refused, nullptr when it is in range. The comparisons are written so that NaN fails them.
+static const char* RequestRangeError(const TreeServiceRequest& request, const TreeServiceSettings& settings)
+{
+	if (request.iterations < 1 || request.iterations > settings.maxIterations) return "iterations out of range";
+	if (request.subdivisions < 1 || request.subdivisions > settings.maxSubdivisions) return "subdivisions out of range";
+	if (request.trunkCylinderDivisions < 3 || request.trunkCylinderDivisions > settings.maxTrunkCylinderDivisions) return "trunk cylinder divisions out of range";
+	if (!(request.leafScale > 0.0f && request.leafScale <= settings.maxLeafScale)) return "leaf scale out of range";
+	if (!(request.flowerChance >= 0.0f && request.flowerChance <= 1.0f)) return "flower chance out of range";
+	return nullptr;
+}
+
+std::string TreeServiceMetrics::JSON() const
+{
+	char text[1024];
+	snprintf(text, sizeof(text),
+		"{ \"queueDepth\": %zu, \"inFlight\": %zu, \"connections\": %zu, \"received\": %zu, \"completed\": %zu, \"rejected\": %zu, \"coalesced\": %zu, \"batches\": %zu, \"sharedTrees\": %zu, \"sharedCopiedBytes\": %zu,"
+		" \"cache\": { \"memoryHits\": %zu, \"diskHits\": %zu, \"misses\": %zu, \"entries\": %zu, \"memoryBytes\": %zu },"
+		" \"latencyMilliseconds\": { \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f }, \"uptimeSeconds\": %.1f }",
+		queueDepth, inFlight, connections, received, completed, rejected, coalesced, batches, sharedTrees, sharedCopiedBytes,
+		cache.memoryHits, cache.diskHits, cache.misses, cache.entries, cache.memoryBytes,
+		latencyMilliseconds[0], latencyMilliseconds[1], latencyMilliseconds[2], latencyMilliseconds[3], uptimeSeconds);
+	return text;
+}
+
+TreeGenerationService::TreeGenerationService(const TreeServiceSettings& serviceSettings, const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh)
+	: settings{ serviceSettings }, leafMesh{ treeLeafMesh }, flowerMesh{ treeFlowerMesh }, cache{ serviceSettings.cacheBytes, serviceSettings.cacheFolder }, startTime{ Clock::now() }
+{
+	settings.defaults.progressive = false;
+	settings.defaults.buildBVH = false; // the answers only carry the meshes
+}
+
+bool TreeGenerationService::Run()
+{
+	LocalSocket listener;
+	if (!listener.Listen(settings.socketPath)) return false;
+
+	int threadCount = (settings.threadCount > 0) ? settings.threadCount : int(std::thread::hardware_concurrency());
+	threadCount = (threadCount < 1) ? 1 : threadCount;
+	for (int i = 0; i < threadCount; i++)
+	{
+		generators.push_back(std::make_unique<TreeGenerator>(leafMesh, flowerMesh, &cache));
+	}
+	for (auto& generator : generators)
+	{
+		workerThreads.emplace_back(&TreeGenerationService::Work, this, generator.get());
+	}
+
+	while (!stopRequested)
+	{
+		LocalSocket socket = listener.Accept(100);
+
+		// Threads of connections the clients closed are joined here
+		for (auto connection = connections.begin(); connection != connections.end();)
+		{
+			if (!(*connection)->closed)
+			{
+				++connection;
+				continue;
+			}
+			(*connection)->thread.join();
+			connection = connections.erase(connection);
+		}
+
+		if (socket.Valid())
+		{
+			auto connection = std::make_shared<Connection>();
+			connection->socket = std::move(socket);
+			connection->thread = std::thread(&TreeGenerationService::Serve, this, connection);
+			connections.push_back(connection);
+		}
+		std::lock_guard<std::mutex> lock{ mutex };
+		metrics.connections = connections.size();
+	}
+	listener.Close();
+
+	// Graceful stop, the queued requests are answered before the workers end
+	{
+		std::unique_lock<std::mutex> lock{ mutex };
+		stopping = true;
+		drained.wait(lock, [&]() { return queue.empty() && metrics.inFlight == 0; });
+		quit = true;
+	}
+	wake.notify_all();
+	for (auto& thread : workerThreads)
+	{
+		thread.join();
+	}
+	workerThreads.clear();
+	generators.clear();
+
+	for (auto& connection : connections)
+	{
+		connection->socket.Shutdown();
+		connection->thread.join();
+	}
+	connections.clear();
+	std::lock_guard<std::mutex> lock{ mutex };
+	metrics.connections = 0;
+	return true;
+}
+
+void TreeGenerationService::Serve(std::shared_ptr<Connection> connection)
+{
+	TreeServiceHeader header;
+	std::vector<uint8_t> payload;
+	while (ReceiveTreeServiceMessage(connection->socket, header, payload))
+	{
+		if (header.type == TreeServiceMessage::Generate)
+		{
+			TreeServiceRequest request;
+			const char* error = nullptr;
+			if (!DecodeTreeServiceRequest(payload, request)) error = "malformed request";
+			else error = RequestRangeError(request, settings);
+
+			PendingRequest pending;
+			if (!error)
+			{
+				pending.connection = connection;
+				pending.id = header.id;
+				pending.sharedMemory = request.sharedMemory;
+				pending.request = request.Apply(settings.defaults);
+				pending.key = TreeCacheKey(pending.request, leafMesh, flowerMesh);
+				pending.received = Clock::now();
+			}
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				metrics.received++;
+				if (!error && stopping) error = "shutting down";
+				if (!error && queue.size() >= settings.maxQueuedRequests) error = "queue full";
+				if (!error) queue.push_back(std::move(pending));
+				else metrics.rejected++;
+			}
+
+			if (error)
+			{
+				Answer(*connection, TreeServiceMessage::Error, header.id, std::vector<uint8_t>(error, error + strlen(error)));
+				continue;
+			}
+			wake.notify_one();
+		}
+		else if (header.type == TreeServiceMessage::Metrics)
+		{
+			std::string text = Metrics().JSON();
+			Answer(*connection, TreeServiceMessage::Metrics, header.id, std::vector<uint8_t>(text.begin(), text.end()));
+		}
+		else if (header.type == TreeServiceMessage::Release)
+		{
+			std::lock_guard<std::mutex> lock{ connection->sendMutex };
+			connection->sharedTrees.erase(header.id);
+		}
+		else if (header.type == TreeServiceMessage::Shutdown)
+		{
+			Stop();
+			Answer(*connection, TreeServiceMessage::Shutdown, header.id, {});
+		}
+		else
+		{
+			const char* error = "unknown message";
+			Answer(*connection, TreeServiceMessage::Error, header.id, std::vector<uint8_t>(error, error + strlen(error)));
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock{ connection->sendMutex };
+		connection->sharedTrees.clear();
+	}
+	connection->closed = true;
+}
+
+void TreeGenerationService::Work(TreeGenerator* generator)
+{
+	std::unique_lock<std::mutex> lock{ mutex };
+	while (true)
+	{
+		wake.wait(lock, [&]() { return quit || !queue.empty(); });
+		if (queue.empty()) return;
+
+		// An even share of the queue, so that the other workers get requests too
+		size_t share = (queue.size() + generators.size() - 1) / generators.size();
+		size_t count = std::min(std::max(share, size_t(1)), std::max(settings.maxBatch, size_t(1)));
+		std::vector<PendingRequest> batch;
+		for (size_t i = 0; i < count; i++)
+		{
+			batch.push_back(std::move(queue.front()));
+			queue.pop_front();
+		}
+		metrics.inFlight += batch.size();
+		metrics.batches++;
+		lock.unlock();
+
+		// Identical requests end up next to each other, and trees with the same symbols follow each other in the stage cache
+		std::stable_sort(batch.begin(), batch.end(), [](const PendingRequest& a, const PendingRequest& b)
+		{
+			if (a.request.options.style != b.request.options.style) return a.request.options.style < b.request.options.style;
+			if (a.request.iterations != b.request.iterations) return a.request.iterations < b.request.iterations;
+			return a.key < b.key;
+		});
+
+		for (size_t first = 0; first < batch.size();)
+		{
+			size_t last = first + 1;
+			while (last < batch.size() && batch[last].key == batch[first].key) last++;
+
+			// One message payload and one shared memory at most, whoever asked for them gets the same one
+			std::vector<uint8_t> payload, sharedPayload;
+			std::shared_ptr<SharedMemory> sharedTree;
+			size_t sharedAnswers = 0, copiedBytes = 0;
+			{
+				// When the tree goes into shared memory it is generated there
+				bool shared = std::any_of(batch.begin() + first, batch.begin() + last, [](const PendingRequest& pending) { return pending.sharedMemory; });
+				std::shared_ptr<TreeSharedArena> arena;
+				if (shared)
+				{
+					arena = std::make_shared<TreeSharedArena>();
+					if (!arena->Create(SharedMemory::UniqueName("treeservice"), settings.maxSharedBytes)) arena.reset();
+				}
+
+				// A tree too large for the arena is generated again on the heap for the other requests
+				std::unique_ptr<TreeGenerationResult> result;
+				try
+				{
+					result = generator->Generate(batch[first].request, nullptr, arena);
+				}
+				catch (const std::bad_alloc&)
+				{
+					if (!arena) throw;
+					arena.reset();
+					result = generator->Generate(batch[first].request);
+				}
+
+				if (arena && WriteTreeShared(*arena, *result, leafMesh, flowerMesh, copiedBytes))
+				{
+					arena->DiscardFree();
+					sharedTree = arena->Memory();
+
+					TreeServiceSharedTree answer;
+					answer.fromCache = result->fromCache;
+					answer.milliseconds = result->milliseconds;
+					answer.bytes = arena->End();
+					answer.name = sharedTree->Name();
+					sharedPayload = EncodeTreeServiceSharedTree(answer);
+				}
+				for (size_t i = first; i < last; i++)
+				{
+					if (!batch[i].sharedMemory && payload.empty()) payload = EncodeTreeServiceTree(*result);
+				}
+			}
+			for (size_t i = first; i < last; i++)
+			{
+				Connection& connection = *batch[i].connection;
+				if (!batch[i].sharedMemory)
+				{
+					Answer(connection, TreeServiceMessage::Tree, batch[i].id, payload);
+				}
+				else if (sharedPayload.empty())
+				{
+					const char* error = "no shared memory";
+					Answer(connection, TreeServiceMessage::Error, batch[i].id, std::vector<uint8_t>(error, error + strlen(error)));
+				}
+				else
+				{
+					// Kept before the answer goes out, the client may release it as soon as it has it
+					{
+						std::lock_guard<std::mutex> lock{ connection.sendMutex };
+						connection.sharedTrees[batch[i].id] = sharedTree;
+					}
+					Answer(connection, TreeServiceMessage::SharedTree, batch[i].id, sharedPayload);
+					sharedAnswers++;
+				}
+			}
+
+			lock.lock();
+			for (size_t i = first; i < last; i++)
+			{
+				RecordLatency(batch[i].received);
+			}
+			metrics.completed += last - first;
+			metrics.sharedTrees += sharedAnswers;
+			metrics.sharedCopiedBytes += copiedBytes;
+			metrics.coalesced += last - first - 1;
+			metrics.inFlight -= last - first;
+			lock.unlock();
+			first = last;
+		}
+
+		batch.clear(); // lets go of the connections before waiting
+		lock.lock();
+		drained.notify_all();
+	}
+}
+
+void TreeGenerationService::Answer(Connection& connection, TreeServiceMessage type, uint64_t id, const std::vector<uint8_t>& payload)
+{
+	// A client that went away only fails the send, its requests are still counted as answered
+	std::lock_guard<std::mutex> lock{ connection.sendMutex };
+	SendTreeServiceMessage(connection.socket, type, id, payload);
+}
+
+void TreeGenerationService::RecordLatency(Clock::time_point received)
+{
+	double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - received).count();
+	if (latencies.size() < latencyWindow)
+	{
+		latencies.push_back(milliseconds);
+		return;
+	}
+	latencies[nextLatency] = milliseconds;
+	nextLatency = (nextLatency + 1) % latencyWindow;
+}
+
+TreeServiceMetrics TreeGenerationService::Metrics()
+{
+	TreeServiceMetrics current;
+	std::vector<double> sorted;
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		current = metrics;
+		current.queueDepth = queue.size();
+		sorted = latencies;
+	}
+	current.cache = cache.Statistics();
+	current.uptimeSeconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+	std::sort(sorted.begin(), sorted.end());
+	const double percentiles[] = { 0.5, 0.9, 0.99, 1.0 };
+	for (int i = 0; i < 4 && !sorted.empty(); i++)
+	{
+		size_t index = std::min(size_t(percentiles[i] * sorted.size()), sorted.size() - 1);
+		current.latencyMilliseconds[i] = sorted[index];
+	}
+	return current;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "core/localsocket.h"
+#include "core/sharedmemory.h"
+#include "treeprotocol.h"
+#include "treecache.h"
+
+/*
+	Local tree generation service
+	Listens on a Unix domain socket and answers generation requests (treeprotocol.h) from a pool of workers, so the
+	tools calling it pay the startup once. Every connection has a thread reading its requests into a shared queue.
+	A worker takes a batch of the queued requests at once, generates every distinct tree in it once and answers all
+	the requests for it; the batch is ordered by style and iterations so its stage cache keeps the symbols. Finished
+	trees go into a cache shared by the workers. Stopping lets the queued requests finish before the workers end.
+	Trees asked for in shared memory are generated straight into memory of their own (treeshared.h), which stays until
+	every client it went to released it or disconnected.
+*/
+
+struct TreeServiceSettings
+{
+	std::string socketPath;
+	TreeGenerationRequest defaults;		// everything a request does not set
+	int threadCount = 0;				// 0 uses the hardware concurrency
+	size_t maxBatch = 8;				// requests a worker takes at once
+	size_t maxQueuedRequests = 1024;	// further requests are answered with an error until the queue drains
+	// Requests outside these are refused before they are queued. The trees grow exponentially with the iterations,
+	// the subdivisions and the cylinder divisions multiply the branch vertices.
+	int maxIterations = 8;
+	int maxSubdivisions = 8;
+	int maxTrunkCylinderDivisions = 256;
+	float maxLeafScale = 8.0f;
+	size_t maxSharedBytes = 1ull << 30;	// address space reserved for a tree in shared memory, a larger one is answered with an error
+	size_t cacheBytes = 256ull << 20;
+	std::filesystem::path cacheFolder;	// empty keeps the cache in memory only
+};
+
+struct TreeServiceMetrics
+{
+	size_t queueDepth = 0;
+	size_t inFlight = 0;				// taken by a worker, not answered yet
+	size_t connections = 0;
+	size_t received = 0;
+	size_t completed = 0;
+	size_t rejected = 0;				// queue full, shutting down or malformed
+	size_t coalesced = 0;				// answered with the tree of an identical request in the same batch
+	size_t batches = 0;
+	size_t sharedTrees = 0;				// answered in shared memory
+	size_t sharedCopiedBytes = 0;		// copied into the shared memory after the generation, the leaf and flower meshes
+	TreeCacheStatistics cache;
+	double latencyMilliseconds[4] = {};	// 50th, 90th and 99th percentile and the maximum, from the request being read to its answer being sent
+	double uptimeSeconds = 0.0;
+
+	std::string JSON() const;
+};
+
+class TreeGenerationService
+{
+public:
+	TreeGenerationService(const TreeServiceSettings& serviceSettings, const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh);
+
+	// Serves until a Shutdown message comes in or Stop is called, returns false when the socket could not be opened
+	bool Run();
+
+	// Only sets a flag, safe from a signal handler. Run stops accepting within a tenth of a second.
+	void Stop() { stopRequested = true; }
+
+	TreeServiceMetrics Metrics();
+
+protected:
+	using Clock = std::chrono::steady_clock;
+
+	struct Connection
+	{
+		LocalSocket socket;
+		std::mutex sendMutex;	// the workers answer on the connection's socket while its thread reads from it, also guards sharedTrees
+		std::unordered_map<uint64_t, std::shared_ptr<SharedMemory>> sharedTrees; // by request id, until released
+		std::thread thread;
+		std::atomic<bool> closed{ false };
+	};
+
+	struct PendingRequest
+	{
+		std::shared_ptr<Connection> connection;
+		uint64_t id = 0;
+		uint64_t key = 0;
+		bool sharedMemory = false;
+		TreeGenerationRequest request;
+		Clock::time_point received;
+	};
+
+	void Serve(std::shared_ptr<Connection> connection);
+	void Work(TreeGenerator* generator);
+	void Answer(Connection& connection, TreeServiceMessage type, uint64_t id, const std::vector<uint8_t>& payload);
+	void RecordLatency(Clock::time_point received); // with the mutex held
+
+	TreeServiceSettings settings;
+	TriangleMesh leafMesh;
+	TriangleMesh flowerMesh;
+	TreeCache cache;
+	Clock::time_point startTime;
+	std::atomic<bool> stopRequested{ false };
+
+	std::mutex mutex;
+	std::condition_variable wake;		// the workers wait for requests
+	std::condition_variable drained;	// Run waits for the queue to empty when stopping
+	std::deque<PendingRequest> queue;
+	bool stopping = false;				// no more requests are queued
+	bool quit = false;					// the queue is empty and the workers end
+	TreeServiceMetrics metrics;
+	std::vector<double> latencies;		// the most recent, a ring
+	size_t nextLatency = 0;
+
+	std::vector<std::unique_ptr<TreeGenerator>> generators; // one per worker thread
+	std::vector<std::thread> workerThreads;
+	std::list<std::shared_ptr<Connection>> connections;
+};
@@ -0,0 +1,181 @@
+#include "treeshared.h"
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <type_traits>
+
+static const uint64_t streamAlignment = 64;
+
+static_assert(std::is_trivially_copyable<MeshChunk>::value && sizeof(MeshChunk) == 13 * 4, "the chunks are shared as they are");
+
+static uint64_t Align(uint64_t bytes)
+{
+	return (bytes + streamAlignment - 1) / streamAlignment * streamAlignment;
+}
+
+bool TreeSharedArena::Create(const std::string& name, size_t maxBytes)
+{
+	memory = std::make_shared<SharedMemory>();
+	freeBlocks.clear();
+	end = Align(sizeof(TreeSharedLayout));
+	return memory->Create(name, maxBytes) && memory->Commit(size_t(end));
+}
+
+void* TreeSharedArena::Allocate(size_t bytes)
+{
+	if (!memory || !memory->Data() || bytes > memory->Reserved()) throw std::bad_alloc{};
+	uint64_t size = Align((bytes != 0) ? bytes : 1);
+
+	// First fit, the rest of the block stays free
+	for (auto block = freeBlocks.begin(); block != freeBlocks.end(); ++block)
+	{
+		if (block->second < size) continue;
+		uint64_t offset = block->first;
+		uint64_t rest = block->second - size;
+		freeBlocks.erase(block);
+		if (rest != 0) freeBlocks.emplace(offset + size, rest);
+		return memory->Data() + offset;
+	}
+
+	if (!memory->Commit(size_t(end + size))) throw std::bad_alloc{};
+	uint64_t offset = end;
+	end += size;
+	return memory->Data() + offset;
+}
+
+void TreeSharedArena::Free(void* pointer, size_t bytes)
+{
+	uint64_t offset = uint64_t(static_cast<uint8_t*>(pointer) - memory->Data());
+	uint64_t size = Align((bytes != 0) ? bytes : 1);
+
+	// Merged with the free blocks right after and right before it
+	auto next = freeBlocks.find(offset + size);
+	if (next != freeBlocks.end())
+	{
+		size += next->second;
+		freeBlocks.erase(next);
+	}
+	auto block = freeBlocks.emplace(offset, size).first;
+	if (block != freeBlocks.begin())
+	{
+		auto previous = std::prev(block);
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += size;
+			freeBlocks.erase(block);
+			block = previous;
+		}
+	}
+
+	// A block reaching the end gives its space back
+	if (block->first + block->second == end)
+	{
+		end = block->first;
+		freeBlocks.erase(block);
+	}
+}
+
+uint64_t TreeSharedArena::Offset(const void* pointer) const
+{
+	const uint8_t* address = static_cast<const uint8_t*>(pointer);
+	if (!memory || !address || address < memory->Data() + Align(sizeof(TreeSharedLayout)) || address >= memory->Data() + end) return 0;
+	return uint64_t(address - memory->Data());
+}
+
+void TreeSharedArena::DiscardFree()
+{
+	for (auto& block : freeBlocks)
+	{
+		memory->Discard(size_t(block.first), size_t(block.second));
+	}
+}
+
+bool WriteTreeShared(TreeSharedArena& arena, const TreeGenerationResult& result, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh, size_t& copiedBytes)
+{
+	const TriangleMesh* meshes[TreeSharedMeshCount] = { &result.branches, &result.leaves, &result.flowers, &leafMesh, &flowerMesh };
+	copiedBytes = 0;
+
+	// The offset of a stream, it is copied into the arena first when it was built elsewhere
+	auto place = [&](const void* data, size_t bytes) -> uint64_t
+	{
+		if (bytes == 0) return 0;
+		uint64_t offset = arena.Offset(data);
+		if (offset != 0) return offset;
+
+		void* copy = arena.Allocate(bytes);
+		memcpy(copy, data, bytes);
+		copiedBytes += bytes;
+		return arena.Offset(copy);
+	};
+
+	TreeSharedLayout layout;
+	memset(&layout, 0, sizeof(layout));
+	layout.magic = treeSharedMagic;
+	layout.version = treeSharedVersion;
+	try
+	{
+		for (int m = 0; m < TreeSharedMeshCount; m++)
+		{
+			const TriangleMesh& mesh = *meshes[m];
+			TreeSharedMesh& shared = layout.meshes[m];
+			shared.vertexCount = mesh.positions.size();
+			shared.indexCount = mesh.indices.size();
+			shared.chunkCount = mesh.chunks.size();
+			shared.positions = place(mesh.positions.data(), mesh.positions.size() * sizeof(glm::fvec3));
+			shared.normals = place(mesh.normals.data(), mesh.normals.size() * sizeof(glm::fvec3));
+			shared.colors = place(mesh.colors.data(), mesh.colors.size() * sizeof(glm::fvec4));
+			shared.texCoords = place(mesh.texCoords.data(), mesh.texCoords.size() * sizeof(glm::fvec4));
+			shared.indices = place(mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+			shared.chunks = place(mesh.chunks.data(), mesh.chunks.size() * sizeof(MeshChunk));
+		}
+		layout.leafInstances.count = result.leafInstances.size();
+		layout.leafInstances.transforms = place(result.leafInstances.data(), result.leafInstances.size() * sizeof(glm::mat4));
+		layout.flowerInstances.count = result.flowerInstances.size();
+		layout.flowerInstances.transforms = place(result.flowerInstances.data(), result.flowerInstances.size() * sizeof(glm::mat4));
+	}
+	catch (const std::bad_alloc&)
+	{
+		return false;
+	}
+
+	layout.totalBytes = arena.End();
+	memcpy(arena.Memory()->Data(), &layout, sizeof(layout));
+	return true;
+}
+
+const TreeSharedLayout* ReadTreeShared(const uint8_t* memory, size_t bytes)
+{
+	if (!memory || bytes < sizeof(TreeSharedLayout)) return nullptr;
+	const TreeSharedLayout* layout = reinterpret_cast<const TreeSharedLayout*>(memory);
+	if (layout->magic != treeSharedMagic || layout->version != treeSharedVersion || layout->totalBytes > bytes) return nullptr;
+
+	// Every stream has to lie inside the memory
+	auto inside = [&](uint64_t offset, uint64_t count, uint64_t elementBytes)
+	{
+		return offset == 0 || (offset >= sizeof(TreeSharedLayout) && offset <= layout->totalBytes && count <= (layout->totalBytes - offset) / elementBytes);
+	};
+	for (auto& mesh : layout->meshes)
+	{
+		if (!inside(mesh.positions, mesh.vertexCount, sizeof(glm::fvec3)) || !inside(mesh.normals, mesh.vertexCount, sizeof(glm::fvec3)) ||
+			!inside(mesh.colors, mesh.vertexCount, sizeof(glm::fvec4)) || !inside(mesh.texCoords, mesh.vertexCount, sizeof(glm::fvec4)) ||
+			!inside(mesh.indices, mesh.indexCount, sizeof(uint32_t)) || !inside(mesh.chunks, mesh.chunkCount, sizeof(MeshChunk)))
+		{
+			return nullptr;
+		}
+
+		// and every chunk inside its mesh
+		const MeshChunk* chunks = TreeSharedStream<MeshChunk>(memory, mesh.chunks);
+		for (uint64_t c = 0; c < mesh.chunkCount; c++)
+		{
+			if (uint64_t(chunks[c].firstIndex) + chunks[c].indexCount > mesh.indexCount || uint64_t(chunks[c].baseVertex) + chunks[c].vertexCount > mesh.vertexCount)
+			{
+				return nullptr;
+			}
+		}
+	}
+	if (!inside(layout->leafInstances.transforms, layout->leafInstances.count, sizeof(glm::mat4)) || !inside(layout->flowerInstances.transforms, layout->flowerInstances.count, sizeof(glm::mat4)))
+	{
+		return nullptr;
+	}
+	return layout;
+}
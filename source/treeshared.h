@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <memory>
+#include "core/sharedmemory.h"
+#include "treeworker.h"
+
+/*
+	Shared memory layout of a finished tree
+	A TreeSharedLayout header at the start, then the streams at 64-byte aligned offsets from the start of the memory:
+	per mesh the positions and normals (3 floats), colors and texture coordinates (4 floats), 32-bit indices and the
+	chunks (MeshChunk, meshdata.h), then the leaf and flower instances (column major 4x4 float matrices). The streams
+	are wherever the generation put them, in no particular order and with unused memory between them. Indices of a
+	mesh with chunks count from the baseVertex of their chunk, the others from the first vertex of their mesh. The leaf
+	and flower meshes are included so a host can draw the foliage instanced instead of using the merged meshes.
+	A consumer maps the memory and reads the streams where they are, an offset of 0 means the stream is empty.
+	The producer builds the tree in the memory itself: a TreeSharedArena over it is handed to the generation, which
+	allocates the meshes and instances from it (see MeshArena), and WriteTreeShared only adds the header. The only
+	streams copied in are those that were not built in the arena, the leaf and flower meshes.
+*/
+
+const uint32_t treeSharedMagic = 0x4D485354; // "TSHM"
+const uint32_t treeSharedVersion = 2;
+
+enum TreeSharedMeshIndex
+{
+	TreeSharedBranches,
+	TreeSharedLeaves,
+	TreeSharedFlowers,
+	TreeSharedLeafMesh,
+	TreeSharedFlowerMesh,
+	TreeSharedMeshCount
+};
+
+struct TreeSharedMesh
+{
+	uint64_t vertexCount;
+	uint64_t indexCount;
+	uint64_t positions;	// offsets
+	uint64_t normals;
+	uint64_t colors;
+	uint64_t texCoords;
+	uint64_t indices;
+	uint64_t chunkCount;
+	uint64_t chunks;
+};
+
+struct TreeSharedInstances
+{
+	uint64_t count;
+	uint64_t transforms; // offset
+};
+
+struct TreeSharedLayout
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t totalBytes;
+	TreeSharedMesh meshes[TreeSharedMeshCount];
+	TreeSharedInstances leafInstances;
+	TreeSharedInstances flowerInstances;
+};
+
+// Allocates from shared memory it creates, one thread at a time. The memory is reserved up front and committed as
+// the allocations reach into it, the header is kept free at the start. Freed blocks are reused and merged with their
+// neighbours, the bookkeeping stays outside the memory so that freeing never writes into what a consumer reads.
+class TreeSharedArena : public MeshArena
+{
+public:
+	bool Create(const std::string& name, size_t maxBytes);
+
+	void* Allocate(size_t bytes) override;
+	void Free(void* memory, size_t bytes) override;
+
+	// Where an allocation of the arena starts, 0 for memory outside of it
+	uint64_t Offset(const void* memory) const;
+
+	// Gives the whole pages of the free blocks back to the system, for when the arena is done allocating
+	void DiscardFree();
+
+	uint64_t End() const { return end; } // of the last allocation still held
+	std::shared_ptr<SharedMemory> Memory() const { return memory; }
+
+protected:
+	std::shared_ptr<SharedMemory> memory;
+	std::map<uint64_t, uint64_t> freeBlocks; // bytes by offset, none of them ends at end
+	uint64_t end = 0;
+};
+
+// Writes the header of the tree at the start of the arena it was generated in. Streams outside the arena are copied
+// into it and counted in copiedBytes, with a tree built in the arena that is only the leaf and flower meshes.
+// False when the arena is full.
+bool WriteTreeShared(TreeSharedArena& arena, const TreeGenerationResult& result, const TriangleMesh& leafMesh, const TriangleMesh& flowerMesh, size_t& copiedBytes);
+
+// The header when the memory holds a complete tree of this version, nullptr otherwise
+const TreeSharedLayout* ReadTreeShared(const uint8_t* memory, size_t bytes);
+
+template <class T>
+const T* TreeSharedStream(const uint8_t* memory, uint64_t offset)
+{
+	return (offset != 0) ? reinterpret_cast<const T*>(memory + offset) : nullptr;
+}
@@ -0,0 +1,184 @@
+#include "treeworker.h"
+#include "treecache.h"
+#include <chrono>
+
+size_t TreeResultBytes(const TreeGenerationResult& result)
+{
+	auto meshBytes = [](const TriangleMesh& mesh)
+	{
+		return mesh.positions.size() * TriangleMesh::VertexSize(VertexLayout::Separate) + mesh.indices.size() * sizeof(unsigned int);
+	};
+
+	size_t bytes = meshBytes(result.branches) + meshBytes(result.leaves) + meshBytes(result.flowers);
+	bytes += (result.leafInstances.size() + result.flowerInstances.size()) * sizeof(glm::mat4);
+	for (auto& level : result.lodChain.levels)
+	{
+		bytes += meshBytes(level->branches) + meshBytes(level->leaves) + meshBytes(level->flowers);
+	}
+	return bytes;
+}
+
+size_t TreeWorkingBytes(const TreeGenerationResult& result)
+{
+	return TreeResultBytes(result) + result.statistics.peakStageBytes;
+}
+
+TreeGenerator::TreeGenerator(const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh, TreeCache* treeCache)
+	: leafMesh{ treeLeafMesh }, flowerMesh{ treeFlowerMesh }, cache{ treeCache }
+{
+}
+
+std::unique_ptr<TreeGenerationResult> TreeGenerator::Generate(const TreeGenerationRequest& request, TreeGenerationProgress* progress, std::shared_ptr<MeshArena> arena)
+{
+	auto result = std::make_unique<TreeGenerationResult>();
+	if (arena)
+	{
+		result->arena = arena;
+		result->branches = TriangleMesh{ arena.get() };
+		result->leaves = TriangleMesh{ arena.get() };
+		result->flowers = TriangleMesh{ arena.get() };
+		result->leafInstances = MeshVector<glm::mat4>{ MeshAllocator<glm::mat4>{ arena.get() } };
+		result->flowerInstances = MeshVector<glm::mat4>{ MeshAllocator<glm::mat4>{ arena.get() } };
+	}
+	result->request = request;
+	result->lodChain.settings = request.lodSettings;
+	result->lodChain.pixelsPerRadian = request.lodPixelsPerRadian;
+
+	uint64_t cacheKey = cache ? TreeCacheKey(request, leafMesh, flowerMesh) : 0;
+	if (cache && cache->Find(cacheKey, *result))
+	{
+		result->fromCache = true;
+		if (progress)
+		{
+			progress->fraction = 1.0f;
+			progress->stage = "Done";
+		}
+		return result;
+	}
+
+	UniformRandomGenerator uniformGenerator{ request.seed };
+	auto startTime = std::chrono::high_resolution_clock::now();
+	GenerateNewTree(result->skeletonLines, result->branches, result->leaves, result->flowers, leafMesh, flowerMesh, uniformGenerator,
+		request.iterations, request.subdivisions, request.showFlowers, request.options, &result->lodChain, request.buildBVH ? &result->bvh : nullptr, &result->budget, progress, &stages);
+	result->branchesKey = stages.branchesKey;
+	result->leavesKey = stages.leavesKey;
+	result->flowersKey = stages.flowersKey;
+	result->stageTimes = stages.stageTimes;
+	result->statistics = stages.statistics;
+	result->leafInstances = std::move(stages.leafInstances);
+	result->flowerInstances = std::move(stages.flowerInstances);
+	result->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	// A cancelled generation is incomplete
+	if (cache && !(progress && progress->cancel))
+	{
+		cache->Store(cacheKey, *result);
+	}
+	return result;
+}
+
+TreeGenerationWorker::TreeGenerationWorker(const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh, TreeCache* treeCache)
+	: generator{ treeLeafMesh, treeFlowerMesh, treeCache }
+{
+	thread = std::thread{ &TreeGenerationWorker::Run, this };
+}
+
+TreeGenerationWorker::~TreeGenerationWorker()
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		quit = true;
+		progress.cancel = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+void TreeGenerationWorker::Request(const TreeGenerationRequest& request)
+{
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		pendingRequest = std::make_unique<TreeGenerationRequest>(request);
+		progress.cancel = generating;
+	}
+	wake.notify_one();
+}
+
+int TreeGenerationWorker::Cancel()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	pendingRequest.reset();
+	finishedResult.reset();
+	publishedParts.clear();
+	progress.cancel = generating;
+	return generationCount;
+}
+
+std::unique_ptr<TreeGenerationResult> TreeGenerationWorker::Generate(const TreeGenerationRequest& request)
+{
+	std::unique_ptr<TreeGenerationResult> result = generator.Generate(request, &progress);
+	result->generation = generationCount;
+	return result;
+}
+
+std::unique_ptr<TreeGenerationResult> TreeGenerationWorker::TakeResult()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	return std::move(finishedResult);
+}
+
+int TreeGenerationWorker::TakeParts(std::vector<TreePart>& parts)
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	for (auto& part : publishedParts)
+	{
+		parts.push_back(std::move(part));
+	}
+	publishedParts.clear();
+	return generationCount;
+}
+
+bool TreeGenerationWorker::Busy()
+{
+	std::lock_guard<std::mutex> lock{ mutex };
+	return generating || pendingRequest;
+}
+
+void TreeGenerationWorker::Run()
+{
+	std::unique_lock<std::mutex> lock{ mutex };
+	while (true)
+	{
+		wake.wait(lock, [&]() { return quit || pendingRequest; });
+		if (quit) return;
+
+		// The cancel flag is only cleared under the lock, a request arriving after this point cancels this generation
+		std::unique_ptr<TreeGenerationRequest> request = std::move(pendingRequest);
+		progress.cancel = false;
+		generating = true;
+		generationCount++;
+		publishedParts.clear();
+		if (request->progressive)
+		{
+			progress.publishPart = [this](TreePart&& part)
+			{
+				std::lock_guard<std::mutex> partLock{ mutex };
+				if (!progress.cancel) publishedParts.push_back(std::move(part));
+			};
+		}
+		else
+		{
+			progress.publishPart = nullptr;
+		}
+		lock.unlock();
+
+		std::unique_ptr<TreeGenerationResult> result = Generate(*request);
+
+		lock.lock();
+		generating = false;
+		if (!progress.cancel)
+		{
+			finishedResult = std::move(result);
+		}
+	}
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "tree.h"
+
+/*
+	Background tree generation
+	The worker generates into CPU side containers on its own thread, the render thread picks up the finished
+	result and uploads it. A new request replaces a waiting one and cancels the one in flight, so a held key
+	only ever generates the latest tree instead of working through a queue.
+*/
+
+class TreeCache;
+
+struct TreeGenerationRequest
+{
+	uint64_t seed = 1;
+	int iterations = 5;
+	int subdivisions = 3;
+	bool showFlowers = true;
+	bool progressive = false;	// publish the meshes while they are built, see TakeParts
+	bool buildBVH = true;		// ray queries, the viewer picks with it
+	TreeGenerationOptions options;
+	std::vector<TreeLODSettings> lodSettings;	// copied into the result's LOD chain
+	float lodPixelsPerRadian = 720.0f;
+};
+
+struct TreeGenerationResult
+{
+	std::shared_ptr<MeshArena> arena; // of the meshes and instances when not the heap, first so that it outlives them
+	TreeGenerationRequest request;
+	int generation = 0;	// counts the generations started by the worker
+	LineMesh skeletonLines;
+	TriangleMesh branches;
+	TriangleMesh leaves;
+	TriangleMesh flowers;
+	TreeLODChain lodChain;
+	BoundingVolumeHierarchy bvh;
+	TreeBudgetReport budget;
+	double milliseconds = 0.0;	// of the generation, also when the tree came from the cache
+	bool fromCache = false;
+
+	// Keys of the finished meshes, equal keys mean equal meshes (see TreeStageCache). 0 when unknown, like for cached trees.
+	uint64_t branchesKey = 0;
+	uint64_t leavesKey = 0;
+	uint64_t flowersKey = 0;
+
+	std::vector<TreeStageTime> stageTimes; // empty for cached trees
+	TreeGenerationStatistics statistics; // zero for cached trees
+
+	// Placements of the leaf and flower meshes that make up the leaves and flowers, see TreeStageCache
+	MeshVector<glm::mat4> leafInstances;
+	MeshVector<glm::mat4> flowerInstances;
+};
+
+// CPU side bytes of the meshes and instances of a finished tree, the containers always hold the float streams
+size_t TreeResultBytes(const TreeGenerationResult& result);
+
+// Bytes the generation of a tree needed at most, the finished tree plus the peak of its stages (see TreeGenerationStatistics)
+size_t TreeWorkingBytes(const TreeGenerationResult& result);
+
+// Generates on the calling thread, for callers that bring their own threads. The generations run one at a time.
+class TreeGenerator
+{
+public:
+	// The leaf and flower meshes are copied, the generator never touches the caller's meshes.
+	// With a cache, finished trees are stored in it and requests it already has are answered from it.
+	TreeGenerator(const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh, TreeCache* treeCache = nullptr);
+
+	// The progress is optional, a cancelled generation returns an incomplete tree that is not cached.
+	// With an arena the meshes and instances of the tree are built in it, also when it comes from the cache, and a full
+	// arena throws std::bad_alloc out of here.
+	std::unique_ptr<TreeGenerationResult> Generate(const TreeGenerationRequest& request, TreeGenerationProgress* progress = nullptr, std::shared_ptr<MeshArena> arena = nullptr);
+
+protected:
+	TriangleMesh leafMesh;
+	TriangleMesh flowerMesh;
+	TreeCache* cache;
+	TreeStageCache stages; // each generation reuses the unchanged stages of the previous one
+};
+
+class TreeGenerationWorker
+{
+public:
+	// The leaf and flower meshes are copied, the worker never touches the caller's meshes.
+	// With a cache, finished trees are stored in it and requests it already has are answered from it.
+	TreeGenerationWorker(const TriangleMesh& treeLeafMesh, const TriangleMesh& treeFlowerMesh, TreeCache* treeCache = nullptr);
+	~TreeGenerationWorker();
+
+	// Replaces the waiting request and cancels the generation in flight
+	void Request(const TreeGenerationRequest& request);
+
+	// Drops the waiting request, the finished tree not taken yet and the generation in flight.
+	// Returns the number of the last generation started, its parts and those before it are stale.
+	int Cancel();
+
+	// Generates on the calling thread, only while no request is in flight
+	std::unique_ptr<TreeGenerationResult> Generate(const TreeGenerationRequest& request);
+
+	// The latest finished tree, nullptr until one is ready. Older finished trees that were never taken are dropped.
+	std::unique_ptr<TreeGenerationResult> TakeResult();
+
+	// Appends the parts published so far by a progressive generation and returns the generation they belong to.
+	// Parts of a generation that was replaced are dropped, so when the number changes the earlier parts are stale.
+	int TakeParts(std::vector<TreePart>& parts);
+
+	bool Busy();
+	float Progress() const { return progress.fraction; }
+	const char* Stage() const { return progress.stage; }
+
+protected:
+	void Run();
+
+	TreeGenerator generator;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::unique_ptr<TreeGenerationRequest> pendingRequest;
+	std::unique_ptr<TreeGenerationResult> finishedResult;
+	std::vector<TreePart> publishedParts;
+	int generationCount = 0;
+	bool generating = false;
+	bool quit = false;
+	TreeGenerationProgress progress;
+
+	std::thread thread; // started last, after everything it uses
+};